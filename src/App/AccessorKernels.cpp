@@ -0,0 +1,336 @@
+#include "AccessorKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <tinygltf/tiny_gltf.h>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#define FGL_ACCESSOR_AVX2 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FGL_ACCESSOR_SSE2 1
+#endif
+
+#if defined(FGL_ACCESSOR_AVX2)
+#include <immintrin.h>
+#elif defined(FGL_ACCESSOR_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+template<typename T>
+constexpr float normalizationScale()
+{
+	return 1.0f / static_cast<float>(std::numeric_limits<T>::max());
+}
+
+#if defined(FGL_ACCESSOR_SSE2)
+
+// Bytes read by the wide load of one element: whole register for 32-bit types, four lanes otherwise.
+template<typename T>
+constexpr size_t wideLoadSize()
+{
+	return sizeof(T) * 4;
+}
+
+// Widens four components to floats. The wide variant may read past the element, the narrow one never does.
+template<typename T, int Components, bool Wide>
+inline __m128 loadElement(const uint8_t * src)
+{
+	if constexpr (!Wide)
+	{
+		T values[4] = {};
+		std::memcpy(values, src, sizeof(T) * Components);
+		return loadElement<T, 4, true>(reinterpret_cast<const uint8_t *>(values));
+	}
+	else if constexpr (std::is_same_v<T, float>)
+	{
+		return _mm_loadu_ps(reinterpret_cast<const float *>(src));
+	}
+	else if constexpr (std::is_same_v<T, uint32_t>)
+	{
+		uint32_t values[4];
+		std::memcpy(values, src, sizeof(values));
+		return _mm_setr_ps(static_cast<float>(values[0]), static_cast<float>(values[1]),
+						   static_cast<float>(values[2]), static_cast<float>(values[3]));
+	}
+	else if constexpr (sizeof(T) == 2)
+	{
+		const __m128i words = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src));
+		if constexpr (std::is_signed_v<T>)
+			return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16));
+		else
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, _mm_setzero_si128()));
+	}
+	else
+	{
+		int packed;
+		std::memcpy(&packed, src, sizeof(packed));
+		const __m128i bytes = _mm_cvtsi32_si128(packed);
+		if constexpr (std::is_signed_v<T>)
+		{
+			const __m128i words = _mm_unpacklo_epi8(bytes, bytes);
+			return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(words, words), 24));
+		}
+		else
+		{
+			const __m128i zero = _mm_setzero_si128();
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+		}
+	}
+}
+
+template<int Components>
+inline void storeElement(float * dst, __m128 value)
+{
+	if constexpr (Components == 4)
+	{
+		_mm_storeu_ps(dst, value);
+	}
+	else if constexpr (Components == 3)
+	{
+		_mm_storel_pi(reinterpret_cast<__m64 *>(dst), value);
+		_mm_store_ss(dst + 2, _mm_movehl_ps(value, value));
+	}
+	else if constexpr (Components == 2)
+	{
+		_mm_storel_pi(reinterpret_cast<__m64 *>(dst), value);
+	}
+	else
+	{
+		_mm_store_ss(dst, value);
+	}
+}
+
+template<typename T, int Components, bool Normalized, bool Wide>
+inline void convertElement(const uint8_t * src, float * dst)
+{
+	__m128 value = loadElement<T, Components, Wide>(src);
+	if constexpr (Normalized && !std::is_same_v<T, float>)
+	{
+		value = _mm_mul_ps(value, _mm_set1_ps(normalizationScale<T>()));
+		if constexpr (std::is_signed_v<T>)
+		{
+			value = _mm_max_ps(value, _mm_set1_ps(-1.0f));
+		}
+	}
+	storeElement<Components>(dst, value);
+}
+
+template<typename T, int Components, bool Normalized>
+void convertElements(const AccessorView & view, float * dst, size_t dstStride)
+{
+	if (view.count == 0)
+		return;
+
+	// Elements whose wide load stays inside the accessor take the fast path; the tail is read exactly.
+	const size_t lastElementEnd = (view.count - 1) * view.stride + sizeof(T) * Components;
+	size_t wideCount = 0;
+	if (lastElementEnd >= wideLoadSize<T>())
+	{
+		wideCount = view.stride ? (lastElementEnd - wideLoadSize<T>()) / view.stride + 1 : view.count;
+		wideCount = std::min(wideCount, view.count);
+	}
+
+	const uint8_t * src = view.data;
+	auto * out = reinterpret_cast<uint8_t *>(dst);
+	size_t i = 0;
+	for (; i < wideCount; ++i, src += view.stride, out += dstStride)
+	{
+		convertElement<T, Components, Normalized, true>(src, reinterpret_cast<float *>(out));
+	}
+	for (; i < view.count; ++i, src += view.stride, out += dstStride)
+	{
+		convertElement<T, Components, Normalized, false>(src, reinterpret_cast<float *>(out));
+	}
+}
+
+#else
+
+template<typename T, int Components, bool Normalized>
+void convertElements(const AccessorView & view, float * dst, size_t dstStride)
+{
+	const uint8_t * src = view.data;
+	auto * out = reinterpret_cast<uint8_t *>(dst);
+	for (size_t i = 0; i < view.count; ++i, src += view.stride, out += dstStride)
+	{
+		T values[4] = {};
+		std::memcpy(values, src, sizeof(T) * Components);
+
+		float * element = reinterpret_cast<float *>(out);
+		for (int c = 0; c < Components; ++c)
+		{
+			float value = static_cast<float>(values[c]);
+			if constexpr (Normalized && !std::is_same_v<T, float>)
+			{
+				value *= normalizationScale<T>();
+				if constexpr (std::is_signed_v<T>)
+				{
+					value = std::max(value, -1.0f);
+				}
+			}
+			element[c] = value;
+		}
+	}
+}
+
+#endif
+
+template<typename T, bool Normalized>
+bool convertComponents(const AccessorView & view, float * dst, size_t dstStride)
+{
+	switch (view.components)
+	{
+		case 1:
+			convertElements<T, 1, Normalized>(view, dst, dstStride);
+			return true;
+		case 2:
+			convertElements<T, 2, Normalized>(view, dst, dstStride);
+			return true;
+		case 3:
+			convertElements<T, 3, Normalized>(view, dst, dstStride);
+			return true;
+		case 4:
+			convertElements<T, 4, Normalized>(view, dst, dstStride);
+			return true;
+		default:
+			return false;
+	}
+}
+
+template<typename T>
+bool convertType(const AccessorView & view, float * dst, size_t dstStride)
+{
+	return view.normalized ? convertComponents<T, true>(view, dst, dstStride)
+						   : convertComponents<T, false>(view, dst, dstStride);
+}
+
+template<typename T>
+void widenIndices(const AccessorView & view, uint32_t * dst)
+{
+	size_t i = 0;
+
+	if (view.stride == sizeof(T))
+	{
+		const T * src = reinterpret_cast<const T *>(view.data);
+		if constexpr (sizeof(T) == sizeof(uint32_t))
+		{
+			std::memcpy(dst, src, view.count * sizeof(uint32_t));
+			return;
+		}
+#if defined(FGL_ACCESSOR_AVX2)
+		for (; i + 8 <= view.count; i += 8)
+		{
+			__m256i wide;
+			if constexpr (sizeof(T) == 1)
+				wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+			else
+				wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), wide);
+		}
+#elif defined(FGL_ACCESSOR_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= view.count; i += 8)
+		{
+			__m128i words;
+			if constexpr (sizeof(T) == 1)
+				words = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)), zero);
+			else
+				words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi16(words, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), _mm_unpackhi_epi16(words, zero));
+		}
+#endif
+	}
+
+	for (; i < view.count; ++i)
+	{
+		T value;
+		std::memcpy(&value, view.data + i * view.stride, sizeof(T));
+		dst[i] = value;
+	}
+}
+
+}// namespace
+
+bool convertToFloat(const AccessorView & view, float * dst, size_t dstStride)
+{
+	if (!view.data || !dst)
+		return false;
+
+	switch (view.componentType)
+	{
+		case TINYGLTF_COMPONENT_TYPE_FLOAT:
+			return convertType<float>(view, dst, dstStride);
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			return convertType<uint8_t>(view, dst, dstStride);
+		case TINYGLTF_COMPONENT_TYPE_BYTE:
+			return convertType<int8_t>(view, dst, dstStride);
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+			return convertType<uint16_t>(view, dst, dstStride);
+		case TINYGLTF_COMPONENT_TYPE_SHORT:
+			return convertType<int16_t>(view, dst, dstStride);
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+			return convertType<uint32_t>(view, dst, dstStride);
+		default:
+			return false;
+	}
+}
+
+bool convertInterleaved(const InterleaveStream * streams, size_t streamCount, uint8_t * dst, size_t dstStride, size_t count)
+{
+	constexpr size_t blockBytes = 32 * 1024;
+	const size_t blockSize = std::max<size_t>(1, blockBytes / std::max<size_t>(1, dstStride));
+
+	bool success = true;
+	for (size_t first = 0; first < count; first += blockSize)
+	{
+		for (size_t s = 0; s < streamCount; ++s)
+		{
+			AccessorView block = streams[s].view;
+			if (!block.data || first >= block.count)
+				continue;
+
+			block.data += first * block.stride;
+			block.count = std::min({blockSize, count - first, block.count - first});
+			success &= convertToFloat(block, reinterpret_cast<float *>(dst + first * dstStride + streams[s].dstOffset), dstStride);
+		}
+	}
+	return success;
+}
+
+bool convertIndices(const AccessorView & view, uint32_t * dst)
+{
+	if (!view.data || !dst || view.components != 1)
+		return false;
+
+	switch (view.componentType)
+	{
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			widenIndices<uint8_t>(view, dst);
+			return true;
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+			widenIndices<uint16_t>(view, dst);
+			return true;
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+			widenIndices<uint32_t>(view, dst);
+			return true;
+		default:
+			return false;
+	}
+}
+
+const char * getAccessorKernelIsa()
+{
+#if defined(FGL_ACCESSOR_AVX2)
+	return "AVX2";
+#elif defined(FGL_ACCESSOR_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Strided view over a glTF accessor. componentType uses the glTF codes (TINYGLTF_COMPONENT_TYPE_*).
+struct AccessorView {
+	const uint8_t * data = nullptr;
+	size_t count = 0;
+	size_t stride = 0;
+	int componentType = 0;
+	int components = 0;
+	bool normalized = false;
+};
+
+// Converts every element to `view.components` floats (1-4), applying glTF normalization rules,
+// and writes them to dst advancing dstStride bytes per element. Returns false for unsupported input.
+bool convertToFloat(const AccessorView & view, float * dst, size_t dstStride);
+
+// Converts several attribute streams into one interleaved buffer. Streams are processed in cache-sized
+// blocks so every destination vertex is written while it is still hot. Streams with null data are skipped.
+struct InterleaveStream {
+	AccessorView view;
+	size_t dstOffset = 0;
+};
+bool convertInterleaved(const InterleaveStream * streams, size_t streamCount, uint8_t * dst, size_t dstStride, size_t count);
+
+// Widens unsigned byte/short/int indices to 32 bits. Returns false for unsupported input.
+bool convertIndices(const AccessorView & view, uint32_t * dst);
+
+// Instruction set the kernels were compiled for: "AVX2", "SSE2" or "scalar".
+const char * getAccessorKernelIsa();
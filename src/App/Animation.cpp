@@ -0,0 +1,342 @@
+#include "Animation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// FGL_ANIMATION_SCALAR forces the scalar kernels, which the animation benchmark compares against.
+#if !defined(FGL_ANIMATION_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FGL_ANIMATION_SSE2 1
+#endif
+
+#if defined(FGL_ANIMATION_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// Above this cosine between two keys, slerp is replaced by a normalized lerp.
+constexpr float g_slerpThreshold = 0.9995f;
+
+inline void copy4(const float * src, float * dst)
+{
+	std::memcpy(dst, src, sizeof(float) * 4);
+}
+
+// dst = a * wa + b * wb, four lanes.
+inline void blend4(const float * a, float wa, const float * b, float wb, float * dst)
+{
+#if defined(FGL_ANIMATION_SSE2)
+	_mm_storeu_ps(dst, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(wa)), _mm_mul_ps(_mm_loadu_ps(b), _mm_set1_ps(wb))));
+#else
+	for (int i = 0; i < 4; ++i)
+	{
+		dst[i] = a[i] * wa + b[i] * wb;
+	}
+#endif
+}
+
+inline void normalize4(float * value)
+{
+	const float length = std::sqrt(value[0] * value[0] + value[1] * value[1] + value[2] * value[2] + value[3] * value[3]);
+	if (length <= 0.0f)
+		return;
+
+	const float inverse = 1.0f / length;
+#if defined(FGL_ANIMATION_SSE2)
+	_mm_storeu_ps(value, _mm_mul_ps(_mm_loadu_ps(value), _mm_set1_ps(inverse)));
+#else
+	for (int i = 0; i < 4; ++i)
+	{
+		value[i] *= inverse;
+	}
+#endif
+}
+
+// Shortest-path spherical interpolation of unit quaternions.
+void slerp(const float * a, const float * b, float t, float * dst)
+{
+	float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+	const float sign = cosine < 0.0f ? -1.0f : 1.0f;
+	cosine *= sign;
+
+	if (cosine > g_slerpThreshold)
+	{
+		blend4(a, 1.0f - t, b, t * sign, dst);
+		normalize4(dst);
+		return;
+	}
+
+	const float angle = std::acos(cosine);
+	const float inverseSine = 1.0f / std::sin(angle);
+	blend4(a, std::sin((1.0f - t) * angle) * inverseSine, b, std::sin(t * angle) * inverseSine * sign, dst);
+}
+
+// Cubic Hermite spline between v0 and v1 with tangents scaled by the key interval dt.
+void hermite(const float * v0, const float * outTangent0, const float * v1, const float * inTangent1, float dt, float t,
+			 float * dst)
+{
+	const float t2 = t * t;
+	const float t3 = t2 * t;
+	float lhs[4];
+	float rhs[4];
+	blend4(v0, 2.0f * t3 - 3.0f * t2 + 1.0f, outTangent0, (t3 - 2.0f * t2 + t) * dt, lhs);
+	blend4(v1, -2.0f * t3 + 3.0f * t2, inTangent1, (t3 - t2) * dt, rhs);
+	blend4(lhs, 1.0f, rhs, 1.0f, dst);
+}
+}// namespace
+
+void multiplyMatrices(const JointMatrix & a, const JointMatrix & b, JointMatrix & result)
+{
+#if defined(FGL_ANIMATION_SSE2)
+	const __m128 a0 = _mm_load_ps(a.m);
+	const __m128 a1 = _mm_load_ps(a.m + 4);
+	const __m128 a2 = _mm_load_ps(a.m + 8);
+	const __m128 a3 = _mm_load_ps(a.m + 12);
+	for (int column = 0; column < 4; ++column)
+	{
+		const float * bColumn = b.m + column * 4;
+		__m128 sum = _mm_mul_ps(a0, _mm_set1_ps(bColumn[0]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(bColumn[1])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(bColumn[2])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(bColumn[3])));
+		_mm_store_ps(result.m + column * 4, sum);
+	}
+#else
+	for (int column = 0; column < 4; ++column)
+	{
+		for (int row = 0; row < 4; ++row)
+		{
+			result.m[column * 4 + row] = a.m[row] * b.m[column * 4] + a.m[4 + row] * b.m[column * 4 + 1]
+										 + a.m[8 + row] * b.m[column * 4 + 2] + a.m[12 + row] * b.m[column * 4 + 3];
+		}
+	}
+#endif
+}
+
+void composeMatrix(const NodeTransform & transform, JointMatrix & result)
+{
+	const float x = transform.rotation[0];
+	const float y = transform.rotation[1];
+	const float z = transform.rotation[2];
+	const float w = transform.rotation[3];
+	const float sx = transform.scale[0];
+	const float sy = transform.scale[1];
+	const float sz = transform.scale[2];
+
+	float * m = result.m;
+	m[0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+	m[1] = 2.0f * (x * y + z * w) * sx;
+	m[2] = 2.0f * (x * z - y * w) * sx;
+	m[3] = 0.0f;
+	m[4] = 2.0f * (x * y - z * w) * sy;
+	m[5] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+	m[6] = 2.0f * (y * z + x * w) * sy;
+	m[7] = 0.0f;
+	m[8] = 2.0f * (x * z + y * w) * sz;
+	m[9] = 2.0f * (y * z - x * w) * sz;
+	m[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+	m[11] = 0.0f;
+	m[12] = transform.translation[0];
+	m[13] = transform.translation[1];
+	m[14] = transform.translation[2];
+	m[15] = 1.0f;
+}
+
+JointMatrix invertAffine(const JointMatrix & matrix)
+{
+	const float * m = matrix.m;
+	const float a = m[0], b = m[4], c = m[8];
+	const float d = m[1], e = m[5], f = m[9];
+	const float g = m[2], h = m[6], i = m[10];
+
+	JointMatrix result;
+	const float determinant = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+	if (std::abs(determinant) < 1.0e-20f)
+		return result;
+
+	const float inverse = 1.0f / determinant;
+	float * r = result.m;
+	r[0] = (e * i - f * h) * inverse;
+	r[1] = (f * g - d * i) * inverse;
+	r[2] = (d * h - e * g) * inverse;
+	r[4] = (c * h - b * i) * inverse;
+	r[5] = (a * i - c * g) * inverse;
+	r[6] = (b * g - a * h) * inverse;
+	r[8] = (b * f - c * e) * inverse;
+	r[9] = (c * d - a * f) * inverse;
+	r[10] = (a * e - b * d) * inverse;
+	r[12] = -(r[0] * m[12] + r[4] * m[13] + r[8] * m[14]);
+	r[13] = -(r[1] * m[12] + r[5] * m[13] + r[9] * m[14]);
+	r[14] = -(r[2] * m[12] + r[6] * m[13] + r[10] * m[14]);
+	return result;
+}
+
+void sampleChannel(const AnimationChannel & channel, float time, uint32_t & cursor, float * value)
+{
+	const auto & times = channel.times;
+	const size_t keys = times.size();
+	const size_t width = channel.width;
+	const bool cubic = channel.interpolation == AnimationInterpolation::CubicSpline;
+	const size_t keyStride = cubic ? width * 3 : width;
+	const size_t valueOffset = cubic ? width : 0;
+	if (keys == 0 || width % 4 != 0 || channel.values.size() < keys * keyStride)
+		return;
+
+	const float * values = channel.values.data();
+	if (keys == 1 || time <= times.front())
+	{
+		std::memcpy(value, values + valueOffset, sizeof(float) * width);
+		return;
+	}
+	if (time >= times.back())
+	{
+		std::memcpy(value, values + (keys - 1) * keyStride + valueOffset, sizeof(float) * width);
+		return;
+	}
+
+	// Key k with times[k] <= time < times[k + 1]: the cached one, the next one, or a binary search.
+	size_t key = cursor < keys - 1 ? cursor : 0;
+	if (!(times[key] <= time && time < times[key + 1]))
+	{
+		if (key + 2 < keys && times[key + 1] <= time && time < times[key + 2])
+			++key;
+		else
+			key = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+	}
+	cursor = static_cast<uint32_t>(key);
+
+	const float interval = times[key + 1] - times[key];
+	const float t = interval > 0.0f ? (time - times[key]) / interval : 0.0f;
+	// Four lanes at a time; only rotations, which are a single quaternion, interpolate across lanes.
+	for (size_t lane = 0; lane < width; lane += 4)
+	{
+		const float * a = values + key * keyStride + lane;
+		const float * b = a + keyStride;
+		switch (channel.interpolation)
+		{
+			case AnimationInterpolation::Step:
+				copy4(a, value + lane);
+				break;
+			case AnimationInterpolation::Linear:
+				if (channel.path == AnimationPath::Rotation)
+					slerp(a, b, t, value + lane);
+				else
+					blend4(a, 1.0f - t, b, t, value + lane);
+				break;
+			case AnimationInterpolation::CubicSpline:
+				hermite(a + width, a + width * 2, b + width, b, interval, t, value + lane);
+				if (channel.path == AnimationPath::Rotation)
+					normalize4(value + lane);
+				break;
+		}
+	}
+}
+
+const char * getAnimationKernelIsa()
+{
+#if defined(FGL_ANIMATION_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+AnimationInstance::AnimationInstance(std::shared_ptr<const AnimationRig> rig)
+	: rig_(std::move(rig))
+	, locals_(rig_->restMatrices)
+	, globals_(rig_->parents.size())
+	, palette_(rig_->paletteSize)
+{
+	setClip(rig_->clips.empty() ? -1 : 0);
+}
+
+void AnimationInstance::setClip(int clip)
+{
+	clip_ = clip >= 0 && clip < static_cast<int>(rig_->clips.size()) ? clip : -1;
+	time_ = 0.0f;
+	pose_ = rig_->restPose;
+	weights_ = rig_->restWeights;
+	cursors_.assign(clip_ >= 0 ? rig_->clips[clip_].channels.size() : 0, 0);
+}
+
+const float * AnimationInstance::getMorphTargetWeights(int node) const
+{
+	if (node < 0 || static_cast<size_t>(node) >= rig_->weightOffsets.size() || rig_->weightOffsets[node] == ~0u)
+		return nullptr;
+	return weights_.data() + rig_->weightOffsets[node];
+}
+
+void AnimationInstance::advance(float deltaTime)
+{
+	if (clip_ < 0)
+		return;
+
+	const float duration = rig_->clips[clip_].duration;
+	time_ += deltaTime * speed_;
+	if (looping_ && duration > 0.0f)
+	{
+		time_ = std::fmod(time_, duration);
+		if (time_ < 0.0f)
+			time_ += duration;
+	}
+	else
+	{
+		time_ = std::clamp(time_, 0.0f, duration);
+	}
+}
+
+void AnimationInstance::evaluate()
+{
+	const auto & rig = *rig_;
+	if (clip_ >= 0)
+	{
+		const auto & channels = rig.clips[clip_].channels;
+		for (size_t i = 0; i < channels.size(); ++i)
+		{
+			const auto & channel = channels[i];
+			auto & transform = pose_[channel.node];
+			float * target = nullptr;
+			switch (channel.path)
+			{
+				case AnimationPath::Translation:
+					target = transform.translation;
+					break;
+				case AnimationPath::Rotation:
+					target = transform.rotation;
+					break;
+				case AnimationPath::Scale:
+					target = transform.scale;
+					break;
+				case AnimationPath::Weights:
+					target = weights_.data() + rig.weightOffsets[channel.node];
+					break;
+			}
+			sampleChannel(channel, time_, cursors_[i], target);
+		}
+	}
+
+	for (size_t node = 0; node < rig.parents.size(); ++node)
+	{
+		if (rig.animated[node])
+			composeMatrix(pose_[node], locals_[node]);
+
+		const int parent = rig.parents[node];
+		if (parent >= 0)
+			multiplyMatrices(globals_[parent], locals_[node], globals_[node]);
+		else
+			globals_[node] = locals_[node];
+	}
+
+	const JointMatrix identity;
+	for (const auto & binding: rig.bindings)
+	{
+		const auto & skin = rig.skins[binding.skin];
+		const JointMatrix toNode = invertAffine(globals_[binding.node]);
+		for (size_t joint = 0; joint < skin.joints.size(); ++joint)
+		{
+			JointMatrix skinned;
+			multiplyMatrices(skin.joints[joint] >= 0 ? globals_[skin.joints[joint]] : identity, skin.inverseBindMatrices[joint], skinned);
+			multiplyMatrices(toNode, skinned, palette_[binding.paletteOffset + joint]);
+		}
+	}
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Column-major 4x4 matrix, aligned for the SIMD kernels.
+struct alignas(16) JointMatrix {
+	float m[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+};
+
+// Local transform of a node. The rotation is a unit quaternion (x, y, z, w); the last lane of translation and
+// scale is padding so that every property loads as one register.
+struct alignas(16) NodeTransform {
+	float translation[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	float scale[4] = {1.0f, 1.0f, 1.0f, 0.0f};
+};
+
+enum class AnimationPath
+{
+	Translation,
+	Rotation,
+	Scale,
+	// Morph target weights of the node's mesh.
+	Weights
+};
+
+enum class AnimationInterpolation
+{
+	Step,
+	Linear,
+	CubicSpline
+};
+
+// Keyframes of one node property, with times in seconds in ascending order. values holds width floats per key, or
+// three groups of width per key for cubic splines: in-tangent, value, out-tangent. width is 4 for transforms and the
+// morph target count rounded up to a multiple of 4 for weights.
+struct AnimationChannel {
+	int node = -1;
+	AnimationPath path = AnimationPath::Translation;
+	AnimationInterpolation interpolation = AnimationInterpolation::Linear;
+	uint32_t width = 4;
+	std::vector<float> times;
+	std::vector<float> values;
+};
+
+struct AnimationClip {
+	std::string name;
+	float duration = 0.0f;
+	std::vector<AnimationChannel> channels;
+};
+
+// Joints of a glTF skin as node indices, -1 for joints outside the scene, with their inverse bind matrices.
+struct ModelSkin {
+	std::vector<int> joints;
+	std::vector<JointMatrix> inverseBindMatrices;
+};
+
+// Node drawing a skinned mesh. Its joint matrices are palette[paletteOffset, paletteOffset + joints) and bring
+// bind-pose vertices into the space of that node, so the node's own transform still applies on top.
+struct SkinBinding {
+	int node = -1;
+	int skin = -1;
+	uint32_t paletteOffset = 0;
+};
+
+// Node hierarchy, skins and clips of a model, indexed like ModelData::nodes, where parents come before children.
+struct AnimationRig {
+	std::vector<int> parents;
+	std::vector<NodeTransform> restPose;
+	// Local matrices of the nodes in the rest pose; nodes that some clip animates are composed from their
+	// transform instead.
+	std::vector<JointMatrix> restMatrices;
+	std::vector<uint8_t> animated;
+	// Morph target weights of the nodes with a morphed mesh start at restWeights[weightOffsets[node]], padded to a
+	// multiple of 4; ~0u for other nodes.
+	std::vector<uint32_t> weightOffsets;
+	std::vector<float> restWeights;
+	std::vector<ModelSkin> skins;
+	std::vector<SkinBinding> bindings;
+	std::vector<AnimationClip> clips;
+	size_t paletteSize = 0;
+};
+
+// result = a * b. result may alias neither input.
+void multiplyMatrices(const JointMatrix & a, const JointMatrix & b, JointMatrix & result);
+
+// Matrix of translation * rotation * scale.
+void composeMatrix(const NodeTransform & transform, JointMatrix & result);
+
+// Inverse of a matrix whose last row is (0, 0, 0, 1); singular matrices give the identity.
+JointMatrix invertAffine(const JointMatrix & matrix);
+
+// Value of the channel at time, width floats, clamped to its first and last key. cursor caches the key found by the previous call
+// and makes forward playback find the next key without a search; any value is valid.
+void sampleChannel(const AnimationChannel & channel, float time, uint32_t & cursor, float * value);
+
+// Instruction set the pose kernels were compiled for: "SSE2" or "scalar".
+const char * getAnimationKernelIsa();
+
+// Playback state and evaluated pose of one character.
+class AnimationInstance
+{
+public:
+	explicit AnimationInstance(std::shared_ptr<const AnimationRig> rig);
+
+	const AnimationRig & getRig() const { return *rig_; }
+
+	// Restarts from the rest pose at time 0; -1 keeps the rest pose. New instances play the first clip, looping.
+	void setClip(int clip);
+	int getClip() const { return clip_; }
+
+	void setSpeed(float speed) { speed_ = speed; }
+	float getSpeed() const { return speed_; }
+
+	void setLooping(bool looping) { looping_ = looping; }
+	bool isLooping() const { return looping_; }
+
+	void setTime(float time) { time_ = time; }
+	float getTime() const { return time_; }
+
+	void advance(float deltaTime);
+	// Samples the clip at the current time, then computes the local and global node matrices and the joint palette.
+	// Instances share no mutable state, so different ones may be evaluated on different threads.
+	void evaluate();
+
+	const std::vector<JointMatrix> & getLocalMatrices() const { return locals_; }
+	const std::vector<JointMatrix> & getGlobalMatrices() const { return globals_; }
+	const std::vector<JointMatrix> & getPalette() const { return palette_; }
+	// Current morph target weights of node, or nullptr when its mesh has no targets.
+	const float * getMorphTargetWeights(int node) const;
+
+	// Where the palette starts in the joint palette texture of the current frame; set by AnimationSystem.
+	void setPaletteBase(size_t base) { paletteBase_ = base; }
+	size_t getPaletteBase() const { return paletteBase_; }
+
+private:
+	std::shared_ptr<const AnimationRig> rig_;
+	int clip_ = -1;
+	float time_ = 0.0f;
+	float speed_ = 1.0f;
+	bool looping_ = true;
+	size_t paletteBase_ = 0;
+
+	std::vector<NodeTransform> pose_;
+	std::vector<float> weights_;
+	std::vector<uint32_t> cursors_;
+	std::vector<JointMatrix> locals_;
+	std::vector<JointMatrix> globals_;
+	std::vector<JointMatrix> palette_;
+};
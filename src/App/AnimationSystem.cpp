@@ -0,0 +1,135 @@
+#include "AnimationSystem.h"
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+#include <QElapsedTimer>
+#include <QOpenGLFunctions>
+#include <algorithm>
+#include <future>
+
+namespace
+{
+// Row width of the palette texture in matrices; getJointMatrix in model.vs addresses it the same way.
+constexpr size_t g_matricesPerRow = 256;
+// Below this, a job costs more to hand out than to run.
+constexpr size_t g_minJointsPerJob = 512;
+}// namespace
+
+void AnimationSystem::add(const std::shared_ptr<AnimationInstance> & instance)
+{
+	if (instance)
+		entries_.push_back({instance, {}});
+}
+
+void AnimationSystem::bindSceneNode(const std::shared_ptr<AnimationInstance> & instance, int node, std::weak_ptr<SceneNode> sceneNode)
+{
+	const auto it = std::find_if(entries_.begin(), entries_.end(), [&instance](const Entry & entry) {
+		return entry.instance.lock() == instance;
+	});
+	if (it != entries_.end() && node >= 0 && static_cast<size_t>(node) < instance->getRig().parents.size() && instance->getRig().animated[node])
+		it->sceneNodes.emplace_back(node, std::move(sceneNode));
+}
+
+void AnimationSystem::update(float deltaTime)
+{
+	entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [](const Entry & entry) { return entry.instance.expired(); }),
+				   entries_.end());
+
+	stats_ = AnimationStats();
+	std::vector<std::shared_ptr<AnimationInstance>> instances;
+	instances.reserve(entries_.size());
+	size_t paletteSize = 0;
+	for (const auto & entry: entries_)
+	{
+		auto instance = entry.instance.lock();
+		instance->advance(deltaTime);
+		instance->setPaletteBase(paletteSize);
+		paletteSize += instance->getRig().paletteSize;
+		stats_.joints += instance->getRig().parents.size();
+		instances.push_back(std::move(instance));
+	}
+	stats_.instances = instances.size();
+	// Whole rows, so that the upload never reads past the end.
+	palette_.resize((paletteSize + g_matricesPerRow - 1) / g_matricesPerRow * g_matricesPerRow);
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// Runs of instances with about the same number of joints, a few per worker so that uneven rigs still balance.
+	const size_t jobCount = std::max<size_t>(ThreadPool::global().getThreadCount() * 4, 1);
+	const size_t jointsPerJob = std::max(stats_.joints / jobCount, g_minJointsPerJob);
+	std::vector<std::future<void>> jobs;
+	size_t first = 0;
+	size_t joints = 0;
+	for (size_t i = 0; i < instances.size(); ++i)
+	{
+		joints += instances[i]->getRig().parents.size();
+		if (joints < jointsPerJob && i + 1 < instances.size())
+			continue;
+
+		jobs.push_back(ThreadPool::global().submit([this, &instances, first, last = i + 1] {
+			for (size_t k = first; k < last; ++k)
+			{
+				auto & instance = *instances[k];
+				instance.evaluate();
+				std::copy(instance.getPalette().begin(), instance.getPalette().end(), palette_.begin() + static_cast<std::ptrdiff_t>(instance.getPaletteBase()));
+			}
+		}));
+		first = i + 1;
+		joints = 0;
+	}
+	for (auto & job: jobs)
+	{
+		job.get();
+	}
+	stats_.milliseconds = static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+
+	for (size_t i = 0; i < entries_.size(); ++i)
+	{
+		const auto & locals = instances[i]->getLocalMatrices();
+		for (const auto & [node, weakSceneNode]: entries_[i].sceneNodes)
+		{
+			if (auto sceneNode = weakSceneNode.lock())
+			{
+				// Column-major, like QMatrix4x4 storage.
+				QMatrix4x4 transform;
+				std::copy(std::begin(locals[node].m), std::end(locals[node].m), transform.data());
+				sceneNode->setTransform(transform);
+			}
+		}
+	}
+}
+
+void AnimationSystem::uploadPalette(OpenGLContext & context)
+{
+	if (palette_.empty())
+		return;
+
+	const int rows = static_cast<int>(palette_.size() / g_matricesPerRow);
+	if (!paletteTexture_ || rows > paletteRows_)
+	{
+		paletteRows_ = std::max(paletteRows_, 1);
+		while (paletteRows_ < rows)
+			paletteRows_ *= 2;
+
+		if (paletteTexture_)
+			context.forgetTexture(paletteTexture_->textureId());
+		paletteTexture_ = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+		paletteTexture_->setFormat(QOpenGLTexture::RGBA32F);
+		paletteTexture_->setSize(static_cast<int>(g_matricesPerRow * 4), paletteRows_);
+		paletteTexture_->setMipLevels(1);
+		paletteTexture_->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+		paletteTexture_->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
+	}
+
+	context.bindTextureForUpdate(GL_TEXTURE_2D, paletteTexture_->textureId());
+	context.functions()->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(g_matricesPerRow * 4), rows, GL_RGBA,
+										 GL_FLOAT, palette_.data());
+}
+
+void AnimationSystem::cleanup(OpenGLContext & context)
+{
+	if (paletteTexture_)
+		context.forgetTexture(paletteTexture_->textureId());
+	paletteTexture_.reset();
+	paletteRows_ = 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Animation.h"
+#include "OpenGLContext.h"
+#include <QOpenGLTexture>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class SceneNode;
+
+struct AnimationStats {
+	size_t instances = 0;
+	size_t joints = 0;
+	// Wall time of the parallel pose evaluation of the last update.
+	double milliseconds = 0.0;
+
+	double getJointsPerMillisecond() const { return milliseconds > 0.0 ? static_cast<double>(joints) / milliseconds : 0.0; }
+};
+
+// Plays every registered animation instance. Poses are evaluated in parallel on the global thread pool and the joint
+// palettes of all instances are packed into one float texture for GPU skinning, four texels per matrix.
+// Instances are held weakly and go away with the entities that own them.
+class AnimationSystem
+{
+public:
+	AnimationSystem() = default;
+	~AnimationSystem() = default;
+
+	AnimationSystem(const AnimationSystem &) = delete;
+	AnimationSystem & operator=(const AnimationSystem &) = delete;
+
+	void add(const std::shared_ptr<AnimationInstance> & instance);
+	// After every update, the local matrix of the rig's node is written to sceneNode when some clip animates it.
+	void bindSceneNode(const std::shared_ptr<AnimationInstance> & instance, int node, std::weak_ptr<SceneNode> sceneNode);
+
+	// Advances and evaluates all instances and moves their bound scene nodes. Call before the scene graph update.
+	void update(float deltaTime);
+
+	// GL thread only. Uploads the palettes evaluated by the last update, binding through context; the texture is null
+	// until one has joints.
+	void uploadPalette(OpenGLContext & context);
+	QOpenGLTexture * getPaletteTexture() const { return paletteTexture_.get(); }
+	void cleanup(OpenGLContext & context);
+
+	const AnimationStats & getStats() const { return stats_; }
+
+private:
+	struct Entry {
+		std::weak_ptr<AnimationInstance> instance;
+		std::vector<std::pair<int, std::weak_ptr<SceneNode>>> sceneNodes;
+	};
+
+	std::vector<Entry> entries_;
+	std::vector<JointMatrix> palette_;
+	std::unique_ptr<QOpenGLTexture> paletteTexture_;
+	int paletteRows_ = 0;
+	AnimationStats stats_;
+};
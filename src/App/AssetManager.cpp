@@ -0,0 +1,149 @@
+#include "AssetManager.h"
+#include <QDebug>
+#include <QFileInfo>
+
+namespace
+{
+const char * getAssetTypeName(AssetType type)
+{
+	switch (type)
+	{
+		case AssetType::Model:
+			return "model";
+		case AssetType::Texture:
+			return "texture";
+		case AssetType::ShaderProgram:
+			return "shader program";
+	}
+	return "asset";
+}
+}// namespace
+
+QString AssetManager::normalizePath(const QString & path)
+{
+	if (path.isEmpty())
+		return path;
+	const QString canonical = QFileInfo(path).canonicalFilePath();
+	return canonical.isEmpty() ? path : canonical;
+}
+
+std::shared_ptr<void> AssetManager::findPath(const PathKey & key)
+{
+	const auto it = paths_.find(key);
+	return it != paths_.end() ? lockEntry(it->second) : nullptr;
+}
+
+std::shared_ptr<void> AssetManager::findContent(const ContentKey & key)
+{
+	const auto it = contents_.find(key);
+	return it != contents_.end() ? lockEntry(it->second) : nullptr;
+}
+
+std::shared_ptr<void> AssetManager::lockEntry(uint64_t id)
+{
+	const auto it = entries_.find(id);
+	auto asset = it != entries_.end() ? it->second.asset.lock() : nullptr;
+	if (asset)
+		++stats_.hits;
+	return asset;
+}
+
+std::shared_ptr<void> AssetManager::insertEntry(AssetType type, const QString & path, uint64_t variant, uint64_t contentHash,
+												std::shared_ptr<void> asset, std::function<AssetMemory(const void *)> memory)
+{
+	prune();
+
+	const QString normalized = normalizePath(path);
+	const ContentKey contentKey(type, contentHash);
+	if (contentHash != 0)
+	{
+		if (auto existing = findContent(contentKey))
+		{
+			if (!normalized.isEmpty())
+				paths_[{type, normalized, variant}] = contents_[contentKey];
+			return existing;
+		}
+	}
+
+	const uint64_t id = nextId_++;
+	entries_[id] = {type, normalized, contentHash, asset, std::move(memory)};
+	if (!normalized.isEmpty())
+		paths_[{type, normalized, variant}] = id;
+	if (contentHash != 0)
+		contents_[contentKey] = id;
+	++stats_.loads;
+	return asset;
+}
+
+void AssetManager::prune()
+{
+	for (auto it = entries_.begin(); it != entries_.end();)
+	{
+		it = it->second.asset.expired() ? entries_.erase(it) : std::next(it);
+	}
+
+	const auto pruneIndex = [this](auto & index) {
+		for (auto it = index.begin(); it != index.end();)
+		{
+			it = entries_.count(it->second) ? std::next(it) : index.erase(it);
+		}
+	};
+	pruneIndex(paths_);
+	pruneIndex(contents_);
+}
+
+std::vector<AssetInfo> AssetManager::getAssets()
+{
+	prune();
+
+	std::vector<AssetInfo> assets;
+	assets.reserve(entries_.size());
+	for (const auto & [id, entry]: entries_)
+	{
+		const auto asset = entry.asset.lock();
+		if (!asset)
+			continue;
+
+		AssetInfo info;
+		info.type = entry.type;
+		info.path = entry.path;
+		info.contentHash = entry.contentHash;
+		info.handles = asset.use_count() - 1;
+		if (entry.memory)
+			info.memory = entry.memory(asset.get());
+		assets.push_back(std::move(info));
+	}
+	return assets;
+}
+
+AssetMemory AssetManager::getTotalMemory()
+{
+	AssetMemory total;
+	for (const auto & asset: getAssets())
+	{
+		total.cpuBytes += asset.memory.cpuBytes;
+		total.gpuBytes += asset.memory.gpuBytes;
+	}
+	return total;
+}
+
+void AssetManager::logReport()
+{
+	const auto assets = getAssets();
+	AssetMemory total;
+	for (const auto & asset: assets)
+	{
+		total.cpuBytes += asset.memory.cpuBytes;
+		total.gpuBytes += asset.memory.gpuBytes;
+	}
+
+	qInfo().nospace() << "Assets: " << assets.size() << " live (" << stats_.loads << " loaded, " << stats_.hits
+					  << " shared), CPU " << total.cpuBytes / 1024 << " KiB, GPU " << total.gpuBytes / 1024 << " KiB";
+	for (const auto & asset: assets)
+	{
+		qInfo().nospace() << "  " << getAssetTypeName(asset.type) << " "
+						  << (asset.path.isEmpty() ? QString("%1").arg(asset.contentHash, 16, 16, QChar('0')) : asset.path) << ": "
+						  << asset.handles << " handles, CPU " << asset.memory.cpuBytes / 1024 << " KiB, GPU "
+						  << asset.memory.gpuBytes / 1024 << " KiB";
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+enum class AssetType
+{
+	Model,
+	Texture,
+	ShaderProgram
+};
+
+struct AssetMemory {
+	size_t cpuBytes = 0;
+	size_t gpuBytes = 0;
+};
+
+struct AssetInfo {
+	AssetType type = AssetType::Model;
+	// First path the asset was registered under; empty for assets known by content only.
+	QString path;
+	uint64_t contentHash = 0;
+	// Handles held outside the registry.
+	long handles = 0;
+	AssetMemory memory;
+};
+
+struct AssetManagerStats {
+	// Lookups and insertions answered with an asset that was already alive.
+	size_t hits = 0;
+	size_t loads = 0;
+};
+
+// Registry of loaded assets, deduplicated by source path and by content hash. Assets are handed out as
+// shared_ptr handles and the registry only keeps weak references, so an asset goes away with its last user.
+// GL thread only, since most assets own GL objects.
+class AssetManager
+{
+public:
+	// Asset registered for path with the options hashed into variant, or nullptr.
+	template<typename T>
+	std::shared_ptr<T> findByPath(AssetType type, const QString & path, uint64_t variant = 0)
+	{
+		return std::static_pointer_cast<T>(findPath({type, normalizePath(path), variant}));
+	}
+
+	// Asset with this content hash, or nullptr; a hash of 0 never matches.
+	template<typename T>
+	std::shared_ptr<T> findByContent(AssetType type, uint64_t contentHash)
+	{
+		return std::static_pointer_cast<T>(findContent({type, contentHash}));
+	}
+
+	// Registers asset under path and variant and under contentHash, either of which may be empty or 0. When an asset
+	// with the same content is alive already, it gets the path too and is returned to be used in place of asset.
+	// memory(const T &) reports what the asset holds when asked.
+	template<typename T, typename Memory>
+	std::shared_ptr<T> insert(AssetType type, const QString & path, uint64_t variant, uint64_t contentHash,
+							  std::shared_ptr<T> asset, Memory memory)
+	{
+		return std::static_pointer_cast<T>(insertEntry(type, path, variant, contentHash, std::move(asset),
+													   [memory](const void * asset) { return memory(*static_cast<const T *>(asset)); }));
+	}
+
+	// Live assets in registration order; entries whose last handle was released are dropped first.
+	std::vector<AssetInfo> getAssets();
+	AssetMemory getTotalMemory();
+	const AssetManagerStats & getStats() const { return stats_; }
+
+	// Logs every live asset with its handles and memory.
+	void logReport();
+
+private:
+	struct Entry {
+		AssetType type = AssetType::Model;
+		QString path;
+		uint64_t contentHash = 0;
+		std::weak_ptr<void> asset;
+		std::function<AssetMemory(const void *)> memory;
+	};
+
+	using PathKey = std::tuple<AssetType, QString, uint64_t>;
+	using ContentKey = std::pair<AssetType, uint64_t>;
+
+	static QString normalizePath(const QString & path);
+
+	std::shared_ptr<void> findPath(const PathKey & key);
+	std::shared_ptr<void> findContent(const ContentKey & key);
+	// Counts a hit when the entry is alive.
+	std::shared_ptr<void> lockEntry(uint64_t id);
+	std::shared_ptr<void> insertEntry(AssetType type, const QString & path, uint64_t variant, uint64_t contentHash,
+									  std::shared_ptr<void> asset, std::function<AssetMemory(const void *)> memory);
+	void prune();
+
+	std::map<uint64_t, Entry> entries_;
+	std::map<PathKey, uint64_t> paths_;
+	std::map<ContentKey, uint64_t> contents_;
+	uint64_t nextId_ = 0;
+	AssetManagerStats stats_;
+};
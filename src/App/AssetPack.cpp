@@ -0,0 +1,321 @@
+#include "AssetPack.h"
+#include "ContentHash.h"
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+namespace
+{
+constexpr char g_magic[8] = {'F', 'G', 'L', 'P', 'A', 'C', 'K', '\0'};
+constexpr uint32_t g_version = 1;
+constexpr uint64_t g_alignment = 16;
+constexpr uint32_t g_flagCompressed = 1;
+constexpr auto g_packPrefix = "pack:/";
+
+struct PackHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entryCount;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+	uint64_t fileSize;
+};
+
+struct EntryRecord {
+	uint64_t nameOffset;
+	uint64_t nameSize;
+	uint64_t offset;
+	uint64_t storedSize;
+	uint64_t size;
+	uint64_t hash;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<PackHeader> && std::is_trivially_copyable_v<EntryRecord>);
+
+uint64_t alignUp(uint64_t value)
+{
+	return (value + g_alignment - 1) & ~(g_alignment - 1);
+}
+
+struct MountedPacks {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<AssetPack>> packs;
+};
+
+MountedPacks & getMountedPacks()
+{
+	static MountedPacks mounted;
+	return mounted;
+}
+}// namespace
+
+AssetPack::~AssetPack()
+{
+	close();
+}
+
+bool AssetPack::open(const QString & filePath)
+{
+	close();
+
+	file_.setFileName(filePath);
+	if (!file_.open(QIODevice::ReadOnly))
+		return false;
+
+	size_ = static_cast<size_t>(file_.size());
+	data_ = size_ >= sizeof(PackHeader) ? file_.map(0, file_.size()) : nullptr;
+	if (!data_)
+	{
+		close();
+		return false;
+	}
+
+	PackHeader header;
+	std::memcpy(&header, data_, sizeof(header));
+	const uint64_t recordsEnd = sizeof(header) + static_cast<uint64_t>(header.entryCount) * sizeof(EntryRecord);
+	if (std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version || header.fileSize != size_
+		|| recordsEnd > size_ || header.namesOffset > size_ || header.namesSize > size_ - header.namesOffset)
+	{
+		close();
+		return false;
+	}
+
+	entries_.reserve(header.entryCount);
+	for (uint32_t i = 0; i < header.entryCount; ++i)
+	{
+		EntryRecord record;
+		std::memcpy(&record, data_ + sizeof(header) + i * sizeof(EntryRecord), sizeof(record));
+		if (record.nameOffset > header.namesSize || record.nameSize > header.namesSize - record.nameOffset
+			|| record.offset > size_ || record.storedSize > size_ - record.offset)
+		{
+			close();
+			return false;
+		}
+
+		Entry entry;
+		entry.name = QString::fromUtf8(reinterpret_cast<const char *>(data_ + header.namesOffset + record.nameOffset),
+									   static_cast<int>(record.nameSize));
+		entry.offset = record.offset;
+		entry.storedSize = record.storedSize;
+		entry.size = record.size;
+		entry.hash = record.hash;
+		entry.compressed = (record.flags & g_flagCompressed) != 0;
+		entries_.push_back(std::move(entry));
+	}
+	std::sort(entries_.begin(), entries_.end(), [](const Entry & a, const Entry & b) { return a.name < b.name; });
+
+	filePath_ = filePath;
+	return true;
+}
+
+void AssetPack::close()
+{
+	if (data_)
+	{
+		file_.unmap(data_);
+		data_ = nullptr;
+	}
+	if (file_.isOpen())
+	{
+		file_.close();
+	}
+
+	filePath_.clear();
+	entries_.clear();
+	size_ = 0;
+}
+
+const AssetPack::Entry * AssetPack::find(const QString & name) const
+{
+	const auto it = std::lower_bound(entries_.begin(), entries_.end(), name,
+									 [](const Entry & entry, const QString & value) { return entry.name < value; });
+	return it != entries_.end() && it->name == name ? &*it : nullptr;
+}
+
+bool AssetPack::read(const Entry & entry, QByteArray & bytes) const
+{
+	const auto * stored = reinterpret_cast<const char *>(data_ + entry.offset);
+	if (!entry.compressed)
+	{
+		bytes = QByteArray::fromRawData(stored, static_cast<int>(entry.storedSize));
+		return true;
+	}
+
+	bytes = qUncompress(reinterpret_cast<const uchar *>(stored), static_cast<int>(entry.storedSize));
+	return static_cast<uint64_t>(bytes.size()) == entry.size;
+}
+
+const uint8_t * AssetPack::getStoredData(const Entry & entry) const
+{
+	return entry.compressed ? nullptr : data_ + entry.offset;
+}
+
+bool writeAssetPack(const QString & filePath, const std::vector<AssetPackInput> & inputs, bool compress, QString & error)
+{
+	struct Payload {
+		QByteArray name;
+		QByteArray bytes;
+		uint64_t size = 0;
+		uint64_t hash = 0;
+		bool compressed = false;
+	};
+
+	std::vector<Payload> payloads;
+	payloads.reserve(inputs.size());
+	for (const auto & input: inputs)
+	{
+		QFile file(input.filePath);
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			error = "Failed to open " + input.filePath;
+			return false;
+		}
+
+		Payload payload;
+		payload.name = input.name.toUtf8();
+		payload.bytes = file.readAll();
+		payload.size = static_cast<uint64_t>(payload.bytes.size());
+		payload.hash = hashBytes(payload.bytes.constData(), static_cast<size_t>(payload.bytes.size()));
+		if (compress && !payload.bytes.isEmpty())
+		{
+			QByteArray deflated = qCompress(payload.bytes, 9);
+			if (static_cast<uint64_t>(deflated.size()) <= payload.size - payload.size / 8)
+			{
+				payload.bytes = std::move(deflated);
+				payload.compressed = true;
+			}
+		}
+		payloads.push_back(std::move(payload));
+	}
+
+	std::sort(payloads.begin(), payloads.end(), [](const Payload & a, const Payload & b) { return a.name < b.name; });
+	const auto duplicate = std::adjacent_find(payloads.begin(), payloads.end(),
+											  [](const Payload & a, const Payload & b) { return a.name == b.name; });
+	if (duplicate != payloads.end())
+	{
+		error = "Duplicate entry " + QString::fromUtf8(duplicate->name);
+		return false;
+	}
+
+	// Header, records and names first, then the entry bytes; the index is all a reader needs to map up front.
+	PackHeader header = {};
+	std::memcpy(header.magic, g_magic, sizeof(g_magic));
+	header.version = g_version;
+	header.entryCount = static_cast<uint32_t>(payloads.size());
+	header.namesOffset = sizeof(header) + payloads.size() * sizeof(EntryRecord);
+
+	std::vector<EntryRecord> records(payloads.size());
+	for (size_t i = 0; i < payloads.size(); ++i)
+	{
+		records[i].nameOffset = header.namesSize;
+		records[i].nameSize = static_cast<uint64_t>(payloads[i].name.size());
+		header.namesSize += records[i].nameSize;
+	}
+
+	uint64_t offset = header.namesOffset + header.namesSize;
+	for (size_t i = 0; i < payloads.size(); ++i)
+	{
+		auto & record = records[i];
+		record.offset = alignUp(offset);
+		record.storedSize = static_cast<uint64_t>(payloads[i].bytes.size());
+		record.size = payloads[i].size;
+		record.hash = payloads[i].hash;
+		record.flags = payloads[i].compressed ? g_flagCompressed : 0;
+		offset = record.offset + record.storedSize;
+	}
+	header.fileSize = offset;
+
+	QSaveFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		error = "Failed to create " + filePath;
+		return false;
+	}
+
+	uint64_t written = 0;
+	const auto write = [&file, &written](uint64_t at, const void * bytes, uint64_t size) {
+		static const char padding[g_alignment] = {};
+		for (; written < at; written += std::min(at - written, g_alignment))
+		{
+			file.write(padding, static_cast<qint64>(std::min(at - written, g_alignment)));
+		}
+		file.write(static_cast<const char *>(bytes), static_cast<qint64>(size));
+		written = at + size;
+	};
+
+	write(0, &header, sizeof(header));
+	write(written, records.data(), records.size() * sizeof(EntryRecord));
+	for (const auto & payload: payloads)
+	{
+		write(written, payload.name.constData(), static_cast<uint64_t>(payload.name.size()));
+	}
+	for (size_t i = 0; i < payloads.size(); ++i)
+	{
+		write(records[i].offset, payloads[i].bytes.constData(), records[i].storedSize);
+	}
+
+	if (!file.commit())
+	{
+		error = "Failed to write " + filePath;
+		return false;
+	}
+	return true;
+}
+
+bool mountAssetPack(const QString & filePath)
+{
+	auto pack = std::make_unique<AssetPack>();
+	if (!pack->open(filePath))
+		return false;
+
+	auto & mounted = getMountedPacks();
+	std::lock_guard lock(mounted.mutex);
+	mounted.packs.push_back(std::move(pack));
+	return true;
+}
+
+bool isPackPath(const QString & path)
+{
+	return path.startsWith(g_packPrefix);
+}
+
+bool findPackEntry(const QString & path, const AssetPack *& pack, const AssetPack::Entry *& entry)
+{
+	if (!isPackPath(path))
+		return false;
+
+	const QString name = path.mid(static_cast<int>(std::strlen(g_packPrefix)));
+	auto & mounted = getMountedPacks();
+	std::lock_guard lock(mounted.mutex);
+	for (auto it = mounted.packs.rbegin(); it != mounted.packs.rend(); ++it)
+	{
+		if (const auto * found = (*it)->find(name))
+		{
+			pack = it->get();
+			entry = found;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool readAsset(const QString & path, QByteArray & bytes)
+{
+	if (isPackPath(path))
+	{
+		const AssetPack * pack = nullptr;
+		const AssetPack::Entry * entry = nullptr;
+		return findPackEntry(path, pack, entry) && pack->read(*entry, bytes);
+	}
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	bytes = file.readAll();
+	return true;
+}
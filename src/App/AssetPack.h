@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+// Read-only archive of assets written by asset-pack-builder: a header, an index of entries sorted by name and the
+// entry bytes, each 16-byte aligned and either stored or zlib-compressed. The file is mapped once; stored entries are
+// served straight from the mapping and only the pages that get touched are ever read.
+class AssetPack
+{
+public:
+	struct Entry {
+		QString name;
+		uint64_t offset = 0;
+		uint64_t storedSize = 0;
+		uint64_t size = 0;
+		// hashBytes of the uncompressed bytes.
+		uint64_t hash = 0;
+		bool compressed = false;
+	};
+
+	AssetPack() = default;
+	~AssetPack();
+
+	AssetPack(const AssetPack &) = delete;
+	AssetPack & operator=(const AssetPack &) = delete;
+
+	bool open(const QString & filePath);
+	void close();
+	bool isOpen() const { return data_ != nullptr; }
+
+	const QString & getFilePath() const { return filePath_; }
+	const std::vector<Entry> & getEntries() const { return entries_; }
+	const Entry * find(const QString & name) const;
+
+	// Thread-safe. Stored entries reference the mapping and stay valid while the pack is open; compressed entries
+	// are inflated into a copy. Returns false when a compressed entry is corrupt.
+	bool read(const Entry & entry, QByteArray & bytes) const;
+	// Null for compressed entries.
+	const uint8_t * getStoredData(const Entry & entry) const;
+
+private:
+	QFile file_;
+	QString filePath_;
+	uchar * data_ = nullptr;
+	size_t size_ = 0;
+	std::vector<Entry> entries_;
+};
+
+struct AssetPackInput {
+	// Name the entry is found by, like "Models/noel.glb".
+	QString name;
+	QString filePath;
+};
+
+// Writes a pack holding the given files. With compress, entries are deflated and kept so when that saves at least
+// an eighth of their size; already compressed formats like PNG stay stored.
+bool writeAssetPack(const QString & filePath, const std::vector<AssetPackInput> & inputs, bool compress, QString & error);
+
+// Pack paths, "pack:/<entry name>", resolve against the mounted packs the way ":/" paths resolve against compiled-in
+// resources. Mount before the first load; packs stay mapped until exit and later mounts shadow earlier ones.
+bool mountAssetPack(const QString & filePath);
+bool isPackPath(const QString & path);
+// Entry of a pack path in the mounted packs; false when none has it.
+bool findPackEntry(const QString & path, const AssetPack *& pack, const AssetPack::Entry *& entry);
+// Bytes of a pack path or of any file Qt can open, ":/" resources included. Stored pack entries are not copied.
+bool readAsset(const QString & path, QByteArray & bytes);
@@ -0,0 +1,570 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+// Share of the second endpoint for each index.
+constexpr float g_bc1Weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+constexpr int g_bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Principal axis of the block's texels over the first `channels` components, by power iteration.
+template<int Channels>
+void computePrincipalAxis(const float (&texels)[16][4], float (&mean)[4], float (&axis)[4])
+{
+	for (int c = 0; c < 4; ++c)
+	{
+		mean[c] = 0.0f;
+		axis[c] = 0.0f;
+	}
+	for (const auto & texel: texels)
+	{
+		for (int c = 0; c < Channels; ++c)
+		{
+			mean[c] += texel[c] / 16.0f;
+		}
+	}
+
+	float covariance[Channels][Channels] = {};
+	for (const auto & texel: texels)
+	{
+		for (int i = 0; i < Channels; ++i)
+		{
+			for (int j = 0; j < Channels; ++j)
+			{
+				covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+			}
+		}
+	}
+
+	float vector[Channels];
+	for (int c = 0; c < Channels; ++c)
+	{
+		vector[c] = 1.0f;
+	}
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[Channels] = {};
+		float length = 0.0f;
+		for (int i = 0; i < Channels; ++i)
+		{
+			for (int j = 0; j < Channels; ++j)
+			{
+				next[i] += covariance[i][j] * vector[j];
+			}
+			length = std::max(length, std::abs(next[i]));
+		}
+		if (length <= std::numeric_limits<float>::min())
+			return;
+
+		for (int c = 0; c < Channels; ++c)
+		{
+			vector[c] = next[c] / length;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < Channels; ++c)
+	{
+		length += vector[c] * vector[c];
+	}
+	length = std::sqrt(length);
+	for (int c = 0; c < Channels; ++c)
+	{
+		axis[c] = vector[c] / length;
+	}
+}
+
+// Extremes of the texels projected on the principal axis.
+template<int Channels>
+void computeEndpoints(const float (&texels)[16][4], float (&low)[4], float (&high)[4])
+{
+	float mean[4];
+	float axis[4];
+	computePrincipalAxis<Channels>(texels, mean, axis);
+
+	float minimum = 0.0f;
+	float maximum = 0.0f;
+	for (const auto & texel: texels)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < Channels; ++c)
+		{
+			t += (texel[c] - mean[c]) * axis[c];
+		}
+		minimum = std::min(minimum, t);
+		maximum = std::max(maximum, t);
+	}
+
+	for (int c = 0; c < 4; ++c)
+	{
+		low[c] = std::clamp(mean[c] + axis[c] * minimum, 0.0f, 255.0f);
+		high[c] = std::clamp(mean[c] + axis[c] * maximum, 0.0f, 255.0f);
+	}
+}
+
+// Endpoints minimizing the squared error for fixed interpolation weights (fraction of `high` per texel).
+template<int Channels>
+bool solveEndpoints(const float (&texels)[16][4], const float (&weights)[16], float (&low)[4], float (&high)[4])
+{
+	float aa = 0.0f;
+	float ab = 0.0f;
+	float bb = 0.0f;
+	float ap[4] = {};
+	float bp[4] = {};
+	for (int i = 0; i < 16; ++i)
+	{
+		const float b = weights[i];
+		const float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < Channels; ++c)
+		{
+			ap[c] += a * texels[i][c];
+			bp[c] += b * texels[i][c];
+		}
+	}
+
+	const float determinant = aa * bb - ab * ab;
+	if (std::abs(determinant) <= 1e-6f)
+		return false;
+
+	for (int c = 0; c < Channels; ++c)
+	{
+		low[c] = std::clamp((ap[c] * bb - bp[c] * ab) / determinant, 0.0f, 255.0f);
+		high[c] = std::clamp((bp[c] * aa - ap[c] * ab) / determinant, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+void loadBlock(const uint8_t * rgba, int width, int height, int blockX, int blockY, float (&texels)[16][4])
+{
+	for (int y = 0; y < 4; ++y)
+	{
+		const int sy = std::min(blockY * 4 + y, height - 1);
+		for (int x = 0; x < 4; ++x)
+		{
+			const int sx = std::min(blockX * 4 + x, width - 1);
+			const uint8_t * texel = rgba + (static_cast<size_t>(sy) * width + sx) * 4;
+			for (int c = 0; c < 4; ++c)
+			{
+				texels[y * 4 + x][c] = texel[c];
+			}
+		}
+	}
+}
+
+uint16_t packRgb565(const float * color)
+{
+	const auto quantize = [](float value, int maximum) {
+		return static_cast<uint16_t>(std::lround(value * static_cast<float>(maximum) / 255.0f));
+	};
+	return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+}
+
+void unpackRgb565(uint16_t packed, float * color)
+{
+	const int r = (packed >> 11) & 31;
+	const int g = (packed >> 5) & 63;
+	const int b = packed & 31;
+	color[0] = static_cast<float>((r << 3) | (r >> 2));
+	color[1] = static_cast<float>((g << 2) | (g >> 4));
+	color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+float distanceSquared(const float * a, const float * b, int channels)
+{
+	float sum = 0.0f;
+	for (int c = 0; c < channels; ++c)
+	{
+		sum += (a[c] - b[c]) * (a[c] - b[c]);
+	}
+	return sum;
+}
+
+// Four-color BC1 block for the given endpoints; returns its squared error.
+float encodeColorEndpoints(const float (&texels)[16][4], const float (&low)[4], const float (&high)[4], uint8_t * dst)
+{
+	uint16_t color0 = packRgb565(high);
+	uint16_t color1 = packRgb565(low);
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	uint32_t indices = 0;
+	float error = 0.0f;
+	float palette[4][3];
+	unpackRgb565(color0, palette[0]);
+	unpackRgb565(color1, palette[1]);
+	if (color0 == color1)
+	{
+		for (const auto & texel: texels)
+		{
+			error += distanceSquared(texel, palette[0], 3);
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			float bestError = std::numeric_limits<float>::max();
+			for (int entry = 0; entry < 4; ++entry)
+			{
+				const float entryError = distanceSquared(texels[i], palette[entry], 3);
+				if (entryError < bestError)
+				{
+					best = entry;
+					bestError = entryError;
+				}
+			}
+			indices |= static_cast<uint32_t>(best) << (2 * i);
+			error += bestError;
+		}
+	}
+
+	std::memcpy(dst, &color0, 2);
+	std::memcpy(dst + 2, &color1, 2);
+	std::memcpy(dst + 4, &indices, 4);
+	return error;
+}
+
+void encodeColorBlock(const float (&texels)[16][4], uint8_t * dst)
+{
+	float low[4];
+	float high[4];
+	computeEndpoints<3>(texels, low, high);
+	const float error = encodeColorEndpoints(texels, low, high, dst);
+
+	// One least-squares pass over the chosen indices; kept only when it helps.
+	uint16_t color0;
+	uint16_t color1;
+	uint32_t indices;
+	std::memcpy(&color0, dst, 2);
+	std::memcpy(&color1, dst + 2, 2);
+	std::memcpy(&indices, dst + 4, 4);
+	if (color0 == color1)
+		return;
+
+	float weights[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		weights[i] = g_bc1Weights[(indices >> (2 * i)) & 3];
+	}
+	float refined0[4];
+	float refined1[4];
+	if (!solveEndpoints<3>(texels, weights, refined0, refined1))
+		return;
+
+	uint8_t refined[8];
+	if (encodeColorEndpoints(texels, refined1, refined0, refined) < error)
+		std::memcpy(dst, refined, sizeof(refined));
+}
+
+// Eight-value BC4 block of one channel.
+void encodeSingleChannelBlock(const float (&texels)[16][4], int channel, uint8_t * dst)
+{
+	float minimum = 255.0f;
+	float maximum = 0.0f;
+	for (const auto & texel: texels)
+	{
+		minimum = std::min(minimum, texel[channel]);
+		maximum = std::max(maximum, texel[channel]);
+	}
+
+	const auto value0 = static_cast<uint8_t>(std::lround(maximum));
+	const auto value1 = static_cast<uint8_t>(std::lround(minimum));
+	dst[0] = value0;
+	dst[1] = value1;
+
+	float palette[8] = {static_cast<float>(value0), static_cast<float>(value1)};
+	for (int i = 1; i < 7; ++i)
+	{
+		palette[i + 1] = (static_cast<float>(7 - i) * value0 + static_cast<float>(i) * value1) / 7.0f;
+	}
+
+	uint64_t indices = 0;
+	if (value0 != value1)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			float bestError = std::numeric_limits<float>::max();
+			for (int entry = 0; entry < 8; ++entry)
+			{
+				const float entryError = std::abs(texels[i][channel] - palette[entry]);
+				if (entryError < bestError)
+				{
+					best = entry;
+					bestError = entryError;
+				}
+			}
+			indices |= static_cast<uint64_t>(best) << (3 * i);
+		}
+	}
+	for (int i = 0; i < 6; ++i)
+	{
+		dst[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+	}
+}
+
+class BitWriter
+{
+public:
+	explicit BitWriter(uint8_t * dst)
+		: dst_(dst)
+	{
+		std::memset(dst_, 0, 16);
+	}
+
+	void write(uint32_t value, int bits)
+	{
+		for (int i = 0; i < bits; ++i, ++position_)
+		{
+			dst_[position_ >> 3] |= static_cast<uint8_t>(((value >> i) & 1u) << (position_ & 7));
+		}
+	}
+
+private:
+	uint8_t * dst_;
+	int position_ = 0;
+};
+
+struct Bc7Endpoints {
+	int color[2][4];
+	int pbit[2];
+};
+
+// Nearest 7-bit value plus shared p-bit for each endpoint, picking the p-bit with the lower error.
+Bc7Endpoints quantizeBc7Endpoints(const float (&low)[4], const float (&high)[4])
+{
+	Bc7Endpoints endpoints;
+	const float * source[2] = {low, high};
+	for (int e = 0; e < 2; ++e)
+	{
+		float bestError = std::numeric_limits<float>::max();
+		for (int pbit = 0; pbit < 2; ++pbit)
+		{
+			int color[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				color[c] = std::clamp(static_cast<int>(std::lround((source[e][c] - static_cast<float>(pbit)) / 2.0f)), 0, 127);
+				const float value = static_cast<float>((color[c] << 1) | pbit);
+				error += (value - source[e][c]) * (value - source[e][c]);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				endpoints.pbit[e] = pbit;
+				std::copy(std::begin(color), std::end(color), endpoints.color[e]);
+			}
+		}
+	}
+	return endpoints;
+}
+
+// Mode 6 block for the given endpoints; returns its squared error.
+float encodeBc7Endpoints(const float (&texels)[16][4], const float (&low)[4], const float (&high)[4], uint8_t * dst)
+{
+	Bc7Endpoints endpoints = quantizeBc7Endpoints(low, high);
+
+	float palette[16][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		const int e0 = (endpoints.color[0][c] << 1) | endpoints.pbit[0];
+		const int e1 = (endpoints.color[1][c] << 1) | endpoints.pbit[1];
+		for (int i = 0; i < 16; ++i)
+		{
+			palette[i][c] = static_cast<float>(((64 - g_bc7Weights[i]) * e0 + g_bc7Weights[i] * e1 + 32) >> 6);
+		}
+	}
+
+	int indices[16];
+	float error = 0.0f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float bestError = std::numeric_limits<float>::max();
+		for (int entry = 0; entry < 16; ++entry)
+		{
+			const float entryError = distanceSquared(texels[i], palette[entry], 4);
+			if (entryError < bestError)
+			{
+				indices[i] = entry;
+				bestError = entryError;
+			}
+		}
+		error += bestError;
+	}
+
+	// The first index is stored without its top bit, so it must be below 8; swapping the endpoints inverts the indices.
+	if (indices[0] >= 8)
+	{
+		std::swap(endpoints.color[0], endpoints.color[1]);
+		std::swap(endpoints.pbit[0], endpoints.pbit[1]);
+		for (int & index: indices)
+		{
+			index = 15 - index;
+		}
+	}
+
+	BitWriter writer(dst);
+	writer.write(1u << 6, 7);
+	for (int c = 0; c < 4; ++c)
+	{
+		writer.write(static_cast<uint32_t>(endpoints.color[0][c]), 7);
+		writer.write(static_cast<uint32_t>(endpoints.color[1][c]), 7);
+	}
+	writer.write(static_cast<uint32_t>(endpoints.pbit[0]), 1);
+	writer.write(static_cast<uint32_t>(endpoints.pbit[1]), 1);
+	writer.write(static_cast<uint32_t>(indices[0]), 3);
+	for (int i = 1; i < 16; ++i)
+	{
+		writer.write(static_cast<uint32_t>(indices[i]), 4);
+	}
+	return error;
+}
+
+void encodeBc7Block(const float (&texels)[16][4], uint8_t * dst)
+{
+	float low[4];
+	float high[4];
+	computeEndpoints<4>(texels, low, high);
+	const float error = encodeBc7Endpoints(texels, low, high, dst);
+
+	// Refit the endpoints to the chosen indices once and keep the better block.
+	const auto readBits = [dst](int offset, int bits) {
+		uint32_t value = 0;
+		for (int i = 0; i < bits; ++i)
+		{
+			value |= static_cast<uint32_t>((dst[(offset + i) >> 3] >> ((offset + i) & 7)) & 1) << i;
+		}
+		return value;
+	};
+	float weights[16];
+	weights[0] = static_cast<float>(g_bc7Weights[readBits(65, 3)]) / 64.0f;
+	for (int i = 1; i < 16; ++i)
+	{
+		weights[i] = static_cast<float>(g_bc7Weights[readBits(68 + (i - 1) * 4, 4)]) / 64.0f;
+	}
+
+	float refinedLow[4];
+	float refinedHigh[4];
+	if (!solveEndpoints<4>(texels, weights, refinedLow, refinedHigh))
+		return;
+
+	uint8_t refined[16];
+	if (encodeBc7Endpoints(texels, refinedLow, refinedHigh, refined) < error)
+		std::memcpy(dst, refined, sizeof(refined));
+}
+}// namespace
+
+size_t getBlockBytes(BlockFormat format)
+{
+	switch (format)
+	{
+		case BlockFormat::BC1:
+			return 8;
+		case BlockFormat::BC3:
+		case BlockFormat::BC5:
+		case BlockFormat::BC7:
+			return 16;
+		case BlockFormat::None:
+		default:
+			return 0;
+	}
+}
+
+const char * getBlockFormatName(BlockFormat format)
+{
+	switch (format)
+	{
+		case BlockFormat::BC1:
+			return "BC1";
+		case BlockFormat::BC3:
+			return "BC3";
+		case BlockFormat::BC5:
+			return "BC5";
+		case BlockFormat::BC7:
+			return "BC7";
+		case BlockFormat::None:
+		default:
+			return "RGBA8";
+	}
+}
+
+size_t getCompressedSize(BlockFormat format, int width, int height)
+{
+	return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * getBlockBytes(format);
+}
+
+void compressBlockRows(const uint8_t * rgba, int width, int height, BlockFormat format, int firstBlockRow,
+					   int endBlockRow, uint8_t * dst)
+{
+	const int blocksX = (width + 3) / 4;
+	const size_t blockBytes = getBlockBytes(format);
+
+	float texels[16][4];
+	for (int blockY = firstBlockRow; blockY < endBlockRow; ++blockY)
+	{
+		for (int blockX = 0; blockX < blocksX; ++blockX)
+		{
+			uint8_t * block = dst + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes;
+			loadBlock(rgba, width, height, blockX, blockY, texels);
+
+			switch (format)
+			{
+				case BlockFormat::BC1:
+					encodeColorBlock(texels, block);
+					break;
+				case BlockFormat::BC3:
+					encodeSingleChannelBlock(texels, 3, block);
+					encodeColorBlock(texels, block + 8);
+					break;
+				case BlockFormat::BC5:
+					encodeSingleChannelBlock(texels, 0, block);
+					encodeSingleChannelBlock(texels, 1, block + 8);
+					break;
+				case BlockFormat::BC7:
+					encodeBc7Block(texels, block);
+					break;
+				case BlockFormat::None:
+					break;
+			}
+		}
+	}
+}
+
+std::vector<uint8_t> downsampleRgba8(const uint8_t * rgba, int width, int height)
+{
+	const int halfWidth = std::max(width / 2, 1);
+	const int halfHeight = std::max(height / 2, 1);
+	std::vector<uint8_t> result(static_cast<size_t>(halfWidth) * halfHeight * 4);
+
+	for (int y = 0; y < halfHeight; ++y)
+	{
+		const int y0 = std::min(y * 2, height - 1);
+		const int y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < halfWidth; ++x)
+		{
+			const int x0 = std::min(x * 2, width - 1);
+			const int x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; ++c)
+			{
+				const auto texel = [rgba, width, c](int tx, int ty) {
+					return static_cast<int>(rgba[(static_cast<size_t>(ty) * width + tx) * 4 + c]);
+				};
+				const int sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1);
+				result[(static_cast<size_t>(y) * halfWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+	return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class BlockFormat
+{
+	None,
+	// RGB, 8 bytes per block; for opaque images.
+	BC1,
+	// RGBA, BC1 color plus an interpolated alpha block, 16 bytes.
+	BC3,
+	// Two independent channels, 16 bytes; for tangent-space normal maps (x, y in red and green).
+	BC5,
+	// RGBA, 16 bytes. Only mode 6 (one subset, 7.7.7.7 endpoints with p-bits, 4-bit indices) is emitted.
+	BC7
+};
+
+size_t getBlockBytes(BlockFormat format);
+const char * getBlockFormatName(BlockFormat format);
+size_t getCompressedSize(BlockFormat format, int width, int height);
+
+// Compresses the block rows [firstBlockRow, endBlockRow) of a tightly packed RGBA8 image into dst, which holds
+// the whole compressed image. Edge blocks of sizes that are not multiples of four replicate the last row and column.
+void compressBlockRows(const uint8_t * rgba, int width, int height, BlockFormat format, int firstBlockRow,
+					   int endBlockRow, uint8_t * dst);
+
+// Half-size RGBA8 image by 2x2 box filtering; odd edges reuse the last texel.
+std::vector<uint8_t> downsampleRgba8(const uint8_t * rgba, int width, int height);
@@ -0,0 +1,94 @@
+#include "ContentHash.h"
+#include <cstring>
+
+namespace
+{
+constexpr uint64_t g_prime1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t g_prime2 = 0xc2b2ae3d27d4eb4full;
+constexpr uint64_t g_prime3 = 0x165667b19e3779f9ull;
+constexpr uint64_t g_prime4 = 0x85ebca77c2b2ae63ull;
+constexpr uint64_t g_prime5 = 0x27d4eb2f165667c5ull;
+
+inline uint64_t rotl(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read64(const uint8_t * p)
+{
+	uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint32_t read32(const uint8_t * p)
+{
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint64_t round(uint64_t accumulator, uint64_t input)
+{
+	return rotl(accumulator + input * g_prime2, 31) * g_prime1;
+}
+
+inline uint64_t mergeRound(uint64_t hash, uint64_t lane)
+{
+	return (hash ^ round(0, lane)) * g_prime1 + g_prime4;
+}
+}// namespace
+
+uint64_t hashBytes(const void * data, size_t size, uint64_t seed)
+{
+	const auto * p = static_cast<const uint8_t *>(data);
+	const uint8_t * const end = p + size;
+	uint64_t hash;
+
+	if (size >= 32)
+	{
+		// Four independent lanes keep the multiplier pipeline busy.
+		uint64_t lanes[4] = {seed + g_prime1 + g_prime2, seed + g_prime2, seed, seed - g_prime1};
+		const uint8_t * const limit = end - 32;
+		do
+		{
+			for (int i = 0; i < 4; ++i, p += 8)
+			{
+				lanes[i] = round(lanes[i], read64(p));
+			}
+		} while (p <= limit);
+
+		hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+		for (uint64_t lane: lanes)
+		{
+			hash = mergeRound(hash, lane);
+		}
+	}
+	else
+	{
+		hash = seed + g_prime5;
+	}
+
+	hash += static_cast<uint64_t>(size);
+
+	for (; p + 8 <= end; p += 8)
+	{
+		hash = rotl(hash ^ round(0, read64(p)), 27) * g_prime1 + g_prime4;
+	}
+	if (p + 4 <= end)
+	{
+		hash = rotl(hash ^ (static_cast<uint64_t>(read32(p)) * g_prime1), 23) * g_prime2 + g_prime3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+	{
+		hash = rotl(hash ^ (*p * g_prime5), 11) * g_prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= g_prime2;
+	hash ^= hash >> 29;
+	hash *= g_prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic content hash (XXH64 construction) for cache keys and asset deduplication.
+uint64_t hashBytes(const void * data, size_t size, uint64_t seed = 0);
+
+inline uint64_t hashCombine(uint64_t hash, uint64_t value)
+{
+	return hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+}
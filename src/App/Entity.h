@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 
+struct BoundingBox;
 class Camera;
 class OpenGLContext;
 using OpenGLContextPtr = std::shared_ptr<OpenGLContext>;
@@ -26,6 +27,11 @@ public:
 
 	const QMatrix4x4 & getTransform() const;
 
+	// World transform of the scene node holding the entity; kept up to date by SceneNode::update.
+	void setParentTransform(const QMatrix4x4 & transform) { parentTransform_ = transform; }
+	const QMatrix4x4 & getParentTransform() const { return parentTransform_; }
+	QMatrix4x4 getWorldTransform() const { return parentTransform_ * getTransform(); }
+
 	const std::string & getName() const { return name_; }
 	void setName(const std::string & name) { name_ = name; }
 
@@ -34,6 +40,9 @@ public:
 
 	virtual void update(float /*deltaTime*/) {}
 
+	// Object-space bounds of what the entity draws. Entities without bounds that hold are never culled.
+	virtual bool getBoundingBox(BoundingBox & /*box*/) const { return false; }
+
 	virtual void render(Camera * camera, OpenGLContextPtr context) = 0;
 
 protected:
@@ -49,6 +58,7 @@ private:
 
 	mutable QMatrix4x4 transform_;
 	mutable bool transformDirty_ = true;
+	QMatrix4x4 parentTransform_;
 
 	bool visible_ = true;
 };
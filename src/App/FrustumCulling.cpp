@@ -0,0 +1,246 @@
+#include "FrustumCulling.h"
+#include <cmath>
+
+#if defined(__AVX2__)
+#define FGL_CULLING_AVX2 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FGL_CULLING_SSE2 1
+#endif
+
+#if defined(FGL_CULLING_AVX2)
+#include <immintrin.h>
+#elif defined(FGL_CULLING_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// A box is outside when it lies entirely behind one plane: its center is farther behind it than the box reaches
+// along the plane normal.
+inline bool isBoxVisible(const FrustumPlanes & planes, const float * center, const float * extent)
+{
+	for (size_t i = 0; i < FrustumPlanes::count; ++i)
+	{
+		const float distance = planes.a[i] * center[0] + planes.b[i] * center[1] + planes.c[i] * center[2] + planes.d[i];
+		const float reach = std::abs(planes.a[i]) * extent[0] + std::abs(planes.b[i]) * extent[1] + std::abs(planes.c[i]) * extent[2];
+		if (!(distance + reach >= 0.0f))
+			return false;
+	}
+	return true;
+}
+
+#if defined(FGL_CULLING_AVX2)
+
+constexpr size_t g_lanes = 8;
+
+size_t cullLanes(const FrustumPlanes & planes, const CullBoxes & boxes, uint8_t * visible)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const size_t count = boxes.size() / g_lanes * g_lanes;
+	size_t culled = 0;
+	for (size_t i = 0; i < count; i += g_lanes)
+	{
+		const __m256 cx = _mm256_loadu_ps(boxes.getCenters(0) + i);
+		const __m256 cy = _mm256_loadu_ps(boxes.getCenters(1) + i);
+		const __m256 cz = _mm256_loadu_ps(boxes.getCenters(2) + i);
+		const __m256 ex = _mm256_loadu_ps(boxes.getExtents(0) + i);
+		const __m256 ey = _mm256_loadu_ps(boxes.getExtents(1) + i);
+		const __m256 ez = _mm256_loadu_ps(boxes.getExtents(2) + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (size_t p = 0; p < FrustumPlanes::count; ++p)
+		{
+			const __m256 a = _mm256_broadcast_ss(planes.a + p);
+			const __m256 b = _mm256_broadcast_ss(planes.b + p);
+			const __m256 c = _mm256_broadcast_ss(planes.c + p);
+			const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)),
+												  _mm256_add_ps(_mm256_mul_ps(c, cz), _mm256_broadcast_ss(planes.d + p)));
+			const __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, a), ex), _mm256_mul_ps(_mm256_andnot_ps(signMask, b), ey)),
+											   _mm256_mul_ps(_mm256_andnot_ps(signMask, c), ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		const int mask = _mm256_movemask_ps(inside);
+		for (size_t lane = 0; lane < g_lanes; ++lane)
+		{
+			visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+			culled += visible[i + lane] ^ 1u;
+		}
+	}
+	return culled;
+}
+
+#elif defined(FGL_CULLING_SSE2)
+
+constexpr size_t g_lanes = 4;
+
+size_t cullLanes(const FrustumPlanes & planes, const CullBoxes & boxes, uint8_t * visible)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const size_t count = boxes.size() / g_lanes * g_lanes;
+	size_t culled = 0;
+	for (size_t i = 0; i < count; i += g_lanes)
+	{
+		const __m128 cx = _mm_loadu_ps(boxes.getCenters(0) + i);
+		const __m128 cy = _mm_loadu_ps(boxes.getCenters(1) + i);
+		const __m128 cz = _mm_loadu_ps(boxes.getCenters(2) + i);
+		const __m128 ex = _mm_loadu_ps(boxes.getExtents(0) + i);
+		const __m128 ey = _mm_loadu_ps(boxes.getExtents(1) + i);
+		const __m128 ez = _mm_loadu_ps(boxes.getExtents(2) + i);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (size_t p = 0; p < FrustumPlanes::count; ++p)
+		{
+			const __m128 a = _mm_set1_ps(planes.a[p]);
+			const __m128 b = _mm_set1_ps(planes.b[p]);
+			const __m128 c = _mm_set1_ps(planes.c[p]);
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(planes.d[p])));
+			const __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex), _mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+											_mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		for (size_t lane = 0; lane < g_lanes; ++lane)
+		{
+			visible[i + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+			culled += visible[i + lane] ^ 1u;
+		}
+	}
+	return culled;
+}
+
+#endif
+}// namespace
+
+FrustumPlanes extractFrustumPlanes(const float * matrix)
+{
+	// Row r of the matrix is matrix[r], matrix[4 + r], ...; the planes are w +- x, w +- y and w +- z in clip space.
+	const auto element = [matrix](int row, int column) { return matrix[column * 4 + row]; };
+
+	FrustumPlanes planes;
+	for (size_t i = 0; i < FrustumPlanes::count; ++i)
+	{
+		const int row = static_cast<int>(i / 2);
+		const float sign = i % 2 == 0 ? 1.0f : -1.0f;
+		float plane[4];
+		for (int column = 0; column < 4; ++column)
+		{
+			plane[column] = element(3, column) + sign * element(row, column);
+		}
+
+		const float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		const float scale = length > 0.0f ? 1.0f / length : 1.0f;
+		planes.a[i] = plane[0] * scale;
+		planes.b[i] = plane[1] * scale;
+		planes.c[i] = plane[2] * scale;
+		planes.d[i] = plane[3] * scale;
+	}
+	return planes;
+}
+
+BoundingBox transformBoundingBox(const BoundingBox & box, const float * matrix)
+{
+	float center[3];
+	float extent[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		center[axis] = (box.minimum[axis] + box.maximum[axis]) * 0.5f;
+		extent[axis] = (box.maximum[axis] - box.minimum[axis]) * 0.5f;
+	}
+
+	// Each half extent of the result is the reach of the transformed box axes along that world axis.
+	BoundingBox result;
+	for (int row = 0; row < 3; ++row)
+	{
+		float transformedCenter = matrix[12 + row];
+		float transformedExtent = 0.0f;
+		for (int column = 0; column < 3; ++column)
+		{
+			transformedCenter += matrix[column * 4 + row] * center[column];
+			transformedExtent += std::abs(matrix[column * 4 + row]) * extent[column];
+		}
+		result.minimum[row] = transformedCenter - transformedExtent;
+		result.maximum[row] = transformedCenter + transformedExtent;
+	}
+	return result;
+}
+
+void CullBoxes::clear()
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		centers_[axis].clear();
+		extents_[axis].clear();
+	}
+}
+
+void CullBoxes::reserve(size_t count)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		centers_[axis].reserve(count);
+		extents_[axis].reserve(count);
+	}
+}
+
+void CullBoxes::add(const BoundingBox & box)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		centers_[axis].push_back((box.minimum[axis] + box.maximum[axis]) * 0.5f);
+		extents_[axis].push_back((box.maximum[axis] - box.minimum[axis]) * 0.5f);
+	}
+}
+
+void CullBoxes::set(size_t index, const BoundingBox & box)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		centers_[axis][index] = (box.minimum[axis] + box.maximum[axis]) * 0.5f;
+		extents_[axis][index] = (box.maximum[axis] - box.minimum[axis]) * 0.5f;
+	}
+}
+
+void CullBoxes::removeSwap(size_t index)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		centers_[axis][index] = centers_[axis].back();
+		centers_[axis].pop_back();
+		extents_[axis][index] = extents_[axis].back();
+		extents_[axis].pop_back();
+	}
+}
+
+size_t cullBoxes(const FrustumPlanes & planes, const CullBoxes & boxes, uint8_t * visible)
+{
+#if defined(FGL_CULLING_AVX2) || defined(FGL_CULLING_SSE2)
+	size_t culled = cullLanes(planes, boxes, visible);
+	const size_t tail = boxes.size() / g_lanes * g_lanes;
+#else
+	size_t culled = 0;
+	const size_t tail = 0;
+#endif
+	for (size_t i = tail; i < boxes.size(); ++i)
+	{
+		const float center[3] = {boxes.getCenters(0)[i], boxes.getCenters(1)[i], boxes.getCenters(2)[i]};
+		const float extent[3] = {boxes.getExtents(0)[i], boxes.getExtents(1)[i], boxes.getExtents(2)[i]};
+		visible[i] = isBoxVisible(planes, center, extent) ? 1 : 0;
+		culled += visible[i] ^ 1u;
+	}
+	return culled;
+}
+
+const char * getCullingKernelIsa()
+{
+#if defined(FGL_CULLING_AVX2)
+	return "AVX2";
+#elif defined(FGL_CULLING_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
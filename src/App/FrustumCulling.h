@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The six planes of a view frustum, normalized, with the inside where a x + b y + c z + d >= 0.
+struct FrustumPlanes {
+	static constexpr size_t count = 6;
+
+	float a[count] = {};
+	float b[count] = {};
+	float c[count] = {};
+	float d[count] = {};
+};
+
+// Planes of a column-major clip matrix. They are in the space the matrix maps from: world space for a view
+// projection, the object space of a model for the view projection times its world transform.
+FrustumPlanes extractFrustumPlanes(const float * matrix);
+
+// Box around box transformed by a column-major affine matrix.
+BoundingBox transformBoundingBox(const BoundingBox & box, const float * matrix);
+
+// Boxes in the structure-of-arrays layout of cullBoxes: centers and half extents, one array per axis.
+class CullBoxes
+{
+public:
+	void clear();
+	void reserve(size_t count);
+	size_t size() const { return centers_[0].size(); }
+
+	void add(const BoundingBox & box);
+	void set(size_t index, const BoundingBox & box);
+	// Moves the last box into index.
+	void removeSwap(size_t index);
+
+	const float * getCenters(int axis) const { return centers_[axis].data(); }
+	const float * getExtents(int axis) const { return extents_[axis].data(); }
+
+private:
+	std::vector<float> centers_[3];
+	std::vector<float> extents_[3];
+};
+
+// Writes 1 to visible[i] for every box that intersects the frustum and 0 for the others, several boxes per
+// instruction. Conservative: a box near a corner of the frustum may be reported visible. Returns the boxes culled.
+size_t cullBoxes(const FrustumPlanes & planes, const CullBoxes & boxes, uint8_t * visible);
+
+// Instruction set the culling kernel was compiled for: "AVX2", "SSE2" or "scalar".
+const char * getCullingKernelIsa();
@@ -0,0 +1,545 @@
+#include "GltfSource.h"
+#include "AssetPack.h"
+#include "ContentHash.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+#include <QFileInfo>
+#include <QUrl>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <tinygltf/json.hpp>
+
+namespace
+{
+constexpr uint32_t g_glbMagic = 0x46546C67;    // "glTF"
+constexpr uint32_t g_glbChunkJson = 0x4E4F534A;// "JSON"
+constexpr uint32_t g_glbChunkBin = 0x004E4942; // "BIN\0"
+constexpr size_t g_glbHeaderSize = 12;
+constexpr size_t g_glbChunkHeaderSize = 8;
+
+// Four zero bytes: tinygltf insists on a non-empty payload for every buffer.
+constexpr auto g_placeholderUri = "data:application/octet-stream;base64,AAAAAA==";
+constexpr auto g_placeholderSize = 4;
+
+uint32_t readU32(const uint8_t * bytes)
+{
+	uint32_t value;
+	std::memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+bool isDataUri(const std::string & uri)
+{
+	return uri.compare(0, 5, "data:") == 0;
+}
+
+// Directory that relative URIs resolve against; pack paths keep their scheme.
+QString getBaseDir(const QString & filePath)
+{
+	return isPackPath(filePath) ? filePath.left(filePath.lastIndexOf('/')) : QFileInfo(filePath).absolutePath();
+}
+
+QString resolveUri(const QString & baseDir, const std::string & uri)
+{
+	return baseDir + '/' + QUrl::fromPercentEncoding(QByteArray::fromStdString(uri));
+}
+}// namespace
+
+GltfSource::ExternalBuffer::~ExternalBuffer()
+{
+	if (mapped)
+		file.unmap(mapped);
+}
+
+bool GltfSource::hashSourceFiles(const QString & filePath, uint64_t & hash)
+{
+	if (!hashFile(filePath, hash))
+		return false;
+
+	// Only text glTF is worth reading again; binary files rarely reference other files.
+	QByteArray bytes;
+	const AssetPack * pack = nullptr;
+	const AssetPack::Entry * entry = nullptr;
+	if (findPackEntry(filePath, pack, entry))
+	{
+		// The magic of a stored entry is read from the pack mapping. A compressed entry cannot be peeked at, so
+		// only one that is not named .glb is inflated.
+		const uint8_t * stored = pack->getStoredData(*entry);
+		const bool binary = stored ? entry->size >= 4 && readU32(stored) == g_glbMagic
+								   : entry->name.endsWith(".glb", Qt::CaseInsensitive);
+		if (!binary)
+			pack->read(*entry, bytes);
+	}
+	else
+	{
+		QFile file(filePath);
+		if (file.open(QIODevice::ReadOnly))
+		{
+			bytes = file.read(4);
+			if (bytes.size() == 4 && readU32(reinterpret_cast<const uint8_t *>(bytes.constData())) != g_glbMagic)
+				bytes += file.readAll();
+		}
+	}
+	if (bytes.size() < 4 || readU32(reinterpret_cast<const uint8_t *>(bytes.constData())) == g_glbMagic)
+		return true;
+
+	const auto document = nlohmann::json::parse(bytes.constData(), bytes.constData() + bytes.size(), nullptr, false);
+	if (!document.is_object())
+		return true;
+
+	const QString baseDir = getBaseDir(filePath);
+	for (const char * key: {"buffers", "images"})
+	{
+		if (!document.contains(key) || !document[key].is_array())
+			continue;
+		for (const auto & item: document[key])
+		{
+			uint64_t fileHash = 0;
+			if (item.contains("uri") && item["uri"].is_string() && !isDataUri(item["uri"].get<std::string>())
+				&& hashFile(resolveUri(baseDir, item["uri"].get<std::string>()), fileHash))
+			{
+				hash = hashCombine(hash, fileHash);
+			}
+		}
+	}
+	return true;
+}
+
+GltfSource::~GltfSource()
+{
+	close();
+}
+
+bool GltfSource::open(const QString & filePath, Mode mode)
+{
+	close();
+	error_.clear();
+
+	if (isPackPath(filePath))
+		return openPackEntry(filePath, mode);
+
+	file_.setFileName(filePath);
+	if (!file_.open(QIODevice::ReadOnly))
+	{
+		error_ = "Failed to open " + filePath.toStdString();
+		return false;
+	}
+
+	baseDir_ = getBaseDir(filePath);
+	mode_ = mode;
+	fileSize_ = static_cast<size_t>(file_.size());
+
+	if (mode == Mode::MemoryMapped)
+	{
+		mapped_ = file_.map(0, file_.size());
+	}
+
+	if (!mapped_)
+	{
+		// Resources compressed by rcc and some file engines cannot be mapped.
+		copy_ = file_.readAll();
+		file_.close();
+	}
+
+	const auto * bytes = mapped_ ? mapped_ : reinterpret_cast<const uint8_t *>(copy_.constData());
+	const size_t length = mapped_ ? fileSize_ : static_cast<size_t>(copy_.size());
+	return parse(bytes, length);
+}
+
+bool GltfSource::openPackEntry(const QString & filePath, Mode mode)
+{
+	const AssetPack * pack = nullptr;
+	const AssetPack::Entry * entry = nullptr;
+	if (!findPackEntry(filePath, pack, entry) || !pack->read(*entry, copy_))
+	{
+		error_ = "Failed to open " + filePath.toStdString();
+		return false;
+	}
+
+	baseDir_ = getBaseDir(filePath);
+	mode_ = mode;
+	fileSize_ = static_cast<size_t>(entry->size);
+	// Stored entries already are a view of the pack mapping.
+	packMapped_ = pack->getStoredData(*entry) != nullptr;
+	if (packMapped_ && mode == Mode::ReadAll)
+	{
+		copy_.detach();
+		packMapped_ = false;
+	}
+
+	return parse(reinterpret_cast<const uint8_t *>(copy_.constData()), static_cast<size_t>(copy_.size()));
+}
+
+void GltfSource::close()
+{
+	// Fetches in flight write into the external buffers.
+	for (auto & fetch: fetches_)
+	{
+		fetch.wait();
+	}
+	fetches_.clear();
+	externalBuffers_.clear();
+
+	if (mapped_)
+	{
+		file_.unmap(mapped_);
+		mapped_ = nullptr;
+	}
+	if (file_.isOpen())
+	{
+		file_.close();
+	}
+
+	copy_.clear();
+	packMapped_ = false;
+	model_ = tinygltf::Model();
+	bin_ = nullptr;
+	binSize_ = 0;
+	binBacked_.clear();
+	images_.clear();
+	fileSize_ = 0;
+}
+
+bool GltfSource::parse(const uint8_t * bytes, size_t length)
+{
+	if (length >= sizeof(uint32_t) && readU32(bytes) == g_glbMagic)
+		return parseBinary(bytes, length);
+	return parseDocument(bytes, length);
+}
+
+bool GltfSource::parseBinary(const uint8_t * bytes, size_t length)
+{
+	if (length < g_glbHeaderSize + g_glbChunkHeaderSize)
+	{
+		error_ = "Invalid GLB header";
+		return false;
+	}
+
+	const size_t declaredLength = readU32(bytes + 8);
+	const size_t jsonLength = readU32(bytes + 12);
+	const size_t jsonBegin = g_glbHeaderSize + g_glbChunkHeaderSize;
+	if (declaredLength > length || readU32(bytes + 16) != g_glbChunkJson || jsonBegin + jsonLength > declaredLength)
+	{
+		error_ = "Invalid GLB header";
+		return false;
+	}
+
+	const size_t binHeader = jsonBegin + jsonLength;
+	if (binHeader + g_glbChunkHeaderSize <= declaredLength && readU32(bytes + binHeader + 4) == g_glbChunkBin)
+	{
+		binSize_ = readU32(bytes + binHeader);
+		bin_ = bytes + binHeader + g_glbChunkHeaderSize;
+		if (binHeader + g_glbChunkHeaderSize + binSize_ > declaredLength)
+		{
+			error_ = "GLB BIN chunk exceeds file size";
+			return false;
+		}
+	}
+
+	return parseDocument(bytes + jsonBegin, jsonLength);
+}
+
+bool GltfSource::parseDocument(const uint8_t * bytes, size_t length)
+{
+	auto document = nlohmann::json::parse(bytes, bytes + length, nullptr, false);
+	if (document.is_discarded() || !document.is_object())
+	{
+		error_ = "Invalid glTF JSON";
+		return false;
+	}
+
+	// Buffers without a uri live in the BIN chunk. Buffers in files of their own are fetched by us, in parallel and
+	// only when read; tinygltf gets a tiny stand-in for all of these and only ever decodes data URIs.
+	if (document.contains("buffers") && document["buffers"].is_array())
+	{
+		for (auto & buffer: document["buffers"])
+		{
+			const bool hasUri = buffer.contains("uri") && buffer["uri"].is_string();
+			binBacked_.push_back(!hasUri);
+
+			std::unique_ptr<ExternalBuffer> external;
+			if (hasUri && !isDataUri(buffer["uri"].get<std::string>()))
+			{
+				external = std::make_unique<ExternalBuffer>();
+				external->path = resolveUri(baseDir_, buffer["uri"].get<std::string>());
+			}
+			if (!hasUri || external)
+			{
+				buffer["uri"] = g_placeholderUri;
+				buffer["byteLength"] = g_placeholderSize;
+			}
+			externalBuffers_.push_back(std::move(external));
+		}
+	}
+
+	// Images are decoded by us straight from the mapping, so tinygltf never sees them.
+	if (document.contains("images") && document["images"].is_array())
+	{
+		for (const auto & image: document["images"])
+		{
+			ImageSource source;
+			if (image.contains("bufferView") && image["bufferView"].is_number_integer())
+				source.bufferView = image["bufferView"].get<int>();
+			if (image.contains("uri") && image["uri"].is_string())
+				source.uri = image["uri"].get<std::string>();
+			images_.push_back(std::move(source));
+		}
+		document.erase("images");
+	}
+
+	const std::string json = document.dump();
+
+	tinygltf::TinyGLTF loader;
+	std::string warn;
+	if (!loader.LoadASCIIFromString(&model_, &error_, &warn, json.data(), static_cast<unsigned int>(json.size()),
+									baseDir_.toStdString()))
+	{
+		return false;
+	}
+
+	prefetchBuffers();
+	return true;
+}
+
+void GltfSource::prefetchBuffers()
+{
+	// The buffers behind accessors and images.
+	std::vector<bool> referenced(externalBuffers_.size(), false);
+	const auto reference = [this, &referenced](int bufferView) {
+		if (bufferView < 0 || static_cast<size_t>(bufferView) >= model_.bufferViews.size())
+			return;
+		const int buffer = model_.bufferViews[bufferView].buffer;
+		if (buffer >= 0 && static_cast<size_t>(buffer) < referenced.size())
+			referenced[buffer] = true;
+	};
+	for (const auto & accessor: model_.accessors)
+	{
+		reference(accessor.bufferView);
+		if (accessor.sparse.isSparse)
+		{
+			reference(accessor.sparse.indices.bufferView);
+			reference(accessor.sparse.values.bufferView);
+		}
+	}
+	for (const auto & image: images_)
+	{
+		reference(image.bufferView);
+	}
+
+	for (size_t i = 0; i < externalBuffers_.size(); ++i)
+	{
+		if (referenced[i] && externalBuffers_[i])
+			fetches_.push_back(ThreadPool::global().submit([this, buffer = externalBuffers_[i].get()] { fetchBuffer(*buffer); }));
+	}
+}
+
+void GltfSource::fetchBuffer(ExternalBuffer & buffer) const
+{
+	std::call_once(buffer.fetched, [this, &buffer] {
+		// Pack entries and mapped files are read by the page as the accessors touch them.
+		if (isPackPath(buffer.path))
+		{
+			if (readAsset(buffer.path, buffer.bytes))
+				buffer.data = reinterpret_cast<const uint8_t *>(buffer.bytes.constData());
+			buffer.size = static_cast<size_t>(buffer.bytes.size());
+			return;
+		}
+
+		buffer.file.setFileName(buffer.path);
+		if (!buffer.file.open(QIODevice::ReadOnly))
+			return;
+		if (mode_ == Mode::MemoryMapped)
+			buffer.mapped = buffer.file.map(0, buffer.file.size());
+		if (buffer.mapped)
+		{
+			buffer.data = buffer.mapped;
+			buffer.size = static_cast<size_t>(buffer.file.size());
+			return;
+		}
+		buffer.bytes = buffer.file.readAll();
+		buffer.file.close();
+		buffer.data = reinterpret_cast<const uint8_t *>(buffer.bytes.constData());
+		buffer.size = static_cast<size_t>(buffer.bytes.size());
+	});
+}
+
+bool GltfSource::isBinBacked(int buffer) const
+{
+	return buffer >= 0 && static_cast<size_t>(buffer) < binBacked_.size() && binBacked_[buffer];
+}
+
+const uint8_t * GltfSource::getBufferData(int buffer, size_t offset, size_t length) const
+{
+	if (buffer < 0 || static_cast<size_t>(buffer) >= model_.buffers.size())
+		return nullptr;
+
+	if (isBinBacked(buffer))
+	{
+		if (!bin_ || offset > binSize_ || length > binSize_ - offset)
+			return nullptr;
+		return bin_ + offset;
+	}
+
+	if (static_cast<size_t>(buffer) < externalBuffers_.size() && externalBuffers_[buffer])
+	{
+		auto & external = *externalBuffers_[buffer];
+		fetchBuffer(external);
+		if (!external.data || offset > external.size || length > external.size - offset)
+			return nullptr;
+		return external.data + offset;
+	}
+
+	const auto & data = model_.buffers[buffer].data;
+	if (offset > data.size() || length > data.size() - offset)
+		return nullptr;
+	return data.data() + offset;
+}
+
+const uint8_t * GltfSource::getBufferViewData(int bufferView) const
+{
+	if (bufferView < 0 || static_cast<size_t>(bufferView) >= model_.bufferViews.size())
+		return nullptr;
+
+	const auto & view = model_.bufferViews[bufferView];
+	return getBufferData(view.buffer, view.byteOffset, view.byteLength);
+}
+
+const uint8_t * GltfSource::getAccessorData(const tinygltf::Accessor & accessor) const
+{
+	const uint8_t * data = getBufferViewData(accessor.bufferView);
+	if (!data || accessor.count == 0)
+		return nullptr;
+
+	const auto & view = model_.bufferViews[accessor.bufferView];
+	const int stride = accessor.ByteStride(view);
+	if (stride <= 0)
+		return nullptr;
+
+	const size_t elementSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(accessor.componentType))
+							 * static_cast<size_t>(tinygltf::GetNumComponentsInType(accessor.type));
+	const size_t lastByte = accessor.byteOffset + static_cast<size_t>(stride) * (accessor.count - 1) + elementSize;
+	if (lastByte > view.byteLength)
+		return nullptr;
+
+	return data + accessor.byteOffset;
+}
+
+AccessorView GltfSource::getAccessorView(int accessor) const
+{
+	AccessorView view;
+	if (accessor < 0 || static_cast<size_t>(accessor) >= model_.accessors.size())
+		return view;
+
+	const auto & gltfAccessor = model_.accessors[accessor];
+	view.data = getAccessorData(gltfAccessor);
+	if (!view.data)
+		return view;
+
+	view.count = gltfAccessor.count;
+	view.stride = static_cast<size_t>(gltfAccessor.ByteStride(model_.bufferViews[gltfAccessor.bufferView]));
+	view.componentType = gltfAccessor.componentType;
+	view.components = tinygltf::GetNumComponentsInType(gltfAccessor.type);
+	view.normalized = gltfAccessor.normalized;
+	return view;
+}
+
+bool GltfSource::readAccessor(int accessor, int components, std::vector<float> & values) const
+{
+	if (accessor < 0 || static_cast<size_t>(accessor) >= model_.accessors.size() || components < 1 || components > 4)
+		return false;
+
+	const auto & gltfAccessor = model_.accessors[accessor];
+	values.assign(gltfAccessor.count * static_cast<size_t>(components), 0.0f);
+
+	auto view = getAccessorView(accessor);
+	if (gltfAccessor.bufferView >= 0 && !view.data)
+		return false;
+	if (view.data)
+	{
+		view.components = std::min(view.components, components);
+		if (!convertToFloat(view, values.data(), sizeof(float) * static_cast<size_t>(components)))
+			return false;
+	}
+
+	const auto & sparse = gltfAccessor.sparse;
+	if (!sparse.isSparse || sparse.count <= 0)
+		return true;
+
+	// Sparse indices and values are tightly packed.
+	const auto count = static_cast<size_t>(sparse.count);
+	const int elementComponents = tinygltf::GetNumComponentsInType(gltfAccessor.type);
+	const size_t indexSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(sparse.indices.componentType));
+	const size_t valueSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(gltfAccessor.componentType)) * static_cast<size_t>(elementComponents);
+	const auto fits = [this](int bufferView, size_t offset, size_t bytes) {
+		return bufferView >= 0 && static_cast<size_t>(bufferView) < model_.bufferViews.size()
+			   && offset + bytes <= model_.bufferViews[bufferView].byteLength;
+	};
+	if (elementComponents <= 0 || !fits(sparse.indices.bufferView, sparse.indices.byteOffset, indexSize * count)
+		|| !fits(sparse.values.bufferView, sparse.values.byteOffset, valueSize * count))
+	{
+		return false;
+	}
+
+	const uint8_t * indexData = getBufferViewData(sparse.indices.bufferView);
+	const uint8_t * valueData = getBufferViewData(sparse.values.bufferView);
+	if (!indexData || !valueData)
+		return false;
+
+	AccessorView indexView;
+	indexView.data = indexData + sparse.indices.byteOffset;
+	indexView.count = count;
+	indexView.stride = indexSize;
+	indexView.componentType = sparse.indices.componentType;
+	indexView.components = 1;
+
+	AccessorView valueView;
+	valueView.data = valueData + sparse.values.byteOffset;
+	valueView.count = count;
+	valueView.stride = valueSize;
+	valueView.componentType = gltfAccessor.componentType;
+	valueView.components = std::min(elementComponents, components);
+	valueView.normalized = gltfAccessor.normalized;
+
+	std::vector<uint32_t> indices(count);
+	std::vector<float> substitutes(count * static_cast<size_t>(components), 0.0f);
+	if (!convertIndices(indexView, indices.data()) || !convertToFloat(valueView, substitutes.data(), sizeof(float) * static_cast<size_t>(components)))
+		return false;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (indices[i] < gltfAccessor.count)
+			std::copy_n(substitutes.begin() + static_cast<std::ptrdiff_t>(i * components), components, values.begin() + static_cast<std::ptrdiff_t>(indices[i] * components));
+	}
+	return true;
+}
+
+size_t GltfSource::getImageCount() const
+{
+	return images_.size();
+}
+
+QImage GltfSource::decodeImage(int image) const
+{
+	if (image < 0 || static_cast<size_t>(image) >= images_.size())
+		return QImage();
+
+	const auto & source = images_[image];
+	if (source.bufferView >= 0)
+	{
+		const uint8_t * data = getBufferViewData(source.bufferView);
+		if (!data)
+			return QImage();
+		const auto length = model_.bufferViews[source.bufferView].byteLength;
+		return QImage::fromData(data, static_cast<int>(length));
+	}
+
+	const QString uri = QString::fromStdString(source.uri);
+	if (uri.startsWith("data:"))
+	{
+		const int comma = uri.indexOf(',');
+		return QImage::fromData(QByteArray::fromBase64(uri.mid(comma + 1).toLatin1()));
+	}
+	QByteArray bytes;
+	return readAsset(resolveUri(baseDir_, source.uri), bytes) ? QImage::fromData(bytes) : QImage();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "AccessorKernels.h"
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tinygltf/tiny_gltf.h>
+#include <vector>
+
+// Owns the bytes behind a glTF asset, binary or text, and resolves buffer views into them.
+// tinygltf only sees the JSON; buffer views and embedded images are read in place from the GLB,
+// which is the file mapping in MemoryMapped mode and a single heap copy in ReadAll mode.
+// Buffers in files of their own are fetched the same way: the ones that accessors or images use start loading in
+// parallel on open, and any other is only read when first touched. Image files are read by decodeImage.
+class GltfSource
+{
+public:
+	enum class Mode
+	{
+		ReadAll,
+		MemoryMapped
+	};
+
+	GltfSource() = default;
+	~GltfSource();
+
+	GltfSource(const GltfSource &) = delete;
+	GltfSource & operator=(const GltfSource &) = delete;
+
+	// filePath may be a pack path ("pack:/...") of a mounted AssetPack; so may be the files it references.
+	bool open(const QString & filePath, Mode mode = Mode::MemoryMapped);
+	void close();
+
+	// Content hash of the file and, for text glTF, of the buffer and image files it references, so that a changed
+	// .bin changes the model. Returns false when the file itself cannot be read.
+	static bool hashSourceFiles(const QString & filePath, uint64_t & hash);
+
+	const tinygltf::Model & getModel() const { return model_; }
+	const std::string & getError() const { return error_; }
+
+	// Also true for stored entries of a mounted asset pack, which are read in place from the pack mapping.
+	bool isMapped() const { return mapped_ != nullptr || packMapped_; }
+	size_t getFileSize() const { return fileSize_; }
+
+	const uint8_t * getBufferViewData(int bufferView) const;
+	const uint8_t * getAccessorData(const tinygltf::Accessor & accessor) const;
+	// Empty view (null data) when the accessor is missing or out of bounds.
+	AccessorView getAccessorView(int accessor) const;
+	// Every element as `components` floats with the sparse substitutions applied; accessors without a buffer view
+	// start from zeros. Returns false when the accessor or its sparse storage cannot be read.
+	bool readAccessor(int accessor, int components, std::vector<float> & values) const;
+
+	size_t getImageCount() const;
+	// Thread-safe. The returned image owns its pixels and may outlive the source.
+	QImage decodeImage(int image) const;
+
+private:
+	struct ImageSource {
+		int bufferView = -1;
+		std::string uri;
+	};
+
+	// Buffer with a uri that is not a data URI. Filled once, by whichever thread reads it first.
+	struct ExternalBuffer {
+		QString path;
+		std::once_flag fetched;
+		QFile file;
+		uchar * mapped = nullptr;
+		QByteArray bytes;
+		const uint8_t * data = nullptr;
+		size_t size = 0;
+
+		~ExternalBuffer();
+	};
+
+	bool openPackEntry(const QString & filePath, Mode mode);
+	bool parse(const uint8_t * bytes, size_t length);
+	bool parseBinary(const uint8_t * bytes, size_t length);
+	bool parseDocument(const uint8_t * bytes, size_t length);
+	void prefetchBuffers();
+	void fetchBuffer(ExternalBuffer & buffer) const;
+	bool isBinBacked(int buffer) const;
+	const uint8_t * getBufferData(int buffer, size_t offset, size_t length) const;
+
+	QFile file_;
+	uchar * mapped_ = nullptr;
+	QByteArray copy_;
+	bool packMapped_ = false;
+	size_t fileSize_ = 0;
+	QString baseDir_;
+	Mode mode_ = Mode::MemoryMapped;
+
+	tinygltf::Model model_;
+	std::string error_;
+
+	const uint8_t * bin_ = nullptr;
+	size_t binSize_ = 0;
+	std::vector<bool> binBacked_;
+	// Indexed by buffer; null for buffers that are not in a file of their own.
+	std::vector<std::unique_ptr<ExternalBuffer>> externalBuffers_;
+	std::vector<std::future<void>> fetches_;
+	std::vector<ImageSource> images_;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Vertex {
+	float position[3];
+	float normal[3];
+	float texCoord[2];
+};
+
+// Up to four joints of the skin bound to the mesh, with weights in 16-bit unorm that sum to one.
+struct SkinVertex {
+	uint16_t joints[4];
+	uint16_t weights[4];
+};
+
+// Displacement of one vertex by a morph target, in object space.
+struct MorphDelta {
+	float position[3];
+	float normal[3];
+};
+
+// Morph target stored sparsely: the vertices it moves, in ascending order, and their deltas.
+struct MorphTarget {
+	std::vector<uint32_t> vertices;
+	std::vector<MorphDelta> deltas;
+};
+
+struct BoundingSphere {
+	float center[3] = {0.0f, 0.0f, 0.0f};
+	float radius = 0.0f;
+};
+
+struct BoundingBox {
+	float minimum[3] = {0.0f, 0.0f, 0.0f};
+	float maximum[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// Small cluster of triangles, contiguous in the index list of its level, with bounds for CPU culling.
+// The cluster faces away from every viewpoint p with dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius;
+// a cutoff of 1 never culls.
+struct Meshlet {
+	uint32_t indexOffset = 0;
+	uint32_t indexCount = 0;
+	BoundingSphere bounds;
+	float coneAxis[3] = {0.0f, 0.0f, 0.0f};
+	float coneCutoff = 1.0f;
+};
+
+// Coarser version of a mesh that reuses its vertices. error is the object-space deviation from the full mesh.
+struct MeshLod {
+	std::vector<uint32_t> indices;
+	float error = 0.0f;
+	std::vector<Meshlet> meshlets;
+};
+
+struct Mesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	// Parallel to vertices for skinned meshes, empty otherwise.
+	std::vector<SkinVertex> skinVertices;
+	std::vector<MorphTarget> morphTargets;
+	// Default weight of each morph target.
+	std::vector<float> morphWeights;
+	int textureIndex = -1;
+	// Object-space bounds of the vertices: the sphere for LOD selection, the box for frustum culling.
+	BoundingSphere bounds;
+	BoundingBox box;
+	// Texture coordinate units per object-space unit, from the total UV and surface areas; 0 without usable UVs.
+	float uvScale = 0.0f;
+	// Clusters of level 0; empty when meshlets are disabled.
+	std::vector<Meshlet> meshlets;
+	// Ordered from fine to coarse; `indices` is the full-detail level 0.
+	std::vector<MeshLod> lods;
+};
+
+// Bytes per index in the index buffer of a mesh; meshes addressable with 16 bits get a half-size buffer.
+inline size_t getIndexSize(size_t vertexCount)
+{
+	return vertexCount <= 0x10000 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Writes the indices of every level of the mesh to out, concatenated like in its index buffer.
+template<typename T>
+void concatenateLods(const Mesh & mesh, T * out)
+{
+	out = std::copy(mesh.indices.begin(), mesh.indices.end(), out);
+	for (const auto & lod: mesh.lods)
+	{
+		out = std::copy(lod.indices.begin(), lod.indices.end(), out);
+	}
+}
@@ -0,0 +1,506 @@
+#include "MeshCache.h"
+#include "AssetPack.h"
+#include "ContentHash.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace
+{
+constexpr char g_magic[8] = {'F', 'G', 'L', 'M', 'E', 'S', 'H', '\0'};
+constexpr uint32_t g_version = 9;
+constexpr uint64_t g_alignment = 16;
+
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t nodeCount;
+	uint32_t meshRangeCount;
+	uint32_t reserved;
+	uint64_t sourceHash;
+	uint64_t optionsHash;
+	uint64_t fileSize;
+};
+
+// The vertex and index blocks of a mesh are its buffers as uploaded: the vertices in vertexFormat, and the indices
+// of level 0 followed by those of each LOD, in 16 bits when getIndexSize allows it.
+struct MeshRecord {
+	int32_t textureIndex;
+	uint32_t vertexFormat;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t verticesOffset;
+	uint64_t verticesSize;
+	uint64_t indicesOffset;
+	uint64_t indicesSize;
+	float positionOffset[3];
+	float positionScale[3];
+	float boundsCenter[3];
+	float boundsRadius;
+	float boxMinimum[3];
+	float boxMaximum[3];
+	float uvScale;
+	uint32_t reserved;
+	uint64_t lodCount;
+	uint64_t lodOffset;
+	uint64_t meshletCount;
+	uint64_t meshletOffset;
+};
+
+struct LodRecord {
+	uint64_t indexCount;
+	uint64_t meshletCount;
+	uint64_t meshletOffset;
+	float error;
+	uint32_t reserved;
+};
+
+struct NodeRecord {
+	int32_t parent;
+	int32_t mesh;
+	float transform[16];
+	uint64_t nameOffset;
+	uint64_t nameSize;
+};
+
+struct TextureRecord {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static_assert(std::is_trivially_copyable_v<CacheHeader> && std::is_trivially_copyable_v<MeshRecord>
+			  && std::is_trivially_copyable_v<LodRecord> && std::is_trivially_copyable_v<TextureRecord>
+			  && std::is_trivially_copyable_v<NodeRecord> && std::is_trivially_copyable_v<Meshlet>);
+
+uint64_t alignUp(uint64_t value)
+{
+	return (value + g_alignment - 1) & ~(g_alignment - 1);
+}
+
+// Keeps the mapping alive for as long as any QImage or mesh buffer built on top of it.
+struct MappedFile {
+	QFile file;
+	uchar * data = nullptr;
+
+	~MappedFile()
+	{
+		if (data)
+			file.unmap(data);
+	}
+};
+
+void releaseMapping(void * mapping)
+{
+	delete static_cast<std::shared_ptr<MappedFile> *>(mapping);
+}
+}// namespace
+
+QString getCacheDirectory()
+{
+	const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+	return directory.isEmpty() ? QDir::temp().filePath("fgl-cache") : directory;
+}
+
+QString getMeshCachePath(const QString & sourcePath)
+{
+	const QString directory = getCacheDirectory();
+	const QFileInfo info(sourcePath);
+	const QByteArray absolutePath = (isPackPath(sourcePath) ? sourcePath : info.absoluteFilePath()).toUtf8();
+	const uint64_t pathHash = hashBytes(absolutePath.constData(), static_cast<size_t>(absolutePath.size()));
+	return QDir(directory).filePath(QString("%1-%2.meshcache").arg(info.completeBaseName()).arg(pathHash, 16, 16, QChar('0')));
+}
+
+bool hashFile(const QString & filePath, uint64_t & hash)
+{
+	// Packs store the hash of every entry, so nothing needs to be paged in.
+	const AssetPack * pack = nullptr;
+	const AssetPack::Entry * entry = nullptr;
+	if (findPackEntry(filePath, pack, entry))
+	{
+		hash = entry->hash;
+		return true;
+	}
+
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	if (uchar * mapped = file.map(0, file.size()))
+	{
+		hash = hashBytes(mapped, static_cast<size_t>(file.size()));
+		file.unmap(mapped);
+		return true;
+	}
+
+	const QByteArray data = file.readAll();
+	hash = hashBytes(data.constData(), static_cast<size_t>(data.size()));
+	return true;
+}
+
+uint64_t hashModelLoadOptions(const ModelLoadOptions & options)
+{
+	const auto floatBits = [](float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return static_cast<uint64_t>(bits);
+	};
+
+	uint64_t hash = g_version;
+	hash = hashCombine(hash, options.weldVertices);
+	hash = hashCombine(hash, floatBits(options.weldTolerance.position));
+	hash = hashCombine(hash, floatBits(options.weldTolerance.normal));
+	hash = hashCombine(hash, floatBits(options.weldTolerance.texCoord));
+	hash = hashCombine(hash, options.optimizeMeshes);
+	hash = hashCombine(hash, static_cast<uint64_t>(options.vertexFormat));
+	hash = hashCombine(hash, options.lod.levels);
+	hash = hashCombine(hash, floatBits(options.lod.reduction));
+	hash = hashCombine(hash, floatBits(options.lod.maxRelativeError));
+	hash = hashCombine(hash, options.lod.minTriangles);
+	hash = hashCombine(hash, options.buildMeshlets);
+	hash = hashCombine(hash, options.meshlets.maxVertices);
+	hash = hashCombine(hash, options.meshlets.maxTriangles);
+	return hash;
+}
+
+std::shared_ptr<ModelData> loadMeshCache(const QString & cachePath, uint64_t sourceHash, uint64_t optionsHash)
+{
+	auto mapping = std::make_shared<MappedFile>();
+	mapping->file.setFileName(cachePath);
+	if (!mapping->file.open(QIODevice::ReadOnly))
+		return nullptr;
+
+	const auto fileSize = static_cast<uint64_t>(mapping->file.size());
+	if (fileSize < sizeof(CacheHeader))
+		return nullptr;
+
+	mapping->data = mapping->file.map(0, mapping->file.size());
+	if (!mapping->data)
+		return nullptr;
+
+	const uint8_t * bytes = mapping->data;
+	const auto inRange = [fileSize](uint64_t offset, uint64_t count, uint64_t elementSize) {
+		return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+	};
+	const auto readMeshlets = [bytes, &inRange](uint64_t offset, uint64_t count, uint64_t indexCount, std::vector<Meshlet> & meshlets) {
+		if (!inRange(offset, count, sizeof(Meshlet)))
+			return false;
+
+		meshlets.resize(count);
+		std::memcpy(meshlets.data(), bytes + offset, count * sizeof(Meshlet));
+		return std::all_of(meshlets.begin(), meshlets.end(), [indexCount](const Meshlet & meshlet) {
+			return meshlet.indexOffset <= indexCount && meshlet.indexCount <= indexCount - meshlet.indexOffset;
+		});
+	};
+	const auto validIndices = [](const auto * indices, uint64_t count, uint64_t vertexCount) {
+		return std::all_of(indices, indices + count, [vertexCount](uint64_t index) { return index < vertexCount; });
+	};
+
+	CacheHeader header;
+	std::memcpy(&header, bytes, sizeof(header));
+	if (std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version
+		|| header.sourceHash != sourceHash || header.optionsHash != optionsHash || header.fileSize != fileSize)
+	{
+		return nullptr;
+	}
+
+	const uint64_t meshTable = sizeof(CacheHeader);
+	const uint64_t textureTable = meshTable + uint64_t{header.meshCount} * sizeof(MeshRecord);
+	const uint64_t nodeTable = textureTable + uint64_t{header.textureCount} * sizeof(TextureRecord);
+	const uint64_t meshRangeTable = nodeTable + uint64_t{header.nodeCount} * sizeof(NodeRecord);
+	if (!inRange(meshTable, header.meshCount, sizeof(MeshRecord)) || !inRange(textureTable, header.textureCount, sizeof(TextureRecord))
+		|| !inRange(nodeTable, header.nodeCount, sizeof(NodeRecord)) || !inRange(meshRangeTable, header.meshRangeCount, sizeof(uint32_t)))
+	{
+		return nullptr;
+	}
+
+	auto data = std::make_shared<ModelData>();
+
+	const auto * meshRanges = reinterpret_cast<const uint32_t *>(bytes + meshRangeTable);
+	data->meshRanges.assign(meshRanges, meshRanges + header.meshRangeCount);
+	if (!std::is_sorted(data->meshRanges.begin(), data->meshRanges.end())
+		|| (!data->meshRanges.empty() && data->meshRanges.back() > header.meshCount))
+	{
+		return nullptr;
+	}
+
+	data->nodes.resize(header.nodeCount);
+	for (uint32_t i = 0; i < header.nodeCount; ++i)
+	{
+		NodeRecord record;
+		std::memcpy(&record, bytes + nodeTable + i * sizeof(NodeRecord), sizeof(record));
+		// Parents precede their children, and a mesh index needs both ends of its range.
+		const bool validParent = record.parent >= -1 && record.parent < static_cast<int32_t>(i);
+		const bool validMesh = record.mesh == -1 || (record.mesh >= 0 && static_cast<uint64_t>(record.mesh) + 1 < header.meshRangeCount);
+		if (!inRange(record.nameOffset, record.nameSize, 1) || !validParent || !validMesh)
+		{
+			return nullptr;
+		}
+
+		auto & node = data->nodes[i];
+		node.name.assign(reinterpret_cast<const char *>(bytes + record.nameOffset), record.nameSize);
+		node.parent = record.parent;
+		node.mesh = record.mesh;
+		std::copy(std::begin(record.transform), std::end(record.transform), node.transform);
+	}
+	data->meshes.resize(header.meshCount);
+	data->packedVertices.resize(header.meshCount);
+	data->mappedBuffers.resize(header.meshCount);
+
+	for (uint32_t i = 0; i < header.meshCount; ++i)
+	{
+		MeshRecord record;
+		std::memcpy(&record, bytes + meshTable + i * sizeof(MeshRecord), sizeof(record));
+		if (record.vertexFormat > static_cast<uint32_t>(VertexFormat::Packed12))
+			return nullptr;
+
+		const auto format = static_cast<VertexFormat>(record.vertexFormat);
+		const uint64_t indexSize = getIndexSize(record.vertexCount);
+		if (!inRange(record.verticesOffset, record.vertexCount, getVertexStride(format))
+			|| record.verticesSize != record.vertexCount * getVertexStride(format) || !inRange(record.indicesOffset, record.indicesSize, 1)
+			|| record.indicesSize % indexSize != 0 || !inRange(record.lodOffset, record.lodCount, sizeof(LodRecord)))
+		{
+			return nullptr;
+		}
+
+		auto & mesh = data->meshes[i];
+		mesh.textureIndex = record.textureIndex;
+		std::copy(std::begin(record.boundsCenter), std::end(record.boundsCenter), mesh.bounds.center);
+		mesh.bounds.radius = record.boundsRadius;
+		std::copy(std::begin(record.boxMinimum), std::end(record.boxMinimum), mesh.box.minimum);
+		std::copy(std::begin(record.boxMaximum), std::end(record.boxMaximum), mesh.box.maximum);
+		mesh.uvScale = record.uvScale;
+
+		// Only the level sizes and the meshlets, which culling reads on the CPU, are copied out of the mapping.
+		auto & mapped = data->mappedBuffers[i];
+		const uint64_t indexCount = record.indicesSize / indexSize;
+		uint64_t levelIndices = record.indexCount;
+		if (record.indexCount > indexCount || !readMeshlets(record.meshletOffset, record.meshletCount, record.indexCount, mesh.meshlets))
+			return nullptr;
+
+		mapped.levelIndexCounts.push_back(record.indexCount);
+		mesh.lods.resize(record.lodCount);
+		for (uint64_t level = 0; level < record.lodCount; ++level)
+		{
+			LodRecord lodRecord;
+			std::memcpy(&lodRecord, bytes + record.lodOffset + level * sizeof(LodRecord), sizeof(lodRecord));
+			if (lodRecord.indexCount > indexCount - levelIndices
+				|| !readMeshlets(lodRecord.meshletOffset, lodRecord.meshletCount, lodRecord.indexCount, mesh.lods[level].meshlets))
+			{
+				return nullptr;
+			}
+
+			mesh.lods[level].error = lodRecord.error;
+			mapped.levelIndexCounts.push_back(lodRecord.indexCount);
+			levelIndices += lodRecord.indexCount;
+		}
+
+		// An index past the vertex buffer would make the GPU read out of bounds.
+		const uint8_t * indices = bytes + record.indicesOffset;
+		const bool valid = indexSize == sizeof(uint16_t)
+							   ? validIndices(reinterpret_cast<const uint16_t *>(indices), indexCount, record.vertexCount)
+							   : validIndices(reinterpret_cast<const uint32_t *>(indices), indexCount, record.vertexCount);
+		if (levelIndices != indexCount || !valid)
+			return nullptr;
+
+		mapped.vertexCount = record.vertexCount;
+		mapped.vertices = std::span(bytes + record.verticesOffset, record.verticesSize);
+		mapped.indices = std::span(indices, record.indicesSize);
+
+		auto & packed = data->packedVertices[i];
+		packed.format = format;
+		packed.stride = getVertexStride(format);
+		std::copy(std::begin(record.positionOffset), std::end(record.positionOffset), packed.positionOffset);
+		std::copy(std::begin(record.positionScale), std::end(record.positionScale), packed.positionScale);
+
+		data->stats.vertexFormat = format;
+		data->stats.floatVertexBytes += record.vertexCount * sizeof(Vertex);
+	}
+
+	data->textures.resize(header.textureCount);
+	for (uint32_t i = 0; i < header.textureCount; ++i)
+	{
+		TextureRecord record;
+		std::memcpy(&record, bytes + textureTable + i * sizeof(TextureRecord), sizeof(record));
+		if (record.size == 0)
+			continue;
+
+		if (record.size != uint64_t{record.width} * record.height * 4 || !inRange(record.offset, record.size, 1))
+			return nullptr;
+
+		// Zero-copy: the image reads straight from the mapping and holds a reference to it.
+		data->textures[i] = QImage(bytes + record.offset, static_cast<int>(record.width), static_cast<int>(record.height),
+								   static_cast<int>(record.width) * 4, QImage::Format_RGBA8888, releaseMapping,
+								   new std::shared_ptr<MappedFile>(mapping));
+	}
+
+	data->mapping = mapping;
+	data->stats.memoryMapped = true;
+	data->stats.fileBytes = fileSize;
+	return data;
+}
+
+bool storeMeshCache(const QString & cachePath, const ModelData & data, uint64_t sourceHash, uint64_t optionsHash)
+{
+	if (!QDir().mkpath(QFileInfo(cachePath).absolutePath()))
+		return false;
+
+	CacheHeader header = {};
+	std::memcpy(header.magic, g_magic, sizeof(g_magic));
+	header.version = g_version;
+	header.meshCount = static_cast<uint32_t>(data.meshes.size());
+	header.textureCount = static_cast<uint32_t>(data.textures.size());
+	header.nodeCount = static_cast<uint32_t>(data.nodes.size());
+	header.meshRangeCount = static_cast<uint32_t>(data.meshRanges.size());
+	header.sourceHash = sourceHash;
+	header.optionsHash = optionsHash;
+
+	uint64_t offset = alignUp(sizeof(CacheHeader) + data.meshes.size() * sizeof(MeshRecord) + data.textures.size() * sizeof(TextureRecord)
+							  + data.nodes.size() * sizeof(NodeRecord) + data.meshRanges.size() * sizeof(uint32_t));
+	const auto reserve = [&offset](uint64_t size) {
+		const uint64_t start = offset;
+		offset = alignUp(offset + size);
+		return start;
+	};
+
+	std::vector<MeshRecord> meshRecords(data.meshes.size());
+	std::vector<std::vector<LodRecord>> lodRecords(data.meshes.size());
+	for (size_t i = 0; i < data.meshes.size(); ++i)
+	{
+		const auto & mesh = data.meshes[i];
+		static const PackedVertices unpacked;
+		const PackedVertices & packed = i < data.packedVertices.size() ? data.packedVertices[i] : unpacked;
+
+		auto & record = meshRecords[i];
+		record.textureIndex = mesh.textureIndex;
+		record.vertexFormat = static_cast<uint32_t>(data.getVertexFormat(i));
+		record.vertexCount = data.getVertexCount(i);
+		record.indexCount = data.getIndexCount(i, 0);
+		record.verticesSize = data.getVertexBuffer(i).size();
+		record.verticesOffset = reserve(record.verticesSize);
+		uint64_t indexCount = 0;
+		for (size_t level = 0; level <= mesh.lods.size(); ++level)
+		{
+			indexCount += data.getIndexCount(i, level);
+		}
+		record.indicesSize = indexCount * getIndexSize(record.vertexCount);
+		record.indicesOffset = reserve(record.indicesSize);
+		std::copy(std::begin(packed.positionOffset), std::end(packed.positionOffset), record.positionOffset);
+		std::copy(std::begin(packed.positionScale), std::end(packed.positionScale), record.positionScale);
+		std::copy(std::begin(mesh.bounds.center), std::end(mesh.bounds.center), record.boundsCenter);
+		record.boundsRadius = mesh.bounds.radius;
+		std::copy(std::begin(mesh.box.minimum), std::end(mesh.box.minimum), record.boxMinimum);
+		std::copy(std::begin(mesh.box.maximum), std::end(mesh.box.maximum), record.boxMaximum);
+		record.uvScale = mesh.uvScale;
+		record.meshletCount = mesh.meshlets.size();
+		record.meshletOffset = reserve(mesh.meshlets.size() * sizeof(Meshlet));
+
+		record.lodCount = mesh.lods.size();
+		record.lodOffset = reserve(mesh.lods.size() * sizeof(LodRecord));
+		for (size_t level = 0; level < mesh.lods.size(); ++level)
+		{
+			const auto & lod = mesh.lods[level];
+			LodRecord lodRecord = {};
+			lodRecord.indexCount = data.getIndexCount(i, level + 1);
+			lodRecord.meshletCount = lod.meshlets.size();
+			lodRecord.meshletOffset = reserve(lod.meshlets.size() * sizeof(Meshlet));
+			lodRecord.error = lod.error;
+			lodRecords[i].push_back(lodRecord);
+		}
+	}
+
+	std::vector<TextureRecord> textureRecords(data.textures.size());
+	for (size_t i = 0; i < data.textures.size(); ++i)
+	{
+		const QImage & image = data.textures[i];
+		if (image.isNull() || image.format() != QImage::Format_RGBA8888)
+			continue;
+
+		auto & record = textureRecords[i];
+		record.width = static_cast<uint32_t>(image.width());
+		record.height = static_cast<uint32_t>(image.height());
+		record.size = uint64_t{record.width} * record.height * 4;
+		record.offset = reserve(record.size);
+	}
+
+	std::vector<NodeRecord> nodeRecords(data.nodes.size());
+	for (size_t i = 0; i < data.nodes.size(); ++i)
+	{
+		const auto & node = data.nodes[i];
+		auto & record = nodeRecords[i];
+		record.parent = node.parent;
+		record.mesh = node.mesh;
+		std::copy(std::begin(node.transform), std::end(node.transform), record.transform);
+		record.nameSize = node.name.size();
+		record.nameOffset = reserve(node.name.size());
+	}
+	header.fileSize = offset;
+
+	QSaveFile file(cachePath);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	uint64_t written = 0;
+	const auto write = [&file, &written](uint64_t at, const void * bytes, uint64_t size) {
+		static const char padding[g_alignment] = {};
+		for (; written < at; written += std::min(at - written, g_alignment))
+		{
+			file.write(padding, static_cast<qint64>(std::min(at - written, g_alignment)));
+		}
+		file.write(static_cast<const char *>(bytes), static_cast<qint64>(size));
+		written = at + size;
+	};
+
+	write(0, &header, sizeof(header));
+	write(written, meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+	write(written, textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+	write(written, nodeRecords.data(), nodeRecords.size() * sizeof(NodeRecord));
+	write(written, data.meshRanges.data(), data.meshRanges.size() * sizeof(uint32_t));
+
+	for (size_t i = 0; i < data.meshes.size(); ++i)
+	{
+		const auto & mesh = data.meshes[i];
+		const auto & record = meshRecords[i];
+		std::vector<uint8_t> storage;
+		write(record.verticesOffset, data.getVertexBuffer(i).data(), record.verticesSize);
+		write(record.indicesOffset, data.getIndexBuffer(i, storage).data(), record.indicesSize);
+		write(record.meshletOffset, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+
+		write(record.lodOffset, lodRecords[i].data(), lodRecords[i].size() * sizeof(LodRecord));
+		for (size_t level = 0; level < mesh.lods.size(); ++level)
+		{
+			const auto & lod = mesh.lods[level];
+			write(lodRecords[i][level].meshletOffset, lod.meshlets.data(), lod.meshlets.size() * sizeof(Meshlet));
+		}
+	}
+
+	for (size_t i = 0; i < data.textures.size(); ++i)
+	{
+		const auto & record = textureRecords[i];
+		if (record.size == 0)
+			continue;
+
+		const QImage & image = data.textures[i];
+		const uint64_t rowBytes = uint64_t{record.width} * 4;
+		for (uint32_t y = 0; y < record.height; ++y)
+		{
+			write(record.offset + y * rowBytes, image.constScanLine(static_cast<int>(y)), rowBytes);
+		}
+	}
+
+	for (size_t i = 0; i < data.nodes.size(); ++i)
+	{
+		write(nodeRecords[i].nameOffset, data.nodes[i].name.data(), nodeRecords[i].nameSize);
+	}
+	write(header.fileSize, nullptr, 0);
+
+	return file.commit();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ModelData.h"
+#include <QString>
+#include <cstdint>
+#include <memory>
+
+// Baked copy of everything ModelLoader::parse produces: vertex and index buffers as uploaded,
+// decoded RGBA8888 textures and per-mesh metadata. The file is keyed by the content hash of the
+// source asset and by the load options, so a changed model or option silently rebuilds it.
+
+// Per-user directory for baked caches; falls back to the temporary directory.
+QString getCacheDirectory();
+
+// Location of the cache file for a source asset, under the per-user cache directory.
+QString getMeshCachePath(const QString & sourcePath);
+
+// Content hash of a file (mapped when possible) or of a pack entry. Returns false when the file cannot be read.
+bool hashFile(const QString & filePath, uint64_t & hash);
+
+// Hash of the options that change the baked output.
+uint64_t hashModelLoadOptions(const ModelLoadOptions & options);
+
+// Maps the cache and builds ModelData from it. Textures and ModelData::mappedBuffers reference the mapping directly.
+// Returns nullptr when the file is missing, truncated, from another version or for other hashes.
+std::shared_ptr<ModelData> loadMeshCache(const QString & cachePath, uint64_t sourceHash, uint64_t optionsHash);
+
+// Writes the cache atomically. Must run before the textures are released by the upload.
+bool storeMeshCache(const QString & cachePath, const ModelData & data, uint64_t sourceHash, uint64_t optionsHash);
@@ -0,0 +1,524 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+constexpr size_t g_maxCacheSize = 32;
+constexpr float g_cacheDecayPower = 1.5f;
+constexpr float g_lastTriangleScore = 0.75f;
+constexpr float g_valenceBoostScale = 2.0f;
+constexpr float g_valenceBoostPower = 0.5f;
+
+float vertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			score = g_lastTriangleScore;
+		}
+		else
+		{
+			const float scaler = 1.0f / static_cast<float>(g_maxCacheSize - 3);
+			score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scaler, g_cacheDecayPower);
+		}
+	}
+
+	return score + g_valenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -g_valenceBoostPower);
+}
+
+// Triangles adjacent to each vertex in compressed sparse row form.
+struct Adjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+	std::vector<uint32_t> counts;
+};
+
+Adjacency buildAdjacency(const std::vector<uint32_t> & indices, size_t vertexCount)
+{
+	Adjacency adjacency;
+	adjacency.counts.assign(vertexCount, 0);
+	for (uint32_t index: indices)
+	{
+		++adjacency.counts[index];
+	}
+
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacency.offsets[v + 1] = adjacency.offsets[v] + adjacency.counts[v];
+	}
+
+	adjacency.triangles.resize(indices.size());
+	std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		adjacency.triangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+	return adjacency;
+}
+
+struct Float3 {
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+};
+
+Float3 position(const Vertex & vertex)
+{
+	return {vertex.position[0], vertex.position[1], vertex.position[2]};
+}
+
+bool nearlyEqual(const float * a, const float * b, int count, float tolerance)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		if (!(std::abs(a[i] - b[i]) <= tolerance))
+			return false;
+	}
+	return true;
+}
+
+bool sameSkin(const Mesh & mesh, size_t a, size_t b)
+{
+	if (mesh.skinVertices.empty())
+		return true;
+	const SkinVertex & lhs = mesh.skinVertices[a];
+	const SkinVertex & rhs = mesh.skinVertices[b];
+	return std::equal(std::begin(lhs.joints), std::end(lhs.joints), std::begin(rhs.joints))
+		   && std::equal(std::begin(lhs.weights), std::end(lhs.weights), std::begin(rhs.weights));
+}
+
+// Vertices moved by some morph target. Welding them could merge vertices that the targets pull apart.
+std::vector<bool> getMorphedVertices(const Mesh & mesh)
+{
+	std::vector<bool> morphed(mesh.vertices.size(), false);
+	for (const auto & target: mesh.morphTargets)
+	{
+		for (const uint32_t vertex: target.vertices)
+		{
+			if (vertex < morphed.size())
+				morphed[vertex] = true;
+		}
+	}
+	return morphed;
+}
+
+// Moves the streams parallel to Mesh::vertices to their new positions; remap entries of ~0u are dropped.
+// Morphed vertices must map to distinct vertices.
+void remapVertexStreams(Mesh & mesh, const std::vector<uint32_t> & remap, size_t vertexCount)
+{
+	if (mesh.skinVertices.size() == remap.size())
+	{
+		std::vector<SkinVertex> skinVertices(vertexCount);
+		for (size_t v = 0; v < remap.size(); ++v)
+		{
+			if (remap[v] < vertexCount)
+				skinVertices[remap[v]] = mesh.skinVertices[v];
+		}
+		mesh.skinVertices.swap(skinVertices);
+	}
+
+	for (auto & target: mesh.morphTargets)
+	{
+		std::vector<std::pair<uint32_t, MorphDelta>> moved;
+		moved.reserve(target.vertices.size());
+		for (size_t i = 0; i < target.vertices.size(); ++i)
+		{
+			const uint32_t vertex = target.vertices[i] < remap.size() ? remap[target.vertices[i]] : ~0u;
+			if (vertex < vertexCount)
+				moved.emplace_back(vertex, target.deltas[i]);
+		}
+		std::sort(moved.begin(), moved.end(), [](const auto & a, const auto & b) { return a.first < b.first; });
+
+		target.vertices.resize(moved.size());
+		target.deltas.resize(moved.size());
+		for (size_t i = 0; i < moved.size(); ++i)
+		{
+			target.vertices[i] = moved[i].first;
+			target.deltas[i] = moved[i].second;
+		}
+	}
+}
+
+uint64_t cellKey(int64_t x, int64_t y, int64_t z)
+{
+	// Collisions only add candidates; every candidate is compared against the tolerance.
+	return static_cast<uint64_t>(x) * 73856093u ^ static_cast<uint64_t>(y) * 19349663u ^ static_cast<uint64_t>(z) * 83492791u;
+}
+}// namespace
+
+size_t weldVertices(Mesh & mesh, const WeldTolerance & tolerance)
+{
+	const size_t vertexCount = mesh.vertices.size();
+	if (vertexCount == 0)
+		return 0;
+
+	if (mesh.indices.empty())
+	{
+		if (vertexCount % 3 != 0)
+			return 0;
+		mesh.indices.resize(vertexCount);
+		std::iota(mesh.indices.begin(), mesh.indices.end(), 0u);
+	}
+
+	// Cells are at least one tolerance wide, so any match lies in the 3x3x3 neighbourhood.
+	const float cellSize = std::max(tolerance.position, 1.0e-6f);
+	const auto cellOf = [cellSize](float value) {
+		return static_cast<int64_t>(std::floor(std::clamp(value / cellSize, -1.0e15f, 1.0e15f)));
+	};
+
+	std::unordered_map<uint64_t, uint32_t> cellHeads;
+	cellHeads.reserve(vertexCount);
+	std::vector<uint32_t> nextInCell;
+	nextInCell.reserve(vertexCount);
+
+	std::vector<Vertex> welded;
+	welded.reserve(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+	// First source vertex of each welded one, for the skin and morph comparisons.
+	std::vector<uint32_t> sources;
+	sources.reserve(vertexCount);
+	if (mesh.skinVertices.size() != vertexCount)
+		mesh.skinVertices.clear();
+	const std::vector<bool> morphed = getMorphedVertices(mesh);
+
+	constexpr uint32_t end = ~0u;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const Vertex & vertex = mesh.vertices[v];
+		const int64_t cx = cellOf(vertex.position[0]);
+		const int64_t cy = cellOf(vertex.position[1]);
+		const int64_t cz = cellOf(vertex.position[2]);
+
+		uint32_t match = end;
+		for (int64_t dz = -1; dz <= 1 && match == end; ++dz)
+		{
+			for (int64_t dy = -1; dy <= 1 && match == end; ++dy)
+			{
+				for (int64_t dx = -1; dx <= 1 && match == end; ++dx)
+				{
+					const auto it = cellHeads.find(cellKey(cx + dx, cy + dy, cz + dz));
+					for (uint32_t candidate = it != cellHeads.end() ? it->second : end; candidate != end; candidate = nextInCell[candidate])
+					{
+						const Vertex & other = welded[candidate];
+						if (nearlyEqual(vertex.position, other.position, 3, tolerance.position)
+							&& nearlyEqual(vertex.normal, other.normal, 3, tolerance.normal)
+							&& nearlyEqual(vertex.texCoord, other.texCoord, 2, tolerance.texCoord) && sameSkin(mesh, v, sources[candidate])
+							&& !morphed[v] && !morphed[sources[candidate]])
+						{
+							match = candidate;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		if (match == end)
+		{
+			match = static_cast<uint32_t>(welded.size());
+			welded.push_back(vertex);
+			sources.push_back(static_cast<uint32_t>(v));
+
+			auto [head, inserted] = cellHeads.try_emplace(cellKey(cx, cy, cz), match);
+			nextInCell.push_back(inserted ? end : head->second);
+			head->second = match;
+		}
+		remap[v] = match;
+	}
+
+	for (uint32_t & index: mesh.indices)
+	{
+		if (index < vertexCount)
+			index = remap[index];
+	}
+
+	const size_t removed = vertexCount - welded.size();
+	remapVertexStreams(mesh, remap, welded.size());
+	mesh.vertices.swap(welded);
+	return removed;
+}
+
+VertexCacheStats & VertexCacheStats::operator+=(const VertexCacheStats & other)
+{
+	triangles += other.triangles;
+	vertices += other.vertices;
+	transforms += other.transforms;
+	return *this;
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> & indices, size_t vertexCount, size_t cacheSize)
+{
+	VertexCacheStats stats;
+	stats.triangles = indices.size() / 3;
+
+	// Timestamps make the FIFO test O(1): a vertex is cached if it was pushed less than cacheSize pushes ago.
+	std::vector<size_t> pushedAt(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t timestamp = cacheSize + 1;
+
+	for (uint32_t index: indices)
+	{
+		if (index >= vertexCount)
+			continue;
+
+		referenced[index] = true;
+		if (timestamp - pushedAt[index] > cacheSize)
+		{
+			pushedAt[index] = timestamp++;
+			++stats.transforms;
+		}
+	}
+
+	stats.vertices = static_cast<size_t>(std::count(referenced.begin(), referenced.end(), true));
+	return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t> & indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	Adjacency adjacency = buildAdjacency(indices, vertexCount);
+	std::vector<uint32_t> & remaining = adjacency.counts;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		score[v] = vertexScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> nextCache;
+	cache.reserve(g_maxCacheSize + 3);
+	nextCache.reserve(g_maxCacheSize + 3);
+
+	size_t scanCursor = 0;
+	size_t best = 0;
+	float bestScore = triangleScore[0];
+	for (size_t t = 1; t < triangleCount; ++t)
+	{
+		if (triangleScore[t] > bestScore)
+		{
+			bestScore = triangleScore[t];
+			best = t;
+		}
+	}
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		emitted[best] = true;
+		const uint32_t * triangle = &indices[best * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+
+		for (int k = 0; k < 3; ++k)
+		{
+			const uint32_t v = triangle[k];
+			uint32_t * begin = &adjacency.triangles[adjacency.offsets[v]];
+			uint32_t * end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)), end - 1);
+			--remaining[v];
+		}
+
+		nextCache.assign(triangle, triangle + 3);
+		for (uint32_t v: cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				nextCache.push_back(v);
+		}
+
+		for (size_t i = 0; i < nextCache.size(); ++i)
+		{
+			const uint32_t v = nextCache[i];
+			cachePosition[v] = i < g_maxCacheSize ? static_cast<int>(i) : -1;
+			score[v] = vertexScore(cachePosition[v], remaining[v]);
+		}
+
+		if (nextCache.size() > g_maxCacheSize)
+			nextCache.resize(g_maxCacheSize);
+		std::swap(cache, nextCache);
+
+		// Only triangles touching the cache changed score, so the next pick comes from them.
+		bestScore = -1.0f;
+		for (uint32_t v: cache)
+		{
+			for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v] + remaining[v]; ++i)
+			{
+				const uint32_t t = adjacency.triangles[i];
+				const float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				triangleScore[t] = s;
+				if (s > bestScore)
+				{
+					bestScore = s;
+					best = t;
+				}
+			}
+		}
+
+		if (bestScore < 0.0f)
+		{
+			while (scanCursor < triangleCount && emitted[scanCursor])
+				++scanCursor;
+			best = scanCursor;
+		}
+	}
+
+	indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> & indices, const std::vector<Vertex> & vertices, float threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	// Clusters start where the FIFO cache is cold anyway (all three vertices miss), so moving them is cheap.
+	constexpr size_t cacheSize = 16;
+	std::vector<size_t> pushedAt(vertices.size(), 0);
+	size_t timestamp = cacheSize + 1;
+
+	std::vector<size_t> clusterStarts;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		int misses = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			const uint32_t v = indices[t * 3 + k];
+			if (timestamp - pushedAt[v] > cacheSize)
+			{
+				pushedAt[v] = timestamp++;
+				++misses;
+			}
+		}
+		if (t == 0 || misses == 3)
+			clusterStarts.push_back(t);
+	}
+	if (clusterStarts.size() < 2)
+		return;
+	clusterStarts.push_back(triangleCount);
+
+	Float3 meshCenter;
+	for (const auto & vertex: vertices)
+	{
+		meshCenter.x += vertex.position[0];
+		meshCenter.y += vertex.position[1];
+		meshCenter.z += vertex.position[2];
+	}
+	const float inverseCount = 1.0f / static_cast<float>(vertices.size());
+	meshCenter = {meshCenter.x * inverseCount, meshCenter.y * inverseCount, meshCenter.z * inverseCount};
+
+	const size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		Float3 centroid;
+		Float3 normal;
+		float area = 0.0f;
+
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+		{
+			const Float3 a = position(vertices[indices[t * 3]]);
+			const Float3 b = position(vertices[indices[t * 3 + 1]]);
+			const Float3 d = position(vertices[indices[t * 3 + 2]]);
+
+			const Float3 ab{b.x - a.x, b.y - a.y, b.z - a.z};
+			const Float3 ad{d.x - a.x, d.y - a.y, d.z - a.z};
+			const Float3 n{ab.y * ad.z - ab.z * ad.y, ab.z * ad.x - ab.x * ad.z, ab.x * ad.y - ab.y * ad.x};
+			const float triangleArea = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+
+			centroid.x += (a.x + b.x + d.x) * triangleArea;
+			centroid.y += (a.y + b.y + d.y) * triangleArea;
+			centroid.z += (a.z + b.z + d.z) * triangleArea;
+			normal.x += n.x;
+			normal.y += n.y;
+			normal.z += n.z;
+			area += triangleArea;
+		}
+
+		const float centroidScale = area > 0.0f ? 1.0f / (3.0f * area) : 0.0f;
+		const float normalLength = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		const float normalScale = normalLength > 0.0f ? 1.0f / normalLength : 0.0f;
+
+		sortKey[c] = (centroid.x * centroidScale - meshCenter.x) * normal.x * normalScale
+				   + (centroid.y * centroidScale - meshCenter.y) * normal.y * normalScale
+				   + (centroid.z * centroidScale - meshCenter.z) * normal.z * normalScale;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t c: order)
+	{
+		result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+
+	const double before = analyzeVertexCache(indices, vertices.size()).getAcmr();
+	const double after = analyzeVertexCache(result, vertices.size()).getAcmr();
+	if (after <= before * threshold)
+	{
+		indices.swap(result);
+	}
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<Vertex> & vertices, std::vector<uint32_t> & indices)
+{
+	constexpr uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+
+	for (uint32_t & index: indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<uint32_t>(result.size());
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(result);
+	return remap;
+}
+
+void optimizeMesh(Mesh & mesh, VertexCacheStats * before, VertexCacheStats * after)
+{
+	const size_t vertexCount = mesh.vertices.size();
+	const bool valid = std::all_of(mesh.indices.begin(), mesh.indices.end(), [vertexCount](uint32_t index) { return index < vertexCount; });
+	if (!valid || mesh.indices.empty() || mesh.indices.size() % 3 != 0)
+		return;
+
+	if (before)
+		*before = analyzeVertexCache(mesh.indices, vertexCount);
+
+	optimizeVertexCache(mesh.indices, vertexCount);
+	optimizeOverdraw(mesh.indices, mesh.vertices);
+	const auto remap = optimizeVertexFetch(mesh.vertices, mesh.indices);
+	remapVertexStreams(mesh, remap, mesh.vertices.size());
+
+	if (after)
+		*after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Post-transform vertex cache statistics for a FIFO cache model.
+struct VertexCacheStats {
+	size_t triangles = 0;
+	size_t vertices = 0;
+	size_t transforms = 0;
+
+	// Average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3 is worst).
+	double getAcmr() const { return triangles ? static_cast<double>(transforms) / static_cast<double>(triangles) : 0.0; }
+	// Average transform to vertex ratio (1 is ideal).
+	double getAtvr() const { return vertices ? static_cast<double>(transforms) / static_cast<double>(vertices) : 0.0; }
+
+	VertexCacheStats & operator+=(const VertexCacheStats & other);
+};
+
+// Per-attribute absolute tolerances for weldVertices. Zero merges bit-identical values only.
+struct WeldTolerance {
+	float position = 1.0e-5f;
+	float normal = 1.0e-3f;
+	float texCoord = 1.0e-5f;
+};
+
+// Merges vertices whose attributes all match within tolerance, using a spatial hash on position; skin joints and
+// weights must match exactly, and vertices moved by morph targets are kept. Non-indexed meshes get an index buffer.
+// Returns the number of vertices removed.
+size_t weldVertices(Mesh & mesh, const WeldTolerance & tolerance = {});
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> & indices, size_t vertexCount, size_t cacheSize = 16);
+
+// Reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm).
+void optimizeVertexCache(std::vector<uint32_t> & indices, size_t vertexCount);
+
+// Reorders cache-optimized triangles in clusters so outward-facing parts draw first, which helps early-Z.
+// The new order is kept only if ACMR grows by less than `threshold` (1.05 allows a 5% increase).
+void optimizeOverdraw(std::vector<uint32_t> & indices, const std::vector<Vertex> & vertices, float threshold = 1.05f);
+
+// Renumbers vertices in first-use order and drops unreferenced ones so vertex fetch walks memory linearly.
+// Returns the new index of every old vertex, ~0u for the dropped ones.
+std::vector<uint32_t> optimizeVertexFetch(std::vector<Vertex> & vertices, std::vector<uint32_t> & indices);
+
+// Runs all of the above on a mesh and returns the cache stats before and after.
+void optimizeMesh(Mesh & mesh, VertexCacheStats * before = nullptr, VertexCacheStats * after = nullptr);
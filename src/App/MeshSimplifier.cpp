@@ -0,0 +1,372 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+// Sum of squared distances to a set of area-weighted planes, stored as the upper triangle of a 4x4 matrix.
+struct Quadric {
+	double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+	double b2 = 0.0, bc = 0.0, bd = 0.0;
+	double c2 = 0.0, cd = 0.0;
+	double d2 = 0.0;
+	double weight = 0.0;
+
+	void addPlane(double a, double b, double c, double d, double w)
+	{
+		a2 += w * a * a;
+		ab += w * a * b;
+		ac += w * a * c;
+		ad += w * a * d;
+		b2 += w * b * b;
+		bc += w * b * c;
+		bd += w * b * d;
+		c2 += w * c * c;
+		cd += w * c * d;
+		d2 += w * d * d;
+		weight += w;
+	}
+
+	Quadric & operator+=(const Quadric & other)
+	{
+		a2 += other.a2;
+		ab += other.ab;
+		ac += other.ac;
+		ad += other.ad;
+		b2 += other.b2;
+		bc += other.bc;
+		bd += other.bd;
+		c2 += other.c2;
+		cd += other.cd;
+		d2 += other.d2;
+		weight += other.weight;
+		return *this;
+	}
+
+	// Mean squared distance from p to the accumulated planes.
+	double evaluate(const float * p) const
+	{
+		const double x = p[0], y = p[1], z = p[2];
+		const double value = a2 * x * x + b2 * y * y + c2 * z * z + d2
+						   + 2.0 * (ab * x * y + ac * x * z + ad * x + bc * y * z + bd * y + cd * z);
+		return weight > 0.0 ? std::abs(value) / weight : 0.0;
+	}
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+void cross(const float * a, const float * b, const float * c, double * normal)
+{
+	const double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+	const double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+	normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+	normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+	normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+	return a < b ? (uint64_t{a} << 32) | b : (uint64_t{b} << 32) | a;
+}
+
+// Vertices that must not move: those sharing a position with another vertex (attribute seams),
+// and those on open or non-manifold edges.
+std::vector<bool> findLockedVertices(const std::vector<Vertex> & vertices, const std::vector<uint32_t> & indices)
+{
+	struct PositionHash {
+		size_t operator()(const std::array<uint32_t, 3> & key) const
+		{
+			return key[0] * 73856093u ^ key[1] * 19349663u ^ key[2] * 83492791u;
+		}
+	};
+
+	std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHash> firstAtPosition;
+	firstAtPosition.reserve(vertices.size());
+	std::vector<uint32_t> group(vertices.size());
+	std::vector<uint32_t> groupSize(vertices.size(), 0);
+
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		std::array<uint32_t, 3> key;
+		std::memcpy(key.data(), vertices[v].position, sizeof(key));
+		group[v] = firstAtPosition.try_emplace(key, static_cast<uint32_t>(v)).first->second;
+		++groupSize[group[v]];
+	}
+
+	std::unordered_map<uint64_t, uint32_t> edgeUses;
+	edgeUses.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			++edgeUses[edgeKey(group[indices[i + k]], group[indices[i + (k + 1) % 3]])];
+		}
+	}
+
+	std::vector<bool> lockedGroup(vertices.size(), false);
+	for (const auto & [key, uses]: edgeUses)
+	{
+		if (uses != 2)
+		{
+			lockedGroup[static_cast<uint32_t>(key >> 32)] = true;
+			lockedGroup[static_cast<uint32_t>(key)] = true;
+		}
+	}
+
+	std::vector<bool> locked(vertices.size());
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		locked[v] = groupSize[group[v]] > 1 || lockedGroup[group[v]];
+	}
+	return locked;
+}
+}// namespace
+
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> & vertices, const std::vector<uint32_t> & indices,
+								   size_t targetIndexCount, float targetError, float * resultError)
+{
+	std::vector<uint32_t> result = indices;
+	float maxError = 0.0f;
+
+	const size_t vertexCount = vertices.size();
+	const bool valid = std::all_of(indices.begin(), indices.end(), [vertexCount](uint32_t index) { return index < vertexCount; });
+	if (!valid || indices.size() % 3 != 0)
+	{
+		if (resultError)
+			*resultError = 0.0f;
+		return result;
+	}
+
+	const std::vector<bool> locked = findLockedVertices(vertices, indices);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const float * p0 = vertices[indices[i]].position;
+		double normal[3];
+		cross(p0, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position, normal);
+
+		const double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length <= 0.0)
+			continue;
+
+		const double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+		const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+		for (int k = 0; k < 3; ++k)
+		{
+			quadrics[indices[i + k]].addPlane(a, b, c, d, length * 0.5);
+		}
+	}
+
+	const double errorLimit = static_cast<double>(targetError) * targetError;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+
+	// Each pass collapses a set of independent edges, cheapest first, then compacts the index buffer.
+	while (result.size() > targetIndexCount)
+	{
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const uint32_t a = result[i + k];
+				const uint32_t b = result[i + (k + 1) % 3];
+				const double forward = locked[a] ? errorLimit + 1.0 : quadrics[a].evaluate(vertices[b].position);
+				const double backward = locked[b] ? errorLimit + 1.0 : quadrics[b].evaluate(vertices[a].position);
+				if (forward <= errorLimit)
+					collapses.push_back({a, b, forward});
+				if (backward <= errorLimit)
+					collapses.push_back({b, a, backward});
+			}
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse & l, const Collapse & r) { return l.cost < r.cost; });
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index: result)
+		{
+			++adjacencyOffsets[index + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			adjacency[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		for (size_t v = 0; v < vertexCount; ++v)
+		{
+			remap[v] = static_cast<uint32_t>(v);
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		size_t triangleCount = result.size() / 3;
+		const size_t targetTriangles = targetIndexCount / 3;
+		size_t performed = 0;
+
+		for (const auto & collapse: collapses)
+		{
+			if (triangleCount <= targetTriangles)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Reject collapses that flip a surviving triangle around `from`.
+			const float * target = vertices[collapse.to].position;
+			bool flips = false;
+			size_t removed = 0;
+			for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1] && !flips; ++i)
+			{
+				const uint32_t * triangle = &result[adjacency[i] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					++removed;
+					continue;
+				}
+
+				const float * corners[3];
+				const float * moved[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					corners[k] = vertices[triangle[k]].position;
+					moved[k] = triangle[k] == collapse.from ? target : corners[k];
+				}
+
+				double before[3];
+				double after[3];
+				cross(corners[0], corners[1], corners[2], before);
+				cross(moved[0], moved[1], moved[2], after);
+				flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0;
+			}
+			if (flips)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			maxError = std::max(maxError, static_cast<float>(std::sqrt(collapse.cost)));
+			triangleCount -= removed;
+			++performed;
+
+			// Every vertex whose triangles changed waits for the next pass, keeping the adjacency valid.
+			for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; ++i)
+			{
+				const uint32_t * triangle = &result[adjacency[i] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+		}
+
+		if (performed == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			const uint32_t a = remap[result[i]];
+			const uint32_t b = remap[result[i + 1]];
+			const uint32_t c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError)
+		*resultError = maxError;
+	return result;
+}
+
+BoundingBox computeBoundingBox(const std::vector<Vertex> & vertices)
+{
+	BoundingBox box;
+	if (vertices.empty())
+		return box;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		box.minimum[axis] = box.maximum[axis] = vertices.front().position[axis];
+	}
+	for (const auto & vertex: vertices)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			box.minimum[axis] = std::min(box.minimum[axis], vertex.position[axis]);
+			box.maximum[axis] = std::max(box.maximum[axis], vertex.position[axis]);
+		}
+	}
+	return box;
+}
+
+BoundingSphere computeBoundingSphere(const std::vector<Vertex> & vertices)
+{
+	BoundingSphere sphere;
+	if (vertices.empty())
+		return sphere;
+
+	const BoundingBox box = computeBoundingBox(vertices);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		sphere.center[axis] = (box.minimum[axis] + box.maximum[axis]) * 0.5f;
+	}
+
+	float radiusSquared = 0.0f;
+	for (const auto & vertex: vertices)
+	{
+		const float dx = vertex.position[0] - sphere.center[0];
+		const float dy = vertex.position[1] - sphere.center[1];
+		const float dz = vertex.position[2] - sphere.center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	sphere.radius = std::sqrt(radiusSquared);
+	return sphere;
+}
+
+void generateLods(Mesh & mesh, const LodOptions & options)
+{
+	mesh.box = computeBoundingBox(mesh.vertices);
+	mesh.bounds = computeBoundingSphere(mesh.vertices);
+	mesh.lods.clear();
+
+	const float errorLimit = options.maxRelativeError * mesh.bounds.radius;
+
+	for (size_t level = 0; level < options.levels; ++level)
+	{
+		const std::vector<uint32_t> & previous = mesh.lods.empty() ? mesh.indices : mesh.lods.back().indices;
+		const float previousError = mesh.lods.empty() ? 0.0f : mesh.lods.back().error;
+
+		const auto target = static_cast<size_t>(static_cast<float>(previous.size() / 3) * options.reduction) * 3;
+		if (target < options.minTriangles * 3)
+			break;
+
+		// Each level starts from the previous one; its error adds up to a conservative bound.
+		MeshLod lod;
+		float error = 0.0f;
+		lod.indices = simplifyMesh(mesh.vertices, previous, target, std::max(errorLimit - previousError, 0.0f), &error);
+		if (lod.indices.size() * 10 > previous.size() * 9)
+			break;
+
+		optimizeVertexCache(lod.indices, mesh.vertices.size());
+		lod.error = previousError + error;
+		mesh.lods.push_back(std::move(lod));
+	}
+}
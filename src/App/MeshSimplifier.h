@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error edge-collapse simplification. Vertices are never moved or created: each collapse
+// snaps one vertex onto a neighbour, so the result indexes the original vertex buffer and LODs can
+// share it. Border vertices and attribute seams (several vertices at one position) stay locked.
+// Stops at targetIndexCount or when the next collapse would exceed targetError (object-space distance).
+std::vector<uint32_t> simplifyMesh(const std::vector<Vertex> & vertices, const std::vector<uint32_t> & indices,
+								   size_t targetIndexCount, float targetError, float * resultError = nullptr);
+
+BoundingBox computeBoundingBox(const std::vector<Vertex> & vertices);
+// Centered on the bounding box.
+BoundingSphere computeBoundingSphere(const std::vector<Vertex> & vertices);
+
+struct LodOptions {
+	// Zero disables LOD generation; bounds are still computed.
+	size_t levels = 4;
+	// Triangle ratio between consecutive levels.
+	float reduction = 0.5f;
+	// Largest error allowed for any level, relative to the bounding sphere radius.
+	float maxRelativeError = 0.05f;
+	size_t minTriangles = 64;
+};
+
+// Fills mesh.bounds, mesh.box and mesh.lods from the current vertices and indices. Levels that fail to
+// reduce the triangle count meaningfully end the chain early.
+void generateLods(Mesh & mesh, const LodOptions & options = {});
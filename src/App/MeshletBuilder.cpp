@@ -0,0 +1,261 @@
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace
+{
+constexpr uint32_t g_unused = std::numeric_limits<uint32_t>::max();
+// Below this agreement between the triangle normals and the cone axis the cone would cover almost every view.
+constexpr float g_minConeDot = 0.1f;
+
+void computeMeshletBounds(const std::vector<Vertex> & vertices, const std::vector<uint32_t> & clusterVertices,
+						  const uint32_t * indices, Meshlet & meshlet)
+{
+	float minimum[3];
+	float maximum[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		minimum[axis] = maximum[axis] = vertices[clusterVertices.front()].position[axis];
+	}
+	for (const uint32_t index: clusterVertices)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			minimum[axis] = std::min(minimum[axis], vertices[index].position[axis]);
+			maximum[axis] = std::max(maximum[axis], vertices[index].position[axis]);
+		}
+	}
+
+	auto & bounds = meshlet.bounds;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		bounds.center[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+	}
+	float radiusSquared = 0.0f;
+	for (const uint32_t index: clusterVertices)
+	{
+		const float * p = vertices[index].position;
+		const float dx = p[0] - bounds.center[0];
+		const float dy = p[1] - bounds.center[1];
+		const float dz = p[2] - bounds.center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+
+	// Unit face normals; the cone axis is their normalized average and the spread is the worst agreement with it.
+	std::vector<float> normals;
+	normals.reserve(meshlet.indexCount);
+	float axis[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+	{
+		const float * a = vertices[indices[i]].position;
+		const float * b = vertices[indices[i + 1]].position;
+		const float * c = vertices[indices[i + 2]].position;
+		const float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		const float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+		const float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+		const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length <= std::numeric_limits<float>::min())
+			continue;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			normals.push_back(n[k] / length);
+			axis[k] += n[k] / length;
+		}
+	}
+
+	const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (normals.empty() || axisLength <= std::numeric_limits<float>::min())
+		return;
+
+	float minDot = 1.0f;
+	for (int k = 0; k < 3; ++k)
+	{
+		meshlet.coneAxis[k] = axis[k] / axisLength;
+	}
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		minDot = std::min(minDot, normals[i] * meshlet.coneAxis[0] + normals[i + 1] * meshlet.coneAxis[1] + normals[i + 2] * meshlet.coneAxis[2]);
+	}
+	if (minDot > g_minConeDot)
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+std::vector<Meshlet> buildLevelMeshlets(const std::vector<Vertex> & vertices, std::vector<uint32_t> & indices,
+										const MeshletOptions & options)
+{
+	std::vector<Meshlet> meshlets;
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || options.maxTriangles == 0 || options.maxVertices < 3 || indices.size() % 3 != 0)
+		return meshlets;
+	if (std::any_of(indices.begin(), indices.end(), [&vertices](uint32_t index) { return index >= vertices.size(); }))
+		return meshlets;
+
+	// Vertex to triangle adjacency in CSR form.
+	std::vector<uint32_t> adjacencyOffsets(vertices.size() + 1, 0);
+	for (const uint32_t index: indices)
+	{
+		++adjacencyOffsets[index + 1];
+	}
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<float> centroids(triangleCount * 3);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			centroids[t * 3 + axis] = (vertices[indices[t * 3]].position[axis] + vertices[indices[t * 3 + 1]].position[axis]
+									   + vertices[indices[t * 3 + 2]].position[axis])
+									/ 3.0f;
+		}
+	}
+
+	// Unused triangles around each vertex; triangles whose vertices have few left would otherwise end up stranded.
+	std::vector<uint32_t> liveTriangles(vertices.size());
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+	}
+
+	std::vector<bool> used(triangleCount, false);
+	std::vector<uint32_t> vertexStamp(vertices.size(), g_unused);
+	std::vector<uint32_t> candidateStamp(triangleCount, g_unused);
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	std::vector<uint32_t> clusterTriangles;
+	std::vector<uint32_t> clusterVertices;
+	std::vector<uint32_t> candidates;
+
+	size_t seed = 0;
+	for (;;)
+	{
+		while (seed < triangleCount && used[seed])
+			++seed;
+		if (seed == triangleCount)
+			break;
+
+		const auto id = static_cast<uint32_t>(meshlets.size());
+		clusterTriangles.clear();
+		clusterVertices.clear();
+		candidates.clear();
+		float centroidSum[3] = {0.0f, 0.0f, 0.0f};
+
+		const auto addTriangle = [&](uint32_t triangle) {
+			used[triangle] = true;
+			clusterTriangles.push_back(triangle);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				centroidSum[axis] += centroids[triangle * 3 + axis];
+			}
+			for (int k = 0; k < 3; ++k)
+			{
+				const uint32_t v = indices[triangle * 3 + k];
+				--liveTriangles[v];
+				if (vertexStamp[v] == id)
+					continue;
+
+				vertexStamp[v] = id;
+				clusterVertices.push_back(v);
+				for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+				{
+					const uint32_t neighbour = adjacency[a];
+					if (!used[neighbour] && candidateStamp[neighbour] != id)
+					{
+						candidateStamp[neighbour] = id;
+						candidates.push_back(neighbour);
+					}
+				}
+			}
+		};
+
+		addTriangle(static_cast<uint32_t>(seed));
+
+		// Prefer triangles that add the fewest vertices, then close to the centroid, scaled so that triangles
+		// with few unused neighbours left are picked up before they get stranded.
+		while (clusterTriangles.size() < options.maxTriangles)
+		{
+			const float inverseCount = 1.0f / static_cast<float>(clusterTriangles.size());
+			const float center[3] = {centroidSum[0] * inverseCount, centroidSum[1] * inverseCount, centroidSum[2] * inverseCount};
+
+			uint32_t best = g_unused;
+			int bestNewVertices = 4;
+			float bestScore = std::numeric_limits<float>::infinity();
+			size_t write = 0;
+			for (const uint32_t candidate: candidates)
+			{
+				if (used[candidate])
+					continue;
+				candidates[write++] = candidate;
+
+				int newVertices = 0;
+				uint32_t live = 0;
+				for (int k = 0; k < 3; ++k)
+				{
+					const uint32_t v = indices[candidate * 3 + k];
+					newVertices += vertexStamp[v] != id;
+					live += liveTriangles[v];
+				}
+				if (clusterVertices.size() + static_cast<size_t>(newVertices) > options.maxVertices)
+					continue;
+
+				const float dx = centroids[candidate * 3] - center[0];
+				const float dy = centroids[candidate * 3 + 1] - center[1];
+				const float dz = centroids[candidate * 3 + 2] - center[2];
+				const float distance = dx * dx + dy * dy + dz * dz;
+				const float score = distance * static_cast<float>(live + 4);
+				if (newVertices < bestNewVertices || (newVertices == bestNewVertices && score < bestScore))
+				{
+					best = candidate;
+					bestNewVertices = newVertices;
+					bestScore = score;
+				}
+			}
+			candidates.resize(write);
+
+			if (best == g_unused)
+				break;
+			addTriangle(best);
+		}
+
+		std::sort(clusterTriangles.begin(), clusterTriangles.end());
+
+		Meshlet meshlet;
+		meshlet.indexOffset = static_cast<uint32_t>(result.size());
+		meshlet.indexCount = static_cast<uint32_t>(clusterTriangles.size() * 3);
+		for (const uint32_t triangle: clusterTriangles)
+		{
+			result.insert(result.end(), indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3);
+		}
+		computeMeshletBounds(vertices, clusterVertices, result.data() + meshlet.indexOffset, meshlet);
+		meshlets.push_back(meshlet);
+	}
+
+	indices = std::move(result);
+	return meshlets;
+}
+}// namespace
+
+void buildMeshlets(Mesh & mesh, const MeshletOptions & options)
+{
+	mesh.meshlets = buildLevelMeshlets(mesh.vertices, mesh.indices, options);
+	for (auto & lod: mesh.lods)
+	{
+		lod.meshlets = buildLevelMeshlets(mesh.vertices, lod.indices, options);
+	}
+}
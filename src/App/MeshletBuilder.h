@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+
+struct MeshletOptions {
+	size_t maxVertices = 64;
+	size_t maxTriangles = 124;
+};
+
+// Splits the index list of every level into meshlets, greedily growing each cluster through shared vertices
+// from the next unused triangle in the current order. Triangles are regrouped so that every meshlet is a
+// contiguous index range; inside a meshlet they keep their previous relative order.
+void buildMeshlets(Mesh & mesh, const MeshletOptions & options = {});
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "Animation.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "TextureCompressor.h"
+#include "VertexFormat.h"
+#include <QImage>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Per-model switches for the CPU side of loading.
+struct ModelLoadOptions {
+	bool memoryMapped = true;
+	// Merges duplicate vertices before optimization; see weldVertices.
+	bool weldVertices = true;
+	WeldTolerance weldTolerance;
+	// Vertex cache, overdraw and vertex fetch reordering after parsing; see MeshOptimizer.h.
+	bool optimizeMeshes = true;
+	// Simplified index buffers for distance-based LOD selection; see MeshSimplifier.h.
+	LodOptions lod;
+	// Clusters with bounds and normal cones for per-cluster culling; see MeshletBuilder.h.
+	bool buildMeshlets = true;
+	MeshletOptions meshlets;
+	VertexFormat vertexFormat = VertexFormat::Packed16;
+	// Block compression of the texture mip chains built after parsing; see TextureCompressor.h.
+	TextureCompressionOptions textureCompression;
+	// Reuses a baked copy of the parse result when the source file and the options above are unchanged; see MeshCache.h.
+	bool useMeshCache = true;
+};
+
+struct ImageDecodeStats {
+	int image = -1;
+	int width = 0;
+	int height = 0;
+	double milliseconds = 0.0;
+};
+
+struct ModelLoadStats {
+	bool memoryMapped = false;
+	bool fromMeshCache = false;
+	size_t fileBytes = 0;
+	double parseMilliseconds = 0.0;
+	double imageDecodeMilliseconds = 0.0;
+	std::vector<ImageDecodeStats> imageDecodes;
+	size_t weldedVertices = 0;
+	size_t lodLevels = 0;
+	size_t meshlets = 0;
+	double optimizeMilliseconds = 0.0;
+	VertexCacheStats vertexCacheBefore;
+	VertexCacheStats vertexCacheAfter;
+	double uploadMilliseconds = 0.0;
+	VertexFormat vertexFormat = VertexFormat::Float;
+	size_t floatVertexBytes = 0;
+	size_t gpuVertexBytes = 0;
+	size_t gpuIndexBytes = 0;
+	size_t gpuTextureBytes = 0;
+	TextureCompressionStats textureCompression;
+	size_t peakResidentBytesBefore = 0;
+	size_t peakResidentBytesAfter = 0;
+};
+
+// glTF node of the default scene. transform is the local matrix in column-major order. weights overrides the morph
+// target weights of the mesh when not empty.
+struct ModelNode {
+	std::string name;
+	int parent = -1;
+	int mesh = -1;
+	float transform[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+	std::vector<float> weights;
+};
+
+// Vertex and index buffers of one mesh exactly as uploaded, read in place from a mapped mesh cache.
+struct MappedMeshBuffers {
+	size_t vertexCount = 0;
+	// The packed vertices, or Vertex when the format is Float.
+	std::span<const uint8_t> vertices;
+	// Indices of every level, concatenated like in the index buffer, getIndexSize(vertexCount) bytes each.
+	std::span<const uint8_t> indices;
+	// Index count of level 0 and then of each LOD.
+	std::vector<size_t> levelIndexCounts;
+};
+
+// CPU-side result of parsing a model, ready for upload on the GL thread.
+// textures holds one RGBA8888 image per glTF texture; null images are skipped on upload.
+// textureMipChains parallels textures with the full mip chain of each image, block-compressed when enabled;
+// the texture streamer uploads from them, and the images are only the fallback for unsupported formats.
+// packedVertices parallels meshes; entries with empty data are uploaded from Mesh::vertices as floats.
+// mappedBuffers is filled by loadMeshCache, one entry per mesh. The buffers of such meshes are uploaded from the cache
+// mapping, which mapping keeps alive, and their vertex, index and packed vectors stay empty; the getters below give
+// the buffers and their sizes either way.
+// meshes holds one entry per glTF primitive; glTF mesh m owns meshes[meshRanges[m], meshRanges[m + 1]).
+// nodes lists parents before their children and is empty for assets without a scene.
+// animation holds the skins and clips of the scene nodes; null for models with neither.
+// contentHash covers the source file and the load options, sourceHash the file alone; 0 when it could not be hashed.
+struct ModelData {
+	std::vector<Mesh> meshes;
+	std::vector<uint32_t> meshRanges;
+	std::vector<ModelNode> nodes;
+	std::shared_ptr<const AnimationRig> animation;
+	std::vector<PackedVertices> packedVertices;
+	std::vector<MappedMeshBuffers> mappedBuffers;
+	std::shared_ptr<const void> mapping;
+	std::vector<QImage> textures;
+	std::vector<TextureMipChain> textureMipChains;
+	uint64_t contentHash = 0;
+	uint64_t sourceHash = 0;
+	ModelLoadStats stats;
+
+	size_t getVertexCount(size_t mesh) const
+	{
+		return mesh < mappedBuffers.size() ? mappedBuffers[mesh].vertexCount : meshes[mesh].vertices.size();
+	}
+	// Level 0 is the mesh itself, level l the LOD meshes[mesh].lods[l - 1].
+	size_t getIndexCount(size_t mesh, size_t level) const
+	{
+		if (mesh < mappedBuffers.size())
+			return mappedBuffers[mesh].levelIndexCounts[level];
+		return level == 0 ? meshes[mesh].indices.size() : meshes[mesh].lods[level - 1].indices.size();
+	}
+	VertexFormat getVertexFormat(size_t mesh) const
+	{
+		const bool packed = mesh < packedVertices.size() && (mesh < mappedBuffers.size() || !packedVertices[mesh].data.empty());
+		return packed ? packedVertices[mesh].format : VertexFormat::Float;
+	}
+	// Vertex buffer of the mesh as uploaded, in getVertexFormat.
+	std::span<const uint8_t> getVertexBuffer(size_t mesh) const
+	{
+		if (mesh < mappedBuffers.size())
+			return mappedBuffers[mesh].vertices;
+		if (getVertexFormat(mesh) != VertexFormat::Float)
+			return packedVertices[mesh].data;
+		return {reinterpret_cast<const uint8_t *>(meshes[mesh].vertices.data()), meshes[mesh].vertices.size() * sizeof(Vertex)};
+	}
+	// Index buffer of the mesh as uploaded, getIndexSize(getVertexCount(mesh)) bytes per index. Mapped meshes are read
+	// in place; the levels of parsed ones are concatenated into storage.
+	std::span<const uint8_t> getIndexBuffer(size_t mesh, std::vector<uint8_t> & storage) const
+	{
+		if (mesh < mappedBuffers.size())
+			return mappedBuffers[mesh].indices;
+
+		const Mesh & source = meshes[mesh];
+		size_t indexCount = 0;
+		for (size_t level = 0; level <= source.lods.size(); ++level)
+		{
+			indexCount += getIndexCount(mesh, level);
+		}
+		const size_t indexSize = getIndexSize(source.vertices.size());
+		storage.resize(indexCount * indexSize);
+		if (indexSize == sizeof(uint16_t))
+			concatenateLods(source, reinterpret_cast<uint16_t *>(storage.data()));
+		else
+			concatenateLods(source, reinterpret_cast<uint32_t *>(storage.data()));
+		return storage;
+	}
+};
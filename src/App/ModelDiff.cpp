@@ -0,0 +1,105 @@
+#include "ModelDiff.h"
+#include "ContentHash.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+// Granularity of the changed ranges; comparing whole blocks keeps the scan at memcmp speed.
+constexpr size_t g_blockBytes = 256;
+
+// Smallest range of whole blocks, clamped to size, outside of which a and b are equal.
+BufferRange findChangedBytes(const void * a, const void * b, size_t size)
+{
+	const auto * left = static_cast<const uint8_t *>(a);
+	const auto * right = static_cast<const uint8_t *>(b);
+
+	size_t begin = 0;
+	while (begin < size && std::memcmp(left + begin, right + begin, std::min(g_blockBytes, size - begin)) == 0)
+		begin += g_blockBytes;
+	if (begin >= size)
+		return {};
+
+	size_t end = begin + (size - begin + g_blockBytes - 1) / g_blockBytes * g_blockBytes;
+	while (end - g_blockBytes > begin)
+	{
+		const size_t start = end - g_blockBytes;
+		if (std::memcmp(left + start, right + start, std::min(end, size) - start) != 0)
+			break;
+		end = start;
+	}
+	return {begin, std::min(end, size)};
+}
+
+BufferRange findChangedElements(std::span<const uint8_t> a, std::span<const uint8_t> b, size_t elementSize)
+{
+	const BufferRange bytes = findChangedBytes(a.data(), b.data(), a.size());
+	return {bytes.begin / elementSize, (bytes.end + elementSize - 1) / elementSize};
+}
+
+bool equalMorphTargets(const Mesh & a, const Mesh & b)
+{
+	return std::equal(a.morphTargets.begin(), a.morphTargets.end(), b.morphTargets.begin(), b.morphTargets.end(),
+					  [](const MorphTarget & left, const MorphTarget & right) {
+						  return left.vertices == right.vertices && left.deltas.size() == right.deltas.size()
+								 && std::memcmp(left.deltas.data(), right.deltas.data(), left.deltas.size() * sizeof(MorphDelta)) == 0;
+					  });
+}
+
+bool compatibleNodes(const ModelData & previous, const ModelData & next)
+{
+	if (previous.meshes.size() != next.meshes.size() || previous.meshRanges != next.meshRanges
+		|| previous.nodes.size() != next.nodes.size() || !previous.animation != !next.animation)
+		return false;
+	if (previous.animation && (previous.animation->paletteSize != next.animation->paletteSize
+							   || previous.animation->bindings.size() != next.animation->bindings.size()))
+		return false;
+
+	return std::equal(previous.nodes.begin(), previous.nodes.end(), next.nodes.begin(), [](const ModelNode & a, const ModelNode & b) {
+		return a.parent == b.parent && a.mesh == b.mesh;
+	});
+}
+}// namespace
+
+ModelDiff diffModelData(const ModelData & previous, const ModelData & next)
+{
+	ModelDiff diff;
+	diff.compatible = compatibleNodes(previous, next);
+	if (!diff.compatible)
+		return diff;
+
+	diff.meshes.resize(next.meshes.size());
+	for (size_t i = 0; i < next.meshes.size(); ++i)
+	{
+		const auto & before = previous.meshes[i];
+		const auto & after = next.meshes[i];
+		auto & meshDiff = diff.meshes[i];
+
+		// Either model may come from the mesh cache, so both are compared as uploaded.
+		std::vector<uint8_t> storageBefore;
+		std::vector<uint8_t> storageAfter;
+		const auto indicesBefore = previous.getIndexBuffer(i, storageBefore);
+		const auto indicesAfter = next.getIndexBuffer(i, storageAfter);
+		const size_t vertexCount = next.getVertexCount(i);
+
+		// The vertex count also decides the index type, so both buffers keep their layout only when it stays.
+		meshDiff.rebuild = previous.getVertexCount(i) != vertexCount || previous.getVertexFormat(i) != next.getVertexFormat(i)
+						   || indicesBefore.size() != indicesAfter.size() || before.skinVertices.size() != after.skinVertices.size();
+		if (meshDiff.rebuild)
+			continue;
+
+		const auto verticesAfter = next.getVertexBuffer(i);
+		meshDiff.vertices = findChangedBytes(previous.getVertexBuffer(i).data(), verticesAfter.data(), verticesAfter.size());
+		meshDiff.indices = findChangedElements(indicesBefore, indicesAfter, getIndexSize(vertexCount));
+		meshDiff.skinVertices = findChangedBytes(before.skinVertices.data(), after.skinVertices.data(), after.skinVertices.size() * sizeof(SkinVertex));
+		meshDiff.morphTargets = !equalMorphTargets(before, after);
+	}
+
+	diff.textureHashes.resize(next.textures.size());
+	for (size_t i = 0; i < next.textures.size(); ++i)
+	{
+		diff.textureHashes[i] = i < next.textureMipChains.size() && next.textureMipChains[i].isValid() ? next.textureMipChains[i].imageHash
+																									   : hashImage(next.textures[i]);
+	}
+	return diff;
+}
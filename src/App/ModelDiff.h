@@ -0,0 +1,40 @@
+#pragma once
+
+#include "ModelData.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Range [begin, end) of a GPU buffer; empty when nothing in it changed.
+struct BufferRange {
+	size_t begin = 0;
+	size_t end = 0;
+
+	bool isEmpty() const { return begin == end; }
+	size_t getSize() const { return end - begin; }
+};
+
+// What changed in one mesh between two parses of the same file. Meshes whose buffers changed size or layout are
+// uploaded again as a whole; otherwise each buffer gets the smallest range that covers its changes.
+struct MeshDiff {
+	bool rebuild = false;
+	// Bytes of ModelData::getVertexBuffer.
+	BufferRange vertices;
+	// Indices of ModelData::getIndexBuffer, which concatenates all levels.
+	BufferRange indices;
+	// Bytes of Mesh::skinVertices.
+	BufferRange skinVertices;
+	bool morphTargets = false;
+};
+
+// Result of comparing a re-exported model with the one on the GPU.
+struct ModelDiff {
+	// False when the node tree, the mesh layout or the rig differs; such a model has to be loaded again.
+	bool compatible = false;
+	std::vector<MeshDiff> meshes;
+	// TextureMipChain::imageHash of every texture of the new model, for comparison with the uploaded ones.
+	std::vector<uint64_t> textureHashes;
+};
+
+// Safe on any thread. Only the meshes, mesh buffers and nodes of previous are read, which its upload leaves intact.
+ModelDiff diffModelData(const ModelData & previous, const ModelData & next);
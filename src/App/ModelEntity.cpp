@@ -1,9 +1,73 @@
 #include "ModelEntity.h"
 #include "Camera.h"
-#include <QFile>
-#include <QImage>
+#include "ContentHash.h"
+#include "MeshCache.h"
+#include "ModelLoader.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLFunctions>
-#include <tinygltf/tiny_gltf.h>
+#include <QVector4D>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+// Row width of the morph delta textures in texels and targets blended per draw; both match model.vs.
+constexpr int g_morphTextureWidth = 4096;
+constexpr size_t g_maxMorphTargets = 8;
+// Locations of the per-instance attributes in model.vs; the transform takes one per column.
+constexpr int g_instanceModelLocation = 5;
+constexpr int g_instanceMorphSphereLocation = 9;
+constexpr int g_instanceMorphFactorLocation = 10;
+
+void writeMorphTarget(OpenGLContext & context, QOpenGLTexture & texture, const MorphTarget & target, size_t vertexCount, GLint offset)
+{
+	const int rows = static_cast<int>((vertexCount * 2 + g_morphTextureWidth - 1) / g_morphTextureWidth);
+	std::vector<float> texels(static_cast<size_t>(rows) * g_morphTextureWidth * 4, 0.0f);
+	for (size_t i = 0; i < target.vertices.size(); ++i)
+	{
+		float * texel = texels.data() + target.vertices[i] * 8;
+		std::copy(std::begin(target.deltas[i].position), std::end(target.deltas[i].position), texel);
+		std::copy(std::begin(target.deltas[i].normal), std::end(target.deltas[i].normal), texel + 4);
+	}
+
+	context.bindTextureForUpdate(GL_TEXTURE_2D, texture.textureId());
+	context.functions()->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, offset / g_morphTextureWidth, g_morphTextureWidth, rows, GL_RGBA, GL_FLOAT,
+										 texels.data());
+}
+
+size_t getModelDataBytes(const ModelData & data)
+{
+	size_t bytes = 0;
+	for (const auto & mesh: data.meshes)
+	{
+		bytes += mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(uint32_t) + mesh.meshlets.size() * sizeof(Meshlet);
+		bytes += mesh.skinVertices.size() * sizeof(SkinVertex);
+		for (const auto & lod: mesh.lods)
+		{
+			bytes += lod.indices.size() * sizeof(uint32_t) + lod.meshlets.size() * sizeof(Meshlet);
+		}
+	}
+	for (const auto & packed: data.packedVertices)
+	{
+		bytes += packed.data.size();
+	}
+	for (const auto & mapped: data.mappedBuffers)
+	{
+		bytes += mapped.vertices.size() + mapped.indices.size();
+	}
+	for (size_t i = 0; i < data.textures.size(); ++i)
+	{
+		bytes += static_cast<size_t>(data.textures[i].sizeInBytes());
+		bytes += i < data.textureMipChains.size() ? data.textureMipChains[i].data.size() : 0;
+	}
+	return bytes;
+}
+}// namespace
 
 ModelEntity::ModelEntity(const std::string & name)
 	: Entity(name)
@@ -15,160 +79,489 @@ ModelEntity::~ModelEntity()
 	cleanupResources();
 }
 
+ModelEntity::SharedModel::~SharedModel()
+{
+	if (!context)
+		return;
+	for (const auto & buffers: meshBuffers)
+	{
+		buffers.forget(*context);
+	}
+}
+
+void ModelEntity::MeshBuffers::forget(OpenGLContext & context) const
+{
+	if (vao)
+		context.forgetVertexArray(vao->objectId());
+	for (const auto * buffer: {vbo.get(), ibo.get(), skinVbo.get()})
+	{
+		if (buffer)
+			context.forgetBuffer(buffer->bufferId());
+	}
+	if (morphDeltas)
+		context.forgetTexture(morphDeltas->textureId());
+}
+
 bool ModelEntity::loadFromGLTF(const QString & filePath)
 {
-	QFile modelFile(filePath);
-	if (!modelFile.open(QIODevice::ReadOnly))
+	if (!shareModel(filePath))
 	{
-		return false;
+		auto data = ModelLoader::parse(filePath, loadOptions_);
+		if (!data)
+		{
+			return false;
+		}
+
+		setModelData(data, filePath);
 	}
 
-	QByteArray modelData = modelFile.readAll();
-	modelFile.close();
+	uploadPending(std::numeric_limits<float>::infinity());
+	return true;
+}
+
+void ModelEntity::setModelData(std::shared_ptr<ModelData> data, const QString & filePath)
+{
+	cleanupResources();
 
-	if (modelData.isEmpty())
+	if (data)
 	{
+		auto shared = std::make_shared<SharedModel>();
+		shared->context = context_;
+		shared->data = data;
+		shared->stats = data->stats;
+		shared->textures.resize(data->textures.size());
+		shared->textureHashes.resize(data->textures.size());
+		if (assets_)
+		{
+			shared = assets_->insert(AssetType::Model, filePath, hashModelLoadOptions(loadOptions_), data->contentHash, shared,
+									 [](const SharedModel & model) {
+										 return AssetMemory{getModelDataBytes(*model.data),
+															model.stats.gpuVertexBytes + model.stats.gpuIndexBytes};
+									 });
+		}
+		shared_ = std::move(shared);
+		meshCount_ = shared_->data->meshes.size();
+		startAnimation();
+	}
+}
+
+bool ModelEntity::shareModel(const QString & filePath)
+{
+	if (!assets_)
 		return false;
+
+	auto shared = assets_->findByPath<SharedModel>(AssetType::Model, filePath, hashModelLoadOptions(loadOptions_));
+	if (!shared)
+		return false;
+
+	cleanupResources();
+	shared_ = std::move(shared);
+	meshCount_ = shared_->data->meshes.size();
+	startAnimation();
+	return true;
+}
+
+void ModelEntity::startAnimation()
+{
+	// Every entity that loads or shares a model is a character of its own; instances share its playback.
+	if (!shared_->data->animation)
+		return;
+
+	animation_ = std::make_shared<AnimationInstance>(shared_->data->animation);
+	if (animationSystem_)
+		animationSystem_->add(animation_);
+}
+
+const SkinBinding * ModelEntity::getSkinBinding(size_t mesh) const
+{
+	if (!animation_ || shared_->data->meshes[mesh].skinVertices.empty())
+		return nullptr;
+
+	// Without a node, the first node drawing the mesh with a skin is used.
+	const auto & data = *shared_->data;
+	for (const auto & binding: animation_->getRig().bindings)
+	{
+		const int nodeMesh = data.nodes[binding.node].mesh;
+		if (node_ >= 0 ? binding.node == node_ : mesh >= data.meshRanges[nodeMesh] && mesh < data.meshRanges[nodeMesh + 1])
+			return &binding;
 	}
+	return nullptr;
+}
+
+const float * ModelEntity::getMorphTargetWeights(size_t mesh) const
+{
+	const auto & meshData = shared_->data->meshes[mesh];
+	const size_t targets = meshData.morphTargets.size();
+	if (targets == 0)
+		return nullptr;
 
-	tinygltf::Model model;
-	tinygltf::TinyGLTF loader;
-	std::string err, warn;
+	if (animation_ && node_ >= 0)
+	{
+		if (const float * animated = animation_->getMorphTargetWeights(node_))
+			return animated;
+	}
+	if (morphTargetWeights_.size() >= targets)
+		return morphTargetWeights_.data();
+	return meshData.morphWeights.size() >= targets ? meshData.morphWeights.data() : nullptr;
+}
+
+bool ModelEntity::isDeformed(size_t mesh) const
+{
+	const auto & meshData = shared_->data->meshes[mesh];
+	const float * weights = getMorphTargetWeights(mesh);
+	const bool morphed = weights && std::any_of(weights, weights + meshData.morphTargets.size(), [](float weight) { return weight != 0.0f; });
+	return morphed || getSkinBinding(mesh);
+}
+
+std::shared_ptr<ModelData> ModelEntity::getModelData() const
+{
+	return shared_ ? shared_->data : nullptr;
+}
+
+std::shared_ptr<ModelEntity> ModelEntity::createInstance(size_t firstMesh, size_t meshCount, const std::string & name, int node)
+{
+	auto instance = std::make_shared<ModelEntity>(name);
+	instance->loadOptions_ = loadOptions_;
+	instance->context_ = context_;
+	instance->textureStreamer_ = textureStreamer_;
+	instance->assets_ = assets_;
+	instance->animationSystem_ = animationSystem_;
+	instance->animation_ = animation_;
+	instance->node_ = node;
+	instance->setShaderProgram(shaderProgram_);
+	instance->shared_ = shared_;
+	instance->setMeshRange(firstMesh, meshCount);
 
-	bool success = loader.LoadBinaryFromMemory(&model, &err, &warn,
-											   reinterpret_cast<const unsigned char *>(modelData.data()),
-											   static_cast<unsigned int>(modelData.size()));
+	instance->morphToSphere_ = morphToSphere_;
+	instance->morphFactor_ = morphFactor_;
+	instance->sphereRadius_ = sphereRadius_;
+	instance->morphCenter_ = morphCenter_;
 
-	if (!success)
+	instances_.push_back(instance);
+	return instance;
+}
+
+void ModelEntity::setMeshRange(size_t firstMesh, size_t meshCount)
+{
+	const size_t total = shared_ && shared_->data ? shared_->data->meshes.size() : 0;
+	firstMesh_ = std::min(firstMesh, total);
+	meshCount_ = std::min(meshCount, total - firstMesh_);
+	selectedLods_.clear();
+	visibleRanges_.clear();
+}
+
+bool ModelEntity::isLoaded() const
+{
+	return shared_ && meshCount_ > 0 && shared_->meshBuffers.size() >= firstMesh_ + meshCount_;
+}
+
+template<typename Function>
+void ModelEntity::forEachInstance(Function function)
+{
+	instances_.erase(std::remove_if(instances_.begin(), instances_.end(), [](const auto & instance) { return instance.expired(); }),
+					 instances_.end());
+	for (const auto & instance: instances_)
 	{
-		return false;
+		function(*instance.lock());
 	}
+}
+
+void ModelEntity::setMorphToSphere(bool enable)
+{
+	morphToSphere_ = enable;
+	forEachInstance([enable](ModelEntity & instance) { instance.setMorphToSphere(enable); });
+}
+
+void ModelEntity::setMorphFactor(float factor)
+{
+	morphFactor_ = qBound(0.0f, factor, 1.0f);
+	forEachInstance([factor](ModelEntity & instance) { instance.setMorphFactor(factor); });
+}
+
+void ModelEntity::setSphereRadius(float radius)
+{
+	sphereRadius_ = radius;
+	forEachInstance([radius](ModelEntity & instance) { instance.setSphereRadius(radius); });
+}
+
+void ModelEntity::setMorphCenter(const QVector3D & center)
+{
+	morphCenter_ = center;
+	forEachInstance([&center](ModelEntity & instance) { instance.setMorphCenter(center); });
+}
+
+bool ModelEntity::uploadPending(float budgetMilliseconds)
+{
+	if (isUploadComplete())
+		return true;
+	if (!context_)
+		return false;
+
+	QElapsedTimer timer;
+	timer.start();
 
-	for (const auto & texture: model.textures)
+	// At least one item goes up per call so that a tiny budget still makes progress.
+	do
 	{
-		if (texture.source >= 0 && texture.source < static_cast<int>(model.images.size()))
+		if (shared_->uploadedTextures < shared_->textures.size())
+		{
+			uploadTexture(shared_->uploadedTextures++);
+		}
+		else
 		{
-			const auto & image = model.images[texture.source];
+			shared_->meshBuffers.push_back(uploadMesh(shared_->meshBuffers.size()));
+		}
+	} while (!isUploadComplete() && static_cast<float>(timer.nsecsElapsed()) / 1.0e6f < budgetMilliseconds);
 
-			QImage qimg;
-			if (image.component == 3)
-			{
-				qimg = QImage(image.image.data(), image.width, image.height, QImage::Format_RGB888);
-			}
-			else if (image.component == 4)
+	auto & loadStats = shared_->stats;
+	loadStats.uploadMilliseconds += static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+
+	if (!isUploadComplete())
+		return false;
+
+	qInfo().nospace() << "Loaded " << QString::fromStdString(getName()) << " (" << (loadStats.fromMeshCache ? "mesh cache" : loadStats.memoryMapped ? "mapped" : "read")
+					  << ", " << loadStats.fileBytes / 1024 << " KiB): parse " << loadStats.parseMilliseconds
+					  << " ms (images " << loadStats.imageDecodeMilliseconds << " ms), upload " << loadStats.uploadMilliseconds
+					  << " ms, buffers " << loadStats.gpuVertexBytes / 1024 << " + " << loadStats.gpuIndexBytes / 1024 << " KiB ("
+					  << getVertexFormatName(loadStats.vertexFormat) << " vertices, " << loadStats.floatVertexBytes / 1024
+					  << " KiB as float), textures " << loadStats.gpuTextureBytes / 1024 << " KiB with all levels, peak RSS "
+					  << loadStats.peakResidentBytesBefore / (1024 * 1024) << " -> "
+					  << loadStats.peakResidentBytesAfter / (1024 * 1024) << " MiB";
+	if (assets_)
+		assets_->logReport();
+	return true;
+}
+
+bool ModelEntity::isUploadComplete() const
+{
+	return !shared_ || !shaderProgram_
+		   || (shared_->uploadedTextures == shared_->textures.size() && shared_->meshBuffers.size() == shared_->data->meshes.size());
+}
+
+const ModelLoadStats & ModelEntity::getLoadStats() const
+{
+	static const ModelLoadStats empty;
+	return shared_ ? shared_->stats : empty;
+}
+
+const std::vector<Mesh> & ModelEntity::getMeshes() const
+{
+	static const std::vector<Mesh> empty;
+	return shared_ ? shared_->data->meshes : empty;
+}
+
+size_t ModelEntity::selectLods(const QVector3D & cameraPosition, float projectionScale, float thresholdPixels)
+{
+	selectedLods_.assign(meshCount_, 0);
+	visibleMeshes_.clear();
+	visibleRanges_.clear();
+	instancedMeshes_.clear();
+	if (!shared_)
+		return 0;
+
+	const auto & meshes = shared_->data->meshes;
+	const QMatrix4x4 transform = getWorldTransform();
+	const float maxScale = std::max({transform.column(0).toVector3D().length(), transform.column(1).toVector3D().length(),
+									 transform.column(2).toVector3D().length()});
+
+	size_t triangles = 0;
+	for (size_t i = 0; i < meshCount_; ++i)
+	{
+		const auto & mesh = meshes[firstMesh_ + i];
+		const QVector3D center = transform.map(QVector3D(mesh.bounds.center[0], mesh.bounds.center[1], mesh.bounds.center[2]));
+		const float distance = (center - cameraPosition).length() - mesh.bounds.radius * maxScale;
+
+		// Inside the bounds, or without a projection yet, everything stays at full detail.
+		if (distance > 0.0f && projectionScale > 0.0f)
+		{
+			const float pixelsPerUnit = maxScale * projectionScale / distance;
+			for (size_t level = mesh.lods.size(); level > 0; --level)
 			{
-				qimg = QImage(image.image.data(), image.width, image.height, QImage::Format_RGBA8888);
+				if (mesh.lods[level - 1].error * pixelsPerUnit <= thresholdPixels)
+				{
+					selectedLods_[i] = level;
+					break;
+				}
 			}
+		}
 
-			auto tex = std::make_unique<QOpenGLTexture>(qimg);
-			tex->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
-			tex->setWrapMode(QOpenGLTexture::Repeat);
-			tex->generateMipMaps();
+		triangles += shared_->data->getIndexCount(firstMesh_ + i, selectedLods_[i]) / 3;
+	}
+	return triangles;
+}
 
-			textures_.push_back(std::move(tex));
-		}
+void ModelEntity::requestTextureResolutions(const QVector3D & cameraPosition, float projectionScale)
+{
+	if (!shared_)
+		return;
+
+	const auto & meshes = shared_->data->meshes;
+	const auto & textures = shared_->textures;
+	const QMatrix4x4 transform = getWorldTransform();
+	const float maxScale = std::max({transform.column(0).toVector3D().length(), transform.column(1).toVector3D().length(),
+									 transform.column(2).toVector3D().length()});
+
+	for (size_t i = 0; i < meshCount_; ++i)
+	{
+		const auto & mesh = meshes[firstMesh_ + i];
+		if (mesh.textureIndex < 0 || mesh.textureIndex >= static_cast<int>(textures.size()) || !textures[mesh.textureIndex])
+			continue;
+
+		const QVector3D center = transform.map(QVector3D(mesh.bounds.center[0], mesh.bounds.center[1], mesh.bounds.center[2]));
+		const float distance = (center - cameraPosition).length() - mesh.bounds.radius * maxScale;
+
+		// Pixels across one UV unit, which is the whole texture. Inside the bounds, without a projection
+		// or without a UV density, the full resolution is wanted.
+		float resolution = std::numeric_limits<float>::infinity();
+		if (distance > 0.0f && projectionScale > 0.0f && mesh.uvScale > 0.0f)
+			resolution = maxScale * projectionScale / (distance * mesh.uvScale);
+		textures[mesh.textureIndex]->requestResolution(resolution);
 	}
+}
 
-	for (const auto & mesh: model.meshes)
+bool ModelEntity::getBoundingBox(BoundingBox & box) const
+{
+	if (!isLoaded() || (morphToSphere_ && morphFactor_ > 0.0f))
+		return false;
+
+	const auto & meshes = shared_->data->meshes;
+	box = meshes[firstMesh_].box;
+	for (size_t i = 0; i < meshCount_; ++i)
 	{
-		for (const auto & primitive: mesh.primitives)
+		if (isDeformed(firstMesh_ + i))
+			return false;
+
+		const auto & meshBox = meshes[firstMesh_ + i].box;
+		for (int axis = 0; axis < 3; ++axis)
 		{
-			Mesh meshData;
+			box.minimum[axis] = std::min(box.minimum[axis], meshBox.minimum[axis]);
+			box.maximum[axis] = std::max(box.maximum[axis], meshBox.maximum[axis]);
+		}
+	}
+	return true;
+}
 
-			if (primitive.attributes.find("POSITION") != primitive.attributes.end())
-			{
-				const auto & accessor = model.accessors[primitive.attributes.at("POSITION")];
-				const auto & bufferView = model.bufferViews[accessor.bufferView];
-				const auto & buffer = model.buffers[bufferView.buffer];
+size_t ModelEntity::cullMeshes(const QMatrix4x4 & viewProjection, CullStats & stats)
+{
+	visibleMeshes_.clear();
+	if (!isLoaded() || (morphToSphere_ && morphFactor_ > 0.0f))
+		return 0;
 
-				const float * positions = reinterpret_cast<const float *>(
-					&buffer.data[bufferView.byteOffset + accessor.byteOffset]);
+	// Like in cullClusters, the planes of the combined matrix are in object space and the boxes need no transform.
+	const FrustumPlanes planes = extractFrustumPlanes((viewProjection * getWorldTransform()).constData());
+	const auto & meshes = shared_->data->meshes;
+	meshBoxes_.clear();
+	boxedMeshes_.clear();
+	for (size_t i = 0; i < meshCount_; ++i)
+	{
+		if (isDeformed(firstMesh_ + i))
+			continue;
+		meshBoxes_.add(meshes[firstMesh_ + i].box);
+		boxedMeshes_.push_back(i);
+	}
 
-				meshData.vertices.resize(accessor.count);
-				for (size_t i = 0; i < accessor.count; ++i)
-				{
-					meshData.vertices[i].position[0] = positions[i * 3 + 0];
-					meshData.vertices[i].position[1] = positions[i * 3 + 1];
-					meshData.vertices[i].position[2] = positions[i * 3 + 2];
-				}
-			}
+	boxVisibility_.resize(meshBoxes_.size());
+	const size_t culled = cullBoxes(planes, meshBoxes_, boxVisibility_.data());
+	stats.tested += meshBoxes_.size();
+	stats.culled += culled;
+	if (culled == 0)
+		return 0;
 
-			if (primitive.attributes.find("NORMAL") != primitive.attributes.end())
-			{
-				const auto & accessor = model.accessors[primitive.attributes.at("NORMAL")];
-				const auto & bufferView = model.bufferViews[accessor.bufferView];
-				const auto & buffer = model.buffers[bufferView.buffer];
+	visibleMeshes_.assign(meshCount_, 1);
+	size_t culledTriangles = 0;
+	for (size_t i = 0; i < boxedMeshes_.size(); ++i)
+	{
+		if (boxVisibility_[i])
+			continue;
 
-				const float * normals = reinterpret_cast<const float *>(
-					&buffer.data[bufferView.byteOffset + accessor.byteOffset]);
+		const size_t index = boxedMeshes_[i];
+		const size_t lod = index < selectedLods_.size() ? selectedLods_[index] : 0;
+		visibleMeshes_[index] = 0;
+		culledTriangles += shared_->data->getIndexCount(firstMesh_ + index, lod) / 3;
+	}
+	return culledTriangles;
+}
 
-				for (size_t i = 0; i < accessor.count && i < meshData.vertices.size(); ++i)
-				{
-					meshData.vertices[i].normal[0] = normals[i * 3 + 0];
-					meshData.vertices[i].normal[1] = normals[i * 3 + 1];
-					meshData.vertices[i].normal[2] = normals[i * 3 + 2];
-				}
-			}
+size_t ModelEntity::cullClusters(const QMatrix4x4 & viewProjection, const QVector3D & cameraPosition, CullStats & stats)
+{
+	visibleRanges_.clear();
+	// The sphere morph moves vertices away from the baked cluster bounds.
+	if (!isLoaded() || (morphToSphere_ && morphFactor_ > 0.0f))
+		return 0;
 
-			if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end())
-			{
-				const auto & accessor = model.accessors[primitive.attributes.at("TEXCOORD_0")];
-				const auto & bufferView = model.bufferViews[accessor.bufferView];
-				const auto & buffer = model.buffers[bufferView.buffer];
+	// Frustum planes of the combined matrix are in object space, so the bounds need no transform.
+	const QMatrix4x4 transform = getWorldTransform();
+	const QMatrix4x4 clip = viewProjection * transform;
+	std::array<QVector4D, 6> planes = {clip.row(3) + clip.row(0), clip.row(3) - clip.row(0), clip.row(3) + clip.row(1),
+										clip.row(3) - clip.row(1), clip.row(3) + clip.row(2), clip.row(3) - clip.row(2)};
+	for (auto & plane: planes)
+	{
+		const float length = plane.toVector3D().length();
+		if (length > 0.0f)
+			plane /= length;
+	}
 
-				const float * texCoords = reinterpret_cast<const float *>(
-					&buffer.data[bufferView.byteOffset + accessor.byteOffset]);
+	// A mirroring transform flips the winding that the cones were built for.
+	bool invertible = false;
+	const QVector3D eye = transform.inverted(&invertible).map(cameraPosition);
+	const bool testCones = invertible && transform.determinant() > 0.0;
 
-				for (size_t i = 0; i < accessor.count && i < meshData.vertices.size(); ++i)
-				{
-					meshData.vertices[i].texCoord[0] = texCoords[i * 2 + 0];
-					meshData.vertices[i].texCoord[1] = texCoords[i * 2 + 1];
-				}
-			}
+	const auto & meshes = shared_->data->meshes;
+	visibleRanges_.resize(meshCount_);
+	size_t culledTriangles = 0;
+	for (size_t i = 0; i < meshCount_; ++i)
+	{
+		const auto & mesh = meshes[firstMesh_ + i];
+		const auto & buffers = shared_->meshBuffers[firstMesh_ + i];
+		const size_t lod = i < selectedLods_.size() ? std::min(selectedLods_[i], buffers.lods.size() - 1) : 0;
+		const auto & meshlets = lod == 0 ? mesh.meshlets : mesh.lods[lod - 1].meshlets;
+		const IndexRange & level = buffers.lods[lod];
+		const size_t indexSize = buffers.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
 
-			if (primitive.indices >= 0)
-			{
-				const auto & accessor = model.accessors[primitive.indices];
-				const auto & bufferView = model.bufferViews[accessor.bufferView];
-				const auto & buffer = model.buffers[bufferView.buffer];
+		// Meshes hidden by cullMeshes keep no ranges and are not drawn.
+		if (i < visibleMeshes_.size() && !visibleMeshes_[i])
+			continue;
 
-				meshData.indices.resize(accessor.count);
+		auto & ranges = visibleRanges_[i];
+		// So do skinning and morph targets.
+		if (meshlets.empty() || isDeformed(firstMesh_ + i))
+		{
+			ranges.push_back(level);
+			continue;
+		}
 
-				if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
-				{
-					const uint16_t * indices = reinterpret_cast<const uint16_t *>(
-						&buffer.data[bufferView.byteOffset + accessor.byteOffset]);
-					for (size_t i = 0; i < accessor.count; ++i)
-					{
-						meshData.indices[i] = indices[i];
-					}
-				}
-				else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
-				{
-					const uint32_t * indices = reinterpret_cast<const uint32_t *>(
-						&buffer.data[bufferView.byteOffset + accessor.byteOffset]);
-					for (size_t i = 0; i < accessor.count; ++i)
-					{
-						meshData.indices[i] = indices[i];
-					}
-				}
+		for (const auto & meshlet: meshlets)
+		{
+			const QVector3D center(meshlet.bounds.center[0], meshlet.bounds.center[1], meshlet.bounds.center[2]);
+			const float radius = meshlet.bounds.radius;
+
+			bool visible = std::all_of(planes.begin(), planes.end(), [&center, radius](const QVector4D & plane) {
+				return QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() >= -radius;
+			});
+			if (visible && testCones && meshlet.coneCutoff < 1.0f)
+			{
+				const QVector3D toCenter = center - eye;
+				const QVector3D axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+				visible = QVector3D::dotProduct(toCenter, axis) < meshlet.coneCutoff * toCenter.length() + radius;
 			}
 
-			if (primitive.material >= 0 && primitive.material < static_cast<int>(model.materials.size()))
+			++stats.tested;
+			if (!visible)
 			{
-				const auto & material = model.materials[primitive.material];
-				if (material.pbrMetallicRoughness.baseColorTexture.index >= 0)
-				{
-					meshData.textureIndex = material.pbrMetallicRoughness.baseColorTexture.index;
-				}
+				++stats.culled;
+				culledTriangles += meshlet.indexCount / 3;
+				continue;
 			}
 
-			meshes_.push_back(std::move(meshData));
+			// Neighbouring visible clusters are adjacent in the index buffer and share one draw.
+			const size_t offset = level.offset + meshlet.indexOffset * indexSize;
+			if (!ranges.empty() && ranges.back().offset + static_cast<size_t>(ranges.back().count) * indexSize == offset)
+				ranges.back().count += static_cast<GLsizei>(meshlet.indexCount);
+			else
+				ranges.push_back({static_cast<GLsizei>(meshlet.indexCount), offset});
 		}
 	}
-
-	setupMeshBuffers();
-	return true;
+	return culledTriangles;
 }
 
 void ModelEntity::setShaderProgram(std::shared_ptr<QOpenGLShaderProgram> program)
@@ -177,31 +570,38 @@ void ModelEntity::setShaderProgram(std::shared_ptr<QOpenGLShaderProgram> program
 
 	if (program)
 	{
-		program->bind();
 		mvpUniform_ = program->uniformLocation("mvp");
 		modelUniform_ = program->uniformLocation("model");
 		normalMatrixUniform_ = program->uniformLocation("normalMatrix");
 		lightPosUniform_ = program->uniformLocation("lightPos");
 		viewPosUniform_ = program->uniformLocation("viewPos");
 		lightColorUniform_ = program->uniformLocation("lightColor");
+		positionOffsetUniform_ = program->uniformLocation("positionOffset");
+		positionScaleUniform_ = program->uniformLocation("positionScale");
+		octahedralNormalsUniform_ = program->uniformLocation("octahedralNormals");
+		skinnedUniform_ = program->uniformLocation("skinned");
+		jointOffsetUniform_ = program->uniformLocation("jointOffset");
+		morphTargetCountUniform_ = program->uniformLocation("morphTargetCount");
+		morphTargetOffsetsUniform_ = program->uniformLocation("morphTargetOffsets");
+		morphTargetWeightsUniform_ = program->uniformLocation("morphTargetWeights");
+		instancedUniform_ = program->uniformLocation("instanced");
+		viewProjectionUniform_ = program->uniformLocation("viewProjection");
 
 		morphFactorUniform_ = program->uniformLocation("morphFactor");
 		morphToSphereUniform_ = program->uniformLocation("morphToSphere");
 		sphereRadiusUniform_ = program->uniformLocation("sphereRadius");
 		morphCenterUniform_ = program->uniformLocation("morphCenter");
-
-		program->release();
 	}
 }
 
 void ModelEntity::render(Camera * camera, OpenGLContextPtr context)
 {
-	if (!shaderProgram_ || !camera || !context || meshes_.empty())
+	if (!shaderProgram_ || !camera || !context || !isLoaded())
 		return;
 
-	shaderProgram_->bind();
+	context->useProgram(shaderProgram_->programId());
 
-	const auto & transform = getTransform();
+	const QMatrix4x4 transform = getWorldTransform();
 	const auto mvp = camera->getViewProjectionMatrix() * transform;
 	const auto normalMatrix = transform.normalMatrix();
 
@@ -224,81 +624,523 @@ void ModelEntity::render(Camera * camera, OpenGLContextPtr context)
 	if (morphCenterUniform_ >= 0)
 		shaderProgram_->setUniformValue(morphCenterUniform_, morphCenter_);
 
-	for (size_t i = 0; i < meshes_.size(); ++i)
+	const auto & meshes = shared_->data->meshes;
+	const auto & textures = shared_->textures;
+	for (size_t i = 0; i < meshCount_; ++i)
 	{
-		const auto & mesh = meshes_[i];
+		const auto & mesh = meshes[firstMesh_ + i];
+		auto & buffers = shared_->meshBuffers[firstMesh_ + i];
+		const bool culled = i < visibleRanges_.size();
+		if ((culled && visibleRanges_[i].empty()) || (i < visibleMeshes_.size() && !visibleMeshes_[i])
+			|| (i < instancedMeshes_.size() && instancedMeshes_[i]))
+			continue;
 
-		if (i < vaos_.size() && vaos_[i])
+		if (buffers.vao)
 		{
-			vaos_[i]->bind();
+			context->bindVertexArray(buffers.vao->objectId());
+
+			if (positionOffsetUniform_ >= 0)
+				shaderProgram_->setUniformValue(positionOffsetUniform_, buffers.positionOffset);
+			if (positionScaleUniform_ >= 0)
+				shaderProgram_->setUniformValue(positionScaleUniform_, buffers.positionScale);
+			if (octahedralNormalsUniform_ >= 0)
+				shaderProgram_->setUniformValue(octahedralNormalsUniform_, buffers.octahedralNormals);
 
-			if (mesh.textureIndex >= 0 && mesh.textureIndex < static_cast<int>(textures_.size()))
+			const SkinBinding * skin = buffers.skinVbo ? getSkinBinding(firstMesh_ + i) : nullptr;
+			if (skinnedUniform_ >= 0)
+				shaderProgram_->setUniformValue(skinnedUniform_, skin != nullptr);
+			if (jointOffsetUniform_ >= 0 && skin)
+				shaderProgram_->setUniformValue(jointOffsetUniform_, static_cast<GLint>(animation_->getPaletteBase() + skin->paletteOffset));
+
+			// The targets with the largest non-zero weights, uploaded on first use.
+			std::vector<std::pair<float, size_t>> activeTargets;
+			if (const float * weights = getMorphTargetWeights(firstMesh_ + i))
 			{
-				textures_[mesh.textureIndex]->bind(0);
+				for (size_t target = 0; target < mesh.morphTargets.size(); ++target)
+				{
+					if (weights[target] != 0.0f && !mesh.morphTargets[target].vertices.empty())
+						activeTargets.emplace_back(weights[target], target);
+				}
+				const size_t count = std::min(activeTargets.size(), g_maxMorphTargets);
+				std::partial_sort(activeTargets.begin(), activeTargets.begin() + static_cast<std::ptrdiff_t>(count), activeTargets.end(),
+								  [](const auto & a, const auto & b) { return std::abs(a.first) > std::abs(b.first); });
+				activeTargets.resize(count);
 			}
 
-			context->functions()->glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, nullptr);
+			std::array<GLint, g_maxMorphTargets> morphOffsets = {};
+			std::array<GLfloat, g_maxMorphTargets> morphWeights = {};
+			for (size_t target = 0; target < activeTargets.size(); ++target)
+			{
+				const size_t index = activeTargets[target].second;
+				morphOffsets[target] = uploadMorphTarget(*context, buffers, mesh, index);
+				morphWeights[target] = activeTargets[target].first;
+			}
+			if (morphTargetCountUniform_ >= 0)
+				shaderProgram_->setUniformValue(morphTargetCountUniform_, static_cast<GLint>(activeTargets.size()));
+			if (!activeTargets.empty())
+			{
+				if (morphTargetOffsetsUniform_ >= 0)
+					shaderProgram_->setUniformValueArray(morphTargetOffsetsUniform_, morphOffsets.data(), static_cast<int>(activeTargets.size()));
+				if (morphTargetWeightsUniform_ >= 0)
+					shaderProgram_->setUniformValueArray(morphTargetWeightsUniform_, morphWeights.data(), static_cast<int>(activeTargets.size()), 1);
+				context->bindTexture(3, GL_TEXTURE_2D, buffers.morphDeltas->textureId());
+			}
 
-			if (mesh.textureIndex >= 0 && mesh.textureIndex < static_cast<int>(textures_.size()))
+			QOpenGLTexture * texture = nullptr;
+			if (mesh.textureIndex >= 0 && mesh.textureIndex < static_cast<int>(textures.size()) && textures[mesh.textureIndex])
 			{
-				textures_[mesh.textureIndex]->release();
+				texture = textures[mesh.textureIndex]->getTexture();
 			}
 
-			vaos_[i]->release();
+			// Untextured meshes sample no texture rather than the previous mesh's.
+			context->bindTexture(0, GL_TEXTURE_2D, texture ? texture->textureId() : 0);
+
+			if (culled)
+			{
+				for (const auto & range: visibleRanges_[i])
+				{
+					context->functions()->glDrawElements(GL_TRIANGLES, range.count, buffers.indexType, reinterpret_cast<const void *>(range.offset));
+				}
+			}
+			else
+			{
+				const size_t lod = i < selectedLods_.size() ? std::min(selectedLods_[i], buffers.lods.size() - 1) : 0;
+				const auto & range = buffers.lods[lod];
+				context->functions()->glDrawElements(GL_TRIANGLES, range.count, buffers.indexType, reinterpret_cast<const void *>(range.offset));
+			}
 		}
 	}
+}
+
+DrawState ModelEntity::getDrawState(size_t mesh) const
+{
+	DrawState state;
+	state.program = shaderProgram_.get();
+	if (!shared_ || mesh >= shared_->meshBuffers.size())
+		return state;
+
+	state.vertexArray = shared_->meshBuffers[mesh].vao.get();
+	const int textureIndex = shared_->data->meshes[mesh].textureIndex;
+	if (textureIndex >= 0 && textureIndex < static_cast<int>(shared_->textures.size()))
+		state.texture = shared_->textures[textureIndex].get();
+	return state;
+}
 
-	shaderProgram_->release();
+const void * ModelEntity::getInstanceKey() const
+{
+	return isLoaded() ? &shared_->meshBuffers[firstMesh_] : nullptr;
 }
 
-void ModelEntity::setupMeshBuffers()
+size_t ModelEntity::collectInstancedMeshes(std::vector<InstancedMesh> & meshes)
 {
-	if (!shaderProgram_)
+	instancedMeshes_.assign(meshCount_, 0);
+	if (!shaderProgram_ || !isLoaded())
+		return meshCount_;
+
+	InstancedMesh instanced;
+	instanced.entity = this;
+	const QMatrix4x4 transform = getWorldTransform();
+	std::copy(transform.constData(), transform.constData() + 16, instanced.instance.model);
+	instanced.instance.morphSphere[0] = morphCenter_.x();
+	instanced.instance.morphSphere[1] = morphCenter_.y();
+	instanced.instance.morphSphere[2] = morphCenter_.z();
+	instanced.instance.morphSphere[3] = sphereRadius_;
+	instanced.instance.morphFactor = morphToSphere_ ? morphFactor_ : 0.0f;
+
+	size_t left = 0;
+	for (size_t i = 0; i < meshCount_; ++i)
+	{
+		if (i < visibleMeshes_.size() && !visibleMeshes_[i])
+			continue;
+
+		const auto & buffers = shared_->meshBuffers[firstMesh_ + i];
+		if (!buffers.vao || i < visibleRanges_.size() || isDeformed(firstMesh_ + i))
+		{
+			++left;
+			continue;
+		}
+
+		instanced.mesh = firstMesh_ + i;
+		instanced.lod = i < selectedLods_.size() ? std::min(selectedLods_[i], buffers.lods.size() - 1) : 0;
+		instanced.key = &buffers;
+		instanced.levelKey = &buffers.lods[instanced.lod];
+		meshes.push_back(instanced);
+		instancedMeshes_[i] = 1;
+	}
+	return left;
+}
+
+void ModelEntity::renderInstances(Camera * camera, OpenGLContextPtr context, const InstancedMesh & mesh, QOpenGLBuffer & instances,
+								  size_t offset, GLsizei count)
+{
+	auto & buffers = shared_->meshBuffers[mesh.mesh];
+	if (!shaderProgram_ || !camera || !context || !buffers.vao)
 		return;
 
-	for (const auto & mesh: meshes_)
+	auto * functions = QOpenGLContext::currentContext()->extraFunctions();
+	context->useProgram(shaderProgram_->programId());
+
+	if (instancedUniform_ >= 0)
+		shaderProgram_->setUniformValue(instancedUniform_, true);
+	if (viewProjectionUniform_ >= 0)
+		shaderProgram_->setUniformValue(viewProjectionUniform_, camera->getViewProjectionMatrix());
+	if (viewPosUniform_ >= 0)
+		shaderProgram_->setUniformValue(viewPosUniform_, camera->getPosition());
+	if (positionOffsetUniform_ >= 0)
+		shaderProgram_->setUniformValue(positionOffsetUniform_, buffers.positionOffset);
+	if (positionScaleUniform_ >= 0)
+		shaderProgram_->setUniformValue(positionScaleUniform_, buffers.positionScale);
+	if (octahedralNormalsUniform_ >= 0)
+		shaderProgram_->setUniformValue(octahedralNormalsUniform_, buffers.octahedralNormals);
+	if (skinnedUniform_ >= 0)
+		shaderProgram_->setUniformValue(skinnedUniform_, false);
+	if (morphTargetCountUniform_ >= 0)
+		shaderProgram_->setUniformValue(morphTargetCountUniform_, 0);
+
+	// The instance attributes point into this frame's range of the buffer and advance once per instance.
+	context->bindVertexArray(buffers.vao->objectId());
+	context->bindBuffer(GL_ARRAY_BUFFER, instances.bufferId());
+	const int stride = static_cast<int>(sizeof(MeshInstance));
+	const auto setInstanceAttribute = [this, functions, stride](int location, size_t attributeOffset, int components) {
+		shaderProgram_->enableAttributeArray(location);
+		shaderProgram_->setAttributeBuffer(location, GL_FLOAT, static_cast<int>(attributeOffset), components, stride);
+		functions->glVertexAttribDivisor(static_cast<GLuint>(location), 1);
+	};
+	for (int column = 0; column < 4; ++column)
 	{
-		auto vao = std::make_unique<QOpenGLVertexArrayObject>();
-		vao->create();
-		vao->bind();
+		setInstanceAttribute(g_instanceModelLocation + column, offset + offsetof(MeshInstance, model) + static_cast<size_t>(column) * 4 * sizeof(float), 4);
+	}
+	setInstanceAttribute(g_instanceMorphSphereLocation, offset + offsetof(MeshInstance, morphSphere), 4);
+	setInstanceAttribute(g_instanceMorphFactorLocation, offset + offsetof(MeshInstance, morphFactor), 1);
 
-		auto vbo = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::Type::VertexBuffer);
-		vbo->create();
-		vbo->bind();
-		vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-		vbo->allocate(mesh.vertices.data(), static_cast<int>(mesh.vertices.size() * sizeof(Vertex)));
+	const auto & meshData = shared_->data->meshes[mesh.mesh];
+	const auto & textures = shared_->textures;
+	QOpenGLTexture * texture = nullptr;
+	if (meshData.textureIndex >= 0 && meshData.textureIndex < static_cast<int>(textures.size()) && textures[meshData.textureIndex])
+	{
+		texture = textures[meshData.textureIndex]->getTexture();
+	}
+	context->bindTexture(0, GL_TEXTURE_2D, texture ? texture->textureId() : 0);
 
-		auto ibo = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::Type::IndexBuffer);
-		ibo->create();
-		ibo->bind();
-		ibo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-		ibo->allocate(mesh.indices.data(), static_cast<int>(mesh.indices.size() * sizeof(uint32_t)));
+	const auto & range = buffers.lods[mesh.lod];
+	functions->glDrawElementsInstanced(GL_TRIANGLES, range.count, buffers.indexType, reinterpret_cast<const void *>(range.offset), count);
 
-		shaderProgram_->bind();
+	// Left enabled, the arrays would feed later draws of the mesh from a buffer the renderer refills every frame.
+	for (int location = g_instanceModelLocation; location <= g_instanceMorphFactorLocation; ++location)
+	{
+		shaderProgram_->disableAttributeArray(location);
+	}
+
+	if (instancedUniform_ >= 0)
+		shaderProgram_->setUniformValue(instancedUniform_, false);
+}
+
+void ModelEntity::uploadTexture(size_t index)
+{
+	auto & data = *shared_->data;
+	QImage & image = data.textures[index];
+	TextureMipChain chain;
+	if (index < data.textureMipChains.size())
+		chain = std::move(data.textureMipChains[index]);
+
+	// RGBA8 fallback when the block format is unsupported or no chain was built.
+	if (!chain.isValid() || !isBlockFormatSupported(chain.format))
+		chain = buildMipChain(image, BlockFormat::None, true, false);
+	image = QImage();
+	if (!chain.isValid())
+		return;
+	shared_->textureHashes[index] = chain.imageHash;
+
+	// Textures with the same pixels, format and levels are shared with every other model.
+	const uint64_t contentHash = hashCombine(hashCombine(chain.imageHash, static_cast<uint64_t>(chain.format)),
+											 static_cast<uint64_t>(chain.getLevelCount()));
+	if (assets_)
+	{
+		if (auto texture = assets_->findByContent<StreamedTexture>(AssetType::Texture, contentHash))
+		{
+			shared_->textures[index] = std::move(texture);
+			return;
+		}
+	}
+
+	shared_->stats.gpuTextureBytes += chain.data.size();
+	auto texture = textureStreamer_ ? textureStreamer_->createTexture(std::move(chain))
+									: std::make_shared<StreamedTexture>(context_, std::move(chain), 0);
+	if (assets_)
+	{
+		assets_->insert(AssetType::Texture, QString(), 0, contentHash, texture, [](const StreamedTexture & texture) {
+			return AssetMemory{texture.getFullBytes(), texture.getResidentBytes()};
+		});
+	}
+	shared_->textures[index] = std::move(texture);
+}
+
+auto ModelEntity::uploadMesh(size_t index) -> MeshBuffers
+{
+	const auto & data = *shared_->data;
+	const auto & mesh = data.meshes[index];
+	const VertexFormat format = data.getVertexFormat(index);
 
-		shaderProgram_->enableAttributeArray(0);
-		shaderProgram_->setAttributeBuffer(0, GL_FLOAT, offsetof(Vertex, position), 3, sizeof(Vertex));
+	MeshBuffers buffers;
 
-		shaderProgram_->enableAttributeArray(1);
-		shaderProgram_->setAttributeBuffer(1, GL_FLOAT, offsetof(Vertex, normal), 3, sizeof(Vertex));
+	buffers.vao = std::make_unique<QOpenGLVertexArrayObject>();
+	buffers.vao->create();
+	context_->bindVertexArray(buffers.vao->objectId());
 
-		shaderProgram_->enableAttributeArray(2);
-		shaderProgram_->setAttributeBuffer(2, GL_FLOAT, offsetof(Vertex, texCoord), 2, sizeof(Vertex));
+	buffers.vbo = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::Type::VertexBuffer);
+	buffers.vbo->create();
+	context_->bindBuffer(GL_ARRAY_BUFFER, buffers.vbo->bufferId());
+	buffers.vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+	// Meshes from the mesh cache are uploaded straight from its mapping.
+	const auto vertices = data.getVertexBuffer(index);
+	buffers.vbo->allocate(vertices.data(), static_cast<int>(vertices.size()));
+	if (format != VertexFormat::Float)
+	{
+		const auto & packed = data.packedVertices[index];
+		buffers.positionOffset = QVector3D(packed.positionOffset[0], packed.positionOffset[1], packed.positionOffset[2]);
+		buffers.positionScale = QVector3D(packed.positionScale[0], packed.positionScale[1], packed.positionScale[2]);
+	}
+
+	buffers.ibo = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::Type::IndexBuffer);
+	buffers.ibo->create();
+	context_->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.ibo->bufferId());
+	buffers.ibo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+	std::vector<uint8_t> storage;
+	const auto indices = data.getIndexBuffer(index, storage);
+	buffers.ibo->allocate(indices.data(), static_cast<int>(indices.size()));
+	const size_t indexSize = getIndexSize(data.getVertexCount(index));
+	if (indexSize == sizeof(uint16_t))
+		buffers.indexType = GL_UNSIGNED_SHORT;
+
+	buffers.lods = getLodRanges(data, index, indexSize);
+	shared_->stats.gpuVertexBytes += static_cast<size_t>(buffers.vbo->size());
+	shared_->stats.gpuIndexBytes += static_cast<size_t>(buffers.ibo->size());
+
+	// The attribute calls name locations and set vertex array state; they need no program in use.
+	shaderProgram_->enableAttributeArray(0);
+	shaderProgram_->enableAttributeArray(1);
+	shaderProgram_->enableAttributeArray(2);
 
-		shaderProgram_->release();
-		vao->release();
+	// setAttributeBuffer always requests normalization, which integer formats rely on and float formats ignore.
+	const int stride = static_cast<int>(getVertexStride(format));
+	switch (format)
+	{
+		case VertexFormat::Float:
+			shaderProgram_->setAttributeBuffer(0, GL_FLOAT, offsetof(Vertex, position), 3, stride);
+			shaderProgram_->setAttributeBuffer(1, GL_FLOAT, offsetof(Vertex, normal), 3, stride);
+			shaderProgram_->setAttributeBuffer(2, GL_FLOAT, offsetof(Vertex, texCoord), 2, stride);
+			break;
+		case VertexFormat::Packed16:
+			shaderProgram_->setAttributeBuffer(0, GL_UNSIGNED_SHORT, 0, 3, stride);
+			shaderProgram_->setAttributeBuffer(1, GL_INT_2_10_10_10_REV, 8, 4, stride);
+			shaderProgram_->setAttributeBuffer(2, GL_HALF_FLOAT, 12, 2, stride);
+			break;
+		case VertexFormat::Packed12:
+			shaderProgram_->setAttributeBuffer(0, GL_UNSIGNED_SHORT, 0, 3, stride);
+			shaderProgram_->setAttributeBuffer(1, GL_BYTE, 6, 2, stride);
+			shaderProgram_->setAttributeBuffer(2, GL_HALF_FLOAT, 8, 2, stride);
+			buffers.octahedralNormals = true;
+			break;
+	}
 
-		vaos_.push_back(std::move(vao));
-		vbos_.push_back(std::move(vbo));
-		ibos_.push_back(std::move(ibo));
+	if (!mesh.skinVertices.empty())
+	{
+		buffers.skinVbo = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::Type::VertexBuffer);
+		buffers.skinVbo->create();
+		context_->bindBuffer(GL_ARRAY_BUFFER, buffers.skinVbo->bufferId());
+		buffers.skinVbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+		buffers.skinVbo->allocate(mesh.skinVertices.data(), static_cast<int>(mesh.skinVertices.size() * sizeof(SkinVertex)));
+		shared_->stats.gpuVertexBytes += static_cast<size_t>(buffers.skinVbo->size());
+
+		// Joint indices are read as plain numbers, which setAttributeBuffer cannot request.
+		shaderProgram_->enableAttributeArray(3);
+		shaderProgram_->enableAttributeArray(4);
+		context_->functions()->glVertexAttribPointer(3, 4, GL_UNSIGNED_SHORT, GL_FALSE, static_cast<GLsizei>(sizeof(SkinVertex)),
+													reinterpret_cast<const void *>(offsetof(SkinVertex, joints)));
+		shaderProgram_->setAttributeBuffer(4, GL_UNSIGNED_SHORT, offsetof(SkinVertex, weights), 4, static_cast<int>(sizeof(SkinVertex)));
 	}
+
+	// Buffers bound later must not land in this vertex array.
+	context_->bindVertexArray(0);
+
+	return buffers;
+}
+
+auto ModelEntity::getLodRanges(const ModelData & data, size_t mesh, size_t indexSize) -> std::vector<IndexRange>
+{
+	std::vector<IndexRange> ranges;
+	size_t offset = 0;
+	for (size_t level = 0; level <= data.meshes[mesh].lods.size(); ++level)
+	{
+		const size_t count = data.getIndexCount(mesh, level);
+		ranges.push_back({static_cast<GLsizei>(count), offset});
+		offset += count * indexSize;
+	}
+	return ranges;
+}
+
+bool ModelEntity::reloadModelData(std::shared_ptr<ModelData> data, const ModelDiff & diff)
+{
+	if (!shared_ || !data || !shaderProgram_ || !context_ || !isUploadComplete() || !diff.compatible
+		|| diff.meshes.size() != shared_->meshBuffers.size())
+		return false;
+	// Applied already through another entity sharing the model.
+	if (shared_->data == data)
+		return true;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	shared_->data = std::move(data);
+	auto & model = *shared_->data;
+	auto & stats = shared_->stats;
+	size_t rebuiltMeshes = 0;
+	size_t updatedMeshes = 0;
+	size_t uploadedBytes = 0;
+	for (size_t i = 0; i < diff.meshes.size(); ++i)
+	{
+		const auto & meshDiff = diff.meshes[i];
+		auto & buffers = shared_->meshBuffers[i];
+		if (meshDiff.rebuild)
+		{
+			stats.gpuVertexBytes -= static_cast<size_t>(buffers.vbo->size()) + (buffers.skinVbo ? static_cast<size_t>(buffers.skinVbo->size()) : 0)
+									+ (buffers.morphDeltas ? static_cast<size_t>(buffers.morphDeltas->height()) * g_morphTextureWidth * 8 : 0);
+			stats.gpuIndexBytes -= static_cast<size_t>(buffers.ibo->size());
+			buffers.forget(*context_);
+			buffers = uploadMesh(i);
+			uploadedBytes += static_cast<size_t>(buffers.vbo->size() + buffers.ibo->size()) + (buffers.skinVbo ? static_cast<size_t>(buffers.skinVbo->size()) : 0);
+			++rebuiltMeshes;
+			continue;
+		}
+
+		const auto & mesh = model.meshes[i];
+		if (model.getVertexFormat(i) != VertexFormat::Float)
+		{
+			const auto & packed = model.packedVertices[i];
+			buffers.positionOffset = QVector3D(packed.positionOffset[0], packed.positionOffset[1], packed.positionOffset[2]);
+			buffers.positionScale = QVector3D(packed.positionScale[0], packed.positionScale[1], packed.positionScale[2]);
+		}
+		// The sizes are unchanged, so every level keeps its index type; only the split between levels may move.
+		const size_t indexSize = buffers.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+		buffers.lods = getLodRanges(model, i, indexSize);
+		if (meshDiff.morphTargets)
+		{
+			// Uploaded again on first use, into the same texture.
+			buffers.morphOffsets.clear();
+			buffers.morphRows = 0;
+		}
+		if (meshDiff.vertices.isEmpty() && meshDiff.indices.isEmpty() && meshDiff.skinVertices.isEmpty() && !meshDiff.morphTargets)
+			continue;
+
+		// The index buffer binding belongs to the vertex array.
+		context_->bindVertexArray(buffers.vao->objectId());
+		if (!meshDiff.vertices.isEmpty())
+		{
+			const auto * stream = model.getVertexBuffer(i).data();
+			context_->bindBuffer(GL_ARRAY_BUFFER, buffers.vbo->bufferId());
+			buffers.vbo->write(static_cast<int>(meshDiff.vertices.begin), stream + meshDiff.vertices.begin, static_cast<int>(meshDiff.vertices.getSize()));
+			uploadedBytes += meshDiff.vertices.getSize();
+		}
+		if (!meshDiff.indices.isEmpty())
+		{
+			std::vector<uint8_t> storage;
+			const auto indices = model.getIndexBuffer(i, storage);
+			context_->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.ibo->bufferId());
+			buffers.ibo->write(static_cast<int>(meshDiff.indices.begin * indexSize), indices.data() + meshDiff.indices.begin * indexSize,
+							   static_cast<int>(meshDiff.indices.getSize() * indexSize));
+			uploadedBytes += meshDiff.indices.getSize() * indexSize;
+		}
+		if (!meshDiff.skinVertices.isEmpty())
+		{
+			const auto * skin = reinterpret_cast<const uint8_t *>(mesh.skinVertices.data());
+			context_->bindBuffer(GL_ARRAY_BUFFER, buffers.skinVbo->bufferId());
+			buffers.skinVbo->write(static_cast<int>(meshDiff.skinVertices.begin), skin + meshDiff.skinVertices.begin,
+								   static_cast<int>(meshDiff.skinVertices.getSize()));
+			uploadedBytes += meshDiff.skinVertices.getSize();
+		}
+		context_->bindVertexArray(0);
+		++updatedMeshes;
+	}
+
+	// Changed textures are uploaded as new ones: the old ones may be shared by content with other models.
+	size_t replacedTextures = 0;
+	shared_->textures.resize(model.textures.size());
+	shared_->textureHashes.resize(model.textures.size());
+	for (size_t i = 0; i < model.textures.size(); ++i)
+	{
+		if (shared_->textureHashes[i] == diff.textureHashes[i])
+		{
+			model.textures[i] = QImage();
+			if (i < model.textureMipChains.size())
+				model.textureMipChains[i] = TextureMipChain();
+			continue;
+		}
+
+		// Textures found by content were never counted here.
+		if (shared_->textures[i])
+			stats.gpuTextureBytes -= std::min(stats.gpuTextureBytes, shared_->textures[i]->getFullBytes());
+		shared_->textures[i].reset();
+		shared_->textureHashes[i] = 0;
+		const size_t before = stats.gpuTextureBytes;
+		uploadTexture(i);
+		uploadedBytes += stats.gpuTextureBytes - before;
+		replacedTextures += shared_->textures[i] ? 1 : 0;
+	}
+	shared_->uploadedTextures = shared_->textures.size();
+
+	qInfo().nospace() << "Reloaded " << QString::fromStdString(getName()) << ": " << rebuiltMeshes << " meshes rebuilt, "
+					  << updatedMeshes << " updated, " << replacedTextures << " textures replaced, " << uploadedBytes / 1024
+					  << " KiB uploaded in " << static_cast<double>(timer.nsecsElapsed()) / 1.0e6 << " ms";
+	return true;
+}
+
+GLint ModelEntity::uploadMorphTarget(OpenGLContext & context, MeshBuffers & buffers, const Mesh & mesh, size_t target)
+{
+	if (buffers.morphOffsets.size() != mesh.morphTargets.size())
+		buffers.morphOffsets.assign(mesh.morphTargets.size(), -1);
+	if (buffers.morphOffsets[target] >= 0)
+		return buffers.morphOffsets[target];
+
+	const size_t vertexCount = mesh.vertices.size();
+	const int rowsPerTarget = static_cast<int>((vertexCount * 2 + g_morphTextureWidth - 1) / g_morphTextureWidth);
+	const int rows = buffers.morphRows + rowsPerTarget;
+	const int capacity = buffers.morphDeltas ? buffers.morphDeltas->height() : 0;
+	if (rows > capacity)
+	{
+		// Grows by doubling; the targets uploaded so far are written again from their sparse deltas.
+		auto texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+		texture->setFormat(QOpenGLTexture::RGBA16F);
+		texture->setSize(g_morphTextureWidth, std::max(rows, capacity * 2));
+		texture->setMipLevels(1);
+		texture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+		texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
+		shared_->stats.gpuVertexBytes += static_cast<size_t>(texture->height() - capacity) * g_morphTextureWidth * 8;
+
+		for (size_t uploaded = 0; uploaded < buffers.morphOffsets.size(); ++uploaded)
+		{
+			if (buffers.morphOffsets[uploaded] >= 0)
+				writeMorphTarget(context, *texture, mesh.morphTargets[uploaded], vertexCount, buffers.morphOffsets[uploaded]);
+		}
+		if (buffers.morphDeltas)
+			context.forgetTexture(buffers.morphDeltas->textureId());
+		buffers.morphDeltas = std::move(texture);
+	}
+
+	const GLint offset = buffers.morphRows * g_morphTextureWidth;
+	writeMorphTarget(context, *buffers.morphDeltas, mesh.morphTargets[target], vertexCount, offset);
+	buffers.morphOffsets[target] = offset;
+	buffers.morphRows = rows;
+	return offset;
 }
 
 void ModelEntity::cleanupResources()
 {
-	vaos_.clear();
-	vbos_.clear();
-	ibos_.clear();
-	textures_.clear();
-	meshes_.clear();
+	// GPU objects go away with the last entity that shares them.
+	shared_.reset();
+	animation_.reset();
+	instances_.clear();
+	firstMesh_ = 0;
+	meshCount_ = 0;
+	selectedLods_.clear();
+	visibleRanges_.clear();
 }
@@ -1,7 +1,13 @@
 #pragma once
 
+#include "AnimationSystem.h"
+#include "AssetManager.h"
 #include "Entity.h"
+#include "FrustumCulling.h"
+#include "ModelData.h"
+#include "ModelDiff.h"
 #include "OpenGLContext.h"
+#include "TextureStreamer.h"
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
@@ -11,16 +17,40 @@
 
 class Camera;
 
-struct Vertex {
-	float position[3];
-	float normal[3];
-	float texCoord[2];
+// Bounding volumes tested and culled by one of the culling passes.
+struct CullStats {
+	size_t tested = 0;
+	size_t culled = 0;
 };
 
-struct Mesh {
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
-	int textureIndex = -1;
+class ModelEntity;
+
+// Per-instance vertex attributes of instanced mesh draws, in the layout of the instance buffer.
+struct MeshInstance {
+	float model[16];
+	// Center and radius of the sphere morph, and its factor, zero while the morph is off.
+	float morphSphere[4];
+	float morphFactor;
+};
+
+// GL objects that drawing a mesh binds, for the renderer to order draws by. Any of them may be null.
+struct DrawState {
+	const void * program = nullptr;
+	const void * texture = nullptr;
+	const void * vertexArray = nullptr;
+};
+
+// A mesh of an entity that the renderer draws in one call with the same mesh of other entities.
+struct InstancedMesh {
+	ModelEntity * entity = nullptr;
+	// Index into the model's meshes, and the level selected for it.
+	size_t mesh = 0;
+	size_t lod = 0;
+	// The same for every entity drawing this mesh of this model, models found in the asset manager included.
+	const void * key = nullptr;
+	// The same for every entity drawing this mesh at this level, from frame to frame; names their instanced draw.
+	const void * levelKey = nullptr;
+	MeshInstance instance;
 };
 
 class ModelEntity : public Entity
@@ -29,41 +59,204 @@ public:
 	ModelEntity(const std::string & name = "Model");
 	~ModelEntity() override;
 
+	// Synchronous parse and upload; see ModelLoader for the streaming path.
 	bool loadFromGLTF(const QString & filePath);
 
+	// With an asset manager, a model with the same content that is registered already is drawn instead, uploads
+	// included, and otherwise this one is registered under filePath.
+	void setModelData(std::shared_ptr<ModelData> data, const QString & filePath = QString());
+	// Draws the model registered for filePath with the same load options instead of loading it again.
+	// Returns false without an asset manager or when no such model is alive.
+	bool shareModel(const QString & filePath);
+	std::shared_ptr<ModelData> getModelData() const;
+	// Uploads pending textures and meshes until the budget is spent. Returns true once everything is on the GPU.
+	bool uploadPending(float budgetMilliseconds);
+	bool isUploadComplete() const;
+	// Swaps in a new parse of the same file, uploading only the meshes, buffer ranges and textures that diff reports
+	// changed; every entity sharing the model sees the result. Node transforms and animation keep playing from the
+	// first load. Returns false and keeps the current model when diff is not compatible or the upload is incomplete.
+	// GL thread only.
+	bool reloadModelData(std::shared_ptr<ModelData> data, const ModelDiff & diff);
+
+	// New entity drawing meshes [firstMesh, firstMesh + meshCount) of this model. Instances share the model data
+	// and its GPU buffers and textures, which are uploaded once, and follow this entity's morph settings and animation.
+	// node is the ModelData node the instance stands for; a node bound to a skin makes the instance skinned.
+	std::shared_ptr<ModelEntity> createInstance(size_t firstMesh, size_t meshCount, const std::string & name, int node = -1);
+	// Meshes drawn by this entity; setModelData selects all of them.
+	void setMeshRange(size_t firstMesh, size_t meshCount);
+	size_t getFirstMesh() const { return firstMesh_; }
+	size_t getMeshCount() const { return meshCount_; }
+
+	// Registry that models and textures are shared through with other entities, instances included.
+	void setAssetManager(std::shared_ptr<AssetManager> assets) { assets_ = std::move(assets); }
+	std::shared_ptr<AssetManager> getAssetManager() const { return assets_; }
+
+	// Models with skins or animations set afterwards play their first clip through it; without one they stay in the
+	// rest pose.
+	void setAnimationSystem(std::shared_ptr<AnimationSystem> animations) { animationSystem_ = std::move(animations); }
+	std::shared_ptr<AnimationSystem> getAnimationSystem() const { return animationSystem_; }
+	// Playback state of this entity and its instances; null for models without skins or animations.
+	std::shared_ptr<AnimationInstance> getAnimation() const { return animation_; }
+
+	// Textures uploaded afterwards stream their finer levels through it; without one they are fully resident.
+	void setTextureStreamer(std::shared_ptr<TextureStreamer> streamer) { textureStreamer_ = std::move(streamer); }
+	std::shared_ptr<TextureStreamer> getTextureStreamer() const { return textureStreamer_; }
+
+	// Context the uploads bind through and the deleted buffers and textures are dropped from; nothing is uploaded
+	// without one.
+	void setContext(OpenGLContextPtr context) { context_ = std::move(context); }
+	OpenGLContextPtr getContext() const { return context_; }
+
+	void setLoadOptions(const ModelLoadOptions & options) { loadOptions_ = options; }
+	const ModelLoadOptions & getLoadOptions() const { return loadOptions_; }
+	const ModelLoadStats & getLoadStats() const;
+
 	void setShaderProgram(std::shared_ptr<QOpenGLShaderProgram> program);
 
 	void render(Camera * camera, OpenGLContextPtr context) override;
 
-	const std::vector<Mesh> & getMeshes() const { return meshes_; }
-	bool isLoaded() const { return !meshes_.empty(); }
+	const std::vector<Mesh> & getMeshes() const;
 
-	void setMorphToSphere(bool enable) { morphToSphere_ = enable; }
+	// Picks per mesh the coarsest LOD whose error projects to at most thresholdPixels.
+	// projectionScale is the size in pixels of one unit at distance one. Returns the triangles selected.
+	size_t selectLods(const QVector3D & cameraPosition, float projectionScale, float thresholdPixels);
+	// Object-space box around the meshes of the entity. False when there is none, or while skinning, morph targets or
+	// the sphere morph move vertices out of the boxes computed at load time.
+	bool getBoundingBox(BoundingBox & box) const override;
+	// Hides the meshes whose boxes lie outside the frustum of viewProjection; cullClusters and the next render skip
+	// them. Call after selectLods. Returns the triangles culled.
+	size_t cullMeshes(const QMatrix4x4 & viewProjection, CullStats & stats);
+	// Tests the meshlets of the selected LODs against the frustum of viewProjection and their normal cones against
+	// cameraPosition; the next render draws only the survivors. Call after selectLods. Returns the triangles culled.
+	size_t cullClusters(const QMatrix4x4 & viewProjection, const QVector3D & cameraPosition, CullStats & stats);
+	// Asks the texture of every mesh for the resolution at which its nearest point is seen, from the UV density
+	// of the mesh and the same projection as selectLods.
+	void requestTextureResolutions(const QVector3D & cameraPosition, float projectionScale);
+	// True once every mesh in the entity's range is on the GPU; an empty range never is.
+	bool isLoaded() const;
+
+	// State that drawing mesh, an index into the model's meshes, binds.
+	DrawState getDrawState(size_t mesh) const;
+	// The same for entities drawing the same meshes of the same model, for the renderer to count copies by; null
+	// until loaded.
+	const void * getInstanceKey() const;
+	// Appends the visible meshes that differ from the same meshes of other entities only in transform and sphere
+	// morph, those neither skinned, morphed by targets nor cluster culled, for the renderer to draw instanced. The
+	// next render skips them. Call after selectLods and cullMeshes, and in place of cullClusters, whose ranges differ
+	// per entity. Returns the meshes left for render.
+	size_t collectInstancedMeshes(std::vector<InstancedMesh> & meshes);
+	// Draws mesh once per instance, count of them starting offset bytes into instances, with this entity's program.
+	// The instances give the transforms and sphere morphs; the rest comes from the mesh's model.
+	void renderInstances(Camera * camera, OpenGLContextPtr context, const InstancedMesh & mesh, QOpenGLBuffer & instances,
+						 size_t offset, GLsizei count);
+
+	// Weights of the morph targets of this entity's meshes, overriding the defaults of the model. Instances keep
+	// their own; animated weights take precedence. Only targets with a non-zero weight are uploaded and blended,
+	// at most the largest few per draw.
+	void setMorphTargetWeights(std::vector<float> weights) { morphTargetWeights_ = std::move(weights); }
+	const std::vector<float> & getMorphTargetWeights() const { return morphTargetWeights_; }
+
+	void setMorphToSphere(bool enable);
 	bool isMorphingToSphere() const { return morphToSphere_; }
 
-	void setMorphFactor(float factor)
-	{
-		morphFactor_ = qBound(0.0f, factor, 1.0f);
-	}
+	void setMorphFactor(float factor);
 	float getMorphFactor() const { return morphFactor_; }
 
-	void setSphereRadius(float radius) { sphereRadius_ = radius; }
+	void setSphereRadius(float radius);
 	float getSphereRadius() const { return sphereRadius_; }
 
-	void setMorphCenter(const QVector3D & center) { morphCenter_ = center; }
+	void setMorphCenter(const QVector3D & center);
 	QVector3D getMorphCenter() const { return morphCenter_; }
 
 private:
-	void setupMeshBuffers();
+	void startAnimation();
+	// Skin binding that mesh is drawn with, or nullptr for a static mesh.
+	const SkinBinding * getSkinBinding(size_t mesh) const;
+	// Weights that the morph targets of mesh are drawn with, one per target, or nullptr for a mesh without targets.
+	const float * getMorphTargetWeights(size_t mesh) const;
+	// True when skinning or morph targets move the vertices of mesh on the GPU, away from its baked bounds.
+	bool isDeformed(size_t mesh) const;
+	void uploadTexture(size_t index);
 	void cleanupResources();
 
+	template<typename Function>
+	void forEachInstance(Function function);
+
 	std::shared_ptr<QOpenGLShaderProgram> shaderProgram_;
-	std::vector<std::unique_ptr<QOpenGLTexture>> textures_;
-	std::vector<Mesh> meshes_;
 
-	std::vector<std::unique_ptr<QOpenGLBuffer>> vbos_;
-	std::vector<std::unique_ptr<QOpenGLBuffer>> ibos_;
-	std::vector<std::unique_ptr<QOpenGLVertexArrayObject>> vaos_;
+	struct IndexRange {
+		GLsizei count = 0;
+		size_t offset = 0;
+	};
+
+	struct MeshBuffers {
+		std::unique_ptr<QOpenGLVertexArrayObject> vao;
+		std::unique_ptr<QOpenGLBuffer> vbo;
+		std::unique_ptr<QOpenGLBuffer> ibo;
+		GLenum indexType = GL_UNSIGNED_INT;
+		// Level 0 followed by the simplified levels, all in one index buffer.
+		std::vector<IndexRange> lods;
+		QVector3D positionOffset = QVector3D(0.0f, 0.0f, 0.0f);
+		QVector3D positionScale = QVector3D(1.0f, 1.0f, 1.0f);
+		bool octahedralNormals = false;
+		// Joints and weights of skinned meshes, parallel to vbo.
+		std::unique_ptr<QOpenGLBuffer> skinVbo;
+		// Deltas of the morph targets uploaded so far, a position and a normal texel per vertex, each target starting
+		// on a new row. morphOffsets holds the first texel of each target, -1 for those not uploaded yet.
+		std::unique_ptr<QOpenGLTexture> morphDeltas;
+		std::vector<GLint> morphOffsets;
+		int morphRows = 0;
+
+		// Drops the objects from context's shadow before they are deleted.
+		void forget(OpenGLContext & context) const;
+	};
+
+	MeshBuffers uploadMesh(size_t index);
+	// Draw ranges of level 0 and the simplified levels in the index buffer.
+	static std::vector<IndexRange> getLodRanges(const ModelData & data, size_t mesh, size_t indexSize);
+	// Texel offset of the target's deltas in buffers.morphDeltas, uploading them first if needed.
+	GLint uploadMorphTarget(OpenGLContext & context, MeshBuffers & buffers, const Mesh & mesh, size_t target);
+
+	// Everything uploaded for a model, shared by the entity that loaded it, all of its instances and the entities that
+	// found it in the asset manager. Textures are registered there on their own.
+	struct SharedModel {
+		~SharedModel();
+
+		OpenGLContextPtr context;
+		std::shared_ptr<ModelData> data;
+		std::vector<std::shared_ptr<StreamedTexture>> textures;
+		// TextureMipChain::imageHash of each uploaded texture.
+		std::vector<uint64_t> textureHashes;
+		size_t uploadedTextures = 0;
+		std::vector<MeshBuffers> meshBuffers;
+		ModelLoadStats stats;
+	};
+	std::shared_ptr<SharedModel> shared_;
+	size_t firstMesh_ = 0;
+	size_t meshCount_ = 0;
+	std::vector<std::weak_ptr<ModelEntity>> instances_;
+	int node_ = -1;
+	std::vector<float> morphTargetWeights_;
+
+	// Indexed by position in the mesh range.
+	std::vector<size_t> selectedLods_;
+	// Zero for the meshes hidden by cullMeshes; empty when every mesh is drawn.
+	std::vector<uint8_t> visibleMeshes_;
+	// Scratch of cullMeshes: the boxes tested, the positions of their meshes in the range and the results.
+	CullBoxes meshBoxes_;
+	std::vector<size_t> boxedMeshes_;
+	std::vector<uint8_t> boxVisibility_;
+	// Per mesh, the runs of visible clusters left by cullClusters; empty when the whole selected level is drawn.
+	std::vector<std::vector<IndexRange>> visibleRanges_;
+	// One for the meshes collectInstancedMeshes handed to the renderer; empty when render draws them all.
+	std::vector<uint8_t> instancedMeshes_;
+
+	ModelLoadOptions loadOptions_;
+	OpenGLContextPtr context_;
+	std::shared_ptr<TextureStreamer> textureStreamer_;
+	std::shared_ptr<AssetManager> assets_;
+	std::shared_ptr<AnimationSystem> animationSystem_;
+	std::shared_ptr<AnimationInstance> animation_;
 
 	GLint mvpUniform_ = -1;
 	GLint modelUniform_ = -1;
@@ -71,6 +264,16 @@ private:
 	GLint lightPosUniform_ = -1;
 	GLint viewPosUniform_ = -1;
 	GLint lightColorUniform_ = -1;
+	GLint positionOffsetUniform_ = -1;
+	GLint positionScaleUniform_ = -1;
+	GLint octahedralNormalsUniform_ = -1;
+	GLint skinnedUniform_ = -1;
+	GLint jointOffsetUniform_ = -1;
+	GLint morphTargetCountUniform_ = -1;
+	GLint morphTargetOffsetsUniform_ = -1;
+	GLint morphTargetWeightsUniform_ = -1;
+	GLint instancedUniform_ = -1;
+	GLint viewProjectionUniform_ = -1;
 
 	bool morphToSphere_ = false;
 	float morphFactor_ = 0.0f;
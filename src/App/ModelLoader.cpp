@@ -0,0 +1,954 @@
+#include "ModelLoader.h"
+#include "AssetPack.h"
+#include "ContentHash.h"
+#include "MeshCache.h"
+#include "ModelEntity.h"
+#include "ProcessStats.h"
+#include "SceneGraph.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QVector3D>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+ModelLoader::ModelLoader(size_t threadCount)
+	: pool_(threadCount)
+{
+	clock_.start();
+}
+
+namespace
+{
+// Exporters write a file in several steps; a reload waits until it has been left alone this long.
+constexpr qint64 g_reloadSettleMilliseconds = 300;
+
+struct DecodedImage {
+	QImage image;
+	double milliseconds = 0.0;
+};
+
+std::vector<QImage> decodeTextures(const GltfSource & source, ModelLoadStats & stats)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	const auto & model = source.getModel();
+
+	// Each referenced image is decoded once on the shared pool; textures sharing an image share the QImage.
+	std::vector<std::future<DecodedImage>> decodes(source.getImageCount());
+	for (const auto & texture: model.textures)
+	{
+		if (texture.source < 0 || static_cast<size_t>(texture.source) >= decodes.size() || decodes[texture.source].valid())
+			continue;
+
+		decodes[texture.source] = ThreadPool::global().submit([&source, image = texture.source] {
+			QElapsedTimer imageTimer;
+			imageTimer.start();
+
+			DecodedImage decoded;
+			decoded.image = source.decodeImage(image).convertToFormat(QImage::Format_RGBA8888);
+			decoded.milliseconds = static_cast<double>(imageTimer.nsecsElapsed()) / 1.0e6;
+			return decoded;
+		});
+	}
+
+	std::vector<QImage> images(decodes.size());
+	for (size_t i = 0; i < decodes.size(); ++i)
+	{
+		if (!decodes[i].valid())
+			continue;
+
+		auto decoded = decodes[i].get();
+
+		ImageDecodeStats imageStats;
+		imageStats.image = static_cast<int>(i);
+		imageStats.width = decoded.image.width();
+		imageStats.height = decoded.image.height();
+		imageStats.milliseconds = decoded.milliseconds;
+		stats.imageDecodes.push_back(imageStats);
+
+		qInfo().nospace() << "Decoded image " << i << " (" << imageStats.width << "x" << imageStats.height << ") in "
+						  << imageStats.milliseconds << " ms";
+
+		images[i] = std::move(decoded.image);
+	}
+
+	std::vector<QImage> textures;
+	textures.reserve(model.textures.size());
+	for (const auto & texture: model.textures)
+	{
+		const bool valid = texture.source >= 0 && static_cast<size_t>(texture.source) < images.size();
+		textures.push_back(valid ? images[texture.source] : QImage());
+	}
+
+	stats.imageDecodeMilliseconds = static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+	return textures;
+}
+
+void getLocalTransform(const tinygltf::Node & node, float * transform)
+{
+	if (node.matrix.size() == 16)
+	{
+		std::copy(node.matrix.begin(), node.matrix.end(), transform);
+		return;
+	}
+
+	QMatrix4x4 matrix;
+	if (node.translation.size() == 3)
+		matrix.translate(static_cast<float>(node.translation[0]), static_cast<float>(node.translation[1]), static_cast<float>(node.translation[2]));
+	if (node.rotation.size() == 4)
+		matrix.rotate(QQuaternion(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+								  static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2])));
+	if (node.scale.size() == 3)
+		matrix.scale(static_cast<float>(node.scale[0]), static_cast<float>(node.scale[1]), static_cast<float>(node.scale[2]));
+	std::copy(matrix.constData(), matrix.constData() + 16, transform);
+}
+
+// Flattens the node tree of the default scene depth-first, so parents always precede their children.
+// nodeMap receives the index in the result of every glTF node, -1 for nodes outside the scene.
+std::vector<ModelNode> collectNodes(const tinygltf::Model & model, std::vector<int> & nodeMap)
+{
+	std::vector<int> roots;
+	const int scene = model.defaultScene >= 0 ? model.defaultScene : 0;
+	if (scene < static_cast<int>(model.scenes.size()))
+	{
+		roots = model.scenes[scene].nodes;
+	}
+	else
+	{
+		std::vector<bool> isChild(model.nodes.size(), false);
+		for (const auto & node: model.nodes)
+		{
+			for (const int child: node.children)
+			{
+				if (child >= 0 && child < static_cast<int>(isChild.size()))
+					isChild[child] = true;
+			}
+		}
+		for (size_t i = 0; i < model.nodes.size(); ++i)
+		{
+			if (!isChild[i])
+				roots.push_back(static_cast<int>(i));
+		}
+	}
+
+	std::vector<ModelNode> nodes;
+	// A malformed file may reference a node twice; each glTF node is emitted at most once.
+	nodeMap.assign(model.nodes.size(), -1);
+	std::vector<std::pair<int, int>> stack;
+	for (auto it = roots.rbegin(); it != roots.rend(); ++it)
+	{
+		stack.emplace_back(*it, -1);
+	}
+	while (!stack.empty())
+	{
+		const auto [index, parent] = stack.back();
+		stack.pop_back();
+		if (index < 0 || index >= static_cast<int>(model.nodes.size()) || nodeMap[index] >= 0)
+			continue;
+
+		const auto & source = model.nodes[index];
+		ModelNode node;
+		node.name = source.name;
+		node.parent = parent;
+		node.mesh = source.mesh >= 0 && source.mesh < static_cast<int>(model.meshes.size()) ? source.mesh : -1;
+		node.weights.assign(source.weights.begin(), source.weights.end());
+		getLocalTransform(source, node.transform);
+
+		const auto self = static_cast<int>(nodes.size());
+		nodeMap[index] = self;
+		nodes.push_back(std::move(node));
+		for (auto child = source.children.rbegin(); child != source.children.rend(); ++child)
+		{
+			stack.emplace_back(*child, self);
+		}
+	}
+	return nodes;
+}
+
+// Deltas of one entry of primitive.targets, keeping only the vertices it moves.
+bool readMorphTarget(const GltfSource & source, const std::map<std::string, int> & attributes, size_t vertexCount, MorphTarget & target)
+{
+	std::vector<float> positions;
+	std::vector<float> normals;
+	const auto position = attributes.find("POSITION");
+	const auto normal = attributes.find("NORMAL");
+	if ((position != attributes.end() && (!source.readAccessor(position->second, 3, positions) || positions.size() != vertexCount * 3))
+		|| (normal != attributes.end() && (!source.readAccessor(normal->second, 3, normals) || normals.size() != vertexCount * 3)))
+	{
+		return false;
+	}
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		MorphDelta delta = {};
+		bool moved = false;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			delta.position[i] = positions.empty() ? 0.0f : positions[v * 3 + i];
+			delta.normal[i] = normals.empty() ? 0.0f : normals[v * 3 + i];
+			moved = moved || delta.position[i] != 0.0f || delta.normal[i] != 0.0f;
+		}
+		if (moved)
+		{
+			target.vertices.push_back(static_cast<uint32_t>(v));
+			target.deltas.push_back(delta);
+		}
+	}
+	return true;
+}
+
+// Reads JOINTS_0 and WEIGHTS_0, normalizing the weights to sum to one in 16-bit unorm. Weights that do not add
+// up to anything leave the vertex bound to its first joint.
+bool readSkinVertices(const AccessorView & joints, const AccessorView & weights, std::vector<SkinVertex> & skinVertices)
+{
+	if (!joints.data || !weights.data || joints.count != weights.count || joints.components != 4 || weights.components != 4)
+		return false;
+
+	std::vector<float> jointValues(joints.count * 4);
+	std::vector<float> weightValues(weights.count * 4);
+	if (!convertToFloat(joints, jointValues.data(), sizeof(float) * 4)
+		|| !convertToFloat(weights, weightValues.data(), sizeof(float) * 4))
+	{
+		return false;
+	}
+
+	skinVertices.resize(joints.count);
+	for (size_t v = 0; v < skinVertices.size(); ++v)
+	{
+		const float * weight = weightValues.data() + v * 4;
+		const float sum = std::max(weight[0], 0.0f) + std::max(weight[1], 0.0f) + std::max(weight[2], 0.0f) + std::max(weight[3], 0.0f);
+
+		auto & skin = skinVertices[v];
+		uint32_t total = 0;
+		int heaviest = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			skin.joints[i] = static_cast<uint16_t>(std::clamp(jointValues[v * 4 + i], 0.0f, 65535.0f));
+			const float normalized = sum > 0.0f ? std::max(weight[i], 0.0f) / sum : (i == 0 ? 1.0f : 0.0f);
+			skin.weights[i] = static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+			total += skin.weights[i];
+			if (skin.weights[i] > skin.weights[heaviest])
+				heaviest = i;
+		}
+		// Rounding error goes to the heaviest joint, so that the weights add up to exactly one.
+		skin.weights[heaviest] = static_cast<uint16_t>(static_cast<int>(skin.weights[heaviest]) + 65535 - static_cast<int>(total));
+	}
+	return true;
+}
+
+void getRestTransform(const tinygltf::Node & node, NodeTransform & transform)
+{
+	for (size_t i = 0; i < node.translation.size() && i < 3; ++i)
+	{
+		transform.translation[i] = static_cast<float>(node.translation[i]);
+	}
+	for (size_t i = 0; i < node.rotation.size() && i < 4; ++i)
+	{
+		transform.rotation[i] = static_cast<float>(node.rotation[i]);
+	}
+	for (size_t i = 0; i < node.scale.size() && i < 3; ++i)
+	{
+		transform.scale[i] = static_cast<float>(node.scale[i]);
+	}
+}
+
+// weightCount is the number of morph targets for weights channels and ignored otherwise.
+bool readAnimationChannel(const GltfSource & source, const tinygltf::AnimationSampler & sampler, size_t weightCount,
+						  AnimationChannel & channel)
+{
+	if (sampler.interpolation == "STEP")
+		channel.interpolation = AnimationInterpolation::Step;
+	else if (sampler.interpolation == "CUBICSPLINE")
+		channel.interpolation = AnimationInterpolation::CubicSpline;
+	else
+		channel.interpolation = AnimationInterpolation::Linear;
+
+	if (!source.readAccessor(sampler.input, 1, channel.times) || channel.times.empty()
+		|| !std::is_sorted(channel.times.begin(), channel.times.end()))
+	{
+		return false;
+	}
+	const size_t values = channel.times.size() * (channel.interpolation == AnimationInterpolation::CubicSpline ? 3 : 1);
+
+	// Transform values are padded to four floats; rotations come as four components already.
+	if (channel.path != AnimationPath::Weights)
+		return source.readAccessor(sampler.output, 4, channel.values) && channel.values.size() == values * 4;
+
+	// Weights come as weightCount scalars per value.
+	std::vector<float> weights;
+	if (weightCount == 0 || !source.readAccessor(sampler.output, 1, weights) || weights.size() != values * weightCount)
+		return false;
+
+	channel.width = static_cast<uint32_t>((weightCount + 3) / 4 * 4);
+	channel.values.assign(values * channel.width, 0.0f);
+	for (size_t value = 0; value < values; ++value)
+	{
+		std::copy_n(weights.begin() + static_cast<std::ptrdiff_t>(value * weightCount), weightCount,
+					channel.values.begin() + static_cast<std::ptrdiff_t>(value * channel.width));
+	}
+	return true;
+}
+
+// Skins, clips and the rest pose of the scene nodes, or nullptr for models with neither skins nor animations.
+// Expects the meshes and nodes of data.
+std::shared_ptr<AnimationRig> buildAnimationRig(const GltfSource & source, const ModelData & data, const std::vector<int> & nodeMap)
+{
+	const auto & model = source.getModel();
+	const auto & nodes = data.nodes;
+	if (nodes.empty() || (model.skins.empty() && model.animations.empty()))
+		return nullptr;
+
+	auto rig = std::make_shared<AnimationRig>();
+	rig->parents.resize(nodes.size());
+	rig->restPose.resize(nodes.size());
+	rig->restMatrices.resize(nodes.size());
+	rig->animated.assign(nodes.size(), 0);
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		rig->parents[i] = nodes[i].parent;
+		std::copy(std::begin(nodes[i].transform), std::end(nodes[i].transform), rig->restMatrices[i].m);
+	}
+	for (size_t gltfNode = 0; gltfNode < nodeMap.size(); ++gltfNode)
+	{
+		if (nodeMap[gltfNode] >= 0)
+			getRestTransform(model.nodes[gltfNode], rig->restPose[nodeMap[gltfNode]]);
+	}
+
+	// Every primitive of a glTF mesh has the same targets, so the first one stands for the mesh.
+	rig->weightOffsets.assign(nodes.size(), ~0u);
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const int mesh = nodes[i].mesh;
+		if (mesh < 0 || data.meshRanges[mesh] == data.meshRanges[mesh + 1] || data.meshes[data.meshRanges[mesh]].morphTargets.empty())
+			continue;
+
+		const auto & weights = nodes[i].weights.empty() ? data.meshes[data.meshRanges[mesh]].morphWeights : nodes[i].weights;
+		rig->weightOffsets[i] = static_cast<uint32_t>(rig->restWeights.size());
+		rig->restWeights.insert(rig->restWeights.end(), weights.begin(), weights.end());
+		rig->restWeights.resize((rig->restWeights.size() + 3) / 4 * 4, 0.0f);
+	}
+
+	for (const auto & gltfSkin: model.skins)
+	{
+		ModelSkin skin;
+		skin.joints.reserve(gltfSkin.joints.size());
+		for (const int joint: gltfSkin.joints)
+		{
+			skin.joints.push_back(joint >= 0 && joint < static_cast<int>(nodeMap.size()) ? nodeMap[joint] : -1);
+		}
+
+		// Matrices are read column by column, since the accessor kernels convert up to four components.
+		skin.inverseBindMatrices.resize(skin.joints.size());
+		auto matrices = source.getAccessorView(gltfSkin.inverseBindMatrices);
+		if (matrices.data && matrices.components == 16 && matrices.count >= skin.joints.size())
+		{
+			matrices.count = skin.joints.size();
+			matrices.components = 4;
+			for (size_t column = 0; column < 4; ++column)
+			{
+				AccessorView view = matrices;
+				view.data += column * 4 * sizeof(float);
+				convertToFloat(view, skin.inverseBindMatrices.front().m + column * 4, sizeof(JointMatrix));
+			}
+		}
+		rig->skins.push_back(std::move(skin));
+	}
+
+	for (size_t gltfNode = 0; gltfNode < nodeMap.size(); ++gltfNode)
+	{
+		const int skin = model.nodes[gltfNode].skin;
+		if (nodeMap[gltfNode] < 0 || nodes[nodeMap[gltfNode]].mesh < 0 || skin < 0 || skin >= static_cast<int>(rig->skins.size()))
+			continue;
+
+		rig->bindings.push_back({nodeMap[gltfNode], skin, static_cast<uint32_t>(rig->paletteSize)});
+		rig->paletteSize += rig->skins[skin].joints.size();
+	}
+
+	for (const auto & animation: model.animations)
+	{
+		AnimationClip clip;
+		clip.name = animation.name;
+		for (const auto & gltfChannel: animation.channels)
+		{
+			const int node = gltfChannel.target_node >= 0 && gltfChannel.target_node < static_cast<int>(nodeMap.size())
+								 ? nodeMap[gltfChannel.target_node]
+								 : -1;
+			if (node < 0 || gltfChannel.sampler < 0 || gltfChannel.sampler >= static_cast<int>(animation.samplers.size()))
+				continue;
+
+			AnimationChannel channel;
+			channel.node = node;
+			if (gltfChannel.target_path == "translation")
+				channel.path = AnimationPath::Translation;
+			else if (gltfChannel.target_path == "rotation")
+				channel.path = AnimationPath::Rotation;
+			else if (gltfChannel.target_path == "scale")
+				channel.path = AnimationPath::Scale;
+			else if (gltfChannel.target_path == "weights" && rig->weightOffsets[node] != ~0u)
+				channel.path = AnimationPath::Weights;
+			else
+				continue;
+
+			const size_t weightCount =
+				channel.path == AnimationPath::Weights ? data.meshes[data.meshRanges[nodes[node].mesh]].morphTargets.size() : 0;
+			if (!readAnimationChannel(source, animation.samplers[gltfChannel.sampler], weightCount, channel))
+				continue;
+
+			// Weights leave the node matrix alone.
+			if (channel.path != AnimationPath::Weights)
+				rig->animated[node] = 1;
+			clip.duration = std::max(clip.duration, channel.times.back());
+			clip.channels.push_back(std::move(channel));
+		}
+		rig->clips.push_back(std::move(clip));
+	}
+
+	size_t channels = 0;
+	for (const auto & clip: rig->clips)
+	{
+		channels += clip.channels.size();
+	}
+	qInfo().nospace() << "Read " << rig->skins.size() << " skins with " << rig->paletteSize << " joint matrices and "
+					  << rig->clips.size() << " animations with " << channels << " channels";
+	return rig;
+}
+
+// Square root of the ratio between the UV and object-space areas of all triangles.
+float computeUvScale(const Mesh & mesh)
+{
+	double uvArea = 0.0;
+	double area = 0.0;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		if (std::max({mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]}) >= mesh.vertices.size())
+			continue;
+
+		const Vertex & a = mesh.vertices[mesh.indices[i]];
+		const Vertex & b = mesh.vertices[mesh.indices[i + 1]];
+		const Vertex & c = mesh.vertices[mesh.indices[i + 2]];
+		const QVector3D edge1(b.position[0] - a.position[0], b.position[1] - a.position[1], b.position[2] - a.position[2]);
+		const QVector3D edge2(c.position[0] - a.position[0], c.position[1] - a.position[1], c.position[2] - a.position[2]);
+		area += QVector3D::crossProduct(edge1, edge2).length();
+		uvArea += std::abs((b.texCoord[0] - a.texCoord[0]) * (c.texCoord[1] - a.texCoord[1])
+						   - (b.texCoord[1] - a.texCoord[1]) * (c.texCoord[0] - a.texCoord[0]));
+	}
+	return area > 0.0 && uvArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / area)) : 0.0f;
+}
+
+void processMeshes(ModelData & data, const ModelLoadOptions & options)
+{
+	auto & meshes = data.meshes;
+	auto & stats = data.stats;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	std::vector<size_t> welded(meshes.size(), 0);
+	std::vector<VertexCacheStats> before(meshes.size());
+	std::vector<VertexCacheStats> after(meshes.size());
+	data.packedVertices.resize(meshes.size());
+
+	std::vector<std::future<void>> jobs;
+	jobs.reserve(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		jobs.push_back(ThreadPool::global().submit([&data, &options, &welded, &before, &after, i] {
+			auto & mesh = data.meshes[i];
+			if (options.weldVertices)
+				welded[i] = weldVertices(mesh, options.weldTolerance);
+			if (options.optimizeMeshes)
+				optimizeMesh(mesh, &before[i], &after[i]);
+			mesh.uvScale = computeUvScale(mesh);
+			generateLods(mesh, options.lod);
+			if (options.buildMeshlets)
+				buildMeshlets(mesh, options.meshlets);
+			data.packedVertices[i] = packVertices(mesh.vertices, options.vertexFormat);
+		}));
+	}
+	for (auto & job: jobs)
+	{
+		job.get();
+	}
+
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		stats.weldedVertices += welded[i];
+		stats.vertexCacheBefore += before[i];
+		stats.vertexCacheAfter += after[i];
+		stats.floatVertexBytes += meshes[i].vertices.size() * sizeof(Vertex);
+		stats.lodLevels += meshes[i].lods.size();
+		stats.meshlets += meshes[i].meshlets.size();
+	}
+	stats.vertexFormat = options.vertexFormat;
+	stats.optimizeMilliseconds = static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+
+	auto log = qInfo().nospace();
+	log << "Processed " << meshes.size() << " meshes (" << getVertexFormatName(options.vertexFormat) << ") in "
+		<< stats.optimizeMilliseconds << " ms";
+	if (options.weldVertices)
+		log << ", welded " << stats.weldedVertices << " vertices";
+	if (options.optimizeMeshes)
+		log << ", ACMR " << stats.vertexCacheBefore.getAcmr() << " -> " << stats.vertexCacheAfter.getAcmr() << ", ATVR "
+			<< stats.vertexCacheBefore.getAtvr() << " -> " << stats.vertexCacheAfter.getAtvr();
+	if (options.lod.levels > 0)
+		log << ", " << stats.lodLevels << " LOD levels";
+	if (options.buildMeshlets)
+		log << ", " << stats.meshlets << " meshlets";
+}
+
+// Runs on the loader thread, so the encoder may wait on the global pool. Textures sharing one image build it once.
+void buildTextureMipChains(ModelData & data, const TextureCompressionOptions & options)
+{
+	auto & stats = data.stats.textureCompression;
+	data.textureMipChains.resize(data.textures.size());
+	std::unordered_map<qint64, size_t> built;
+	for (size_t i = 0; i < data.textures.size(); ++i)
+	{
+		const QImage & image = data.textures[i];
+		const auto [it, inserted] = built.emplace(image.cacheKey(), i);
+		if (!inserted)
+		{
+			data.textureMipChains[i] = data.textureMipChains[it->second];
+			continue;
+		}
+		data.textureMipChains[i] = buildMipChain(image, chooseBlockFormat(image, options), true, options.useCache, &stats);
+	}
+
+	if (stats.textures > 0)
+	{
+		qInfo().nospace() << "Compressed " << stats.textures << " textures in " << stats.milliseconds << " ms ("
+						  << stats.cacheHits << " cached): " << stats.rgbaBytes / 1024 << " KiB as RGBA8 -> "
+						  << stats.compressedBytes / 1024 << " KiB";
+	}
+}
+}// namespace
+
+std::shared_ptr<ModelData> ModelLoader::parse(const QString & filePath, const ModelLoadOptions & options)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	const size_t peakResidentBytesBefore = getPeakResidentBytes();
+
+	QString cachePath;
+	uint64_t sourceHash = 0;
+	const uint64_t optionsHash = hashModelLoadOptions(options);
+	const bool hashed = GltfSource::hashSourceFiles(filePath, sourceHash);
+	const uint64_t contentHash = hashed ? hashCombine(sourceHash, optionsHash) : 0;
+	if (options.useMeshCache && hashed)
+	{
+		cachePath = getMeshCachePath(filePath);
+		if (auto cached = loadMeshCache(cachePath, sourceHash, optionsHash))
+		{
+			cached->contentHash = contentHash;
+			cached->sourceHash = sourceHash;
+			cached->stats.fromMeshCache = true;
+			cached->stats.parseMilliseconds = static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+			cached->stats.peakResidentBytesBefore = peakResidentBytesBefore;
+			buildTextureMipChains(*cached, options.textureCompression);
+			cached->stats.peakResidentBytesAfter = getPeakResidentBytes();
+			return cached;
+		}
+	}
+
+	auto data = std::make_shared<ModelData>();
+	data->contentHash = contentHash;
+	data->sourceHash = hashed ? sourceHash : 0;
+	data->stats.peakResidentBytesBefore = peakResidentBytesBefore;
+
+	GltfSource source;
+	if (!source.open(filePath, options.memoryMapped ? GltfSource::Mode::MemoryMapped : GltfSource::Mode::ReadAll))
+	{
+		qWarning() << "Failed to load" << filePath << ":" << QString::fromStdString(source.getError());
+		return nullptr;
+	}
+
+	const auto & model = source.getModel();
+
+	data->textures = decodeTextures(source, data->stats);
+
+	data->meshRanges.reserve(model.meshes.size() + 1);
+	for (const auto & mesh: model.meshes)
+	{
+		data->meshRanges.push_back(static_cast<uint32_t>(data->meshes.size()));
+		for (const auto & primitive: mesh.primitives)
+		{
+			Mesh meshData;
+
+			const auto attribute = [&primitive](const char * name) {
+				const auto it = primitive.attributes.find(name);
+				return it != primitive.attributes.end() ? it->second : -1;
+			};
+
+			auto positions = source.getAccessorView(attribute("POSITION"));
+			if (!positions.data)
+				continue;
+
+			auto normals = source.getAccessorView(attribute("NORMAL"));
+			auto texCoords = source.getAccessorView(attribute("TEXCOORD_0"));
+			positions.components = std::min(positions.components, 3);
+			normals.components = std::min(normals.components, 3);
+			texCoords.components = std::min(texCoords.components, 2);
+
+			const InterleaveStream streams[] = {
+				{positions, offsetof(Vertex, position)},
+				{normals, offsetof(Vertex, normal)},
+				{texCoords, offsetof(Vertex, texCoord)}};
+
+			meshData.vertices.resize(positions.count);
+			convertInterleaved(streams, std::size(streams), reinterpret_cast<uint8_t *>(meshData.vertices.data()),
+							   sizeof(Vertex), meshData.vertices.size());
+
+			const auto joints = source.getAccessorView(attribute("JOINTS_0"));
+			const auto weights = source.getAccessorView(attribute("WEIGHTS_0"));
+			if (joints.data && (weights.count != positions.count || !readSkinVertices(joints, weights, meshData.skinVertices)))
+			{
+				qWarning() << "Ignoring unsupported skin attributes in" << filePath;
+				meshData.skinVertices.clear();
+			}
+
+			meshData.morphTargets.resize(primitive.targets.size());
+			for (size_t target = 0; target < primitive.targets.size(); ++target)
+			{
+				if (!readMorphTarget(source, primitive.targets[target], positions.count, meshData.morphTargets[target]))
+				{
+					qWarning() << "Ignoring unreadable morph target" << target << "in" << filePath;
+					meshData.morphTargets[target] = MorphTarget();
+				}
+			}
+			meshData.morphWeights.assign(meshData.morphTargets.size(), 0.0f);
+			for (size_t target = 0; target < meshData.morphWeights.size() && target < mesh.weights.size(); ++target)
+			{
+				meshData.morphWeights[target] = static_cast<float>(mesh.weights[target]);
+			}
+
+			const auto indices = source.getAccessorView(primitive.indices);
+			meshData.indices.resize(indices.count);
+			if (indices.data && !convertIndices(indices, meshData.indices.data()))
+			{
+				meshData.indices.clear();
+			}
+
+			if (primitive.material >= 0 && primitive.material < static_cast<int>(model.materials.size()))
+			{
+				const auto & material = model.materials[primitive.material];
+				if (material.pbrMetallicRoughness.baseColorTexture.index >= 0)
+				{
+					meshData.textureIndex = material.pbrMetallicRoughness.baseColorTexture.index;
+				}
+			}
+
+			data->meshes.push_back(std::move(meshData));
+		}
+	}
+	data->meshRanges.push_back(static_cast<uint32_t>(data->meshes.size()));
+	std::vector<int> nodeMap;
+	data->nodes = collectNodes(model, nodeMap);
+	data->animation = buildAnimationRig(source, *data, nodeMap);
+
+	processMeshes(*data, options);
+
+	data->stats.memoryMapped = source.isMapped();
+	data->stats.fileBytes = source.getFileSize();
+	data->stats.parseMilliseconds = static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+
+	// The cache holds no skins, morph targets or animations, so such models are always parsed.
+	const bool deforms = data->animation
+						 || std::any_of(data->meshes.begin(), data->meshes.end(), [](const Mesh & mesh) { return !mesh.morphTargets.empty(); });
+	if (!cachePath.isEmpty() && !deforms && !storeMeshCache(cachePath, *data, sourceHash, optionsHash))
+	{
+		qWarning() << "Failed to write mesh cache" << cachePath;
+	}
+
+	buildTextureMipChains(*data, options.textureCompression);
+	data->stats.peakResidentBytesAfter = getPeakResidentBytes();
+
+	return data;
+}
+
+size_t ModelLoader::instantiateNodes(const std::shared_ptr<ModelEntity> & model, SceneNode & parent)
+{
+	const auto data = model->getModelData();
+	if (!data || data->nodes.empty())
+		return 0;
+
+	std::vector<std::shared_ptr<SceneNode>> created;
+	created.reserve(data->nodes.size());
+	std::vector<bool> meshUsed(data->meshRanges.empty() ? 0 : data->meshRanges.size() - 1, false);
+	size_t instances = 0;
+	const auto animation = model->getAnimation();
+	const auto animations = model->getAnimationSystem();
+	for (size_t i = 0; i < data->nodes.size(); ++i)
+	{
+		const auto & node = data->nodes[i];
+		const std::string name = node.name.empty() ? model->getName() + "#" + std::to_string(i) : node.name;
+
+		// glTF matrices are column-major, like QMatrix4x4 storage.
+		QMatrix4x4 transform;
+		std::copy(std::begin(node.transform), std::end(node.transform), transform.data());
+
+		auto sceneNode = std::make_shared<SceneNode>(name);
+		sceneNode->setTransform(transform);
+		if (node.mesh >= 0)
+		{
+			const uint32_t first = data->meshRanges[node.mesh];
+			auto instance = model->createInstance(first, data->meshRanges[node.mesh + 1] - first, name, static_cast<int>(i));
+			if (!node.weights.empty())
+				instance->setMorphTargetWeights(node.weights);
+			sceneNode->setEntity(std::move(instance));
+			meshUsed[node.mesh] = true;
+			++instances;
+		}
+
+		// Animated nodes follow the model's playback from the next update on.
+		if (animation && animations)
+			animations->bindSceneNode(animation, static_cast<int>(i), sceneNode);
+
+		(node.parent >= 0 ? *created[node.parent] : parent).addChild(sceneNode);
+		created.push_back(std::move(sceneNode));
+	}
+	model->setMeshRange(0, 0);
+	// Resolve the world transforms right away so that the new instances never draw with a stale one.
+	parent.update(0.0f);
+
+	qInfo().nospace() << "Instantiated " << QString::fromStdString(model->getName()) << ": " << created.size() << " nodes, "
+					  << instances << " mesh instances of " << std::count(meshUsed.begin(), meshUsed.end(), true) << " meshes";
+	return created.size();
+}
+
+auto ModelLoader::request(std::shared_ptr<ModelEntity> entity, const QString & filePath, std::shared_ptr<SceneNode> node) -> Handle
+{
+	const auto options = entity->getLoadOptions();
+
+	// A model registered already is shared right away.
+	if (entity->shareModel(filePath))
+	{
+		std::promise<std::shared_ptr<ModelData>> ready;
+		ready.set_value(entity->getModelData());
+		if (node)
+			instantiateNodes(entity, *node);
+		watch(entity, filePath);
+		return ready.get_future().share();
+	}
+
+	Request request;
+	request.entity = entity;
+	request.node = node;
+	request.filePath = filePath;
+	request.optionsHash = hashModelLoadOptions(options);
+
+	// Requests for a model still in flight wait for the same parse; only entities with an asset manager can,
+	// since they share the upload through it as well.
+	if (entity->getAssetManager())
+	{
+		for (const auto & pending: requests_)
+		{
+			if (pending.filePath == filePath && pending.optionsHash == request.optionsHash)
+			{
+				request.result = pending.result;
+				break;
+			}
+		}
+	}
+	if (!request.result.valid())
+		request.result = pool_.submit([filePath, options] { return parse(filePath, options); }).share();
+
+	requests_.push_back(request);
+	return request.result;
+}
+
+void ModelLoader::processUploads(float budgetMilliseconds)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	if (watcher_)
+		processReloads();
+
+	for (auto it = requests_.begin(); it != requests_.end();)
+	{
+		auto entity = it->entity.lock();
+		if (!entity)
+		{
+			it = requests_.erase(it);
+			continue;
+		}
+
+		if (!it->uploading)
+		{
+			if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++it;
+				continue;
+			}
+
+			auto data = it->result.get();
+			if (!data)
+			{
+				it = requests_.erase(it);
+				continue;
+			}
+
+			if (!entity->shareModel(it->filePath))
+				entity->setModelData(data, it->filePath);
+			if (auto node = it->node.lock())
+				instantiateNodes(entity, *node);
+			it->uploading = true;
+		}
+
+		const float remaining = budgetMilliseconds - static_cast<float>(timer.nsecsElapsed()) / 1.0e6f;
+		if (remaining <= 0.0f)
+			return;
+
+		if (!entity->uploadPending(remaining))
+			return;
+
+		watch(entity, it->filePath);
+		it = requests_.erase(it);
+	}
+}
+
+void ModelLoader::setHotReload(bool enable)
+{
+	if (enable == isHotReloadEnabled())
+		return;
+
+	if (!enable)
+	{
+		watcher_.reset();
+		return;
+	}
+
+	watcher_ = std::make_unique<QFileSystemWatcher>();
+	QObject::connect(watcher_.get(), &QFileSystemWatcher::fileChanged, [this](const QString & path) { onFileChanged(path); });
+	for (const auto & model: watched_)
+	{
+		if (!model.watchedPath.isEmpty() && !watcher_->files().contains(model.watchedPath))
+			watcher_->addPath(model.watchedPath);
+	}
+}
+
+void ModelLoader::watch(const std::shared_ptr<ModelEntity> & entity, const QString & filePath)
+{
+	const auto data = entity->getModelData();
+	if (!data || data->sourceHash == 0)
+		return;
+
+	const uint64_t optionsHash = hashModelLoadOptions(entity->getLoadOptions());
+	const auto it = std::find_if(watched_.begin(), watched_.end(), [&filePath, optionsHash](const WatchedModel & model) {
+		return model.filePath == filePath && model.optionsHash == optionsHash;
+	});
+	if (it != watched_.end())
+	{
+		it->entities.push_back(entity);
+		return;
+	}
+
+	WatchedModel model;
+	model.filePath = filePath;
+	model.options = entity->getLoadOptions();
+	model.optionsHash = optionsHash;
+	model.sourceHash = data->sourceHash;
+	model.entities.push_back(entity);
+
+	// A pack entry changes with the whole pack.
+	const AssetPack * pack = nullptr;
+	const AssetPack::Entry * entry = nullptr;
+	if (findPackEntry(filePath, pack, entry))
+		model.watchedPath = pack->getFilePath();
+	else if (!filePath.startsWith(":/"))
+		model.watchedPath = QFileInfo(filePath).absoluteFilePath();
+
+	if (watcher_ && !model.watchedPath.isEmpty() && !watcher_->files().contains(model.watchedPath))
+		watcher_->addPath(model.watchedPath);
+	watched_.push_back(std::move(model));
+}
+
+void ModelLoader::onFileChanged(const QString & path)
+{
+	for (auto & model: watched_)
+	{
+		if (model.watchedPath == path)
+			model.changedAt = clock_.elapsed();
+	}
+}
+
+void ModelLoader::processReloads()
+{
+	std::vector<QString> remounted;
+	for (auto it = watched_.begin(); it != watched_.end();)
+	{
+		auto & model = *it;
+		model.entities.erase(std::remove_if(model.entities.begin(), model.entities.end(), [](const auto & entity) { return entity.expired(); }),
+							 model.entities.end());
+		if (model.entities.empty())
+		{
+			it = watched_.erase(it);
+			continue;
+		}
+
+		if (model.reload.valid())
+		{
+			if (model.reload.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			{
+				const Reload reload = model.reload.get();
+				model.reload = {};
+				if (reload.data)
+				{
+					model.sourceHash = reload.sourceHash;
+					bool applied = true;
+					for (const auto & weakEntity: model.entities)
+					{
+						if (auto entity = weakEntity.lock())
+							applied = entity->reloadModelData(reload.data, reload.diff) && applied;
+					}
+					if (!applied)
+						qWarning() << "Cannot reload" << model.filePath << "in place; its node tree or rig changed";
+				}
+			}
+		}
+		else if (model.changedAt >= 0 && clock_.elapsed() - model.changedAt >= g_reloadSettleMilliseconds)
+		{
+			model.changedAt = -1;
+			// Files replaced through a rename drop out of the watcher.
+			if (!watcher_->files().contains(model.watchedPath))
+				watcher_->addPath(model.watchedPath);
+
+			// The rebuilt pack is mapped again and shadows the old mapping; a pack still being written fails to mount
+			// and waits for the next change.
+			bool mounted = !isPackPath(model.filePath) || std::find(remounted.begin(), remounted.end(), model.watchedPath) != remounted.end();
+			if (!mounted && mountAssetPack(model.watchedPath))
+			{
+				remounted.push_back(model.watchedPath);
+				mounted = true;
+			}
+
+			if (mounted)
+			{
+				auto previous = model.entities.front().lock()->getModelData();
+				model.reload = pool_.submit([filePath = model.filePath, options = model.options, sourceHash = model.sourceHash, previous] {
+					Reload reload;
+					// Saved again without changes, or another entry of the same pack changed.
+					if (!GltfSource::hashSourceFiles(filePath, reload.sourceHash) || reload.sourceHash == sourceHash)
+						return reload;
+					reload.data = parse(filePath, options);
+					if (reload.data && previous)
+						reload.diff = diffModelData(*previous, *reload.data);
+					return reload;
+				}).share();
+			}
+		}
+		++it;
+	}
+}
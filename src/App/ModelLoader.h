@@ -0,0 +1,91 @@
+#pragma once
+
+#include "GltfSource.h"
+#include "ModelData.h"
+#include "ModelDiff.h"
+#include "ThreadPool.h"
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QString>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+class ModelEntity;
+class SceneNode;
+
+// Parses models on worker threads and streams their GL upload in per-frame slices.
+class ModelLoader
+{
+public:
+	using Handle = std::shared_future<std::shared_ptr<ModelData>>;
+
+	explicit ModelLoader(size_t threadCount = 2);
+	~ModelLoader() = default;
+
+	// CPU-only part of loading; safe to call from any thread. Returns nullptr on failure.
+	static std::shared_ptr<ModelData> parse(const QString & filePath, const ModelLoadOptions & options = {});
+
+	// With a node, the glTF node tree is attached under it as soon as the parse finishes; see instantiateNodes.
+	// With an asset manager on the entity, a file requested again is parsed and uploaded only once.
+	Handle request(std::shared_ptr<ModelEntity> entity, const QString & filePath, std::shared_ptr<SceneNode> node = nullptr);
+
+	// Builds the node tree of the model's data as SceneNodes under parent, carrying the glTF local transforms.
+	// Every node with a mesh gets an instance of model drawing that mesh, so a mesh used by many nodes is
+	// uploaded once; model itself then draws nothing. Animated nodes are bound to the model's animation.
+	// Returns the number of nodes created.
+	static size_t instantiateNodes(const std::shared_ptr<ModelEntity> & model, SceneNode & parent);
+
+	// GL thread only. Hands finished parses to their entities and uploads until the budget is spent; with hot reload,
+	// applies the reloads that finished first.
+	void processUploads(float budgetMilliseconds);
+
+	size_t getPendingCount() const { return requests_.size(); }
+
+	// Watches the files of the loaded models, or the packs holding them. A file that changed and then stayed alone for
+	// a moment is parsed again on the loader's threads, compared with the model on the GPU and handed to
+	// ModelEntity::reloadModelData, so only what changed is uploaded again. Resources compiled in never change.
+	void setHotReload(bool enable);
+	bool isHotReloadEnabled() const { return watcher_ != nullptr; }
+
+private:
+	struct Request {
+		std::weak_ptr<ModelEntity> entity;
+		std::weak_ptr<SceneNode> node;
+		QString filePath;
+		uint64_t optionsHash = 0;
+		Handle result;
+		bool uploading = false;
+	};
+
+	struct Reload {
+		std::shared_ptr<ModelData> data;
+		ModelDiff diff;
+		uint64_t sourceHash = 0;
+	};
+
+	// A loaded file with the entities drawing it, one per file and set of load options.
+	struct WatchedModel {
+		QString filePath;
+		// File on disk whose changes are watched; empty for resources.
+		QString watchedPath;
+		ModelLoadOptions options;
+		uint64_t optionsHash = 0;
+		uint64_t sourceHash = 0;
+		std::vector<std::weak_ptr<ModelEntity>> entities;
+		// Time on clock_ of the last change not reloaded yet, -1 for none.
+		qint64 changedAt = -1;
+		std::shared_future<Reload> reload;
+	};
+
+	void watch(const std::shared_ptr<ModelEntity> & entity, const QString & filePath);
+	void onFileChanged(const QString & path);
+	void processReloads();
+
+	ThreadPool pool_;
+	std::vector<Request> requests_;
+	std::vector<WatchedModel> watched_;
+	std::unique_ptr<QFileSystemWatcher> watcher_;
+	QElapsedTimer clock_;
+};
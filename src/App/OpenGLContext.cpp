@@ -1,4 +1,6 @@
 #include "OpenGLContext.h"
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 
 OpenGLContext::OpenGLContext(QOpenGLFunctions * functions)
 	: functions_(functions)
@@ -8,4 +10,154 @@ OpenGLContext::OpenGLContext(QOpenGLFunctions * functions)
 void OpenGLContext::setFunctions(QOpenGLFunctions * functions)
 {
 	functions_ = functions;
+	invalidate();
+}
+
+void OpenGLContext::invalidate()
+{
+	program_.known = false;
+	vertexArray_.known = false;
+	arrayBuffer_.known = false;
+	elementBuffer_.known = false;
+	activeTexture_.known = false;
+	for (auto & unit: textures_)
+	{
+		for (auto & texture: unit)
+		{
+			texture.known = false;
+		}
+	}
+	depthTest_.known = false;
+	depthMask_.known = false;
+	depthFunc_.known = false;
+	cullFace_.known = false;
+	blend_.known = false;
+	blendFunc_.known = false;
+}
+
+void OpenGLContext::useProgram(GLuint program)
+{
+	if (change(program_, program))
+		functions_->glUseProgram(program);
+}
+
+void OpenGLContext::bindVertexArray(GLuint vertexArray)
+{
+	if (!change(vertexArray_, vertexArray))
+		return;
+	// Not part of QOpenGLFunctions, which covers OpenGL ES 2.0.
+	QOpenGLContext::currentContext()->extraFunctions()->glBindVertexArray(vertexArray);
+	elementBuffer_.known = false;
+}
+
+void OpenGLContext::bindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ARRAY_BUFFER || target == GL_ELEMENT_ARRAY_BUFFER)
+	{
+		if (!change(target == GL_ARRAY_BUFFER ? arrayBuffer_ : elementBuffer_, buffer))
+			return;
+	}
+	else
+	{
+		++stats_.issued;
+	}
+	functions_->glBindBuffer(target, buffer);
+}
+
+void OpenGLContext::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	const bool shadowed = unit < textureUnits && (target == GL_TEXTURE_2D || target == GL_TEXTURE_CUBE_MAP);
+	if (shadowed)
+	{
+		if (!change(textures_[unit][target == GL_TEXTURE_2D ? 0 : 1], texture))
+			return;
+	}
+	else
+	{
+		++stats_.issued;
+	}
+	setActiveTexture(unit);
+	functions_->glBindTexture(target, texture);
+}
+
+void OpenGLContext::bindTextureForUpdate(GLenum target, GLuint texture)
+{
+	bindTexture(updateTextureUnit, target, texture);
+	// bindTexture skips the unit along with a binding that is already there.
+	setActiveTexture(updateTextureUnit);
+}
+
+void OpenGLContext::forgetVertexArray(GLuint vertexArray)
+{
+	if (!vertexArray_.known || vertexArray_.value != vertexArray)
+		return;
+	// Its element buffer binding goes with it.
+	vertexArray_.known = false;
+	elementBuffer_.known = false;
+}
+
+void OpenGLContext::forgetBuffer(GLuint buffer)
+{
+	forget(arrayBuffer_, buffer);
+	forget(elementBuffer_, buffer);
+}
+
+void OpenGLContext::forgetTexture(GLuint texture)
+{
+	for (auto & unit: textures_)
+	{
+		for (auto & binding: unit)
+		{
+			forget(binding, texture);
+		}
+	}
+}
+
+void OpenGLContext::setActiveTexture(GLuint unit)
+{
+	if (change(activeTexture_, unit))
+		functions_->glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void OpenGLContext::setCapability(Shadow<bool> & shadow, GLenum capability, bool enabled)
+{
+	if (!change(shadow, enabled))
+		return;
+	if (enabled)
+		functions_->glEnable(capability);
+	else
+		functions_->glDisable(capability);
+}
+
+void OpenGLContext::setDepthTest(bool enabled)
+{
+	setCapability(depthTest_, GL_DEPTH_TEST, enabled);
+}
+
+void OpenGLContext::setDepthMask(bool enabled)
+{
+	if (change(depthMask_, enabled))
+		functions_->glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void OpenGLContext::setDepthFunc(GLenum func)
+{
+	if (change(depthFunc_, func))
+		functions_->glDepthFunc(func);
+}
+
+void OpenGLContext::setCullFace(bool enabled)
+{
+	setCapability(cullFace_, GL_CULL_FACE, enabled);
+}
+
+void OpenGLContext::setBlend(bool enabled)
+{
+	setCapability(blend_, GL_BLEND, enabled);
+}
+
+void OpenGLContext::setBlendFunc(GLenum source, GLenum destination)
+{
+	if (change(blendFunc_, std::make_pair(source, destination)))
+		functions_->glBlendFunc(source, destination);
 }
@@ -1,11 +1,29 @@
 #pragma once
 
 #include <QOpenGLFunctions>
+#include <array>
 #include <memory>
+#include <utility>
 
+struct OpenGLStateStats {
+	// State calls made, and those skipped because they repeated the shadowed state.
+	size_t issued = 0;
+	size_t filtered = 0;
+};
+
+// The GL functions of the current context, with a shadow of the state that draws change: the program, the vertex
+// array, the array and element buffers, the textures of each unit, and the depth, cull and blend state. Calls made
+// through the setters below are skipped when they repeat the shadow, which is never read back from the driver.
+// State changed around it, as Qt's bind() wrappers do, leaves the shadow stale until invalidate(); the renderer and
+// its entities bind through it, uploads included, and drop the objects they delete with the forget calls.
 class OpenGLContext
 {
 public:
+	// Units whose 2D and cube map bindings are shadowed.
+	static constexpr GLuint textureUnits = 8;
+	// The last of them, which no program samples, is where textures are bound to be specified.
+	static constexpr GLuint updateTextureUnit = textureUnits - 1;
+
 	OpenGLContext(QOpenGLFunctions * functions = nullptr);
 	~OpenGLContext() = default;
 
@@ -17,8 +35,85 @@ public:
 	QOpenGLFunctions * operator->() const { return functions_; }
 	operator QOpenGLFunctions *() const { return functions_; }
 
+	// Forgets the shadow, so that the next call for each piece of state is made.
+	void invalidate();
+
+	void useProgram(GLuint program);
+	// Also forgets the element buffer binding, which belongs to the vertex array.
+	void bindVertexArray(GLuint vertexArray);
+	// GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER are shadowed; other targets are bound as they come.
+	void bindBuffer(GLenum target, GLuint buffer);
+	// GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP on the first textureUnits units are shadowed, others bound as they come.
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	// Binds texture on updateTextureUnit and makes that unit active, for glTexImage2D and the like.
+	void bindTextureForUpdate(GLenum target, GLuint texture);
+
+	// Drops a name from the shadow before the object is deleted, so that a new object given the name is bound.
+	void forgetVertexArray(GLuint vertexArray);
+	void forgetBuffer(GLuint buffer);
+	void forgetTexture(GLuint texture);
+
+	void setDepthTest(bool enabled);
+	void setDepthMask(bool enabled);
+	void setDepthFunc(GLenum func);
+	void setCullFace(bool enabled);
+	void setBlend(bool enabled);
+	void setBlendFunc(GLenum source, GLenum destination);
+
+	// The shadowed depth write mask; GL's default, true, while unknown.
+	bool getDepthMask() const { return !depthMask_.known || depthMask_.value; }
+
+	const OpenGLStateStats & getStats() const { return stats_; }
+	void resetStats() { stats_ = {}; }
+
 private:
+	template<typename T>
+	struct Shadow {
+		T value = {};
+		bool known = false;
+	};
+
+	// Records value, counting the call as issued when it changes the shadow and as filtered when it does not.
+	template<typename T>
+	bool change(Shadow<T> & shadow, T value)
+	{
+		if (shadow.known && shadow.value == value)
+		{
+			++stats_.filtered;
+			return false;
+		}
+		shadow.value = value;
+		shadow.known = true;
+		++stats_.issued;
+		return true;
+	}
+
+	void setCapability(Shadow<bool> & shadow, GLenum capability, bool enabled);
+	void setActiveTexture(GLuint unit);
+
+	template<typename T>
+	static void forget(Shadow<T> & shadow, T value)
+	{
+		if (shadow.known && shadow.value == value)
+			shadow.known = false;
+	}
+
 	QOpenGLFunctions * functions_;
+	OpenGLStateStats stats_;
+
+	Shadow<GLuint> program_;
+	Shadow<GLuint> vertexArray_;
+	Shadow<GLuint> arrayBuffer_;
+	Shadow<GLuint> elementBuffer_;
+	Shadow<GLuint> activeTexture_;
+	// 2D and cube map binding of each unit.
+	std::array<std::array<Shadow<GLuint>, 2>, textureUnits> textures_;
+	Shadow<bool> depthTest_;
+	Shadow<bool> depthMask_;
+	Shadow<GLenum> depthFunc_;
+	Shadow<bool> cullFace_;
+	Shadow<bool> blend_;
+	Shadow<std::pair<GLenum, GLenum>> blendFunc_;
 };
 
 using OpenGLContextPtr = std::shared_ptr<OpenGLContext>;
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstddef>
+
+// High-water mark of the process resident set in bytes, 0 when the platform does not report it.
+size_t getPeakResidentBytes();
@@ -0,0 +1,180 @@
+#include "RenderSort.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+// Insertion sort moves allowed per batch before falling back to the radix sort.
+constexpr size_t g_coherentMovesPerBatch = 4;
+constexpr int g_radixBits = 8;
+constexpr size_t g_radixBuckets = size_t(1) << g_radixBits;
+constexpr int g_radixPasses = 64 / g_radixBits;
+
+uint64_t getField(uint32_t value, int bits)
+{
+	return static_cast<uint64_t>(value) & ((uint64_t(1) << bits) - 1);
+}
+
+// The bits of a non-negative float order like the float; the top ones past the sign keep the most significant part.
+uint64_t quantizeDepth(float depth)
+{
+	if (!(depth > 0.0f))
+		return 0;
+	uint32_t bits = 0;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (31 - SortKeyBits::depth);
+}
+}// namespace
+
+uint64_t makeSortKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t vertexArray, float depth)
+{
+	uint64_t key = getField(pass, SortKeyBits::pass);
+	key = key << SortKeyBits::shader | getField(shader, SortKeyBits::shader);
+	key = key << SortKeyBits::material | getField(material, SortKeyBits::material);
+	key = key << SortKeyBits::vertexArray | getField(vertexArray, SortKeyBits::vertexArray);
+	return key << SortKeyBits::depth | quantizeDepth(depth);
+}
+
+SortStateIds::SortStateIds(int bits)
+	: limit_(uint32_t(1) << bits)
+{
+}
+
+uint32_t SortStateIds::get(const void * object)
+{
+	if (!object)
+		return 0;
+
+	auto [it, inserted] = ids_.try_emplace(object);
+	auto & entry = it->second;
+	entry.frame = frame_;
+	if (!inserted)
+		return entry.id;
+
+	if (!freeIds_.empty())
+	{
+		entry.id = freeIds_.back();
+		freeIds_.pop_back();
+	}
+	else
+	{
+		// The last id is shared by all objects past the others.
+		entry.id = nextId_;
+		if (nextId_ + 1 < limit_)
+			++nextId_;
+	}
+	return entry.id;
+}
+
+void SortStateIds::endFrame()
+{
+	// The last id stays with nextId_, free for the next object once no other is left.
+	const uint32_t sharedId = limit_ - 1;
+	for (auto it = ids_.begin(); it != ids_.end();)
+	{
+		if (it->second.frame == frame_)
+		{
+			++it;
+			continue;
+		}
+		if (it->second.id != sharedId)
+			freeIds_.push_back(it->second.id);
+		it = ids_.erase(it);
+	}
+	++frame_;
+}
+
+const std::vector<uint32_t> & SortKeySorter::sort(const std::vector<uint64_t> & keys, const std::vector<const void *> & ids)
+{
+	stats_ = {};
+	const size_t count = keys.size();
+	entries_.resize(count);
+
+	stats_.coherent = ids == ids_ && order_.size() == count;
+	if (stats_.coherent)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			entries_[i] = {keys[order_[i]], order_[i]};
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			entries_[i] = {keys[i], static_cast<uint32_t>(i)};
+		}
+		ids_ = ids;
+	}
+
+	if (!stats_.coherent || !insertionSort(count * g_coherentMovesPerBatch))
+		radixSort();
+
+	order_.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		order_[i] = entries_[i].index;
+	}
+	return order_;
+}
+
+bool SortKeySorter::insertionSort(size_t maxMoves)
+{
+	for (size_t i = 1; i < entries_.size(); ++i)
+	{
+		const Entry entry = entries_[i];
+		size_t j = i;
+		for (; j > 0 && entries_[j - 1].key > entry.key; --j)
+		{
+			entries_[j] = entries_[j - 1];
+		}
+		entries_[j] = entry;
+
+		stats_.moves += i - j;
+		if (stats_.moves > maxMoves)
+			return false;
+	}
+	return true;
+}
+
+void SortKeySorter::radixSort()
+{
+	const size_t count = entries_.size();
+	if (count < 2)
+		return;
+
+	// The histograms of all bytes come from one pass over the keys.
+	std::array<std::array<uint32_t, g_radixBuckets>, g_radixPasses> histograms = {};
+	for (const auto & entry: entries_)
+	{
+		for (int pass = 0; pass < g_radixPasses; ++pass)
+		{
+			++histograms[pass][(entry.key >> (pass * g_radixBits)) & (g_radixBuckets - 1)];
+		}
+	}
+
+	scratch_.resize(count);
+	for (int pass = 0; pass < g_radixPasses; ++pass)
+	{
+		const int shift = pass * g_radixBits;
+		auto & histogram = histograms[pass];
+		// A byte that all keys share leaves the order as it is.
+		if (histogram[(entries_[0].key >> shift) & (g_radixBuckets - 1)] == count)
+			continue;
+
+		uint32_t offset = 0;
+		for (auto & bucket: histogram)
+		{
+			const uint32_t size = bucket;
+			bucket = offset;
+			offset += size;
+		}
+		for (const auto & entry: entries_)
+		{
+			scratch_[histogram[(entry.key >> shift) & (g_radixBuckets - 1)]++] = entry;
+		}
+		entries_.swap(scratch_);
+		++stats_.radixPasses;
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Widths of the fields of render sort keys, most significant first. Sorting by key groups the draws by state, from
+// the most to the least expensive change, and orders each group front to back.
+struct SortKeyBits {
+	static constexpr int pass = 2;
+	static constexpr int shader = 8;
+	static constexpr int material = 16;
+	static constexpr int vertexArray = 14;
+	static constexpr int depth = 24;
+};
+static_assert(SortKeyBits::pass + SortKeyBits::shader + SortKeyBits::material + SortKeyBits::vertexArray + SortKeyBits::depth == 64);
+
+// Ids are truncated to their fields; depth is a non-negative distance, nearer first.
+uint64_t makeSortKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t vertexArray, float depth);
+// The pass, shader, material and vertex array of key, equal for draws that need no state change in between.
+inline uint64_t getSortKeyState(uint64_t key)
+{
+	return key >> SortKeyBits::depth;
+}
+
+// Small ids for the state objects of one key field. An object keeps its id from frame to frame while it is drawn,
+// so that unchanged draws keep their keys. The ids of objects no longer drawn, destroyed ones among them, are
+// released at the end of the frame and handed out again. Objects past the field's ids in one frame share the last
+// one, which only costs state changes.
+class SortStateIds
+{
+public:
+	explicit SortStateIds(int bits);
+
+	// 0 for null, which sorts first.
+	uint32_t get(const void * object);
+	// Releases the ids of the objects not passed to get() since the previous call.
+	void endFrame();
+
+private:
+	struct Entry {
+		uint32_t id = 0;
+		uint32_t frame = 0;
+	};
+
+	std::unordered_map<const void *, Entry> ids_;
+	std::vector<uint32_t> freeIds_;
+	uint32_t nextId_ = 1;
+	uint32_t frame_ = 0;
+	uint32_t limit_;
+};
+
+struct SortStats {
+	// Whether last frame's order was reused, and what fixing it up or sorting anew took.
+	bool coherent = false;
+	size_t moves = 0;
+	size_t radixPasses = 0;
+};
+
+// Orders render batches by their keys. An LSD radix sort handles any input in linear time, skipping the bytes all
+// keys share. When the batches arrive as they did last frame, the order found then is reused and repaired with an
+// insertion sort, which costs little while few keys changed place; too many moves fall back to the radix sort.
+class SortKeySorter
+{
+public:
+	// Indices of keys in ascending order of key, stable. ids name the batches; when they equal last frame's, its
+	// order is the starting point.
+	const std::vector<uint32_t> & sort(const std::vector<uint64_t> & keys, const std::vector<const void *> & ids);
+
+	const SortStats & getStats() const { return stats_; }
+
+private:
+	struct Entry {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// False, leaving entries_ partly sorted, once the moves exceed the budget.
+	bool insertionSort(size_t maxMoves);
+	void radixSort();
+
+	std::vector<Entry> entries_;
+	std::vector<Entry> scratch_;
+	std::vector<uint32_t> order_;
+	std::vector<const void *> ids_;
+	SortStats stats_;
+};
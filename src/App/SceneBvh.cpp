@@ -0,0 +1,548 @@
+#include "SceneBvh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+// Trees with fewer proxies are never rebuilt; inserting them one by one is good enough.
+constexpr size_t g_minimumRebuildProxies = 64;
+// Rebuild once the cost has grown by this factor since the last build.
+constexpr float g_rebuildCostRatio = 1.5f;
+constexpr int g_bins = 16;
+constexpr uint32_t g_allPlanes = (1u << FrustumPlanes::count) - 1;
+
+float getSurfaceArea(const BoundingBox & box)
+{
+	const float x = box.maximum[0] - box.minimum[0];
+	const float y = box.maximum[1] - box.minimum[1];
+	const float z = box.maximum[2] - box.minimum[2];
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+BoundingBox merge(const BoundingBox & a, const BoundingBox & b)
+{
+	BoundingBox box;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		box.minimum[axis] = std::min(a.minimum[axis], b.minimum[axis]);
+		box.maximum[axis] = std::max(a.maximum[axis], b.maximum[axis]);
+	}
+	return box;
+}
+
+bool isSameBox(const BoundingBox & a, const BoundingBox & b)
+{
+	return std::equal(std::begin(a.minimum), std::end(a.minimum), std::begin(b.minimum))
+		   && std::equal(std::begin(a.maximum), std::end(a.maximum), std::begin(b.maximum));
+}
+
+BoundingBox getEmptyBox()
+{
+	BoundingBox box;
+	std::fill(std::begin(box.minimum), std::end(box.minimum), std::numeric_limits<float>::max());
+	std::fill(std::begin(box.maximum), std::end(box.maximum), std::numeric_limits<float>::lowest());
+	return box;
+}
+}// namespace
+
+int SceneBvh::allocateProxy(void * payload)
+{
+	int proxy;
+	if (!freeProxies_.empty())
+	{
+		proxy = freeProxies_.back();
+		freeProxies_.pop_back();
+	}
+	else
+	{
+		proxy = static_cast<int>(proxies_.size());
+		proxies_.emplace_back();
+	}
+
+	proxies_[proxy] = Proxy();
+	proxies_[proxy].payload = payload;
+	proxies_[proxy].alive = true;
+	return proxy;
+}
+
+int SceneBvh::createProxy(const BoundingBox & box, void * payload)
+{
+	const int proxy = allocateProxy(payload);
+	proxies_[proxy].box = box;
+	proxies_[proxy].linear = static_cast<int>(linearProxies_.size());
+	linearBoxes_.add(box);
+	linearProxies_.push_back(proxy);
+	linearPayloads_.push_back(payload);
+	insertLeaf(proxy);
+	++boundedProxies_;
+	return proxy;
+}
+
+int SceneBvh::createUnboundedProxy(void * payload)
+{
+	const int proxy = allocateProxy(payload);
+	proxies_[proxy].unbounded = static_cast<int>(unbounded_.size());
+	unbounded_.push_back(proxy);
+	return proxy;
+}
+
+void SceneBvh::destroyProxy(int proxy)
+{
+	auto & entry = proxies_[proxy];
+	if (entry.unbounded >= 0)
+	{
+		proxies_[unbounded_.back()].unbounded = entry.unbounded;
+		unbounded_[entry.unbounded] = unbounded_.back();
+		unbounded_.pop_back();
+	}
+	else
+	{
+		removeLeaf(entry.leaf);
+		--boundedProxies_;
+
+		proxies_[linearProxies_.back()].linear = entry.linear;
+		linearProxies_[entry.linear] = linearProxies_.back();
+		linearProxies_.pop_back();
+		linearPayloads_[entry.linear] = linearPayloads_.back();
+		linearPayloads_.pop_back();
+		linearBoxes_.removeSwap(static_cast<size_t>(entry.linear));
+	}
+
+	entry = Proxy();
+	freeProxies_.push_back(proxy);
+}
+
+void SceneBvh::moveProxy(int proxy, const BoundingBox & box)
+{
+	auto & entry = proxies_[proxy];
+	if (entry.unbounded >= 0 || isSameBox(entry.box, box))
+		return;
+
+	entry.box = box;
+	linearBoxes_.set(static_cast<size_t>(entry.linear), box);
+	nodes_[entry.leaf].box = box;
+	refit(nodes_[entry.leaf].parent);
+}
+
+int SceneBvh::allocateNode()
+{
+	if (!freeNodes_.empty())
+	{
+		const int node = freeNodes_.back();
+		freeNodes_.pop_back();
+		return node;
+	}
+	nodes_.emplace_back();
+	return static_cast<int>(nodes_.size() - 1);
+}
+
+void SceneBvh::freeNode(int node)
+{
+	if (!nodes_[node].isLeaf())
+		innerArea_ -= getSurfaceArea(nodes_[node].box);
+	nodes_[node] = Node();
+	freeNodes_.push_back(node);
+}
+
+void SceneBvh::setNodeBox(int node, const BoundingBox & box)
+{
+	if (!nodes_[node].isLeaf())
+		innerArea_ += getSurfaceArea(box) - getSurfaceArea(nodes_[node].box);
+	nodes_[node].box = box;
+}
+
+void SceneBvh::insertLeaf(int proxy)
+{
+	const BoundingBox box = proxies_[proxy].box;
+	const int leaf = allocateNode();
+	nodes_[leaf].box = box;
+	nodes_[leaf].proxy = proxy;
+	proxies_[proxy].leaf = leaf;
+	if (root_ < 0)
+	{
+		root_ = leaf;
+		return;
+	}
+
+	// Descend to the sibling that enlarges the tree the least: pairing with a node creates a parent around both,
+	// descending into it also enlarges the node itself.
+	int sibling = root_;
+	while (!nodes_[sibling].isLeaf())
+	{
+		const auto & node = nodes_[sibling];
+		const float area = getSurfaceArea(node.box);
+		const float combined = getSurfaceArea(merge(node.box, box));
+		const float cost = 2.0f * combined;
+		const float inheritance = 2.0f * (combined - area);
+
+		float childCosts[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			const auto & child = nodes_[node.children[i]];
+			const float enlarged = getSurfaceArea(merge(child.box, box));
+			childCosts[i] = (child.isLeaf() ? enlarged : enlarged - getSurfaceArea(child.box)) + inheritance;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		sibling = node.children[childCosts[0] <= childCosts[1] ? 0 : 1];
+	}
+
+	const int parent = allocateNode();
+	const int grandParent = nodes_[sibling].parent;
+	nodes_[parent].parent = grandParent;
+	nodes_[parent].children[0] = sibling;
+	nodes_[parent].children[1] = leaf;
+	nodes_[sibling].parent = parent;
+	nodes_[leaf].parent = parent;
+	if (grandParent >= 0)
+	{
+		auto & children = nodes_[grandParent].children;
+		children[children[0] == sibling ? 0 : 1] = parent;
+	}
+	else
+	{
+		root_ = parent;
+	}
+	setNodeBox(parent, merge(nodes_[sibling].box, box));
+	refit(grandParent);
+}
+
+void SceneBvh::removeLeaf(int leaf)
+{
+	const int parent = nodes_[leaf].parent;
+	freeNode(leaf);
+	if (parent < 0)
+	{
+		root_ = -1;
+		return;
+	}
+
+	const int grandParent = nodes_[parent].parent;
+	const int sibling = nodes_[parent].children[nodes_[parent].children[0] == leaf ? 1 : 0];
+	nodes_[sibling].parent = grandParent;
+	if (grandParent >= 0)
+	{
+		auto & children = nodes_[grandParent].children;
+		children[children[0] == parent ? 0 : 1] = sibling;
+	}
+	else
+	{
+		root_ = sibling;
+	}
+	freeNode(parent);
+	refit(grandParent);
+}
+
+void SceneBvh::refit(int node)
+{
+	while (node >= 0)
+	{
+		const auto & children = nodes_[node].children;
+		const BoundingBox box = merge(nodes_[children[0]].box, nodes_[children[1]].box);
+		if (isSameBox(box, nodes_[node].box))
+			break;
+		setNodeBox(node, box);
+		node = nodes_[node].parent;
+	}
+}
+
+void SceneBvh::update()
+{
+	if (rebuild_.valid())
+	{
+		if (rebuild_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			finishRebuild();
+		return;
+	}
+
+	if (boundedProxies_ < g_minimumRebuildProxies)
+		return;
+	const float cost = getStats().cost;
+	if (rebuilds_ == 0 || cost > builtCost_ * g_rebuildCostRatio)
+		startRebuild();
+}
+
+void SceneBvh::startRebuild()
+{
+	std::vector<std::pair<int, BoundingBox>> leaves;
+	leaves.reserve(boundedProxies_);
+	for (size_t i = 0; i < proxies_.size(); ++i)
+	{
+		if (proxies_[i].alive && proxies_[i].unbounded < 0)
+			leaves.emplace_back(static_cast<int>(i), proxies_[i].box);
+	}
+	rebuild_ = ThreadPool::global().submit([leaves = std::move(leaves)]() mutable { return buildTree(std::move(leaves)); });
+}
+
+void SceneBvh::finishRebuild()
+{
+	Build build = rebuild_.get();
+	nodes_ = std::move(build.nodes);
+	root_ = build.root;
+	freeNodes_.clear();
+	innerArea_ = 0.0;
+	for (auto & proxy: proxies_)
+	{
+		proxy.leaf = -1;
+	}
+
+	// The tree holds the proxies as they were when the build started; destroyed ones leave, new ones join and
+	// moved ones are refitted.
+	std::vector<int> stale;
+	for (size_t i = 0; i < nodes_.size(); ++i)
+	{
+		const auto & node = nodes_[i];
+		if (!node.isLeaf())
+		{
+			innerArea_ += getSurfaceArea(node.box);
+			continue;
+		}
+
+		auto & proxy = proxies_[node.proxy];
+		if (proxy.alive && proxy.unbounded < 0)
+			proxy.leaf = static_cast<int>(i);
+		else
+			stale.push_back(static_cast<int>(i));
+	}
+	builtCost_ = getStats().cost;
+	++rebuilds_;
+
+	for (const int leaf: stale)
+	{
+		removeLeaf(leaf);
+	}
+	for (size_t i = 0; i < proxies_.size(); ++i)
+	{
+		auto & proxy = proxies_[i];
+		if (!proxy.alive || proxy.unbounded >= 0)
+			continue;
+
+		if (proxy.leaf < 0)
+		{
+			insertLeaf(static_cast<int>(i));
+		}
+		else if (!isSameBox(nodes_[proxy.leaf].box, proxy.box))
+		{
+			nodes_[proxy.leaf].box = proxy.box;
+			refit(nodes_[proxy.leaf].parent);
+		}
+	}
+}
+
+SceneBvh::Build SceneBvh::buildTree(std::vector<std::pair<int, BoundingBox>> leaves)
+{
+	Build build;
+	if (leaves.empty())
+		return build;
+
+	const auto getCentroid = [](const BoundingBox & box, int axis) { return box.minimum[axis] + box.maximum[axis]; };
+
+	struct Task {
+		int node;
+		size_t begin;
+		size_t end;
+	};
+	// A full binary tree over n leaves has 2n - 1 nodes, so the storage never moves.
+	build.nodes.reserve(leaves.size() * 2 - 1);
+	build.nodes.emplace_back();
+	build.root = 0;
+	std::vector<Task> tasks = {{0, 0, leaves.size()}};
+	while (!tasks.empty())
+	{
+		const Task task = tasks.back();
+		tasks.pop_back();
+
+		BoundingBox bounds = getEmptyBox();
+		BoundingBox centroids = getEmptyBox();
+		for (size_t i = task.begin; i < task.end; ++i)
+		{
+			bounds = merge(bounds, leaves[i].second);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float centroid = getCentroid(leaves[i].second, axis);
+				centroids.minimum[axis] = std::min(centroids.minimum[axis], centroid);
+				centroids.maximum[axis] = std::max(centroids.maximum[axis], centroid);
+			}
+		}
+		build.nodes[task.node].box = bounds;
+
+		if (task.end - task.begin == 1)
+		{
+			build.nodes[task.node].proxy = leaves[task.begin].first;
+			continue;
+		}
+
+		int axis = 0;
+		for (int i = 1; i < 3; ++i)
+		{
+			if (centroids.maximum[i] - centroids.minimum[i] > centroids.maximum[axis] - centroids.minimum[axis])
+				axis = i;
+		}
+
+		// Bin the centroids along the widest axis and split where the surface area heuristic is lowest.
+		size_t middle = task.begin;
+		const float extent = centroids.maximum[axis] - centroids.minimum[axis];
+		if (extent > 0.0f)
+		{
+			const float scale = static_cast<float>(g_bins) / extent;
+			const auto getBin = [&](const BoundingBox & box) {
+				return std::min(g_bins - 1, static_cast<int>((getCentroid(box, axis) - centroids.minimum[axis]) * scale));
+			};
+
+			BoundingBox binBounds[g_bins];
+			size_t binCounts[g_bins] = {};
+			std::fill(std::begin(binBounds), std::end(binBounds), getEmptyBox());
+			for (size_t i = task.begin; i < task.end; ++i)
+			{
+				const int bin = getBin(leaves[i].second);
+				binBounds[bin] = merge(binBounds[bin], leaves[i].second);
+				++binCounts[bin];
+			}
+
+			float rightCosts[g_bins] = {};
+			BoundingBox right = getEmptyBox();
+			size_t rightCount = 0;
+			for (int bin = g_bins - 1; bin > 0; --bin)
+			{
+				right = merge(right, binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightCosts[bin] = rightCount > 0 ? getSurfaceArea(right) * static_cast<float>(rightCount) : 0.0f;
+			}
+
+			BoundingBox left = getEmptyBox();
+			size_t leftCount = 0;
+			float bestCost = std::numeric_limits<float>::max();
+			int bestSplit = -1;
+			for (int split = 1; split < g_bins; ++split)
+			{
+				left = merge(left, binBounds[split - 1]);
+				leftCount += binCounts[split - 1];
+				if (leftCount == 0 || leftCount == task.end - task.begin)
+					continue;
+				const float cost = getSurfaceArea(left) * static_cast<float>(leftCount) + rightCosts[split];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestSplit = split;
+				}
+			}
+
+			if (bestSplit > 0)
+			{
+				const auto it = std::partition(leaves.begin() + static_cast<std::ptrdiff_t>(task.begin), leaves.begin() + static_cast<std::ptrdiff_t>(task.end),
+											   [&](const auto & leaf) { return getBin(leaf.second) < bestSplit; });
+				middle = static_cast<size_t>(it - leaves.begin());
+			}
+		}
+
+		// Coincident centroids: any halving is as good as another.
+		if (middle == task.begin || middle == task.end)
+			middle = task.begin + (task.end - task.begin) / 2;
+
+		const int first = static_cast<int>(build.nodes.size());
+		build.nodes.emplace_back();
+		build.nodes.emplace_back();
+		build.nodes[first].parent = task.node;
+		build.nodes[first + 1].parent = task.node;
+		build.nodes[task.node].children[0] = first;
+		build.nodes[task.node].children[1] = first + 1;
+		tasks.push_back({first, task.begin, middle});
+		tasks.push_back({first + 1, middle, task.end});
+	}
+	return build;
+}
+
+void SceneBvh::cull(const FrustumPlanes & planes, std::vector<void *> & visible, BvhCullStats & stats) const
+{
+	size_t reported = 0;
+	if (root_ >= 0)
+	{
+		// Each entry carries the planes its parent was not yet entirely inside of.
+		std::vector<std::pair<int, uint32_t>> stack;
+		stack.reserve(64);
+		stack.emplace_back(root_, g_allPlanes);
+		while (!stack.empty())
+		{
+			auto [index, mask] = stack.back();
+			stack.pop_back();
+			++stats.nodesVisited;
+
+			const auto & node = nodes_[index];
+			bool outside = false;
+			for (size_t i = 0; i < FrustumPlanes::count && !outside; ++i)
+			{
+				if (!(mask & (1u << i)))
+					continue;
+
+				float distance = planes.d[i];
+				float reach = 0.0f;
+				const float normal[3] = {planes.a[i], planes.b[i], planes.c[i]};
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					distance += normal[axis] * (node.box.minimum[axis] + node.box.maximum[axis]) * 0.5f;
+					reach += std::abs(normal[axis]) * (node.box.maximum[axis] - node.box.minimum[axis]) * 0.5f;
+				}
+				outside = !(distance + reach >= 0.0f);
+				if (distance - reach >= 0.0f)
+					mask &= ~(1u << i);
+			}
+			if (outside)
+				continue;
+
+			if (node.isLeaf())
+			{
+				visible.push_back(proxies_[node.proxy].payload);
+				++reported;
+				continue;
+			}
+			stack.emplace_back(node.children[0], mask);
+			stack.emplace_back(node.children[1], mask);
+		}
+	}
+	stats.proxiesCulled += boundedProxies_ - reported;
+
+	for (const int proxy: unbounded_)
+	{
+		visible.push_back(proxies_[proxy].payload);
+	}
+}
+
+void SceneBvh::cullLinear(const FrustumPlanes & planes, std::vector<void *> & visible, BvhCullStats & stats) const
+{
+	const size_t count = linearPayloads_.size();
+	linearVisibility_.resize(count);
+	linearVisible_.resize(count);
+	stats.proxiesCulled += cullBoxes(planes, linearBoxes_, linearVisibility_.data());
+
+	// Every payload is written and kept when visible, which a branch on the visibility would mispredict.
+	size_t kept = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		linearVisible_[kept] = linearPayloads_[i];
+		kept += linearVisibility_[i];
+	}
+	visible.insert(visible.end(), linearVisible_.begin(), linearVisible_.begin() + static_cast<std::ptrdiff_t>(kept));
+
+	for (const int proxy: unbounded_)
+	{
+		visible.push_back(proxies_[proxy].payload);
+	}
+}
+
+BvhStats SceneBvh::getStats() const
+{
+	BvhStats stats;
+	stats.proxies = boundedProxies_ + unbounded_.size();
+	stats.unboundedProxies = unbounded_.size();
+	stats.nodes = nodes_.size() - freeNodes_.size();
+	const float rootArea = root_ >= 0 ? getSurfaceArea(nodes_[root_].box) : 0.0f;
+	stats.cost = rootArea > 0.0f ? static_cast<float>(innerArea_ / rootArea) : 0.0f;
+	stats.builtCost = builtCost_;
+	stats.rebuilds = rebuilds_;
+	stats.rebuilding = rebuild_.valid();
+	return stats;
+}
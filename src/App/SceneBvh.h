@@ -0,0 +1,118 @@
+#pragma once
+
+#include "FrustumCulling.h"
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+struct BvhCullStats {
+	size_t nodesVisited = 0;
+	size_t proxiesCulled = 0;
+};
+
+struct BvhStats {
+	size_t proxies = 0;
+	size_t unboundedProxies = 0;
+	size_t nodes = 0;
+	// Surface area heuristic: the summed areas of the inner nodes relative to the root, now and after the last build.
+	float cost = 0.0f;
+	float builtCost = 0.0f;
+	size_t rebuilds = 0;
+	bool rebuilding = false;
+};
+
+// Dynamic bounding volume hierarchy over world-space boxes, one leaf per proxy. Proxies are inserted where they
+// enlarge the tree the least and moving one refits only its ancestors, so the tree stays valid every frame but loses
+// quality as things move. Once its cost has grown enough, update() rebuilds it with a binned SAH split on the global
+// thread pool from a snapshot of the boxes and swaps the result in when it is ready, patched with the changes made in
+// the meantime. Proxies without bounds are kept aside and reported by every cull.
+class SceneBvh
+{
+public:
+	SceneBvh() = default;
+
+	SceneBvh(const SceneBvh &) = delete;
+	SceneBvh & operator=(const SceneBvh &) = delete;
+
+	int createProxy(const BoundingBox & box, void * payload);
+	int createUnboundedProxy(void * payload);
+	void destroyProxy(int proxy);
+	// Refits the ancestors of the proxy's leaf; a box that did not change costs nothing.
+	void moveProxy(int proxy, const BoundingBox & box);
+	void * getPayload(int proxy) const { return proxies_[proxy].payload; }
+
+	// Swaps in a finished rebuild and starts a new one when the tree has degraded. Call once per frame.
+	void update();
+
+	// Appends the payloads of the proxies whose boxes intersect the frustum, and of all unbounded ones. Subtrees
+	// fully inside a plane skip it, and fully inside the frustum are reported without further tests.
+	void cull(const FrustumPlanes & planes, std::vector<void *> & visible, BvhCullStats & stats) const;
+	// The same result from cullBoxes over every bounded proxy, without the tree. Tests more boxes, but in SIMD
+	// batches and without branching down the tree, which wins once a large part of the scene is visible.
+	void cullLinear(const FrustumPlanes & planes, std::vector<void *> & visible, BvhCullStats & stats) const;
+
+	BvhStats getStats() const;
+
+private:
+	struct Node {
+		BoundingBox box;
+		int parent = -1;
+		int children[2] = {-1, -1};
+		// Leaves only.
+		int proxy = -1;
+
+		bool isLeaf() const { return children[0] < 0; }
+	};
+
+	struct Proxy {
+		BoundingBox box;
+		void * payload = nullptr;
+		int leaf = -1;
+		// Position in unbounded_, or -1 for proxies in the tree.
+		int unbounded = -1;
+		// Position in linearBoxes_ of proxies in the tree.
+		int linear = -1;
+		bool alive = false;
+	};
+
+	struct Build {
+		std::vector<Node> nodes;
+		int root = -1;
+	};
+
+	int allocateProxy(void * payload);
+	int allocateNode();
+	void freeNode(int node);
+	void insertLeaf(int proxy);
+	void removeLeaf(int leaf);
+	// Recomputes the boxes from node up to the root, stopping at the first one that does not change.
+	void refit(int node);
+	void setNodeBox(int node, const BoundingBox & box);
+	void startRebuild();
+	void finishRebuild();
+	static Build buildTree(std::vector<std::pair<int, BoundingBox>> leaves);
+
+	std::vector<Node> nodes_;
+	std::vector<int> freeNodes_;
+	int root_ = -1;
+	std::vector<Proxy> proxies_;
+	std::vector<int> freeProxies_;
+	std::vector<int> unbounded_;
+	size_t boundedProxies_ = 0;
+
+	// The boxes of the bounded proxies for cullLinear, kept up to date as proxies come, go and move, with their proxies
+	// and payloads at the same positions.
+	CullBoxes linearBoxes_;
+	std::vector<int> linearProxies_;
+	std::vector<void *> linearPayloads_;
+	mutable std::vector<uint8_t> linearVisibility_;
+	mutable std::vector<void *> linearVisible_;
+
+	// Sum of the surface areas of the inner nodes, kept up to date by setNodeBox.
+	double innerArea_ = 0.0;
+	float builtCost_ = 0.0f;
+	size_t rebuilds_ = 0;
+	std::future<Build> rebuild_;
+};
@@ -1,6 +1,7 @@
 #include "SceneGraph.h"
 #include "Camera.h"
 #include "Entity.h"
+#include "FrustumCulling.h"
 #include <QVector3D>
 #include <algorithm>
 
@@ -9,6 +10,12 @@ SceneNode::SceneNode(const std::string & name)
 {
 }
 
+SceneNode::~SceneNode()
+{
+	if (proxy_ >= 0)
+		bvh_->destroyProxy(proxy_);
+}
+
 void SceneNode::addChild(std::shared_ptr<SceneNode> child)
 {
 	if (!child || child.get() == this)
@@ -22,6 +29,8 @@ void SceneNode::addChild(std::shared_ptr<SceneNode> child)
 
 	child->parent_ = this;
 	children_.push_back(child);
+	if (child->bvh_ != bvh_)
+		child->attach(bvh_);
 }
 
 void SceneNode::removeChild(std::shared_ptr<SceneNode> child)
@@ -33,6 +42,7 @@ void SceneNode::removeChild(std::shared_ptr<SceneNode> child)
 	if (it != children_.end())
 	{
 		(*it)->parent_ = nullptr;
+		(*it)->attach(nullptr);
 		children_.erase(it);
 	}
 }
@@ -95,12 +105,24 @@ void SceneNode::traverseVisible(const std::function<void(SceneNode *)> & visitor
 void SceneNode::update(float deltaTime)
 {
 	if (!visible_)
+	{
+		if (!proxiesReleased_)
+			releaseProxies();
+		proxiesReleased_ = true;
 		return;
+	}
+	proxiesReleased_ = false;
+
+	// Parents update first, so their world transform is current when the children read it.
+	worldTransform_ = parent_ ? parent_->worldTransform_ * transform_ : transform_;
 
 	if (entity_)
 	{
+		entity_->setParentTransform(worldTransform_);
 		entity_->update(deltaTime);
+		worldTransform_ *= entity_->getTransform();
 	}
+	updateProxy();
 
 	for (auto & child: children_)
 	{
@@ -108,6 +130,58 @@ void SceneNode::update(float deltaTime)
 	}
 }
 
+void SceneNode::attach(const std::shared_ptr<SceneBvh> & bvh)
+{
+	traverse([&bvh](SceneNode * node) {
+		if (node->proxy_ >= 0)
+			node->bvh_->destroyProxy(node->proxy_);
+		node->proxy_ = -1;
+		node->bvh_ = bvh;
+	});
+}
+
+void SceneNode::updateProxy()
+{
+	if (!bvh_)
+		return;
+
+	BoundingBox box;
+	const bool bounded = entity_ && entity_->getBoundingBox(box);
+	// Bounds come and go as models load and skinning or morphing starts, so the kind of proxy may change.
+	if (proxy_ >= 0 && (!entity_ || bounded != proxyBounded_))
+	{
+		bvh_->destroyProxy(proxy_);
+		proxy_ = -1;
+	}
+	if (!entity_)
+		return;
+
+	if (!bounded)
+	{
+		if (proxy_ < 0)
+			proxy_ = bvh_->createUnboundedProxy(this);
+	}
+	else
+	{
+		// The box is in the space of the entity, which worldTransform_ now maps from.
+		box = transformBoundingBox(box, worldTransform_.constData());
+		if (proxy_ < 0)
+			proxy_ = bvh_->createProxy(box, this);
+		else
+			bvh_->moveProxy(proxy_, box);
+	}
+	proxyBounded_ = bounded;
+}
+
+void SceneNode::releaseProxies()
+{
+	traverse([](SceneNode * node) {
+		if (node->proxy_ >= 0)
+			node->bvh_->destroyProxy(node->proxy_);
+		node->proxy_ = -1;
+	});
+}
+
 void SceneNode::render(Camera * camera, OpenGLContextPtr context)
 {
 	if (!visible_)
@@ -125,8 +199,10 @@ void SceneNode::render(Camera * camera, OpenGLContextPtr context)
 }
 
 SceneGraph::SceneGraph()
+	: bvh_(std::make_shared<SceneBvh>())
 {
 	root_ = std::make_shared<SceneNode>("Root");
+	root_->attach(bvh_);
 }
 
 std::shared_ptr<SceneNode> SceneGraph::createNode(const std::string & name)
@@ -151,6 +227,20 @@ std::shared_ptr<SceneNode> SceneGraph::findNode(const std::string & name) const
 void SceneGraph::update(float deltaTime)
 {
 	root_->update(deltaTime);
+	bvh_->update();
+}
+
+void SceneGraph::cull(const FrustumPlanes & planes, std::vector<SceneNode *> & nodes, BvhCullStats & stats, bool linear) const
+{
+	culled_.clear();
+	if (linear)
+		bvh_->cullLinear(planes, culled_, stats);
+	else
+		bvh_->cull(planes, culled_, stats);
+	for (void * payload: culled_)
+	{
+		nodes.push_back(static_cast<SceneNode *>(payload));
+	}
 }
 
 size_t SceneGraph::getNodeCount() const
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "SceneBvh.h"
+#include <QMatrix4x4>
 #include <functional>
 #include <memory>
 #include <string>
@@ -16,7 +18,7 @@ class SceneNode
 {
 public:
 	SceneNode(const std::string & name = "Node");
-	virtual ~SceneNode() = default;
+	virtual ~SceneNode();
 
 	void addChild(std::shared_ptr<SceneNode> child);
 	void removeChild(std::shared_ptr<SceneNode> child);
@@ -32,6 +34,12 @@ public:
 	void setEntity(std::shared_ptr<Entity> entity);
 	std::shared_ptr<Entity> getEntity() const { return entity_; }
 
+	// Local transform relative to the parent node, applied before the entity's own transform.
+	void setTransform(const QMatrix4x4 & transform) { transform_ = transform; }
+	const QMatrix4x4 & getTransform() const { return transform_; }
+	// Parent world * local * entity transform, as of the last update().
+	const QMatrix4x4 & getWorldTransform() const { return worldTransform_; }
+
 	void traverse(const std::function<void(SceneNode *)> & visitor);
 	void traverseVisible(const std::function<void(SceneNode *)> & visitor);
 
@@ -42,11 +50,28 @@ public:
 	void setVisible(bool visible) { visible_ = visible; }
 
 protected:
+	friend class SceneGraph;
+
+	// Moves the subtree into the BVH of another graph, or out of any with null.
+	void attach(const std::shared_ptr<SceneBvh> & bvh);
+	// Keeps the node's proxy in line with its entity after its world transform changed.
+	void updateProxy();
+	void releaseProxies();
+
 	std::string name_;
 	SceneNode * parent_ = nullptr;
 	std::vector<std::shared_ptr<SceneNode>> children_;
 	std::shared_ptr<Entity> entity_;
+	QMatrix4x4 transform_;
+	QMatrix4x4 worldTransform_;
 	bool visible_ = true;
+
+	// BVH of the graph holding the node, and the proxy of its entity there: -1 without an entity or inside a hidden
+	// subtree, whose proxies are released once rather than on every update.
+	std::shared_ptr<SceneBvh> bvh_;
+	int proxy_ = -1;
+	bool proxyBounded_ = false;
+	bool proxiesReleased_ = false;
 };
 
 class SceneGraph
@@ -62,11 +87,21 @@ public:
 
 	std::shared_ptr<SceneNode> findNode(const std::string & name) const;
 
+	// Updates the world transforms, refits the BVH around the entities that moved and rebuilds it in the background
+	// when it has degraded.
 	void update(float deltaTime);
 
+	// Appends the nodes of visible subtrees whose entity may intersect the frustum, as of the last update: those whose
+	// world-space box the BVH finds inside, and all whose entity has no bounds. Replaces traverseVisible for culling.
+	// linear tests every box in SIMD batches instead of walking the tree, as SceneBvh::cullLinear does.
+	void cull(const FrustumPlanes & planes, std::vector<SceneNode *> & nodes, BvhCullStats & stats, bool linear = false) const;
+	BvhStats getBvhStats() const { return bvh_->getStats(); }
+
 	size_t getNodeCount() const;
 	size_t getVisibleNodeCount() const;
 
 private:
+	std::shared_ptr<SceneBvh> bvh_;
 	std::shared_ptr<SceneNode> root_;
+	mutable std::vector<void *> culled_;
 };
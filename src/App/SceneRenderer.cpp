@@ -1,20 +1,60 @@
 #include "SceneRenderer.h"
 #include "Camera.h"
+#include "ContentHash.h"
 #include "Entity.h"
+#include "FrustumCulling.h"
 #include "ModelEntity.h"
+#include "RenderSort.h"
 #include "SceneGraph.h"
 #include "SkyboxEntity.h"
+#include "TextureStreamer.h"
+#include <QElapsedTimer>
+#include <QFile>
 #include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
+
+namespace
+{
+// Models with fewer visible copies are drawn one by one, cluster culled.
+constexpr size_t g_minimumInstances = 8;
+// Automatic culling runs the cheaper method by its measured cost, and the other one every this many frames so that
+// its cost follows the view. scene-bvh-bench shows why no fixed visible share works: at a million boxes the two cross
+// between 5% and 7% of the scene in view, while at a hundred thousand the BVH is still ahead at 10%.
+constexpr int g_cullingProbeInterval = 30;
+// Weight of the newest frame in the running cull cost.
+constexpr double g_cullingCostSmoothing = 0.25;
+// Sort key passes: the skybox first, then everything else.
+constexpr uint32_t g_skyboxPass = 0;
+constexpr uint32_t g_opaquePass = 1;
+}// namespace
 
 SceneRenderer::SceneRenderer(OpenGLContextPtr context)
 	: context_(context)
+	, shaderIds_(SortKeyBits::shader)
+	, materialIds_(SortKeyBits::material)
+	, vertexArrayIds_(SortKeyBits::vertexArray)
+	, textureStreamer_(std::make_shared<TextureStreamer>(context))
+	, assets_(std::make_shared<AssetManager>())
+	, animations_(std::make_shared<AnimationSystem>())
+{
+}
+
+void SceneRenderer::setTextureBudget(size_t bytes)
 {
+	textureStreamer_->setBudget(bytes);
 }
 
 void SceneRenderer::setContext(OpenGLContextPtr context)
 {
 	context_ = context;
+	textureStreamer_->setContext(context);
+}
+
+void SceneRenderer::setViewportSize(int /*width*/, int height)
+{
+	viewportHeight_ = height;
 }
 
 bool SceneRenderer::initialize()
@@ -32,11 +72,22 @@ bool SceneRenderer::initialize()
 		return false;
 	}
 
-	context_->functions()->glEnable(GL_DEPTH_TEST);
-	context_->functions()->glEnable(GL_CULL_FACE);
+	context_->setDepthTest(true);
+	context_->setCullFace(true);
 	context_->functions()->glCullFace(GL_BACK);
 	context_->functions()->glFrontFace(GL_CCW);
 
+	instanceBuffer_ = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::Type::VertexBuffer);
+	instanceBuffer_->create();
+	instanceBuffer_->setUsagePattern(QOpenGLBuffer::StreamDraw);
+
+	for (auto & timer: frameTimers_)
+	{
+		timer = std::make_unique<QOpenGLTimerQuery>();
+		if (!timer->create())
+			timer.reset();
+	}
+
 	initialized_ = true;
 	return true;
 }
@@ -45,7 +96,22 @@ void SceneRenderer::cleanup()
 {
 	modelShader_.reset();
 	skyboxShader_.reset();
+	if (context_)
+	{
+		animations_->cleanup(*context_);
+		if (instanceBuffer_)
+			context_->forgetBuffer(instanceBuffer_->bufferId());
+	}
 	renderBatches_.clear();
+	nodes_.clear();
+	models_.clear();
+	instancedMeshes_.clear();
+	instanceGroups_.clear();
+	instanceBuffer_.reset();
+	for (auto & timer: frameTimers_)
+	{
+		timer.reset();
+	}
 	initialized_ = false;
 }
 
@@ -54,7 +120,7 @@ void SceneRenderer::setupLightUniforms(QOpenGLShaderProgram * shader)
 	if (!shader)
 		return;
 
-	shader->bind();
+	context_->useProgram(shader->programId());
 
 	shader->setUniformValue("dirLightDirection", directionalLight_.direction);
 	shader->setUniformValue("dirLightColor", directionalLight_.color);
@@ -68,8 +134,6 @@ void SceneRenderer::setupLightUniforms(QOpenGLShaderProgram * shader)
 	shader->setUniformValue("spotLightCutOff", spotLight_.cutOff);
 	shader->setUniformValue("spotLightOuterCutOff", spotLight_.outerCutOff);
 	shader->setUniformValue("spotLightEnabled", spotLight_.enabled);
-
-	shader->release();
 }
 
 void SceneRenderer::renderScene(SceneGraph * scene, Camera * camera)
@@ -77,42 +141,116 @@ void SceneRenderer::renderScene(SceneGraph * scene, Camera * camera)
 	if (!initialized_ || !scene || !camera || !context_)
 		return;
 
+	// Qt binds textures in this context behind the shadow when it recreates the widget's framebuffer, as on resize;
+	// everything of ours binds through the context, so forgetting the shadow once per frame covers the rest.
+	context_->invalidate();
 	context_->functions()->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	collectRenderBatches(scene, camera);
 
 	sortBatches(camera);
 
+	// Uploads made now are sampled by this frame's draws.
+	textureStreamer_->update();
+	animations_->uploadPalette(*context_);
+	uploadInstances();
+
+	// The query reused this frame was issued frameTimers_.size() frames ago, so reading it rarely stalls.
+	auto & timer = frameTimers_[frameIndex_++ % frameTimers_.size()];
+	if (timer)
+	{
+		if (frameIndex_ > frameTimers_.size() && timer->isResultAvailable())
+			lastFrameGpuMilliseconds_ = static_cast<double>(timer->waitForResult()) / 1.0e6;
+		timer->begin();
+	}
+
 	renderBatches(camera);
 
+	if (timer)
+		timer->end();
+
 	lastFrameBatchCount_ = renderBatches_.size();
 }
 
 void SceneRenderer::collectRenderBatches(SceneGraph * scene, Camera * camera)
 {
 	renderBatches_.clear();
+	nodes_.clear();
+	models_.clear();
+	modelCopies_.clear();
+	instancedMeshes_.clear();
+	instances_.clear();
+	instanceGroups_.clear();
+	lastFrameModelsCulled_ = 0;
+	lastFrameMeshesCulled_ = 0;
+	lastFrameTriangleCount_ = 0;
+	lastFrameClustersTested_ = 0;
+	lastFrameClustersCulled_ = 0;
+	lastFrameInstancedDraws_ = 0;
+	lastFrameInstancedMeshes_ = 0;
 
 	if (!scene->getRoot())
 		return;
 
 	const QVector3D cameraPos = camera->getPosition();
+	// Pixels covered by one unit at distance one; the projection's y scale is cot(fov / 2).
+	const float projectionScale = camera->getProjectionMatrix()(1, 1) * static_cast<float>(viewportHeight_) * 0.5f;
+	const QMatrix4x4 viewProjection = camera->getViewProjectionMatrix();
 
-	scene->getRoot()->traverseVisible([this, &cameraPos](SceneNode * node) {
+	// The scene's BVH rejects entities by their world-space boxes, whole groups of them per node it tests, or the
+	// linear pass tests all of them; entities without static bounds always pass.
+	if (frustumCulling_)
+	{
+		bool linear = cullingMethod_ == CullingMethod::Linear;
+		if (cullingMethod_ == CullingMethod::Automatic)
+		{
+			// Each method is timed once before either is preferred.
+			if (bvhCullMilliseconds_ < 0.0 || linearCullMilliseconds_ < 0.0)
+			{
+				linear = bvhCullMilliseconds_ >= 0.0;
+			}
+			else
+			{
+				linear = linearCullMilliseconds_ < bvhCullMilliseconds_;
+				if (++framesSinceCullingProbe_ >= g_cullingProbeInterval)
+				{
+					linear = !linear;
+					framesSinceCullingProbe_ = 0;
+				}
+			}
+		}
+
+		QElapsedTimer timer;
+		timer.start();
+		BvhCullStats stats;
+		scene->cull(extractFrustumPlanes(viewProjection.constData()), nodes_, stats, linear);
+		const double milliseconds = static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+
+		// A method that did not run last frame has a stale cost, so its fresh one replaces it.
+		double & cost = linear ? linearCullMilliseconds_ : bvhCullMilliseconds_;
+		cost = cost < 0.0 || linear != lastFrameLinearCulling_ ? milliseconds
+															  : cost + (milliseconds - cost) * g_cullingCostSmoothing;
+		lastFrameModelsCulled_ = stats.proxiesCulled;
+		lastFrameLinearCulling_ = linear;
+	}
+	else
+	{
+		scene->getRoot()->traverseVisible([this](SceneNode * node) { nodes_.push_back(node); });
+	}
+
+	for (auto * node: nodes_)
+	{
 		auto entity = node->getEntity();
 		if (!entity || !entity->isVisible())
-			return;
-
-		float distance = (entity->getPosition() - cameraPos).length();
+			continue;
 
 		if (auto modelEntity = std::dynamic_pointer_cast<ModelEntity>(entity))
 		{
 			if (modelEntity->isLoaded())
 			{
-				RenderBatch batch;
-				batch.type = RenderBatch::MODEL;
-				batch.entity = modelEntity.get();
-				batch.distance = distance;
-				renderBatches_.push_back(batch);
+				models_.push_back(modelEntity.get());
+				if (instancing_)
+					++modelCopies_[modelEntity->getInstanceKey()];
 			}
 		}
 		else if (auto skyboxEntity = std::dynamic_pointer_cast<SkyboxEntity>(entity))
@@ -122,29 +260,159 @@ void SceneRenderer::collectRenderBatches(SceneGraph * scene, Camera * camera)
 				RenderBatch batch;
 				batch.type = RenderBatch::SKYBOX;
 				batch.entity = skyboxEntity.get();
-				batch.distance = distance;
+				batch.distance = (entity->getWorldTransform().column(3).toVector3D() - cameraPos).length();
 				renderBatches_.push_back(batch);
 			}
 		}
+	}
+
+	CullStats meshes;
+	CullStats clusters;
+	for (auto * modelEntity: models_)
+	{
+		RenderBatch batch;
+		batch.type = RenderBatch::MODEL;
+		batch.entity = modelEntity;
+		batch.distance = (modelEntity->getWorldTransform().column(3).toVector3D() - cameraPos).length();
+		batch.triangles = modelEntity->selectLods(cameraPos, projectionScale, lodThresholdPixels_);
+		if (frustumCulling_)
+			batch.triangles -= modelEntity->cullMeshes(viewProjection, meshes);
+
+		// Many copies cost more in draw calls than cluster culling saves on the GPU.
+		const bool instanced = instancing_ && modelCopies_[modelEntity->getInstanceKey()] >= g_minimumInstances;
+		if (clusterCulling_ && !instanced)
+			batch.triangles -= modelEntity->cullClusters(viewProjection, cameraPos, clusters);
+		modelEntity->requestTextureResolutions(cameraPos, projectionScale);
+		lastFrameTriangleCount_ += batch.triangles;
+
+		// Copies whose meshes all went to the instanced draws need no batch of their own.
+		if (instanced && modelEntity->collectInstancedMeshes(instancedMeshes_) == 0)
+			continue;
+		renderBatches_.push_back(batch);
+	}
+	collectInstanceGroups(cameraPos);
+
+	lastFrameMeshesCulled_ = meshes.culled;
+	lastFrameClustersTested_ = clusters.tested;
+	lastFrameClustersCulled_ = clusters.culled;
+}
+
+void SceneRenderer::collectInstanceGroups(const QVector3D & cameraPos)
+{
+	std::sort(instancedMeshes_.begin(), instancedMeshes_.end(), [](const InstancedMesh & a, const InstancedMesh & b) {
+		return a.key != b.key ? std::less<const void *>()(a.key, b.key) : a.lod < b.lod;
 	});
+
+	// Each group sorts by its nearest instance.
+	const size_t firstBatch = renderBatches_.size();
+	for (size_t i = 0; i < instancedMeshes_.size(); ++i)
+	{
+		const auto & mesh = instancedMeshes_[i];
+		if (i == 0 || mesh.key != instancedMeshes_[i - 1].key || mesh.lod != instancedMeshes_[i - 1].lod)
+		{
+			instanceGroups_.push_back({i, 0});
+			RenderBatch batch;
+			batch.type = RenderBatch::INSTANCES;
+			batch.distance = std::numeric_limits<float>::max();
+			renderBatches_.push_back(batch);
+		}
+		++instanceGroups_.back().count;
+		instances_.push_back(mesh.instance);
+
+		const QVector3D position(mesh.instance.model[12], mesh.instance.model[13], mesh.instance.model[14]);
+		renderBatches_.back().distance = std::min(renderBatches_.back().distance, (position - cameraPos).length());
+	}
+
+	// The groups stay where they are from here on.
+	for (size_t i = 0; i < instanceGroups_.size(); ++i)
+	{
+		renderBatches_[firstBatch + i].entity = &instanceGroups_[i];
+	}
+
+	lastFrameInstancedDraws_ = instanceGroups_.size();
+	lastFrameInstancedMeshes_ = instancedMeshes_.size();
+}
+
+void SceneRenderer::uploadInstances()
+{
+	if (instances_.empty() || !instanceBuffer_)
+		return;
+
+	// Allocating anew orphans the storage that the previous frame's draws may still read.
+	context_->bindBuffer(GL_ARRAY_BUFFER, instanceBuffer_->bufferId());
+	instanceBuffer_->allocate(instances_.data(), static_cast<int>(instances_.size() * sizeof(MeshInstance)));
+}
+
+uint64_t SceneRenderer::getSortKey(const RenderBatch & batch)
+{
+	DrawState state;
+	switch (batch.type)
+	{
+		case RenderBatch::SKYBOX:
+			return makeSortKey(g_skyboxPass, 0, 0, 0, batch.distance);
+
+		case RenderBatch::MODEL: {
+			// A model binds the state of each of its meshes in turn; the first one stands for all.
+			const auto * modelEntity = static_cast<const ModelEntity *>(batch.entity);
+			state = modelEntity->getDrawState(modelEntity->getFirstMesh());
+			break;
+		}
+
+		case RenderBatch::INSTANCES: {
+			const auto & first = instancedMeshes_[static_cast<const InstanceGroup *>(batch.entity)->first];
+			state = first.entity->getDrawState(first.mesh);
+			break;
+		}
+	}
+	return makeSortKey(g_opaquePass, shaderIds_.get(state.program), materialIds_.get(state.texture),
+					   vertexArrayIds_.get(state.vertexArray), batch.distance);
 }
 
 void SceneRenderer::sortBatches(Camera * /*camera*/)
 {
-	std::sort(renderBatches_.begin(), renderBatches_.end(),
-			  [](const RenderBatch & a, const RenderBatch & b) {
-				  if (a.type == RenderBatch::SKYBOX && b.type != RenderBatch::SKYBOX)
-					  return true;
-				  if (a.type != RenderBatch::SKYBOX && b.type == RenderBatch::SKYBOX)
-					  return false;
+	QElapsedTimer timer;
+	timer.start();
+
+	sortKeys_.clear();
+	sortIds_.clear();
+	for (const auto & batch: renderBatches_)
+	{
+		sortKeys_.push_back(getSortKey(batch));
+		// Instance groups are collected anew every frame; their mesh and level name them across frames.
+		if (batch.type == RenderBatch::INSTANCES)
+			sortIds_.push_back(instancedMeshes_[static_cast<const InstanceGroup *>(batch.entity)->first].levelKey);
+		else
+			sortIds_.push_back(batch.entity);
+	}
+	// State objects no longer drawn, destroyed ones among them, give their ids back.
+	shaderIds_.endFrame();
+	materialIds_.endFrame();
+	vertexArrayIds_.endFrame();
+
+	// Batches collected in the same order as last frame start from last frame's sorted order.
+	const auto & order = sorter_.sort(sortKeys_, sortIds_);
+	sortedBatches_.clear();
+	lastFrameStateChanges_ = 0;
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		sortedBatches_.push_back(renderBatches_[order[i]]);
+		if (i == 0 || getSortKeyState(sortKeys_[order[i]]) != getSortKeyState(sortKeys_[order[i - 1]]))
+			++lastFrameStateChanges_;
+	}
+	renderBatches_.swap(sortedBatches_);
 
-				  return a.distance < b.distance;
-			  });
+	lastFrameSortMicroseconds_ = static_cast<double>(timer.nsecsElapsed()) / 1.0e3;
 }
 
 void SceneRenderer::renderBatches(Camera * camera)
 {
-	lastFrameTriangleCount_ = 0;
+	// The pass's defaults, filtered like every later call.
+	context_->resetStats();
+	context_->setDepthTest(true);
+	context_->setDepthMask(true);
+	context_->setDepthFunc(GL_LESS);
+	context_->setCullFace(true);
+	context_->setBlend(false);
 
 	SkyboxEntity * skyboxEntity = nullptr;
 	for (const auto & batch: renderBatches_)
@@ -161,6 +429,12 @@ void SceneRenderer::renderBatches(Camera * camera)
 		setupLightUniforms(modelShader_.get());
 	}
 
+	QOpenGLTexture * jointPalette = animations_->getPaletteTexture();
+	if (jointPalette)
+	{
+		context_->bindTexture(2, GL_TEXTURE_2D, jointPalette->textureId());
+	}
+
 	for (const auto & batch: renderBatches_)
 	{
 		switch (batch.type)
@@ -171,72 +445,87 @@ void SceneRenderer::renderBatches(Camera * camera)
 				break;
 			}
 
-			case RenderBatch::MODEL: {
-				auto modelEntity = static_cast<ModelEntity *>(batch.entity);
-
+			case RenderBatch::MODEL:
+			case RenderBatch::INSTANCES: {
 				if (skyboxEntity && skyboxEntity->getTexture())
 				{
-					skyboxEntity->getTexture()->bind(1);
+					context_->bindTexture(1, GL_TEXTURE_CUBE_MAP, skyboxEntity->getTexture()->textureId());
 				}
 
-				modelEntity->render(camera, context_);
-
-				if (skyboxEntity && skyboxEntity->getTexture())
+				if (batch.type == RenderBatch::MODEL)
 				{
-					skyboxEntity->getTexture()->release();
+					static_cast<ModelEntity *>(batch.entity)->render(camera, context_);
 				}
-
-				for (const auto & mesh: modelEntity->getMeshes())
+				else
 				{
-					lastFrameTriangleCount_ += mesh.indices.size() / 3;
+					// Any instance draws the group: they share the mesh buffers, textures and program.
+					const auto * group = static_cast<const InstanceGroup *>(batch.entity);
+					const auto & first = instancedMeshes_[group->first];
+					first.entity->renderInstances(camera, context_, first, *instanceBuffer_, group->first * sizeof(MeshInstance),
+												  static_cast<GLsizei>(group->count));
 				}
 				break;
 			}
 		}
 	}
+
+	// Buffers Qt binds before the next frame must not land in the last mesh's vertex array.
+	context_->bindVertexArray(0);
+	lastFrameGlState_ = context_->getStats();
 }
 
-bool SceneRenderer::createShaders()
+std::shared_ptr<QOpenGLShaderProgram> SceneRenderer::loadShaderProgram(const QString & vertexPath, const QString & fragmentPath)
 {
-	modelShader_ = std::make_shared<QOpenGLShaderProgram>();
-	if (!modelShader_->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/Shaders/model.vs"))
+	const QString path = vertexPath + "|" + fragmentPath;
+	if (auto program = assets_->findByPath<QOpenGLShaderProgram>(AssetType::ShaderProgram, path))
+		return program;
+
+	QFile vertexFile(vertexPath);
+	QFile fragmentFile(fragmentPath);
+	if (!vertexFile.open(QIODevice::ReadOnly) || !fragmentFile.open(QIODevice::ReadOnly))
 	{
-		return false;
+		return nullptr;
 	}
+	const QByteArray vertexSource = vertexFile.readAll();
+	const QByteArray fragmentSource = fragmentFile.readAll();
+	const uint64_t contentHash = hashBytes(fragmentSource.constData(), static_cast<size_t>(fragmentSource.size()),
+										   hashBytes(vertexSource.constData(), static_cast<size_t>(vertexSource.size())));
 
-	if (!modelShader_->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/Shaders/model.fs"))
+	auto program = assets_->findByContent<QOpenGLShaderProgram>(AssetType::ShaderProgram, contentHash);
+	if (!program)
 	{
-		return false;
+		program = std::make_shared<QOpenGLShaderProgram>();
+		if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource)
+			|| !program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource) || !program->link())
+		{
+			return nullptr;
+		}
 	}
 
-	if (!modelShader_->link())
+	// Drivers do not report program sizes, so only the sources are counted.
+	const auto sourceBytes = static_cast<size_t>(vertexSource.size() + fragmentSource.size());
+	return assets_->insert(AssetType::ShaderProgram, path, 0, contentHash, program,
+						   [sourceBytes](const QOpenGLShaderProgram &) { return AssetMemory{sourceBytes, 0}; });
+}
+
+bool SceneRenderer::createShaders()
+{
+	modelShader_ = loadShaderProgram(":/Shaders/model.vs", ":/Shaders/model.fs");
+	if (!modelShader_)
 	{
 		return false;
 	}
 
-	modelShader_->bind();
+	context_->useProgram(modelShader_->programId());
 	modelShader_->setUniformValue("diffuseTexture", 0);// GL_TEXTURE0
 	modelShader_->setUniformValue("skybox", 1);        // GL_TEXTURE1
+	modelShader_->setUniformValue("jointPalette", 2);  // GL_TEXTURE2
+	modelShader_->setUniformValue("morphDeltas", 3);   // GL_TEXTURE3
 
 	setupLightUniforms(modelShader_.get());
 
-	modelShader_->release();
-
-	skyboxShader_ = std::make_shared<QOpenGLShaderProgram>();
-	if (!skyboxShader_->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/Shaders/skybox.vs"))
-	{
-		return false;
-	}
-
-	if (!skyboxShader_->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/Shaders/skybox.fs"))
-	{
-		return false;
-	}
-
-	if (!skyboxShader_->link())
-	{
-		return false;
-	}
+	context_->useProgram(0);
 
-	return true;
+	skyboxShader_ = loadShaderProgram(":/Shaders/skybox.vs", ":/Shaders/skybox.fs");
+	return skyboxShader_ != nullptr;
 }
\ No newline at end of file
@@ -1,27 +1,39 @@
 #pragma once
 
+#include "AnimationSystem.h"
+#include "AssetManager.h"
+#include "ModelEntity.h"
 #include "OpenGLContext.h"
+#include "RenderSort.h"
+#include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLTimerQuery>
 #include <QVector3D>
+#include <array>
 #include <memory>
 #include <qmath.h>
+#include <unordered_map>
 #include <vector>
 
 class Camera;
 class SceneGraph;
-class ModelEntity;
+class SceneNode;
 class SkyboxEntity;
+class TextureStreamer;
 
 struct RenderBatch {
 	enum Type
 	{
 		MODEL,
-		SKYBOX
+		SKYBOX,
+		INSTANCES
 	};
 
 	Type type;
+	// The entity drawn, or for INSTANCES the InstanceGroup.
 	void * entity;
 	float distance;
+	size_t triangles = 0;
 };
 
 struct DirectionalLight {
@@ -64,13 +76,76 @@ public:
 	std::shared_ptr<QOpenGLShaderProgram> getModelShader() const { return modelShader_; }
 	std::shared_ptr<QOpenGLShaderProgram> getSkyboxShader() const { return skyboxShader_; }
 
+	void setViewportSize(int width, int height);
+
+	// Largest projected LOD error, in pixels, that model LOD selection accepts.
+	void setLodThreshold(float pixels) { lodThresholdPixels_ = pixels; }
+	float getLodThreshold() const { return lodThresholdPixels_; }
+
+	// Frustum culling of models by the world-space boxes the scene's BVH keeps, and then of the meshes of those that
+	// pass, before any other per-model work.
+	void setFrustumCulling(bool enable) { frustumCulling_ = enable; }
+	bool isFrustumCullingEnabled() const { return frustumCulling_; }
+
+	// How frustum culling finds the models that pass: by walking the BVH, which wins while little of the scene is in
+	// view, by testing every box in SIMD batches, which wins when much of it is, or by timing both and running the
+	// cheaper one.
+	enum class CullingMethod
+	{
+		Automatic,
+		Bvh,
+		Linear
+	};
+	void setCullingMethod(CullingMethod method) { cullingMethod_ = method; }
+	CullingMethod getCullingMethod() const { return cullingMethod_; }
+	bool isLastFrameCulledLinearly() const { return lastFrameLinearCulling_; }
+
+	// Per-meshlet frustum and normal cone culling of models before their draws are emitted.
+	void setClusterCulling(bool enable) { clusterCulling_ = enable; }
+	bool isClusterCullingEnabled() const { return clusterCulling_; }
+
+	// One instanced draw per mesh and level for models with many visible copies, in place of a draw per copy. Their
+	// static meshes skip cluster culling, whose results differ per copy.
+	void setInstancing(bool enable) { instancing_ = enable; }
+	bool isInstancingEnabled() const { return instancing_; }
+
+	// Registry of the shader programs, shared with the models for their meshes and textures.
+	std::shared_ptr<AssetManager> getAssetManager() const { return assets_; }
+
+	// Shared with the models, whose skins it evaluates; its joint palette is uploaded for every frame's draws.
+	std::shared_ptr<AnimationSystem> getAnimationSystem() const { return animations_; }
+
+	// Shared with the models, whose textures it streams at the density they are seen with.
+	std::shared_ptr<TextureStreamer> getTextureStreamer() const { return textureStreamer_; }
+	void setTextureBudget(size_t bytes);
+
 	size_t getLastFrameBatchCount() const { return lastFrameBatchCount_; }
+	size_t getLastFrameModelsCulled() const { return lastFrameModelsCulled_; }
+	size_t getLastFrameMeshesCulled() const { return lastFrameMeshesCulled_; }
 	size_t getLastFrameTriangleCount() const { return lastFrameTriangleCount_; }
+	size_t getLastFrameClustersTested() const { return lastFrameClustersTested_; }
+	size_t getLastFrameClustersCulled() const { return lastFrameClustersCulled_; }
+	size_t getLastFrameInstancedDraws() const { return lastFrameInstancedDraws_; }
+	size_t getLastFrameInstancedMeshes() const { return lastFrameInstancedMeshes_; }
+	// Changes of program, texture or vertex array between consecutive batches, as sorted.
+	size_t getLastFrameStateChanges() const { return lastFrameStateChanges_; }
+	double getLastFrameSortMicroseconds() const { return lastFrameSortMicroseconds_; }
+	// GL state calls of the draws, made and skipped as repeating the context's shadow.
+	const OpenGLStateStats & getLastFrameGlState() const { return lastFrameGlState_; }
+	// GPU time of a recent frame's draws, a few frames behind; 0 until timer queries report.
+	double getLastFrameGpuMilliseconds() const { return lastFrameGpuMilliseconds_; }
 
 private:
 	void collectRenderBatches(SceneGraph * scene, Camera * camera);
+	uint64_t getSortKey(const RenderBatch & batch);
+	// Orders the batches by sort key: the skybox first, then by program, texture and vertex array, then front to back.
 	void sortBatches(Camera * camera);
 	void renderBatches(Camera * camera);
+	// Groups the meshes collected for instancing into one batch per mesh and level and lays out their attributes.
+	void collectInstanceGroups(const QVector3D & cameraPos);
+	void uploadInstances();
+	// Compiles and links the program, or shares the one already built from the same files or sources.
+	std::shared_ptr<QOpenGLShaderProgram> loadShaderProgram(const QString & vertexPath, const QString & fragmentPath);
 	bool createShaders();
 	void setupLightUniforms(QOpenGLShaderProgram * shader);
 
@@ -83,9 +158,62 @@ private:
 	SpotLight spotLight_;
 
 	std::vector<RenderBatch> renderBatches_;
+	// Scratch of sortBatches, and the ids and sorter kept across frames so that unchanged batches keep their keys
+	// and order.
+	std::vector<uint64_t> sortKeys_;
+	std::vector<const void *> sortIds_;
+	std::vector<RenderBatch> sortedBatches_;
+	SortStateIds shaderIds_;
+	SortStateIds materialIds_;
+	SortStateIds vertexArrayIds_;
+	SortKeySorter sorter_;
+	// Scratch of collectRenderBatches: the nodes the scene's BVH did not cull, or all visible ones without culling,
+	// their loaded models and the number of those drawing the same meshes.
+	std::vector<SceneNode *> nodes_;
+	std::vector<ModelEntity *> models_;
+	std::unordered_map<const void *, size_t> modelCopies_;
+
+	// Meshes drawn instanced this frame, sorted by mesh and level, with their attributes in the same order; each group
+	// is a run of them drawn with one call.
+	struct InstanceGroup {
+		size_t first = 0;
+		size_t count = 0;
+	};
+	std::vector<InstancedMesh> instancedMeshes_;
+	std::vector<MeshInstance> instances_;
+	std::vector<InstanceGroup> instanceGroups_;
+	std::unique_ptr<QOpenGLBuffer> instanceBuffer_;
+	std::shared_ptr<TextureStreamer> textureStreamer_;
+	std::shared_ptr<AssetManager> assets_;
+	std::shared_ptr<AnimationSystem> animations_;
+
+	int viewportHeight_ = 0;
+	float lodThresholdPixels_ = 1.0f;
+	bool frustumCulling_ = true;
+	CullingMethod cullingMethod_ = CullingMethod::Automatic;
+	bool lastFrameLinearCulling_ = false;
+	// Running cull cost of each method in milliseconds, negative until it has been timed.
+	double bvhCullMilliseconds_ = -1.0;
+	double linearCullMilliseconds_ = -1.0;
+	int framesSinceCullingProbe_ = 0;
+	bool clusterCulling_ = true;
+	bool instancing_ = true;
 
 	size_t lastFrameBatchCount_ = 0;
+	size_t lastFrameModelsCulled_ = 0;
+	size_t lastFrameMeshesCulled_ = 0;
 	size_t lastFrameTriangleCount_ = 0;
+	size_t lastFrameClustersTested_ = 0;
+	size_t lastFrameClustersCulled_ = 0;
+	size_t lastFrameInstancedDraws_ = 0;
+	size_t lastFrameInstancedMeshes_ = 0;
+	size_t lastFrameStateChanges_ = 0;
+	double lastFrameSortMicroseconds_ = 0.0;
+	OpenGLStateStats lastFrameGlState_;
+
+	std::array<std::unique_ptr<QOpenGLTimerQuery>, 3> frameTimers_;
+	size_t frameIndex_ = 0;
+	double lastFrameGpuMilliseconds_ = 0.0;
 
 	bool initialized_ = false;
 };
\ No newline at end of file
@@ -3,11 +3,38 @@
 layout(location=0) in vec3 pos;
 layout(location=1) in vec3 normal;
 layout(location=2) in vec2 texCoord;
+layout(location=3) in vec4 joints;
+layout(location=4) in vec4 weights;
+
+// Instanced draws take the transform and the sphere morph per instance instead of from mvp, model and the morph
+// uniforms below: the center and radius of the sphere, and the factor, zero while the morph is off.
+uniform bool instanced;
+uniform mat4 viewProjection;
+layout(location=5) in mat4 instanceModel;
+layout(location=9) in vec4 instanceMorphSphere;
+layout(location=10) in float instanceMorphFactor;
 
 uniform mat4 mvp;
 uniform mat4 model;
 uniform mat4 normalMatrix;
 
+// Dequantization of packed vertex formats; identity for float vertices.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octahedralNormals;
+
+// Joint matrices of all skinned meshes, four texels per matrix and 256 matrices per row.
+uniform bool skinned;
+uniform int jointOffset;
+uniform sampler2D jointPalette;
+
+// Morph targets with a non-zero weight. Each starts at a texel offset into morphDeltas, rows of 4096 texels,
+// with a position and a normal delta per vertex.
+uniform int morphTargetCount;
+uniform int morphTargetOffsets[8];
+uniform float morphTargetWeights[8];
+uniform sampler2D morphDeltas;
+
 uniform float morphFactor;
 uniform float morphToSphere;
 uniform float sphereRadius;
@@ -17,28 +44,81 @@ out vec3 fragPos;
 out vec3 fragNormal;
 out vec2 fragTexCoord;
 
-vec3 morphToSpherePosition(vec3 position, float factor)
+vec3 morphToSpherePosition(mat4 modelMatrix, vec3 position, float factor, vec3 center, float radius)
 {
-    vec3 worldPos = vec3(model * vec4(position, 1.0));
+    vec3 worldPos = vec3(modelMatrix * vec4(position, 1.0));
     
-    if (morphToSphere > 0.5 && factor > 0.0) {
-        vec3 toCenter = worldPos - morphCenter;
+    if (factor > 0.0) {
+        vec3 toCenter = worldPos - center;
         float dist = length(toCenter);
         vec3 dir = toCenter / dist;
         
-        float targetDist = mix(dist, sphereRadius, min(factor, 0.99));
-        return morphCenter + dir * targetDist;
+        float targetDist = mix(dist, radius, min(factor, 0.99));
+        return center + dir * targetDist;
     }
     
     return worldPos;
 }
 
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+vec3 getMorphDelta(int texel)
+{
+    return texelFetch(morphDeltas, ivec2(texel % 4096, texel / 4096), 0).xyz;
+}
+
+mat4 getJointMatrix(float joint)
+{
+    int index = jointOffset + int(joint);
+    ivec2 texel = ivec2((index % 256) * 4, index / 256);
+    return mat4(texelFetch(jointPalette, texel, 0),
+                texelFetch(jointPalette, texel + ivec2(1, 0), 0),
+                texelFetch(jointPalette, texel + ivec2(2, 0), 0),
+                texelFetch(jointPalette, texel + ivec2(3, 0), 0));
+}
+
 void main() {
-    vec3 morphedWorldPos = morphToSpherePosition(pos, morphFactor);
+    vec3 position = positionOffset + pos * positionScale;
+    vec3 vertexNormal = octahedralNormals ? decodeOctahedral(normal.xy) : normal;
+
+    for (int i = 0; i < morphTargetCount; ++i) {
+        int texel = morphTargetOffsets[i] + gl_VertexID * 2;
+        position += morphTargetWeights[i] * getMorphDelta(texel);
+        vertexNormal += morphTargetWeights[i] * getMorphDelta(texel + 1);
+    }
+
+    if (skinned) {
+        mat4 skin = weights.x * getJointMatrix(joints.x) + weights.y * getJointMatrix(joints.y)
+                  + weights.z * getJointMatrix(joints.z) + weights.w * getJointMatrix(joints.w);
+        position = vec3(skin * vec4(position, 1.0));
+        vertexNormal = mat3(skin) * vertexNormal;
+    }
+
+    if (instanced) {
+        vec3 morphedWorldPos = morphToSpherePosition(instanceModel, position, instanceMorphFactor,
+                                                     instanceMorphSphere.xyz, instanceMorphSphere.w);
+
+        fragPos = morphedWorldPos;
+        fragNormal = transpose(inverse(mat3(instanceModel))) * vertexNormal;
+        fragTexCoord = texCoord;
+
+        gl_Position = viewProjection * vec4(morphedWorldPos, 1.0);
+        return;
+    }
+
+    float factor = morphToSphere > 0.5 ? morphFactor : 0.0;
+    vec3 morphedWorldPos = morphToSpherePosition(model, position, factor, morphCenter, sphereRadius);
     vec3 morphedLocalPos = vec3(inverse(model) * vec4(morphedWorldPos, 1.0));
     
     fragPos = morphedWorldPos;
-    fragNormal = transpose(inverse(mat3(model))) * normal;
+    fragNormal = transpose(inverse(mat3(model))) * vertexNormal;
     fragTexCoord = texCoord;
 
     gl_Position = mvp * vec4(morphedLocalPos, 1.0);
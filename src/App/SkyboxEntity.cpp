@@ -1,7 +1,10 @@
 #include "SkyboxEntity.h"
+#include "AssetPack.h"
 #include "Camera.h"
+#include <QDebug>
 #include <QImage>
 #include <QOpenGLFunctions>
+#include <vector>
 
 SkyboxEntity::SkyboxEntity(const std::string & name)
 	: Entity(name)
@@ -15,20 +18,20 @@ SkyboxEntity::~SkyboxEntity()
 
 bool SkyboxEntity::loadCubemap(const QStringList & faces)
 {
-	if (faces.size() != 6)
+	if (faces.size() != 6 || !context_)
 	{
 		return false;
 	}
 
-	texture_ = std::make_unique<QOpenGLTexture>(QOpenGLTexture::TargetCubeMap);
-	texture_->create();
-	texture_->setSize(1024, 1024);
-	texture_->setFormat(QOpenGLTexture::RGBA8_UNorm);
-	texture_->allocateStorage();
-
+	// All faces take the size of the first one so that they fit one allocation.
+	std::vector<QImage> images;
+	BlockFormat format = BlockFormat::None;
 	for (int i = 0; i < faces.size(); ++i)
 	{
-		QImage image(faces[i]);
+		QByteArray bytes;
+		QImage image;
+		if (readAsset(faces[i], bytes))
+			image.loadFromData(bytes);
 		if (image.isNull())
 		{
 			image = QImage(512, 512, QImage::Format_RGBA8888);
@@ -40,11 +43,54 @@ bool SkyboxEntity::loadCubemap(const QStringList & faces)
 			image = image.convertToFormat(QImage::Format_RGBA8888);
 		}
 
-		texture_->setData(0, 0, static_cast<QOpenGLTexture::CubeMapFace>(QOpenGLTexture::CubeMapPositiveX + i),
-						  QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, image.constBits());
+		if (!images.empty() && image.size() != images.front().size())
+			image = image.scaled(images.front().size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+		const BlockFormat faceFormat = chooseBlockFormat(image, textureCompression_);
+		if (images.empty() || faceFormat == BlockFormat::BC3)
+			format = faceFormat;
+		images.push_back(std::move(image));
 	}
 
+	if (texture_)
+		context_->forgetTexture(texture_->textureId());
+	texture_ = std::make_unique<QOpenGLTexture>(QOpenGLTexture::TargetCubeMap);
+	texture_->create();
+
+	// Block-compressed faces when every face encodes and the format is supported, RGBA8 otherwise.
+	bool compressed = format != BlockFormat::None && isBlockFormatSupported(format);
+	std::vector<TextureMipChain> compressedFaces;
+	for (size_t i = 0; compressed && i < images.size(); ++i)
+	{
+		compressedFaces.push_back(buildMipChain(images[i], format, false, textureCompression_.useCache));
+		compressed = compressedFaces.back().isValid();
+	}
+	for (size_t i = 0; compressed && i < compressedFaces.size(); ++i)
+	{
+		compressed = uploadCubeMapFace(*context_, *texture_, static_cast<int>(i), compressedFaces[i]);
+	}
+
+	if (!compressed)
+	{
+		context_->forgetTexture(texture_->textureId());
+		texture_ = std::make_unique<QOpenGLTexture>(QOpenGLTexture::TargetCubeMap);
+		texture_->create();
+		texture_->setSize(images.front().width(), images.front().height());
+		texture_->setFormat(QOpenGLTexture::RGBA8_UNorm);
+		texture_->allocateStorage();
+
+		for (size_t i = 0; i < images.size(); ++i)
+		{
+			texture_->setData(0, 0, static_cast<QOpenGLTexture::CubeMapFace>(QOpenGLTexture::CubeMapPositiveX + static_cast<int>(i)),
+							  QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, images[i].constBits());
+		}
+	}
+
+	qInfo().nospace() << "Loaded skybox " << images.front().width() << "x" << images.front().height() << " as "
+					  << getBlockFormatName(compressed ? format : BlockFormat::None);
+
 	texture_->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+	texture_->setMipLevelRange(0, 0);
 	texture_->setWrapMode(QOpenGLTexture::ClampToEdge);
 
 	initializeGeometry();
@@ -57,11 +103,9 @@ void SkyboxEntity::setShaderProgram(std::shared_ptr<QOpenGLShaderProgram> progra
 
 	if (program)
 	{
-		program->bind();
 		viewUniform_ = program->uniformLocation("view");
 		projectionUniform_ = program->uniformLocation("projection");
 		textureUniform_ = program->uniformLocation("skybox");
-		program->release();
 	}
 }
 
@@ -70,22 +114,22 @@ void SkyboxEntity::render(Camera * camera, OpenGLContextPtr context)
 	if (!camera || !shaderProgram_ || !texture_ || !initialized_ || !context)
 		return;
 
-	GLboolean depthMask;
-	context->functions()->glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	// The mask comes from the context's shadow; reading it back from the driver could stall the pipeline.
+	const bool depthMask = context->getDepthMask();
 
-	context->functions()->glDepthMask(GL_FALSE);
-	context->functions()->glDepthFunc(GL_LEQUAL);
-	context->functions()->glDisable(GL_CULL_FACE);
+	context->setDepthMask(false);
+	context->setDepthFunc(GL_LEQUAL);
+	context->setCullFace(false);
 
-	shaderProgram_->bind();
-	vao_.bind();
+	context->useProgram(shaderProgram_->programId());
+	context->bindVertexArray(vao_.objectId());
 
 	if (viewUniform_ >= 0)
 		shaderProgram_->setUniformValue(viewUniform_, camera->getViewMatrix());
 	if (projectionUniform_ >= 0)
 		shaderProgram_->setUniformValue(projectionUniform_, camera->getProjectionMatrix());
 
-	texture_->bind(0);
+	context->bindTexture(0, GL_TEXTURE_CUBE_MAP, texture_->textureId());
 	if (textureUniform_ >= 0)
 	{
 		shaderProgram_->setUniformValue(textureUniform_, 0);
@@ -93,13 +137,9 @@ void SkyboxEntity::render(Camera * camera, OpenGLContextPtr context)
 
 	context->functions()->glDrawArrays(GL_TRIANGLES, 0, 36);
 
-	texture_->release();
-	vao_.release();
-	shaderProgram_->release();
-
-	context->functions()->glDepthMask(depthMask);
-	context->functions()->glDepthFunc(GL_LESS);
-	context->functions()->glEnable(GL_CULL_FACE);
+	context->setDepthMask(depthMask);
+	context->setDepthFunc(GL_LESS);
+	context->setCullFace(true);
 }
 
 void SkyboxEntity::initializeGeometry()
@@ -151,25 +191,30 @@ void SkyboxEntity::initializeGeometry()
 		1.0f, -1.0f, 1.0f};
 
 	vao_.create();
-	vao_.bind();
+	context_->bindVertexArray(vao_.objectId());
 
 	vbo_.create();
-	vbo_.bind();
+	context_->bindBuffer(GL_ARRAY_BUFFER, vbo_.bufferId());
 	vbo_.setUsagePattern(QOpenGLBuffer::StaticDraw);
 	vbo_.allocate(skyboxVertices, sizeof(skyboxVertices));
 
-	shaderProgram_->bind();
 	shaderProgram_->enableAttributeArray(0);
 	shaderProgram_->setAttributeBuffer(0, GL_FLOAT, 0, 3, 3 * sizeof(float));
-	shaderProgram_->release();
 
-	vao_.release();
+	context_->bindVertexArray(0);
 
 	initialized_ = true;
 }
 
 void SkyboxEntity::cleanupResources()
 {
+	if (context_)
+	{
+		context_->forgetVertexArray(vao_.objectId());
+		context_->forgetBuffer(vbo_.bufferId());
+		if (texture_)
+			context_->forgetTexture(texture_->textureId());
+	}
 	vao_.destroy();
 	vbo_.destroy();
 	texture_.reset();
@@ -2,6 +2,7 @@
 
 #include "Entity.h"
 #include "OpenGLContext.h"
+#include "TextureCompressor.h"
 #include <QOpenGLBuffer>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
@@ -16,8 +17,15 @@ public:
 	SkyboxEntity(const std::string & name = "Skybox");
 	~SkyboxEntity() override;
 
+	// Context the uploads bind through and the deleted objects are dropped from; set before loadCubemap.
+	void setContext(OpenGLContextPtr context) { context_ = std::move(context); }
+
+	// Faces are file, ":/" or pack paths.
 	bool loadCubemap(const QStringList & faces);
 
+	// Applies to the next loadCubemap. Faces are stored without mipmaps.
+	void setTextureCompression(const TextureCompressionOptions & options) { textureCompression_ = options; }
+
 	void setShaderProgram(std::shared_ptr<QOpenGLShaderProgram> program);
 
 	void render(Camera * camera, OpenGLContextPtr context) override;
@@ -30,8 +38,10 @@ private:
 	void initializeGeometry();
 	void cleanupResources();
 
+	OpenGLContextPtr context_;
 	std::shared_ptr<QOpenGLShaderProgram> shaderProgram_;
 	std::unique_ptr<QOpenGLTexture> texture_;
+	TextureCompressionOptions textureCompression_;
 
 	QOpenGLBuffer vbo_{QOpenGLBuffer::Type::VertexBuffer};
 	QOpenGLVertexArrayObject vao_;
@@ -0,0 +1,312 @@
+#include "TextureCompressor.h"
+#include "ContentHash.h"
+#include "MeshCache.h"
+#include "OpenGLContext.h"
+#include "ThreadPool.h"
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLTexture>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <type_traits>
+
+namespace
+{
+constexpr char g_magic[8] = {'F', 'G', 'L', 'B', 'C', 'T', 'X', '\0'};
+// Bumped whenever the encoders change their output.
+constexpr uint32_t g_version = 1;
+// Blocks encoded per job; small mip levels share one job.
+constexpr size_t g_blocksPerJob = 4096;
+
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t reserved;
+	uint64_t imageHash;
+	uint64_t dataSize;
+};
+
+static_assert(std::is_trivially_copyable_v<CacheHeader>);
+
+QString getTextureCachePath(uint64_t imageHash, BlockFormat format, bool mipmapped)
+{
+	return QDir(getCacheDirectory())
+		.filePath(QString("textures/%1-%2%3.bctex").arg(imageHash, 16, 16, QChar('0')).arg(getBlockFormatName(format)).arg(mipmapped ? "-mips" : ""));
+}
+
+bool loadTextureCache(const QString & cachePath, uint64_t imageHash, BlockFormat format, int width, int height,
+					  TextureMipChain & texture)
+{
+	QFile file(cachePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	const QByteArray bytes = file.readAll();
+	CacheHeader header;
+	if (static_cast<size_t>(bytes.size()) < sizeof(header))
+		return false;
+
+	std::memcpy(&header, bytes.constData(), sizeof(header));
+	const uint64_t tableSize = uint64_t{header.levelCount + 1} * sizeof(uint64_t);
+	if (std::memcmp(header.magic, g_magic, sizeof(g_magic)) != 0 || header.version != g_version
+		|| header.format != static_cast<uint32_t>(format) || header.imageHash != imageHash
+		|| header.width != static_cast<uint32_t>(width) || header.height != static_cast<uint32_t>(height)
+		|| static_cast<uint64_t>(bytes.size()) != sizeof(header) + tableSize + header.dataSize)
+	{
+		return false;
+	}
+
+	std::vector<uint64_t> offsets(header.levelCount + 1);
+	std::memcpy(offsets.data(), bytes.constData() + sizeof(header), tableSize);
+	if (offsets.front() != 0 || offsets.back() != header.dataSize || !std::is_sorted(offsets.begin(), offsets.end()))
+		return false;
+
+	texture.format = format;
+	texture.width = width;
+	texture.height = height;
+	texture.levelOffsets.assign(offsets.begin(), offsets.end());
+	const auto * data = reinterpret_cast<const uint8_t *>(bytes.constData()) + sizeof(header) + tableSize;
+	texture.data.assign(data, data + header.dataSize);
+	return true;
+}
+
+bool storeTextureCache(const QString & cachePath, uint64_t imageHash, const TextureMipChain & texture)
+{
+	if (!QDir().mkpath(QFileInfo(cachePath).absolutePath()))
+		return false;
+
+	CacheHeader header = {};
+	std::memcpy(header.magic, g_magic, sizeof(g_magic));
+	header.version = g_version;
+	header.format = static_cast<uint32_t>(texture.format);
+	header.width = static_cast<uint32_t>(texture.width);
+	header.height = static_cast<uint32_t>(texture.height);
+	header.levelCount = static_cast<uint32_t>(texture.getLevelCount());
+	header.imageHash = imageHash;
+	header.dataSize = texture.data.size();
+	const std::vector<uint64_t> offsets(texture.levelOffsets.begin(), texture.levelOffsets.end());
+
+	QSaveFile file(cachePath);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(offsets.data()), static_cast<qint64>(offsets.size() * sizeof(uint64_t)));
+	file.write(reinterpret_cast<const char *>(texture.data.data()), static_cast<qint64>(texture.data.size()));
+	return file.commit();
+}
+
+GLenum getInternalFormat(BlockFormat format)
+{
+	switch (format)
+	{
+		case BlockFormat::BC1:
+			return QOpenGLTexture::RGB_DXT1;
+		case BlockFormat::BC3:
+			return QOpenGLTexture::RGBA_DXT5;
+		case BlockFormat::BC5:
+			return QOpenGLTexture::RG_ATI2N_UNorm;
+		case BlockFormat::BC7:
+			return QOpenGLTexture::RGB_BP_UNorm;
+		case BlockFormat::None:
+			break;
+	}
+	return GL_RGBA8;
+}
+
+}// namespace
+
+uint64_t hashImage(const QImage & image)
+{
+	uint64_t hash = hashCombine(static_cast<uint64_t>(image.width()), static_cast<uint64_t>(image.height()));
+	const auto rowBytes = static_cast<size_t>(image.width()) * 4;
+	if (static_cast<size_t>(image.bytesPerLine()) == rowBytes)
+		return hashBytes(image.constBits(), rowBytes * static_cast<size_t>(image.height()), hash);
+
+	for (int y = 0; y < image.height(); ++y)
+	{
+		hash = hashBytes(image.constScanLine(y), rowBytes, hash);
+	}
+	return hash;
+}
+
+BlockFormat chooseBlockFormat(const QImage & image, const TextureCompressionOptions & options)
+{
+	if (!options.enabled || image.isNull() || image.format() != QImage::Format_RGBA8888)
+		return BlockFormat::None;
+	if (options.allowBc7)
+		return BlockFormat::BC7;
+
+	for (int y = 0; y < image.height(); ++y)
+	{
+		const uchar * row = image.constScanLine(y);
+		for (int x = 0; x < image.width(); ++x)
+		{
+			if (row[x * 4 + 3] != 255)
+				return BlockFormat::BC3;
+		}
+	}
+	return BlockFormat::BC1;
+}
+
+TextureMipChain buildMipChain(const QImage & image, BlockFormat format, bool mipmapped, bool useCache,
+							  TextureCompressionStats * stats)
+{
+	TextureMipChain texture;
+	if (image.isNull() || image.format() != QImage::Format_RGBA8888)
+		return texture;
+	useCache = useCache && format != BlockFormat::None;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	const int width = image.width();
+	const int height = image.height();
+	const uint64_t imageHash = hashImage(image);
+	const QString cachePath = getTextureCachePath(imageHash, format, mipmapped);
+	const bool cacheHit = useCache && loadTextureCache(cachePath, imageHash, format, width, height, texture);
+
+	if (!cacheHit)
+	{
+		// Tightly packed copies of every level; level 0 borrows the image when it has no row padding.
+		std::vector<std::vector<uint8_t>> levels;
+		std::vector<const uint8_t *> pixels;
+		const auto rowBytes = static_cast<size_t>(width) * 4;
+		if (static_cast<size_t>(image.bytesPerLine()) == rowBytes)
+		{
+			pixels.push_back(image.constBits());
+		}
+		else
+		{
+			auto & copy = levels.emplace_back(rowBytes * static_cast<size_t>(height));
+			for (int y = 0; y < height; ++y)
+			{
+				std::memcpy(copy.data() + rowBytes * static_cast<size_t>(y), image.constScanLine(y), rowBytes);
+			}
+			pixels.push_back(copy.data());
+		}
+		for (int level = 1; mipmapped && std::max(width >> (level - 1), height >> (level - 1)) > 1; ++level)
+		{
+			levels.push_back(downsampleRgba8(pixels.back(), std::max(1, width >> (level - 1)), std::max(1, height >> (level - 1))));
+			pixels.push_back(levels.back().data());
+		}
+
+		texture.format = format;
+		texture.width = width;
+		texture.height = height;
+		texture.levelOffsets.push_back(0);
+		for (size_t level = 0; level < pixels.size(); ++level)
+		{
+			const int levelWidth = std::max(1, width >> level);
+			const int levelHeight = std::max(1, height >> level);
+			const size_t size = format == BlockFormat::None ? static_cast<size_t>(levelWidth) * static_cast<size_t>(levelHeight) * 4
+															: getCompressedSize(format, levelWidth, levelHeight);
+			texture.levelOffsets.push_back(texture.levelOffsets.back() + size);
+		}
+		texture.data.resize(texture.levelOffsets.back());
+
+		std::vector<std::future<void>> jobs;
+		for (size_t level = 0; level < pixels.size(); ++level)
+		{
+			uint8_t * dst = texture.data.data() + texture.levelOffsets[level];
+			if (format == BlockFormat::None)
+			{
+				std::memcpy(dst, pixels[level], texture.getLevelBytes(static_cast<int>(level)));
+				continue;
+			}
+
+			const int levelWidth = std::max(1, width >> level);
+			const int levelHeight = std::max(1, height >> level);
+			const int blockRows = (levelHeight + 3) / 4;
+			const int rowsPerJob = static_cast<int>(std::max<size_t>(1, g_blocksPerJob / static_cast<size_t>((levelWidth + 3) / 4)));
+			for (int row = 0; row < blockRows; row += rowsPerJob)
+			{
+				const int endRow = std::min(blockRows, row + rowsPerJob);
+				jobs.push_back(ThreadPool::global().submit([source = pixels[level], levelWidth, levelHeight, format, row, endRow, dst] {
+					compressBlockRows(source, levelWidth, levelHeight, format, row, endRow, dst);
+				}));
+			}
+		}
+		for (auto & job: jobs)
+		{
+			job.get();
+		}
+
+		if (useCache && !storeTextureCache(cachePath, imageHash, texture))
+			qWarning() << "Failed to write texture cache" << cachePath;
+	}
+
+	texture.imageHash = imageHash;
+	if (stats && format != BlockFormat::None)
+	{
+		++stats->textures;
+		stats->cacheHits += cacheHit;
+		// What the RGBA8 path would allocate, including generated mipmaps.
+		stats->rgbaBytes += static_cast<size_t>(width) * static_cast<size_t>(height) * 4 * (mipmapped ? 4 : 3) / 3;
+		stats->compressedBytes += texture.data.size();
+		stats->milliseconds += static_cast<double>(timer.nsecsElapsed()) / 1.0e6;
+	}
+	return texture;
+}
+
+bool isBlockFormatSupported(BlockFormat format)
+{
+	const QOpenGLContext * context = QOpenGLContext::currentContext();
+	if (!context || context->isOpenGLES())
+		return format == BlockFormat::None;
+
+	const auto version = context->format().version();
+	switch (format)
+	{
+		case BlockFormat::BC1:
+		case BlockFormat::BC3:
+			return context->hasExtension("GL_EXT_texture_compression_s3tc");
+		case BlockFormat::BC5:
+			return version >= qMakePair(3, 0) || context->hasExtension("GL_ARB_texture_compression_rgtc");
+		case BlockFormat::BC7:
+			return version >= qMakePair(4, 2) || context->hasExtension("GL_ARB_texture_compression_bptc");
+		case BlockFormat::None:
+			break;
+	}
+	return true;
+}
+
+void uploadMipLevel(GLenum target, const TextureMipChain & chain, int level)
+{
+	QOpenGLFunctions * functions = QOpenGLContext::currentContext()->functions();
+	const GLsizei width = std::max(1, chain.width >> level);
+	const GLsizei height = std::max(1, chain.height >> level);
+	const uint8_t * data = chain.data.data() + chain.levelOffsets[static_cast<size_t>(level)];
+	if (chain.format == BlockFormat::None)
+	{
+		functions->glTexImage2D(target, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		return;
+	}
+
+	functions->glCompressedTexImage2D(target, level, getInternalFormat(chain.format), width, height, 0,
+									  static_cast<GLsizei>(chain.getLevelBytes(level)), data);
+}
+
+bool uploadCubeMapFace(OpenGLContext & context, QOpenGLTexture & cubeMap, int face, const TextureMipChain & chain)
+{
+	if (!chain.isValid() || face < 0 || face > 5 || !isBlockFormatSupported(chain.format))
+		return false;
+
+	context.bindTextureForUpdate(GL_TEXTURE_CUBE_MAP, cubeMap.textureId());
+	for (int level = 0; level < chain.getLevelCount(); ++level)
+	{
+		uploadMipLevel(GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(face), chain, level);
+	}
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "BlockCompression.h"
+#include <QImage>
+#include <qopengl.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class OpenGLContext;
+class QOpenGLTexture;
+
+struct TextureCompressionOptions {
+	bool enabled = true;
+	// BC7 needs GL 4.2 or ARB_texture_compression_bptc; without it opaque images use BC1 and the rest BC3.
+	bool allowBc7 = true;
+	// Reuses mip chains encoded by earlier runs, keyed by the hash of the pixels.
+	bool useCache = true;
+};
+
+// Image with its mip chain, block-compressed or RGBA8 for BlockFormat::None.
+// Level i is data[levelOffsets[i], levelOffsets[i + 1]).
+struct TextureMipChain {
+	BlockFormat format = BlockFormat::None;
+	// Content hash of the source pixels.
+	uint64_t imageHash = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<size_t> levelOffsets;
+	std::vector<uint8_t> data;
+
+	bool isValid() const { return levelOffsets.size() > 1; }
+	int getLevelCount() const { return levelOffsets.empty() ? 0 : static_cast<int>(levelOffsets.size() - 1); }
+	size_t getLevelBytes(int level) const { return levelOffsets[level + 1] - levelOffsets[level]; }
+};
+
+struct TextureCompressionStats {
+	size_t textures = 0;
+	size_t cacheHits = 0;
+	size_t rgbaBytes = 0;
+	size_t compressedBytes = 0;
+	double milliseconds = 0.0;
+};
+
+// Content hash of the pixels of an RGBA8888 image, as stored in TextureMipChain::imageHash.
+uint64_t hashImage(const QImage & image);
+
+// BC7 when allowed, otherwise BC1 for opaque images and BC3 for images with any non-opaque texel.
+BlockFormat chooseBlockFormat(const QImage & image, const TextureCompressionOptions & options);
+
+// Builds the box-filtered mip chain of an RGBA8888 image down to 1x1 (or level 0 only) and encodes it. Block rows
+// of all levels are spread over ThreadPool::global(), so this must not run inside a job of that pool.
+// BlockFormat::None keeps the levels as RGBA8 and bypasses the cache.
+// An invalid result means the image was null or had another format.
+TextureMipChain buildMipChain(const QImage & image, BlockFormat format, bool mipmapped, bool useCache,
+							  TextureCompressionStats * stats = nullptr);
+
+// Whether the current context can sample the format; RGBA8 always can. GL thread only.
+bool isBlockFormatSupported(BlockFormat format);
+
+// Specifies one level of the texture bound to target (a 2D target or a cube map face), with glCompressedTexImage2D
+// for block formats. GL thread only.
+void uploadMipLevel(GLenum target, const TextureMipChain & chain, int level);
+
+// Uploads the chain into one face (0 to 5, in GL order) of a created cube map texture, bound through context; sampling
+// is left to the caller.
+bool uploadCubeMapFace(OpenGLContext & context, QOpenGLTexture & cubeMap, int face, const TextureMipChain & chain);
@@ -0,0 +1,208 @@
+#include "TextureStreamer.h"
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+constexpr int g_residentSize = 64;
+
+int getMinimumLevel(const TextureMipChain & chain)
+{
+	int level = 0;
+	while (level + 1 < chain.getLevelCount() && std::max(chain.width >> level, chain.height >> level) > g_residentSize)
+		++level;
+	return level;
+}
+
+// Zero-sized levels outside [base, max] give their memory back and do not affect completeness.
+void releaseLevel(int level)
+{
+	QOpenGLContext::currentContext()->functions()->glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA,
+																GL_UNSIGNED_BYTE, nullptr);
+}
+}// namespace
+
+StreamedTexture::StreamedTexture(OpenGLContextPtr context, TextureMipChain chain, int firstLevel)
+	: context_(std::move(context))
+	, chain_(std::move(chain))
+	, texture_(std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D))
+	, residentLevel_(std::clamp(firstLevel, 0, std::max(chain_.getLevelCount() - 1, 0)))
+{
+	if (!context_ || !chain_.isValid() || !texture_->create())
+	{
+		texture_.reset();
+		return;
+	}
+
+	context_->bindTextureForUpdate(GL_TEXTURE_2D, texture_->textureId());
+	for (int level = residentLevel_; level < getLevelCount(); ++level)
+	{
+		uploadMipLevel(GL_TEXTURE_2D, chain_, level);
+	}
+	texture_->setMipLevelRange(residentLevel_, getLevelCount() - 1);
+	texture_->setMinMagFilters(getLevelCount() > 1 ? QOpenGLTexture::LinearMipMapLinear : QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+	texture_->setWrapMode(QOpenGLTexture::Repeat);
+}
+
+StreamedTexture::~StreamedTexture()
+{
+	if (texture_)
+		context_->forgetTexture(texture_->textureId());
+}
+
+size_t StreamedTexture::getResidentBytes() const
+{
+	return chain_.isValid() ? chain_.levelOffsets.back() - chain_.levelOffsets[static_cast<size_t>(residentLevel_)] : 0;
+}
+
+void StreamedTexture::requestResolution(float texels)
+{
+	requestedResolution_ = std::max(requestedResolution_, texels);
+}
+
+int StreamedTexture::takeRequestedLevel()
+{
+	const float resolution = requestedResolution_;
+	requestedResolution_ = 0.0f;
+	if (resolution <= 0.0f || !chain_.isValid())
+		return -1;
+
+	// Level l is size / 2^l texels wide.
+	const auto size = static_cast<float>(std::max(chain_.width, chain_.height));
+	const int level = resolution >= size ? 0 : static_cast<int>(std::floor(std::log2(size / resolution)));
+	return std::clamp(level, 0, getLevelCount() - 1);
+}
+
+void StreamedTexture::setResidentLevel(int level)
+{
+	level = std::clamp(level, 0, std::max(getLevelCount() - 1, 0));
+	if (!texture_ || level == residentLevel_)
+		return;
+
+	context_->bindTextureForUpdate(GL_TEXTURE_2D, texture_->textureId());
+	if (level < residentLevel_)
+	{
+		for (int finer = residentLevel_ - 1; finer >= level; --finer)
+		{
+			uploadMipLevel(GL_TEXTURE_2D, chain_, finer);
+		}
+		texture_->setMipBaseLevel(level);
+	}
+	else
+	{
+		texture_->setMipBaseLevel(level);
+		for (int finer = residentLevel_; finer < level; ++finer)
+		{
+			releaseLevel(finer);
+		}
+	}
+	residentLevel_ = level;
+}
+
+TextureStreamer::TextureStreamer(OpenGLContextPtr context)
+	: context_(std::move(context))
+{
+}
+
+std::shared_ptr<StreamedTexture> TextureStreamer::createTexture(TextureMipChain chain)
+{
+	const int minimumLevel = getMinimumLevel(chain);
+	auto texture = std::make_shared<StreamedTexture>(context_, std::move(chain), minimumLevel);
+	entries_.push_back({texture, minimumLevel, minimumLevel, frame_});
+	return texture;
+}
+
+void TextureStreamer::update()
+{
+	++frame_;
+	entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [](const Entry & entry) { return entry.texture.expired(); }),
+				   entries_.end());
+
+	stats_ = TextureStreamingStats();
+	std::vector<Entry *> loads;
+	for (auto & entry: entries_)
+	{
+		const auto texture = entry.texture.lock();
+		const int requested = texture->takeRequestedLevel();
+		if (requested >= 0)
+		{
+			entry.wantedLevel = std::min(requested, entry.minimumLevel);
+			entry.lastRequestFrame = frame_;
+			if (entry.wantedLevel < texture->getResidentLevel())
+				loads.push_back(&entry);
+		}
+
+		++stats_.textures;
+		stats_.residentBytes += texture->getResidentBytes();
+		stats_.fullBytes += texture->getFullBytes();
+	}
+
+	// The budget may have shrunk since the last frame.
+	if (stats_.residentBytes > budgetBytes_)
+		evict(stats_.residentBytes - budgetBytes_, nullptr);
+
+	std::sort(loads.begin(), loads.end(), [](const Entry * a, const Entry * b) {
+		return a->texture.lock()->getResidentLevel() - a->wantedLevel > b->texture.lock()->getResidentLevel() - b->wantedLevel;
+	});
+
+	// One level per step, so that the allowance is shared out before any texture gets its finest levels.
+	bool loaded = true;
+	while (loaded)
+	{
+		loaded = false;
+		for (Entry * entry: loads)
+		{
+			const auto texture = entry->texture.lock();
+			const int level = texture->getResidentLevel() - 1;
+			if (level < entry->wantedLevel)
+				continue;
+
+			// A single level larger than the whole allowance still loads when it is the first this frame.
+			const size_t bytes = texture->getLevelBytes(level);
+			if (stats_.uploadedBytes > 0 && stats_.uploadedBytes + bytes > uploadBytesPerFrame_)
+				return;
+			if (stats_.residentBytes + bytes > budgetBytes_
+				&& evict(stats_.residentBytes + bytes - budgetBytes_, texture.get()) < stats_.residentBytes + bytes - budgetBytes_)
+			{
+				continue;
+			}
+
+			texture->setResidentLevel(level);
+			stats_.residentBytes += bytes;
+			stats_.uploadedBytes += bytes;
+			loaded = true;
+		}
+	}
+}
+
+size_t TextureStreamer::evict(size_t bytes, const StreamedTexture * keep)
+{
+	std::vector<Entry *> candidates;
+	for (auto & entry: entries_)
+	{
+		if (entry.texture.lock().get() != keep)
+			candidates.push_back(&entry);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Entry * a, const Entry * b) { return a->lastRequestFrame < b->lastRequestFrame; });
+
+	// Textures requested this frame only give up levels finer than they asked for.
+	size_t freed = 0;
+	for (Entry * entry: candidates)
+	{
+		const auto texture = entry->texture.lock();
+		const int floor = entry->lastRequestFrame == frame_ ? entry->wantedLevel : entry->minimumLevel;
+		while (freed < bytes && texture->getResidentLevel() < floor)
+		{
+			freed += texture->getLevelBytes(texture->getResidentLevel());
+			texture->setResidentLevel(texture->getResidentLevel() + 1);
+		}
+		if (freed >= bytes)
+			break;
+	}
+
+	stats_.residentBytes -= std::min(freed, stats_.residentBytes);
+	stats_.evictedBytes += freed;
+	return freed;
+}
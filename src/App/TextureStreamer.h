@@ -0,0 +1,96 @@
+#pragma once
+
+#include "OpenGLContext.h"
+#include "TextureCompressor.h"
+#include <QOpenGLTexture>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 2D texture that keeps the whole mip chain on the CPU and only the coarser levels on the GPU.
+// Levels below the resident one are unspecified and excluded through GL_TEXTURE_BASE_LEVEL.
+class StreamedTexture
+{
+public:
+	// Uploads the levels from firstLevel to the end of the chain, binding through context. GL thread only.
+	StreamedTexture(OpenGLContextPtr context, TextureMipChain chain, int firstLevel);
+	~StreamedTexture();
+
+	QOpenGLTexture * getTexture() const { return texture_.get(); }
+
+	int getLevelCount() const { return chain_.getLevelCount(); }
+	int getResidentLevel() const { return residentLevel_; }
+	size_t getLevelBytes(int level) const { return chain_.getLevelBytes(level); }
+	size_t getResidentBytes() const;
+	size_t getFullBytes() const { return chain_.data.size(); }
+
+	// Records that the texture is sampled at up to this many texels across the larger side this frame.
+	void requestResolution(float texels);
+	// Coarsest level that still provides the largest resolution requested since the last call, which resets it.
+	// Returns -1 when nothing was requested.
+	int takeRequestedLevel();
+
+	// Uploads or drops levels until level is the finest one resident. GL thread only.
+	void setResidentLevel(int level);
+
+private:
+	OpenGLContextPtr context_;
+	TextureMipChain chain_;
+	std::unique_ptr<QOpenGLTexture> texture_;
+	int residentLevel_ = 0;
+	float requestedResolution_ = 0.0f;
+};
+
+struct TextureStreamingStats {
+	size_t textures = 0;
+	size_t residentBytes = 0;
+	size_t fullBytes = 0;
+	// During the last update.
+	size_t uploadedBytes = 0;
+	size_t evictedBytes = 0;
+};
+
+// Streams mip levels of its textures in and out once per frame, within a per-frame upload allowance and a total
+// budget. Textures furthest from their requested level load first; levels are evicted from the textures requested
+// least recently. Levels at most 64 texels wide are uploaded on creation and never dropped, so every texture can
+// be sampled from the start.
+class TextureStreamer
+{
+public:
+	explicit TextureStreamer(OpenGLContextPtr context = nullptr);
+
+	// Its textures bind through it; set before the first createTexture.
+	void setContext(OpenGLContextPtr context) { context_ = std::move(context); }
+
+	std::shared_ptr<StreamedTexture> createTexture(TextureMipChain chain);
+
+	// GL memory the streamed levels may use in total; the always-resident low levels count but are never evicted.
+	void setBudget(size_t bytes) { budgetBytes_ = bytes; }
+	size_t getBudget() const { return budgetBytes_; }
+
+	void setUploadBytesPerFrame(size_t bytes) { uploadBytesPerFrame_ = bytes; }
+	size_t getUploadBytesPerFrame() const { return uploadBytesPerFrame_; }
+
+	// GL thread, once per frame after the resolutions for that frame were requested.
+	void update();
+
+	const TextureStreamingStats & getStats() const { return stats_; }
+
+private:
+	struct Entry {
+		std::weak_ptr<StreamedTexture> texture;
+		int minimumLevel = 0;
+		int wantedLevel = 0;
+		uint64_t lastRequestFrame = 0;
+	};
+
+	size_t evict(size_t bytes, const StreamedTexture * keep);
+
+	OpenGLContextPtr context_;
+	std::vector<Entry> entries_;
+	size_t budgetBytes_ = size_t{256} * 1024 * 1024;
+	size_t uploadBytesPerFrame_ = size_t{16} * 1024 * 1024;
+	uint64_t frame_ = 0;
+	TextureStreamingStats stats_;
+};
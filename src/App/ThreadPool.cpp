@@ -0,0 +1,63 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	workers_.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		workers_.emplace_back([this] { workerLoop(); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	condition_.notify_all();
+
+	for (auto & worker: workers_)
+	{
+		worker.join();
+	}
+}
+
+ThreadPool & ThreadPool::global()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push_back(std::move(job));
+	}
+	condition_.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			condition_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+			if (jobs_.empty())
+				return;
+
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+
+	// Shared pool for short CPU jobs. Do not block on it from inside its own jobs.
+	static ThreadPool & global();
+
+	template<typename Function>
+	auto submit(Function && function) -> std::future<std::invoke_result_t<std::decay_t<Function>>>
+	{
+		using Result = std::invoke_result_t<std::decay_t<Function>>;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+		auto future = task->get_future();
+		enqueue([task] { (*task)(); });
+		return future;
+	}
+
+	size_t getThreadCount() const { return workers_.size(); }
+
+private:
+	void enqueue(std::function<void()> job);
+	void workerLoop();
+
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> jobs_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stopping_ = false;
+};
@@ -0,0 +1,180 @@
+#include "VertexFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+template<typename T>
+void store(uint8_t * dst, const T & value)
+{
+	std::memcpy(dst, &value, sizeof(T));
+}
+
+uint16_t quantizeUnorm16(float value, float offset, float inverseScale)
+{
+	const float normalized = std::clamp((value - offset) * inverseScale, 0.0f, 1.0f);
+	return static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+}
+
+int8_t quantizeSnorm8(float value)
+{
+	return static_cast<int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+}// namespace
+
+size_t getVertexStride(VertexFormat format)
+{
+	switch (format)
+	{
+		case VertexFormat::Packed16:
+			return 16;
+		case VertexFormat::Packed12:
+			return 12;
+		case VertexFormat::Float:
+		default:
+			return sizeof(Vertex);
+	}
+}
+
+const char * getVertexFormatName(VertexFormat format)
+{
+	switch (format)
+	{
+		case VertexFormat::Packed16:
+			return "packed16";
+		case VertexFormat::Packed12:
+			return "packed12";
+		case VertexFormat::Float:
+		default:
+			return "float";
+	}
+}
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+	const uint32_t magnitude = bits & 0x7fffffffu;
+
+	if (magnitude > 0x7f800000u)
+		return static_cast<uint16_t>(sign | 0x7e00u);
+	if (magnitude >= 0x47800000u)
+		return static_cast<uint16_t>(sign | 0x7c00u);
+
+	// Below the smallest normal half everything is a multiple of 2^-24.
+	if (magnitude < 0x38800000u)
+	{
+		float absolute;
+		std::memcpy(&absolute, &magnitude, sizeof(absolute));
+		return static_cast<uint16_t>(sign | static_cast<uint16_t>(std::nearbyint(absolute * 16777216.0f)));
+	}
+
+	// Rebias the exponent and round the dropped 13 mantissa bits to nearest even; a carry may round up to infinity.
+	uint32_t half = (magnitude - 0x38000000u) >> 13;
+	const uint32_t remainder = magnitude & 0x1fffu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+		++half;
+	return static_cast<uint16_t>(sign | half);
+}
+
+uint32_t packSnorm10x3(const float * normal)
+{
+	uint32_t packed = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		const auto component = static_cast<int32_t>(std::lround(std::clamp(normal[i], -1.0f, 1.0f) * 511.0f));
+		packed |= (static_cast<uint32_t>(component) & 0x3ffu) << (10 * i);
+	}
+	return packed;
+}
+
+void encodeOctahedral(const float * normal, int8_t * encoded)
+{
+	const float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+	if (length <= std::numeric_limits<float>::min())
+	{
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if (normal[2] < 0.0f)
+	{
+		const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	encoded[0] = quantizeSnorm8(x);
+	encoded[1] = quantizeSnorm8(y);
+}
+
+PackedVertices packVertices(const std::vector<Vertex> & vertices, VertexFormat format)
+{
+	PackedVertices packed;
+	packed.format = format;
+	packed.stride = getVertexStride(format);
+	if (format == VertexFormat::Float || vertices.empty())
+		return packed;
+
+	float minimum[3];
+	float maximum[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		minimum[axis] = maximum[axis] = vertices.front().position[axis];
+	}
+	for (const auto & vertex: vertices)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			minimum[axis] = std::min(minimum[axis], vertex.position[axis]);
+			maximum[axis] = std::max(maximum[axis], vertex.position[axis]);
+		}
+	}
+
+	float inverseScale[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		packed.positionOffset[axis] = minimum[axis];
+		packed.positionScale[axis] = maximum[axis] - minimum[axis];
+		inverseScale[axis] = packed.positionScale[axis] > 0.0f ? 1.0f / packed.positionScale[axis] : 0.0f;
+	}
+
+	packed.data.resize(vertices.size() * packed.stride);
+	uint8_t * dst = packed.data.data();
+	for (const auto & vertex: vertices)
+	{
+		uint16_t position[4] = {};
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			position[axis] = quantizeUnorm16(vertex.position[axis], packed.positionOffset[axis], inverseScale[axis]);
+		}
+		const uint16_t texCoord[2] = {floatToHalf(vertex.texCoord[0]), floatToHalf(vertex.texCoord[1])};
+
+		if (format == VertexFormat::Packed16)
+		{
+			store(dst, position);
+			store(dst + 8, packSnorm10x3(vertex.normal));
+			store(dst + 12, texCoord);
+		}
+		else
+		{
+			int8_t normal[2];
+			encodeOctahedral(vertex.normal, normal);
+
+			std::memcpy(dst, position, sizeof(uint16_t) * 3);
+			store(dst + 6, normal);
+			store(dst + 8, texCoord);
+		}
+		dst += packed.stride;
+	}
+
+	return packed;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GPU vertex layouts. Packed positions are 16-bit unorm inside the mesh bounds and are
+// restored in model.vs as positionOffset + position * positionScale.
+enum class VertexFormat
+{
+	Float,   // 32 bytes: float3 position, float3 normal, float2 texCoord
+	Packed16,// 16 bytes: unorm16x4 position, snorm 10_10_10_2 normal, half2 texCoord
+	Packed12 // 12 bytes: unorm16x3 position, octahedral snorm8x2 normal, half2 texCoord
+};
+
+struct PackedVertices {
+	VertexFormat format = VertexFormat::Float;
+	size_t stride = sizeof(Vertex);
+	std::vector<uint8_t> data;
+	float positionOffset[3] = {0.0f, 0.0f, 0.0f};
+	float positionScale[3] = {1.0f, 1.0f, 1.0f};
+};
+
+size_t getVertexStride(VertexFormat format);
+const char * getVertexFormatName(VertexFormat format);
+
+// Converts vertices to `format`. For VertexFormat::Float the data stays empty; upload the vertices as they are.
+PackedVertices packVertices(const std::vector<Vertex> & vertices, VertexFormat format);
+
+uint16_t floatToHalf(float value);
+uint32_t packSnorm10x3(const float * normal);
+void encodeOctahedral(const float * normal, int8_t * encoded);
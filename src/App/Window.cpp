@@ -1,5 +1,6 @@
 #include "Window.h"
 #include "ModelEntity.h"
+#include "ModelLoader.h"
 #include "SkyboxEntity.h"
 
 #include <QApplication>
@@ -17,14 +18,52 @@
 
 #include <cmath>
 
+namespace
+{
+constexpr auto g_uploadBudgetMilliseconds = 4.0f;
+constexpr auto g_modelCopiesPerRow = 25;
+}// namespace
+
 Window::Window() noexcept
 {
 	const auto formatFPS = [](const auto value) {
 		return QString("FPS: %1").arg(QString::number(value));
 	};
+	const auto formatGpu = [](double milliseconds, size_t triangles) {
+		const double trianglesPerSecond = milliseconds > 0.0 ? static_cast<double>(triangles) / milliseconds * 1.0e3 : 0.0;
+		return QString("GPU: %1 ms, %2 Mtri/s").arg(milliseconds, 0, 'f', 2).arg(trianglesPerSecond / 1.0e6, 0, 'f', 1);
+	};
+	const auto formatCulling = [](size_t batches, size_t models, size_t meshes) {
+		return QString("Batches: %1, culled %2 models, %3 meshes").arg(batches).arg(models).arg(meshes);
+	};
+	const auto formatClusters = [](size_t culled, size_t tested) {
+		return QString("Clusters: %1 / %2 culled").arg(culled).arg(tested);
+	};
+	const auto formatInstancing = [](size_t draws, size_t meshes) {
+		return QString("Instancing: %1 meshes in %2 draws").arg(meshes).arg(draws);
+	};
+	const auto formatSort = [](double microseconds, size_t stateChanges) {
+		return QString("Sort: %1 us, %2 state changes").arg(microseconds, 0, 'f', 1).arg(stateChanges);
+	};
+	const auto formatGlState = [](const OpenGLStateStats & stats) {
+		return QString("GL state: %1 calls, %2 filtered").arg(stats.issued).arg(stats.filtered);
+	};
+	const auto formatTextures = [](size_t residentBytes, size_t budgetBytes) {
+		return QString("Textures: %1 / %2 MiB").arg(residentBytes / (1024 * 1024)).arg(budgetBytes / (1024 * 1024));
+	};
+	const auto formatAssets = [](size_t assets, const AssetMemory & memory) {
+		return QString("Assets: %1, CPU %2 MiB, GPU %3 MiB").arg(assets).arg(memory.cpuBytes / (1024 * 1024)).arg(memory.gpuBytes / (1024 * 1024));
+	};
+	const auto formatAnimation = [](size_t characters, double jointsPerMillisecond) {
+		return QString("Animation: %1 characters, %2 joints/ms").arg(characters).arg(jointsPerMillisecond, 0, 'f', 0);
+	};
 
-	auto fps = new QLabel(formatFPS(0), this);
+	auto fps = new QLabel(formatFPS(0) + "\n" + formatGpu(0.0, 0) + "\n" + formatCulling(0, 0, 0) + "\n" + formatClusters(0, 0) + "\n"
+							  + formatInstancing(0, 0) + "\n" + formatSort(0.0, 0) + "\n" + formatGlState({}) + "\n" + formatTextures(0, 0) + "\n"
+							  + formatAssets(0, {}) + "\n" + formatAnimation(0, 0.0),
+						  this);
 	fps->setStyleSheet("QLabel { color : white; }");
+	fps->adjustSize();
 
 	auto mainLayout = new QVBoxLayout();
 	mainLayout->addWidget(fps, 1);
@@ -91,7 +130,15 @@ Window::Window() noexcept
 	inputTimer_->start(16);
 
 	connect(this, &Window::updateUI, [=, this] {
-		fps->setText(formatFPS(ui_.fps));
+		fps->setText(formatFPS(ui_.fps) + "\n" + formatGpu(ui_.gpuMilliseconds, ui_.triangles) + "\n"
+					 + formatCulling(ui_.batches, ui_.modelsCulled, ui_.meshesCulled) + "\n"
+					 + formatClusters(ui_.clustersCulled, ui_.clustersTested) + "\n"
+					 + formatInstancing(ui_.instancedDraws, ui_.instancedMeshes) + "\n"
+					 + formatSort(ui_.sortMicroseconds, ui_.stateChanges) + "\n" + formatGlState(ui_.glState) + "\n"
+					 + formatTextures(ui_.textureResidentBytes, ui_.textureBudgetBytes) + "\n"
+					 + formatAssets(ui_.assets, ui_.assetMemory) + "\n"
+					 + formatAnimation(ui_.animatedCharacters, ui_.jointsPerMillisecond));
+		fps->adjustSize();
 	});
 }
 
@@ -100,6 +147,7 @@ Window::~Window()
 {
 	const auto guard = bindContext();
 
+	modelLoader_.reset();
 	sceneGraph_.reset();
 	renderer_.reset();
 	camera_.reset();
@@ -338,6 +386,9 @@ void Window::onInit()
 	camera_->setMouseSensitivity(0.1f);
 
 	sceneGraph_ = std::make_unique<SceneGraph>();
+	modelLoader_ = std::make_unique<ModelLoader>();
+	// Re-exported models, or a rebuilt asset pack, show up without a restart.
+	modelLoader_->setHotReload(hotReload_);
 
 	renderer_ = std::make_unique<SceneRenderer>(openglContext_);
 	if (!renderer_->initialize())
@@ -360,8 +411,12 @@ void Window::onRender()
 	float deltaTime = 0.016f;
 	camera_->update(deltaTime);
 
+	// Moves the animated nodes before the scene graph resolves their world transforms.
+	renderer_->getAnimationSystem()->update(deltaTime);
 	sceneGraph_->update(deltaTime);
 
+	modelLoader_->processUploads(g_uploadBudgetMilliseconds);
+
 	renderer_->renderScene(sceneGraph_.get(), camera_.get());
 
 	++frameCount_;
@@ -376,6 +431,11 @@ void Window::onResize(const size_t width, const size_t height)
 		openglContext_->functions()->glViewport(0, 0, static_cast<GLint>(width), static_cast<GLint>(height));
 	}
 
+	if (renderer_)
+	{
+		renderer_->setViewportSize(static_cast<int>(width), static_cast<int>(height));
+	}
+
 	if (camera_)
 	{
 		const auto aspect = static_cast<float>(width) / static_cast<float>(height);
@@ -407,6 +467,24 @@ auto Window::captureMetrics() -> PerfomanceMetricsGuard
 			{
 				const auto elapsedSeconds = static_cast<float>(timer_.restart()) / 1000.0f;
 				ui_.fps = static_cast<size_t>(std::round(frameCount_ / elapsedSeconds));
+				ui_.gpuMilliseconds = renderer_->getLastFrameGpuMilliseconds();
+				ui_.triangles = renderer_->getLastFrameTriangleCount();
+				ui_.batches = renderer_->getLastFrameBatchCount();
+				ui_.modelsCulled = renderer_->getLastFrameModelsCulled();
+				ui_.meshesCulled = renderer_->getLastFrameMeshesCulled();
+				ui_.clustersTested = renderer_->getLastFrameClustersTested();
+				ui_.clustersCulled = renderer_->getLastFrameClustersCulled();
+				ui_.instancedDraws = renderer_->getLastFrameInstancedDraws();
+				ui_.instancedMeshes = renderer_->getLastFrameInstancedMeshes();
+				ui_.sortMicroseconds = renderer_->getLastFrameSortMicroseconds();
+				ui_.stateChanges = renderer_->getLastFrameStateChanges();
+				ui_.glState = renderer_->getLastFrameGlState();
+				ui_.textureResidentBytes = renderer_->getTextureStreamer()->getStats().residentBytes;
+				ui_.textureBudgetBytes = renderer_->getTextureStreamer()->getBudget();
+				ui_.assets = renderer_->getAssetManager()->getAssets().size();
+				ui_.assetMemory = renderer_->getAssetManager()->getTotalMemory();
+				ui_.animatedCharacters = renderer_->getAnimationSystem()->getStats().instances;
+				ui_.jointsPerMillisecond = renderer_->getAnimationSystem()->getStats().getJointsPerMillisecond();
 				frameCount_ = 0;
 				emit updateUI();
 			}
@@ -447,15 +525,43 @@ bool Window::initializeScene()
 	model_ = std::make_shared<ModelEntity>("noel");
 	model_->setShaderProgram(renderer_->getModelShader());
 
-	if (!model_->loadFromGLTF(":/Models/noel.glb"))
-	{
-		return false;
-	}
+	// Textures are encoded on the loader thread, so the formats are checked here while the context is current.
+	TextureCompressionOptions textureCompression;
+	textureCompression.allowBc7 = isBlockFormatSupported(BlockFormat::BC7);
+	textureCompression.enabled = textureCompression.allowBc7 || isBlockFormatSupported(BlockFormat::BC1);
+	ModelLoadOptions loadOptions = model_->getLoadOptions();
+	loadOptions.textureCompression = textureCompression;
+	model_->setLoadOptions(loadOptions);
+	model_->setContext(openglContext_);
+	model_->setTextureStreamer(renderer_->getTextureStreamer());
+	model_->setAssetManager(renderer_->getAssetManager());
+	model_->setAnimationSystem(renderer_->getAnimationSystem());
+
+	// The glTF node tree is attached under this node once parsed.
+	const auto modelNode = sceneGraph_->addEntity(model_, "SponzaNode");
+	modelLoader_->request(model_, "pack:/Models/noel.glb", modelNode);
 
 	model_->setScale(QVector3D(2.f, 2.f, 2.f));
 	//model_->setPosition(QVector3D(0.0f, 1.5f, 0.0f));
 	model_->setRotation(QVector3D(90.0f, 0.0f, 0.0f));
 
+	for (int i = 0; i < modelCopies_; ++i)
+	{
+		auto copy = std::make_shared<ModelEntity>("noel#" + std::to_string(i));
+		copy->setShaderProgram(renderer_->getModelShader());
+		copy->setLoadOptions(loadOptions);
+		copy->setContext(openglContext_);
+		copy->setTextureStreamer(renderer_->getTextureStreamer());
+		copy->setAssetManager(renderer_->getAssetManager());
+		copy->setAnimationSystem(renderer_->getAnimationSystem());
+		modelLoader_->request(copy, "pack:/Models/noel.glb", sceneGraph_->addEntity(copy, copy->getName() + "Node"));
+
+		copy->setScale(model_->getScale());
+		copy->setPosition(QVector3D(static_cast<float>(i % g_modelCopiesPerRow + 1) * 2.0f, 0.0f,
+									static_cast<float>(i / g_modelCopiesPerRow) * 2.0f));
+		copy->setRotation(model_->getRotation());
+	}
+
 	model_->setMorphCenter(QVector3D(0.0f, 1.5f, 0.0f));
 	model_->setSphereRadius(1.0f);
 
@@ -475,15 +581,17 @@ bool Window::initializeScene()
 	renderer_->setSpotLight(spotLight);
 
 	auto skybox = std::make_shared<SkyboxEntity>("Skybox");
+	skybox->setContext(openglContext_);
 	skybox->setShaderProgram(renderer_->getSkyboxShader());
+	skybox->setTextureCompression(textureCompression);
 
 	QStringList skyboxFaces;
-	skyboxFaces << ":/Textures/sky-cube/px.png"
-				<< ":/Textures/sky-cube/nx.png"
-				<< ":/Textures/sky-cube/py.png"
-				<< ":/Textures/sky-cube/ny.png"
-				<< ":/Textures/sky-cube/pz.png"
-				<< ":/Textures/sky-cube/nz.png";
+	skyboxFaces << "pack:/Textures/sky-cube/px.png"
+				<< "pack:/Textures/sky-cube/nx.png"
+				<< "pack:/Textures/sky-cube/py.png"
+				<< "pack:/Textures/sky-cube/ny.png"
+				<< "pack:/Textures/sky-cube/pz.png"
+				<< "pack:/Textures/sky-cube/nz.png";
 
 	if (!skybox->loadCubemap(skyboxFaces))
 	{
@@ -491,7 +599,6 @@ bool Window::initializeScene()
 	}
 
 	sceneGraph_->addEntity(skybox, "SkyboxNode");
-	sceneGraph_->addEntity(model_, "SponzaNode");
 
 	return true;
 }
@@ -21,6 +21,7 @@
 #include <memory>
 
 class ModelEntity;
+class ModelLoader;
 class SkyboxEntity;
 
 class Window final : public fgl::GLWidget
@@ -31,6 +32,12 @@ public:
 	Window() noexcept;
 	~Window() override;
 
+	// Copies of the model laid out in a grid next to it; they share its parse and upload through the asset manager.
+	// Takes effect when the scene is created, so it is set before the window is shown.
+	void setModelCopies(int copies) { modelCopies_ = copies; }
+	// Watches the loaded models' files and reloads what changes; off by default, set before the window is shown.
+	void setHotReload(bool enable) { hotReload_ = enable; }
+
 public:// fgl::GLWidget
 	void onInit() override;
 	void onRender() override;
@@ -108,11 +115,14 @@ private:
 	QComboBox * spotLightColorCombo_ = nullptr;
 
 	std::shared_ptr<ModelEntity> model_;
+	int modelCopies_ = 0;
+	bool hotReload_ = false;
 
 	OpenGLContextPtr openglContext_;
 	std::unique_ptr<Camera> camera_;
 	std::unique_ptr<SceneGraph> sceneGraph_;
 	std::unique_ptr<SceneRenderer> renderer_;
+	std::unique_ptr<ModelLoader> modelLoader_;
 
 	bool firstMouse_{true};
 	QPoint lastMousePos_;
@@ -127,5 +137,23 @@ private:
 
 	struct {
 		size_t fps = 0;
+		double gpuMilliseconds = 0.0;
+		size_t triangles = 0;
+		size_t batches = 0;
+		size_t modelsCulled = 0;
+		size_t meshesCulled = 0;
+		size_t clustersTested = 0;
+		size_t clustersCulled = 0;
+		size_t instancedDraws = 0;
+		size_t instancedMeshes = 0;
+		double sortMicroseconds = 0.0;
+		size_t stateChanges = 0;
+		OpenGLStateStats glState;
+		size_t textureResidentBytes = 0;
+		size_t textureBudgetBytes = 0;
+		size_t assets = 0;
+		AssetMemory assetMemory;
+		size_t animatedCharacters = 0;
+		double jointsPerMillisecond = 0.0;
 	} ui_;
 };
\ No newline at end of file
@@ -1,6 +1,10 @@
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
 #include <QSurfaceFormat>
 
+#include "AssetPack.h"
 #include "Window.h"
 
 namespace
@@ -15,6 +19,19 @@ int main(int argc, char ** argv)
 	QApplication::setAttribute(Qt::AA_UseDesktopOpenGL);
 	QApplication app(argc, argv);
 
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	const QCommandLineOption copiesOption("copies", "Draw <count> copies of the model, sharing its parse and upload.", "count", "0");
+	parser.addOption(copiesOption);
+	const QCommandLineOption hotReloadOption("hot-reload", "Reload models and the asset pack when their files change.");
+	parser.addOption(hotReloadOption);
+	parser.process(app);
+
+	// Models and textures are paged in from the pack built next to the executable.
+	const QString assetPack = QDir(QCoreApplication::applicationDirPath()).filePath("assets.pak");
+	if (!mountAssetPack(assetPack))
+		qWarning() << "Failed to mount" << assetPack;
+
 	QSurfaceFormat format;
 	format.setSamples(g_sampels);
 	format.setVersion(g_gl_major_version, g_gl_minor_version);
@@ -22,6 +39,8 @@ int main(int argc, char ** argv)
 	QSurfaceFormat::setDefaultFormat(format);
 
 	Window window;
+	window.setModelCopies(qMax(parser.value(copiesOption).toInt(), 0));
+	window.setHotReload(parser.isSet(hotReloadOption));
 	window.resize(640, 480);
 	window.show();
 
@@ -0,0 +1,165 @@
+#include <App/AccessorKernels.h>
+#include <App/Mesh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <tinygltf/tiny_gltf.h>
+#include <vector>
+
+namespace
+{
+constexpr size_t g_vertexCount = 4 * 1024 * 1024;
+constexpr size_t g_indexCount = 3 * g_vertexCount;
+constexpr int g_repeats = 5;
+
+double bestMilliseconds(const std::function<void()> & body)
+{
+	double best = 1.0e30;
+	for (int i = 0; i < g_repeats; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		body();
+		const auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+void report(const char * name, double milliseconds, size_t bytes)
+{
+	std::printf("%-40s %8.2f ms %8.2f GB/s\n", name, milliseconds, static_cast<double>(bytes) / (milliseconds * 1.0e6));
+}
+
+AccessorView makeView(const void * data, size_t stride, int componentType, int components, bool normalized = false)
+{
+	AccessorView view;
+	view.data = static_cast<const uint8_t *>(data);
+	view.count = g_vertexCount;
+	view.stride = stride;
+	view.componentType = componentType;
+	view.components = components;
+	view.normalized = normalized;
+	return view;
+}
+}// namespace
+
+int main()
+{
+	std::vector<float> positions(g_vertexCount * 3);
+	std::vector<float> normals(g_vertexCount * 3);
+	std::vector<float> texCoords(g_vertexCount * 2);
+	std::vector<uint16_t> texCoords16(g_vertexCount * 2);
+	std::vector<uint16_t> indices16(g_indexCount);
+	std::vector<uint32_t> indices32(g_indexCount);
+
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		positions[i] = static_cast<float>(i);
+		normals[i] = static_cast<float>(i % 7);
+	}
+	for (size_t i = 0; i < texCoords.size(); ++i)
+	{
+		texCoords[i] = static_cast<float>(i % 13) / 13.0f;
+		texCoords16[i] = static_cast<uint16_t>(i * 31);
+	}
+	for (size_t i = 0; i < g_indexCount; ++i)
+	{
+		indices16[i] = static_cast<uint16_t>(i % 65536);
+		indices32[i] = static_cast<uint32_t>(i % g_vertexCount);
+	}
+
+	std::vector<Vertex> vertices(g_vertexCount);
+	std::vector<uint32_t> indices(g_indexCount);
+
+	const size_t attributeBytes = (positions.size() + normals.size() + texCoords.size()) * sizeof(float) + vertices.size() * sizeof(Vertex);
+
+	std::printf("Accessor kernels (%s), %zu vertices, %zu indices, best of %d\n", getAccessorKernelIsa(), g_vertexCount, g_indexCount, g_repeats);
+
+	report("attributes: legacy scalar loops", bestMilliseconds([&] {
+			   for (size_t i = 0; i < g_vertexCount; ++i)
+			   {
+				   vertices[i].position[0] = positions[i * 3 + 0];
+				   vertices[i].position[1] = positions[i * 3 + 1];
+				   vertices[i].position[2] = positions[i * 3 + 2];
+			   }
+			   for (size_t i = 0; i < g_vertexCount; ++i)
+			   {
+				   vertices[i].normal[0] = normals[i * 3 + 0];
+				   vertices[i].normal[1] = normals[i * 3 + 1];
+				   vertices[i].normal[2] = normals[i * 3 + 2];
+			   }
+			   for (size_t i = 0; i < g_vertexCount; ++i)
+			   {
+				   vertices[i].texCoord[0] = texCoords[i * 2 + 0];
+				   vertices[i].texCoord[1] = texCoords[i * 2 + 1];
+			   }
+		   }),
+		   attributeBytes);
+
+	report("attributes: kernels", bestMilliseconds([&] {
+			   convertToFloat(makeView(positions.data(), 12, TINYGLTF_COMPONENT_TYPE_FLOAT, 3), vertices[0].position, sizeof(Vertex));
+			   convertToFloat(makeView(normals.data(), 12, TINYGLTF_COMPONENT_TYPE_FLOAT, 3), vertices[0].normal, sizeof(Vertex));
+			   convertToFloat(makeView(texCoords.data(), 8, TINYGLTF_COMPONENT_TYPE_FLOAT, 2), vertices[0].texCoord, sizeof(Vertex));
+		   }),
+		   attributeBytes);
+
+	report("attributes: kernels, interleaved blocks", bestMilliseconds([&] {
+			   const InterleaveStream streams[] = {
+				   {makeView(positions.data(), 12, TINYGLTF_COMPONENT_TYPE_FLOAT, 3), offsetof(Vertex, position)},
+				   {makeView(normals.data(), 12, TINYGLTF_COMPONENT_TYPE_FLOAT, 3), offsetof(Vertex, normal)},
+				   {makeView(texCoords.data(), 8, TINYGLTF_COMPONENT_TYPE_FLOAT, 2), offsetof(Vertex, texCoord)}};
+			   convertInterleaved(streams, 3, reinterpret_cast<uint8_t *>(vertices.data()), sizeof(Vertex), g_vertexCount);
+		   }),
+		   attributeBytes);
+
+	report("texcoords: kernels, normalized u16", bestMilliseconds([&] {
+			   convertToFloat(makeView(texCoords16.data(), 4, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, 2, true), vertices[0].texCoord, sizeof(Vertex));
+		   }),
+		   texCoords16.size() * sizeof(uint16_t) + g_vertexCount * sizeof(float) * 2);
+
+	std::vector<Vertex> copy(g_vertexCount);
+	report("attributes: kernels, interleaved source", bestMilliseconds([&] {
+			   const auto * base = reinterpret_cast<const uint8_t *>(vertices.data());
+			   convertToFloat(makeView(base + offsetof(Vertex, position), sizeof(Vertex), TINYGLTF_COMPONENT_TYPE_FLOAT, 3), copy[0].position, sizeof(Vertex));
+			   convertToFloat(makeView(base + offsetof(Vertex, normal), sizeof(Vertex), TINYGLTF_COMPONENT_TYPE_FLOAT, 3), copy[0].normal, sizeof(Vertex));
+			   convertToFloat(makeView(base + offsetof(Vertex, texCoord), sizeof(Vertex), TINYGLTF_COMPONENT_TYPE_FLOAT, 2), copy[0].texCoord, sizeof(Vertex));
+		   }),
+		   2 * vertices.size() * sizeof(Vertex));
+
+	const auto indexView = [](const void * data, size_t stride, int componentType) {
+		AccessorView view = makeView(data, stride, componentType, 1);
+		view.count = g_indexCount;
+		return view;
+	};
+
+	report("indices u16: legacy scalar loop", bestMilliseconds([&] {
+			   for (size_t i = 0; i < g_indexCount; ++i)
+			   {
+				   indices[i] = indices16[i];
+			   }
+		   }),
+		   g_indexCount * (sizeof(uint16_t) + sizeof(uint32_t)));
+
+	report("indices u16: kernels", bestMilliseconds([&] {
+			   convertIndices(indexView(indices16.data(), 2, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT), indices.data());
+		   }),
+		   g_indexCount * (sizeof(uint16_t) + sizeof(uint32_t)));
+
+	report("indices u32: legacy scalar loop", bestMilliseconds([&] {
+			   for (size_t i = 0; i < g_indexCount; ++i)
+			   {
+				   indices[i] = indices32[i];
+			   }
+		   }),
+		   g_indexCount * 2 * sizeof(uint32_t));
+
+	report("indices u32: kernels", bestMilliseconds([&] {
+			   convertIndices(indexView(indices32.data(), 4, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT), indices.data());
+		   }),
+		   g_indexCount * 2 * sizeof(uint32_t));
+
+	return 0;
+}
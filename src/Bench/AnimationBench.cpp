@@ -0,0 +1,162 @@
+#include <App/Animation.h>
+#include <App/ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+constexpr size_t g_characterCounts[] = {1, 100, 1000};
+constexpr size_t g_jointCounts[] = {32, 128};
+constexpr size_t g_keys = 60;
+constexpr float g_clipDuration = 2.0f;
+constexpr float g_frameTime = 1.0f / 60.0f;
+// As in AnimationSystem: below this, a job costs more to hand out than to run.
+constexpr size_t g_minJointsPerJob = 512;
+constexpr int g_repeats = 5;
+
+double bestMilliseconds(const std::function<void()> & body)
+{
+	double best = 1.0e30;
+	for (int i = 0; i < g_repeats; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		body();
+		const auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+void report(const char * name, double milliseconds, size_t joints)
+{
+	std::printf("  %-24s %10.3f ms %12.0f joints/ms\n", name, milliseconds, static_cast<double>(joints) / milliseconds);
+}
+
+// A skeleton of joints joints, each the child of one of the joints before it, with one skin over all of them and
+// a clip with linear translation, rotation and scale keys for every joint.
+std::shared_ptr<AnimationRig> makeRig(size_t joints, std::mt19937 & random)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	auto rig = std::make_shared<AnimationRig>();
+	rig->parents.resize(joints);
+	for (size_t joint = 0; joint < joints; ++joint)
+	{
+		rig->parents[joint] = joint == 0 ? -1 : static_cast<int>(random() % joint);
+	}
+	rig->restPose.resize(joints);
+	rig->restMatrices.resize(joints);
+	rig->animated.assign(joints, 1);
+	rig->weightOffsets.assign(joints, ~0u);
+
+	ModelSkin skin;
+	skin.inverseBindMatrices.resize(joints);
+	for (size_t joint = 0; joint < joints; ++joint)
+	{
+		skin.joints.push_back(static_cast<int>(joint));
+	}
+	rig->skins.push_back(std::move(skin));
+	rig->bindings.push_back({0, 0, 0});
+	rig->paletteSize = joints;
+
+	AnimationClip clip;
+	clip.duration = g_clipDuration;
+	for (size_t joint = 0; joint < joints; ++joint)
+	{
+		for (const auto path: {AnimationPath::Translation, AnimationPath::Rotation, AnimationPath::Scale})
+		{
+			AnimationChannel channel;
+			channel.node = static_cast<int>(joint);
+			channel.path = path;
+			for (size_t key = 0; key < g_keys; ++key)
+			{
+				channel.times.push_back(g_clipDuration * static_cast<float>(key) / static_cast<float>(g_keys - 1));
+				float value[4] = {unit(random), unit(random), unit(random), unit(random)};
+				if (path == AnimationPath::Rotation)
+				{
+					const float length = std::sqrt(value[0] * value[0] + value[1] * value[1] + value[2] * value[2] + value[3] * value[3]);
+					for (auto & component: value)
+					{
+						component /= length;
+					}
+				}
+				else if (path == AnimationPath::Scale)
+				{
+					for (auto & component: value)
+					{
+						component = 1.0f + 0.1f * component;
+					}
+				}
+				channel.values.insert(channel.values.end(), std::begin(value), std::end(value));
+			}
+			clip.channels.push_back(std::move(channel));
+		}
+	}
+	rig->clips.push_back(std::move(clip));
+	return rig;
+}
+
+// One frame of AnimationSystem::update without the scene and the palette upload: every character advances and is
+// evaluated, in jobs of about the same joint count on the global pool.
+void evaluateParallel(std::vector<AnimationInstance> & characters, size_t joints)
+{
+	const size_t jobCount = std::max<size_t>(ThreadPool::global().getThreadCount() * 4, 1);
+	const size_t charactersPerJob = std::max<size_t>(std::max(characters.size() * joints / jobCount, g_minJointsPerJob) / joints, 1);
+	std::vector<std::future<void>> jobs;
+	for (size_t first = 0; first < characters.size(); first += charactersPerJob)
+	{
+		jobs.push_back(ThreadPool::global().submit([&characters, first, last = std::min(first + charactersPerJob, characters.size())] {
+			for (size_t i = first; i < last; ++i)
+			{
+				characters[i].advance(g_frameTime);
+				characters[i].evaluate();
+			}
+		}));
+	}
+	for (auto & job: jobs)
+	{
+		job.get();
+	}
+}
+}// namespace
+
+int main()
+{
+	std::printf("Animation kernels (%s), %zu pool threads, %zu keys per channel, best of %d\n", getAnimationKernelIsa(),
+				ThreadPool::global().getThreadCount(), g_keys, g_repeats);
+
+	for (size_t joints: g_jointCounts)
+	{
+		std::mt19937 random(1);
+		const std::shared_ptr<const AnimationRig> rig = makeRig(joints, random);
+		for (size_t count: g_characterCounts)
+		{
+			std::vector<AnimationInstance> characters(count, AnimationInstance(rig));
+			for (size_t i = 0; i < count; ++i)
+			{
+				characters[i].setTime(g_clipDuration * static_cast<float>(i) / static_cast<float>(count));
+			}
+			std::printf("%zu characters x %zu joints\n", count, joints);
+
+			const double serial = bestMilliseconds([&characters]() {
+				for (auto & character: characters)
+				{
+					character.advance(g_frameTime);
+					character.evaluate();
+				}
+			});
+			report("one thread", serial, count * joints);
+
+			const double parallel = bestMilliseconds([&characters, joints]() { evaluateParallel(characters, joints); });
+			report("global pool", parallel, count * joints);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include <App/RenderSort.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace
+{
+constexpr size_t g_batchCounts[] = {1000, 10000, 100000, 1000000};
+constexpr uint32_t g_shaders = 4;
+constexpr uint32_t g_materials = 200;
+constexpr uint32_t g_vertexArrays = 2000;
+constexpr float g_maximumDistance = 1000.0f;
+// Distance a batch moves between frames as the camera does.
+constexpr float g_frameMotion = 0.05f;
+constexpr int g_repeats = 5;
+
+double bestMilliseconds(const std::function<void()> & body)
+{
+	double best = 1.0e30;
+	for (int i = 0; i < g_repeats; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		body();
+		const auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+struct Batch {
+	uint32_t shader;
+	uint32_t material;
+	uint32_t vertexArray;
+	float distance;
+};
+
+uint64_t getKey(const Batch & batch)
+{
+	return makeSortKey(1, batch.shader, batch.material, batch.vertexArray, batch.distance);
+}
+
+size_t countStateChanges(const std::vector<Batch> & batches, const std::vector<uint32_t> & order)
+{
+	size_t changes = 0;
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		if (i == 0 || getSortKeyState(getKey(batches[order[i]])) != getSortKeyState(getKey(batches[order[i - 1]])))
+			++changes;
+	}
+	return changes;
+}
+
+void report(const char * name, double milliseconds, size_t stateChanges)
+{
+	std::printf("  %-36s %10.3f ms %10zu state changes\n", name, milliseconds, stateChanges);
+}
+}// namespace
+
+int main()
+{
+	std::printf("Render sort, best of %d\n", g_repeats);
+
+	for (size_t count: g_batchCounts)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> distance(0.0f, g_maximumDistance);
+		std::uniform_real_distribution<float> motion(-g_frameMotion, g_frameMotion);
+		// Vertex arrays belong to one material each and materials to one shader, as meshes of models do.
+		std::vector<Batch> batches(count);
+		for (auto & batch: batches)
+		{
+			batch.vertexArray = static_cast<uint32_t>(random() % g_vertexArrays) + 1;
+			batch.material = batch.vertexArray % g_materials + 1;
+			batch.shader = batch.material % g_shaders + 1;
+			batch.distance = distance(random);
+		}
+		std::printf("%zu batches\n", count);
+
+		// What sortBatches did before: front to back by distance alone.
+		std::vector<uint32_t> order(count);
+		const double byDistance = bestMilliseconds([&]() {
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [&batches](uint32_t a, uint32_t b) { return batches[a].distance < batches[b].distance; });
+		});
+		report("std::sort by distance", byDistance, countStateChanges(batches, order));
+
+		std::vector<uint64_t> keys(count);
+		std::transform(batches.begin(), batches.end(), keys.begin(), getKey);
+		const double byKey = bestMilliseconds([&]() {
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+		});
+		report("std::sort by key", byKey, countStateChanges(batches, order));
+
+		// New ids every time rule out the coherent path.
+		SortKeySorter sorter;
+		std::vector<const void *> ids(count);
+		size_t frame = 0;
+		const double radix = bestMilliseconds([&]() {
+			for (size_t i = 0; i < count; ++i)
+			{
+				ids[i] = reinterpret_cast<const void *>((frame << 32) + i + 1);
+			}
+			++frame;
+			sorter.sort(keys, ids);
+		});
+		report("radix sort", radix, countStateChanges(batches, sorter.sort(keys, ids)));
+
+		// The same batches every frame, each a little nearer or farther than before.
+		size_t moves = 0;
+		const double coherent = bestMilliseconds([&]() {
+			for (size_t i = 0; i < count; ++i)
+			{
+				batches[i].distance = std::max(0.0f, batches[i].distance + motion(random));
+				keys[i] = getKey(batches[i]);
+			}
+			sorter.sort(keys, ids);
+			moves = sorter.getStats().moves;
+		});
+		report("coherent, keys included", coherent, countStateChanges(batches, sorter.sort(keys, ids)));
+		std::printf("  %-36s %10zu\n", "insertion sort moves", moves);
+	}
+	return 0;
+}
@@ -0,0 +1,169 @@
+#include <App/FrustumCulling.h>
+#include <App/SceneBvh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr size_t g_sceneSizes[] = {1000, 10000, 100000, 1000000};
+// The boxes fill a cube of this half size around the camera, so view distances past it see no more of the scene.
+// The camera sees about a tenth of it at the far view distance and under a hundredth at the near one; the steps in
+// between bracket the share at which the BVH and the linear pass cost the same.
+constexpr float g_sceneExtent = 500.0f;
+constexpr float g_viewDistances[] = {500.0f, 450.0f, 400.0f, 350.0f, 300.0f, 250.0f, 200.0f};
+constexpr float g_maximumBoxSize = 4.0f;
+constexpr float g_movedFraction = 0.01f;
+constexpr int g_repeats = 5;
+
+double bestMilliseconds(const std::function<void()> & body)
+{
+	double best = 1.0e30;
+	for (int i = 0; i < g_repeats; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		body();
+		const auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	return best;
+}
+
+void report(const char * name, double milliseconds, size_t visible)
+{
+	std::printf("  %-32s %10.3f ms %10zu visible\n", name, milliseconds, visible);
+}
+
+// Column-major perspective projection looking down -z from the origin.
+FrustumPlanes makeFrustum(float farPlane)
+{
+	const float fovY = 60.0f * 3.14159265f / 180.0f;
+	const float aspect = 16.0f / 9.0f;
+	const float nearPlane = 0.1f;
+	const float f = 1.0f / std::tan(fovY * 0.5f);
+
+	float matrix[16] = {};
+	matrix[0] = f / aspect;
+	matrix[5] = f;
+	matrix[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+	matrix[11] = -1.0f;
+	matrix[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+	return extractFrustumPlanes(matrix);
+}
+
+BoundingBox makeBox(std::mt19937 & random)
+{
+	std::uniform_real_distribution<float> position(-g_sceneExtent, g_sceneExtent);
+	std::uniform_real_distribution<float> size(0.1f, g_maximumBoxSize);
+	BoundingBox box;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		box.minimum[axis] = position(random);
+		box.maximum[axis] = box.minimum[axis] + size(random);
+	}
+	return box;
+}
+
+BoundingBox offsetBox(const BoundingBox & box, float offset)
+{
+	BoundingBox result = box;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		result.minimum[axis] += offset;
+		result.maximum[axis] += offset;
+	}
+	return result;
+}
+
+// Lets a background rebuild started by update() finish and swaps it in.
+void settle(SceneBvh & bvh)
+{
+	bvh.update();
+	while (bvh.getStats().rebuilding)
+	{
+		std::this_thread::yield();
+		bvh.update();
+	}
+}
+}// namespace
+
+int main()
+{
+	std::printf("Scene BVH culling (%s kernel for the linear pass), best of %d\n", getCullingKernelIsa(), g_repeats);
+
+	for (size_t count: g_sceneSizes)
+	{
+		std::mt19937 random(1);
+		std::vector<BoundingBox> boxes(count);
+		std::generate(boxes.begin(), boxes.end(), [&random]() { return makeBox(random); });
+
+		CullBoxes linearBoxes;
+		linearBoxes.reserve(count);
+		for (const auto & box: boxes)
+		{
+			linearBoxes.add(box);
+		}
+
+		SceneBvh bvh;
+		std::vector<int> proxies(count);
+		const auto insertStart = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; ++i)
+		{
+			proxies[i] = bvh.createProxy(boxes[i], &boxes[i]);
+		}
+		const auto insertEnd = std::chrono::steady_clock::now();
+		const float insertedCost = bvh.getStats().cost;
+		settle(bvh);
+
+		std::printf("%zu boxes: inserted in %.2f ms, cost %.1f incremental, %.1f rebuilt\n", count,
+					std::chrono::duration<double, std::milli>(insertEnd - insertStart).count(), insertedCost, bvh.getStats().cost);
+
+		std::vector<uint8_t> visibility(count);
+		std::vector<void *> visible;
+		for (float viewDistance: g_viewDistances)
+		{
+			const FrustumPlanes planes = makeFrustum(viewDistance);
+			std::printf("  view distance %.0f\n", viewDistance);
+
+			size_t linearVisible = 0;
+			const double linear = bestMilliseconds([&]() { linearVisible = count - cullBoxes(planes, linearBoxes, visibility.data()); });
+			report("linear cullBoxes", linear, linearVisible);
+
+			BvhCullStats stats;
+			const double hierarchy = bestMilliseconds([&]() {
+				visible.clear();
+				stats = {};
+				bvh.cull(planes, visible, stats);
+			});
+			report("BVH cull", hierarchy, visible.size());
+			std::printf("  %-32s %10zu\n", "BVH nodes visited", stats.nodesVisited);
+
+			const double linearProxies = bestMilliseconds([&]() {
+				visible.clear();
+				stats = {};
+				bvh.cullLinear(planes, visible, stats);
+			});
+			report("BVH proxies, linear pass", linearProxies, visible.size());
+		}
+
+		// Jitters a fixed subset every frame, as animated objects would, and refits their ancestors.
+		const size_t moved = std::max<size_t>(1, static_cast<size_t>(static_cast<float>(count) * g_movedFraction));
+		int frame = 0;
+		const double refit = bestMilliseconds([&]() {
+			const float offset = (++frame % 2 == 0) ? 0.5f : -0.5f;
+			for (size_t i = 0; i < moved; ++i)
+			{
+				const size_t index = i * (count / moved);
+				bvh.moveProxy(proxies[index], offsetBox(boxes[index], offset));
+			}
+		});
+		report("refit 1% moved", refit, moved);
+	}
+	return 0;
+}
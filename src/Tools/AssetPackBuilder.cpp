@@ -0,0 +1,58 @@
+#include <App/AssetPack.h>
+
+#include <QDir>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// asset-pack-builder [--compress] <output.pak> <root> <file>...
+// Packs files given relative to root under their relative paths, so "pack:/Models/noel.glb" finds
+// <root>/Models/noel.glb.
+int main(int argc, char ** argv)
+{
+	int arg = 1;
+	bool compress = false;
+	if (arg < argc && std::strcmp(argv[arg], "--compress") == 0)
+	{
+		compress = true;
+		++arg;
+	}
+	if (argc - arg < 2)
+	{
+		std::fprintf(stderr, "usage: %s [--compress] <output.pak> <root> <file>...\n", argv[0]);
+		return 1;
+	}
+
+	const QString output = QString::fromLocal8Bit(argv[arg]);
+	const QDir root(QString::fromLocal8Bit(argv[arg + 1]));
+	std::vector<AssetPackInput> inputs;
+	for (int i = arg + 2; i < argc; ++i)
+	{
+		const QString name = QDir::cleanPath(QString::fromLocal8Bit(argv[i]));
+		inputs.push_back({name, root.filePath(name)});
+	}
+
+	QString error;
+	if (!writeAssetPack(output, inputs, compress, error))
+	{
+		std::fprintf(stderr, "%s\n", qPrintable(error));
+		return 1;
+	}
+
+	AssetPack pack;
+	if (!pack.open(output))
+	{
+		std::fprintf(stderr, "Failed to read back %s\n", qPrintable(output));
+		return 1;
+	}
+	uint64_t size = 0;
+	uint64_t storedSize = 0;
+	for (const auto & entry: pack.getEntries())
+	{
+		size += entry.size;
+		storedSize += entry.storedSize;
+	}
+	std::printf("%s: %zu entries, %llu KiB -> %llu KiB\n", qPrintable(output), pack.getEntries().size(),
+				static_cast<unsigned long long>(size / 1024), static_cast<unsigned long long>(storedSize / 1024));
+	return 0;
+}